@@ -0,0 +1,512 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "common.h"
+#include "benchmark.h"
+#include "main.h"
+#include "rules.h"
+#include "helper.h"
+#include "timers.h"
+#include "conntrack.h"
+#include "expectation.h"
+#include "perf.h"
+#include "checksum.h"
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+int benchmark_mode = 0;
+
+#define benchmark_swap32(x) ((((x) & 0xff) << 24) | (((x) & 0xff00) << 8) | (((x) >> 8) & 0xff00) | (((x) >> 24) & 0xff))
+
+/// Packets of the pcap file preloaded in memory
+struct benchmark_frames {
+	struct frame **frames;
+	unsigned int count;
+	uint64_t bytes;
+	struct timeval duration; ///< Time between the first and last packet
+};
+
+/// Sizes of the buffers used by the checksum benchmark : DOCSIS headers with and without EHDR, a full ethernet frame
+static const unsigned int benchmark_checksum_sizes[] = { 6, 30, 64, 1500 };
+
+/// Number of checksums computed for each size per loop
+#define BENCHMARK_CHECKSUM_ITERATIONS 1000000
+
+static char *benchmark_linktype_to_layer(uint32_t linktype) {
+
+	switch (linktype) {
+		case 1: // DLT_EN10MB
+			return "ethernet";
+		case 143: // DLT_DOCSIS
+			return "docsis";
+		case 113: // DLT_LINUX_SLL
+			return "linux_cooked";
+		case 12: // DLT_RAW
+		case 14:
+		case 101:
+			return "ipv4";
+		case 105: // DLT_IEEE802_11
+			return "80211";
+		case 119: // DLT_PRISM_HEADER
+			return "prism";
+		case 192: // DLT_PPI
+			return "ppi";
+		case 127: // DLT_IEEE802_11_RADIO
+			return "radiotap";
+	}
+
+	return "undefined";
+}
+
+static void benchmark_cleanup_frames(struct benchmark_frames *bf) {
+
+	unsigned int i;
+	for (i = 0; i < bf->count; i++) {
+		free(bf->frames[i]->buff_base);
+		free(bf->frames[i]);
+	}
+	free(bf->frames);
+}
+
+static int benchmark_load_pcap(char *filename, struct benchmark_frames *bf) {
+
+	FILE *fd = fopen(filename, "r");
+	if (!fd) {
+		char errbuff[256];
+		memset(errbuff, 0, sizeof(errbuff));
+		strerror_r(errno, errbuff, sizeof(errbuff));
+		pom_log(POM_LOG_ERR "Unable to open pcap file %s : %s", filename, errbuff);
+		return POM_ERR;
+	}
+
+	struct benchmark_pcap_hdr hdr;
+	if (fread(&hdr, sizeof(hdr), 1, fd) != 1) {
+		pom_log(POM_LOG_ERR "Unable to read the header of pcap file %s", filename);
+		fclose(fd);
+		return POM_ERR;
+	}
+
+	int swapped = 0, nsec = 0;
+	if (hdr.magic == BENCHMARK_PCAP_MAGIC) {
+		// Native byte order
+	} else if (hdr.magic == BENCHMARK_PCAP_MAGIC_NSEC) {
+		nsec = 1;
+	} else if (hdr.magic == benchmark_swap32(BENCHMARK_PCAP_MAGIC)) {
+		swapped = 1;
+	} else if (hdr.magic == benchmark_swap32(BENCHMARK_PCAP_MAGIC_NSEC)) {
+		swapped = 1;
+		nsec = 1;
+	} else {
+		pom_log(POM_LOG_ERR "File %s is not a pcap file", filename);
+		fclose(fd);
+		return POM_ERR;
+	}
+
+	if (swapped) {
+		hdr.snaplen = benchmark_swap32(hdr.snaplen);
+		hdr.linktype = benchmark_swap32(hdr.linktype);
+	}
+
+	char *layer_name = benchmark_linktype_to_layer(hdr.linktype);
+	int first_layer = match_register(layer_name);
+	if (first_layer == POM_ERR) {
+		pom_log(POM_LOG_ERR "Unable to register match %s for the pcap link type %u", layer_name, hdr.linktype);
+		fclose(fd);
+		return POM_ERR;
+	}
+
+	// Same alignment as input_pcap
+	unsigned int align_offset = (hdr.linktype == 1 ? 2 : 0);
+
+	unsigned int allocated = 0;
+	struct timeval first;
+	memset(&first, 0, sizeof(struct timeval));
+
+	struct benchmark_pcap_rec_hdr rec;
+	while (fread(&rec, sizeof(rec), 1, fd) == 1) {
+
+		if (swapped) {
+			rec.ts_sec = benchmark_swap32(rec.ts_sec);
+			rec.ts_usec = benchmark_swap32(rec.ts_usec);
+			rec.caplen = benchmark_swap32(rec.caplen);
+			rec.len = benchmark_swap32(rec.len);
+		}
+
+		if (nsec)
+			rec.ts_usec /= 1000;
+
+		if (rec.caplen > BENCHMARK_PCAP_MAX_CAPLEN || (hdr.snaplen && rec.caplen > hdr.snaplen)) {
+			pom_log(POM_LOG_ERR "Invalid packet length %u for packet %u in pcap file %s", rec.caplen, bf->count + 1, filename);
+			goto err;
+		}
+
+		if (bf->count >= allocated) {
+			unsigned int new_allocated = (allocated ? allocated * 2 : 1024);
+			struct frame **frames = realloc(bf->frames, sizeof(struct frame *) * new_allocated);
+			if (!frames) {
+				pom_log(POM_LOG_ERR "Not enough memory to store the packets of pcap file %s", filename);
+				goto err;
+			}
+			bf->frames = frames;
+			allocated = new_allocated;
+		}
+
+		struct frame *f = malloc(sizeof(struct frame));
+		if (!f) {
+			pom_log(POM_LOG_ERR "Not enough memory to allocate a frame");
+			goto err;
+		}
+		memset(f, 0, sizeof(struct frame));
+		f->align_offset = align_offset;
+		if (frame_alloc_aligned_buff(f, rec.caplen) != POM_OK) {
+			pom_log(POM_LOG_ERR "Not enough memory to allocate a frame buffer of %u bytes", rec.caplen);
+			free(f);
+			goto err;
+		}
+		f->input = main_config->input;
+		f->first_layer = first_layer;
+		f->len = rec.caplen;
+		// Some writers store more than a second worth of microseconds
+		f->tv.tv_sec = rec.ts_sec + rec.ts_usec / 1000000;
+		f->tv.tv_usec = rec.ts_usec % 1000000;
+
+		if (fread(f->buff, rec.caplen, 1, fd) != 1) {
+			pom_log(POM_LOG_WARN "Truncated packet at the end of pcap file %s", filename);
+			free(f->buff_base);
+			free(f);
+			break;
+		}
+
+		if (!bf->count)
+			memcpy(&first, &f->tv, sizeof(struct timeval));
+
+		bf->frames[bf->count] = f;
+		bf->count++;
+		bf->bytes += rec.caplen;
+	}
+
+	fclose(fd);
+
+	if (!bf->count) {
+		pom_log(POM_LOG_ERR "No packet found in pcap file %s", filename);
+		benchmark_cleanup_frames(bf);
+		return POM_ERR;
+	}
+
+	timersub(&bf->frames[bf->count - 1]->tv, &first, &bf->duration);
+
+	return POM_OK;
+
+err:
+	fclose(fd);
+	benchmark_cleanup_frames(bf);
+	return POM_ERR;
+}
+
+/**
+ * Print a string between quotes with the characters JSON doesn't allow escaped.
+ */
+static void benchmark_print_json_string(char *str) {
+
+	putchar('"');
+	for (; *str; str++) {
+		unsigned char c = *str;
+		if (c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if (c < 0x20)
+			printf("\\u%04x", c);
+		else
+			putchar(c);
+	}
+	putchar('"');
+}
+
+/**
+ * Preload a pcap file and process it loops times through do_rules().
+ * The result is printed on stdout.
+ * @param pcap_file Pcap file to replay
+ * @param loops Number of times to replay the file
+ * @param json Print the results in JSON instead of plain text
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int benchmark_run(char *pcap_file, unsigned int loops, int json) {
+
+	struct benchmark_frames bf;
+	memset(&bf, 0, sizeof(struct benchmark_frames));
+
+	pom_log("Loading pcap file %s in memory", pcap_file);
+
+	if (benchmark_load_pcap(pcap_file, &bf) == POM_ERR)
+		return POM_ERR;
+
+	pom_log("Loaded %u packets (%llu bytes), replaying them %u times", bf.count, (long long unsigned int)bf.bytes, loops);
+
+	// Record per stage timings as well
+	perf_timing_enable(1);
+
+	struct perf_class *stages = perf_find_class("stages");
+	if (stages && stages->instances)
+		perf_instance_items_val_reset(stages->instances);
+
+	// Timestamps are shifted by the duration of the capture after each loop to keep the time increasing
+	struct timeval loop_duration;
+	memcpy(&loop_duration, &bf.duration, sizeof(struct timeval));
+	loop_duration.tv_sec++;
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	unsigned int loop, i;
+	for (loop = 0; loop < loops; loop++) {
+		for (i = 0; i < bf.count; i++) {
+			struct frame *f = bf.frames[i];
+			struct timeval *now = get_current_time_p();
+			memcpy(now, &f->tv, sizeof(struct timeval));
+			now->tv_usec += 1;
+			if (now->tv_usec >= 1000000) {
+				now->tv_sec++;
+				now->tv_usec -= 1000000;
+			}
+
+			struct rule_snapshot *rules = rules_snapshot_get();
+			timers_process(rules);
+			do_rules(f, rules);
+			helper_process_queue(rules);
+			rules_snapshot_release();
+		}
+
+		for (i = 0; i < bf.count; i++) {
+			struct timeval tmp;
+			timeradd(&bf.frames[i]->tv, &loop_duration, &tmp);
+			memcpy(&bf.frames[i]->tv, &tmp, sizeof(struct timeval));
+		}
+	}
+
+	// Process remaining queued frames
+	conntrack_close_connections(rules_snapshot_get());
+	rules_snapshot_release();
+	expectation_cleanup_all();
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	perf_timing_enable(0);
+
+	uint64_t elapsed = ((uint64_t)(end.tv_sec - start.tv_sec) * 1000000000LLU) + end.tv_nsec - start.tv_nsec;
+	uint64_t pkts = (uint64_t)bf.count * loops, bytes = bf.bytes * loops;
+	double secs = (double)elapsed / 1000000000.0;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	if (json) {
+		printf("{\n");
+		printf("  \"file\": ");
+		benchmark_print_json_string(pcap_file);
+		printf(",\n");
+		printf("  \"loops\": %u,\n", loops);
+		printf("  \"packets\": %llu,\n", (long long unsigned int)pkts);
+		printf("  \"bytes\": %llu,\n", (long long unsigned int)bytes);
+		printf("  \"elapsed_ns\": %llu,\n", (long long unsigned int)elapsed);
+		printf("  \"packets_per_sec\": %.0f,\n", pkts / secs);
+		printf("  \"bytes_per_sec\": %.0f,\n", bytes / secs);
+		printf("  \"ns_per_packet\": %.1f,\n", (double)elapsed / pkts);
+		printf("  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+		printf("  \"stages\": {");
+	} else {
+		printf("Benchmark results for %s (%u loops) :\n", pcap_file, loops);
+		printf("  Packets         : %llu\n", (long long unsigned int)pkts);
+		printf("  Bytes           : %llu\n", (long long unsigned int)bytes);
+		printf("  Elapsed time    : %.3f secs\n", secs);
+		printf("  Packets/s       : %.0f\n", pkts / secs);
+		printf("  Bytes/s         : %.0f\n", bytes / secs);
+		printf("  ns/packet       : %.1f\n", (double)elapsed / pkts);
+		printf("  Peak RSS        : %ld KB\n", usage.ru_maxrss);
+		printf("  Stages (mean, p50, p99 in ns/packet) :\n");
+	}
+
+	if (stages && stages->instances) {
+		struct perf_item *itm = stages->instances->items;
+		while (itm) {
+			uint64_t mean = perf_item_val_get_mean(itm);
+			uint64_t p50 = perf_item_val_get_percentile(itm, 50);
+			uint64_t p99 = perf_item_val_get_percentile(itm, 99);
+			if (json) {
+				printf("\n    ");
+				benchmark_print_json_string(itm->name);
+				printf(": { \"mean_ns\": %llu, \"p50_ns\": %llu, \"p99_ns\": %llu }%s", (long long unsigned int)mean, (long long unsigned int)p50, (long long unsigned int)p99, (itm->next ? "," : ""));
+			} else {
+				printf("    %-12s  : %llu, %llu, %llu\n", itm->name, (long long unsigned int)mean, (long long unsigned int)p50, (long long unsigned int)p99);
+			}
+			itm = itm->next;
+		}
+	}
+
+	if (json)
+		printf("\n  }\n}\n");
+
+	benchmark_cleanup_frames(&bf);
+
+	return POM_OK;
+}
+
+/**
+ * Byte at a time CRC-CCITT as previously done by input_docsis.
+ */
+static uint16_t benchmark_crc_ccitt_bytewise(uint16_t crc, const unsigned char *buff, size_t len) {
+
+	static uint16_t table[256];
+	if (!table[1]) {
+		unsigned int i, j;
+		for (i = 0; i < 256; i++) {
+			uint16_t c = i;
+			for (j = 0; j < 8; j++)
+				c = (c & 1) ? (c >> 1) ^ CHECKSUM_CRC_CCITT_POLY : c >> 1;
+			table[i] = c;
+		}
+	}
+
+	for (; len; len--)
+		crc = (crc >> 8) ^ table[(crc ^ *buff++) & 0xff];
+
+	return crc;
+}
+
+/**
+ * 16 bits at a time sum as previously done by target_tcpkill.
+ */
+static uint32_t benchmark_inet_wordwise(const void *buff, size_t len) {
+
+	const uint16_t *addr = buff;
+	uint32_t sum = 0;
+	uint16_t last_byte = 0;
+
+	while (len > 1) {
+		sum += *addr++;
+		len -= 2;
+	}
+	if (len == 1) {
+		*(uint8_t*)&last_byte = *(uint8_t*)addr;
+		sum += last_byte;
+	}
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return sum;
+}
+
+static uint64_t benchmark_elapsed(struct timespec *start) {
+
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return ((uint64_t)(end.tv_sec - start->tv_sec) * 1000000000LLU) + end.tv_nsec - start->tv_nsec;
+}
+
+/**
+ * Compare the checksum functions of libpom to the byte and word loops they replaced.
+ * Returns POM_ERR if the results differ.
+ */
+int benchmark_checksum(unsigned int loops, int json) {
+
+	unsigned int max_size = benchmark_checksum_sizes[sizeof(benchmark_checksum_sizes) / sizeof(benchmark_checksum_sizes[0]) - 1];
+
+	// Odd offset so that unaligned accesses are part of the measure
+	unsigned char *buff_base = malloc(max_size + 1);
+	if (!buff_base) {
+		pom_log(POM_LOG_ERR "Unable to allocate the checksum benchmark buffer");
+		return POM_ERR;
+	}
+	unsigned char *buff = buff_base + 1;
+
+	unsigned int i;
+	srandom(time(NULL));
+	for (i = 0; i < max_size; i++)
+		buff[i] = random();
+
+	uint64_t iterations = (uint64_t)loops * BENCHMARK_CHECKSUM_ITERATIONS;
+
+	if (json)
+		printf("{\n  \"loops\": %u,\n  \"checksums\": [", loops);
+	else
+		printf("Checksum benchmark results (%u loops, ns per call) :\n", loops);
+
+	int res = POM_OK;
+
+	unsigned int s;
+	for (s = 0; s < sizeof(benchmark_checksum_sizes) / sizeof(benchmark_checksum_sizes[0]); s++) {
+
+		unsigned int size = benchmark_checksum_sizes[s];
+
+		if (benchmark_crc_ccitt_bytewise(0xffff, buff, size) != checksum_crc_ccitt(0xffff, buff, size) ||
+			benchmark_inet_wordwise(buff, size) != checksum_inet(buff, size)) {
+			pom_log(POM_LOG_ERR "Checksum mismatch for a buffer of %u bytes", size);
+			res = POM_ERR;
+		}
+
+		// The result is accumulated so that the calls are not optimized out
+		volatile uint32_t acc = 0;
+		struct timespec start;
+		uint64_t j, elapsed[4];
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (j = 0; j < iterations; j++)
+			acc += benchmark_crc_ccitt_bytewise(j, buff, size);
+		elapsed[0] = benchmark_elapsed(&start);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (j = 0; j < iterations; j++)
+			acc += checksum_crc_ccitt(j, buff, size);
+		elapsed[1] = benchmark_elapsed(&start);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (j = 0; j < iterations; j++) {
+			buff[0] = j;
+			acc += benchmark_inet_wordwise(buff, size);
+		}
+		elapsed[2] = benchmark_elapsed(&start);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (j = 0; j < iterations; j++) {
+			buff[0] = j;
+			acc += checksum_inet(buff, size);
+		}
+		elapsed[3] = benchmark_elapsed(&start);
+
+		double ns[4];
+		for (i = 0; i < 4; i++)
+			ns[i] = (double)elapsed[i] / iterations;
+
+		if (json) {
+			printf("%s\n    { \"size\": %u, \"crc_ccitt_bytewise_ns\": %.2f, \"crc_ccitt_ns\": %.2f, \"inet_wordwise_ns\": %.2f, \"inet_ns\": %.2f }", (s ? "," : ""), size, ns[0], ns[1], ns[2], ns[3]);
+		} else {
+			printf("  %4u bytes : CRC-CCITT %8.2f -> %8.2f (x%.1f), inet %8.2f -> %8.2f (x%.1f)\n", size, ns[0], ns[1], ns[0] / ns[1], ns[2], ns[3], ns[2] / ns[3]);
+		}
+	}
+
+	if (json)
+		printf("\n  ]\n}\n");
+
+	free(buff_base);
+
+	return res;
+}
@@ -0,0 +1,58 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include "common.h"
+
+/// Pcap file header
+struct benchmark_pcap_hdr {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+};
+
+/// Pcap record header as stored in the file
+struct benchmark_pcap_rec_hdr {
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+#define BENCHMARK_PCAP_MAGIC		0xa1b2c3d4
+#define BENCHMARK_PCAP_MAGIC_NSEC	0xa1b23c4d
+
+/// Biggest packet accepted from a pcap file, same limit as libpcap
+#define BENCHMARK_PCAP_MAX_CAPLEN	262144
+
+/// Set when packet-o-matic runs in benchmark mode
+extern int benchmark_mode;
+
+int benchmark_run(char *pcap_file, unsigned int loops, int json);
+int benchmark_checksum(unsigned int loops, int json);
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "checksum.h"
+
+/**
+ * Lookup tables for the CRC-CCITT processed eight bytes at a time.
+ * The first one is the CRC of each possible byte, the Nth one is the
+ * CRC of each possible byte followed by N - 1 zero bytes.
+ */
+static uint16_t checksum_crc_ccitt_table[8][256];
+
+int checksum_init() {
+
+	unsigned int i, j;
+	for (i = 0; i < 256; i++) {
+		uint16_t crc = i;
+		for (j = 0; j < 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ CHECKSUM_CRC_CCITT_POLY : crc >> 1;
+		checksum_crc_ccitt_table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; i++) {
+		for (j = 1; j < 8; j++) {
+			uint16_t crc = checksum_crc_ccitt_table[j - 1][i];
+			checksum_crc_ccitt_table[j][i] = (crc >> 8) ^ checksum_crc_ccitt_table[0][crc & 0xff];
+		}
+	}
+
+	return POM_OK;
+}
+
+/**
+ * The initial value and the final xor are left to the caller.
+ * Returns the updated CRC.
+ */
+uint16_t checksum_crc_ccitt(uint16_t crc, const unsigned char *buff, size_t len) {
+
+	uint16_t (*t)[256] = checksum_crc_ccitt_table;
+
+	for (; len >= 8; len -= 8, buff += 8) {
+		crc = t[7][(buff[0] ^ crc) & 0xff] ^ t[6][(buff[1] ^ (crc >> 8)) & 0xff] ^
+			t[5][buff[2]] ^ t[4][buff[3]] ^
+			t[3][buff[4]] ^ t[2][buff[5]] ^
+			t[1][buff[6]] ^ t[0][buff[7]];
+	}
+
+	for (; len; len--)
+		crc = (crc >> 8) ^ t[0][(crc ^ *buff++) & 0xff];
+
+	return crc;
+}
+
+/**
+ * Words are summed 32 bits at a time and the carries are folded back at the end.
+ * A trailing odd byte is padded with zero.
+ * Returns the sum folded to 16 bits, ready to be added to other sums before being complemented.
+ */
+uint32_t checksum_inet(const void *buff, size_t len) {
+
+	const unsigned char *b = buff;
+	uint64_t sum = 0;
+	uint32_t w[4];
+
+	for (; len >= sizeof(w); len -= sizeof(w), b += sizeof(w)) {
+		memcpy(w, b, sizeof(w));
+		sum += (uint64_t) w[0] + w[1] + w[2] + w[3];
+	}
+
+	for (; len >= sizeof(w[0]); len -= sizeof(w[0]), b += sizeof(w[0])) {
+		memcpy(w, b, sizeof(w[0]));
+		sum += w[0];
+	}
+
+	if (len >= sizeof(uint16_t)) {
+		uint16_t half;
+		memcpy(&half, b, sizeof(half));
+		sum += half;
+		len -= sizeof(uint16_t);
+		b += sizeof(uint16_t);
+	}
+
+	if (len) {
+		uint16_t last_byte = 0;
+		*(uint8_t*)&last_byte = *b;
+		sum += last_byte;
+	}
+
+	// 2^16 is 1 modulo 0xffff so each half can be added to the other
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+
+	return sum;
+}
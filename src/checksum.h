@@ -0,0 +1,39 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __CHECKSUM_H__
+#define __CHECKSUM_H__
+
+#include "common.h"
+
+/// Polynomial of the CRC-CCITT, bit reversed
+#define CHECKSUM_CRC_CCITT_POLY	0x8408
+
+/// Init the checksum API
+int checksum_init();
+
+/// Update a CRC-CCITT with the content of a buffer
+uint16_t checksum_crc_ccitt(uint16_t crc, const unsigned char *buff, size_t len);
+
+/// Sum the 16 bits words of a buffer as used by the internet checksum
+uint32_t checksum_inet(const void *buff, size_t len);
+
+#endif
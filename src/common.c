@@ -28,6 +28,7 @@
 #include <pthread.h>
 
 int console_output;
+int console_stderr;
 unsigned int console_debug_level;
 
 static struct log_entry *log_head = NULL, *log_tail = NULL;
@@ -99,7 +100,7 @@ void pom_log_internal(char *file, const char *format, ...) {
 	mgmtsrv_send_debug(entry);
 
 	if (console_output && console_debug_level >= level)
-		printf("%s: %s\n", entry->file, entry->data);
+		fprintf((console_stderr ? stderr : stdout), "%s: %s\n", entry->file, entry->data);
 
 	if (level >= *POM_LOG_TSHOOT) {
 		if (pthread_rwlock_unlock(&log_buffer_lock)) {
@@ -241,6 +242,8 @@ int frame_alloc_aligned_buff(struct frame *f, int length) {
 
 	int total_len = length + f->align_offset + 4;
 	f->buff_base = malloc(total_len);
+	if (!f->buff_base)
+		return POM_ERR;
 	f->buff = (void*) (((long)f->buff_base & ~3) + 4 + f->align_offset);
 	f->bufflen = total_len - ((long)f->buff - (long)f->buff_base);
 
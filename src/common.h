@@ -132,6 +132,9 @@ extern unsigned int console_debug_level;
 /// Should we output to console
 extern int console_output;
 
+/// Should the console output go to stderr instead of stdout
+extern int console_stderr;
+
 /// Log entry
 
 struct log_entry {
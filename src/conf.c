@@ -29,6 +29,7 @@
 #include <pthread.h>
 
 #include "conf.h"
+#include "benchmark.h"
 #include "input.h"
 #include "target.h"
 #include "match.h"
@@ -212,6 +213,7 @@ struct target *parse_target(xmlDocPtr doc, xmlNodePtr cur) {
 		if (uid) {
 			uid_release(tp->uid);
 			tp->uid = uid_set(uid);
+			uid_attach(tp->uid, UID_OBJ_TARGET, tp);
 		}
 		xmlFree(target_uid);
 	}
@@ -481,6 +483,7 @@ struct rule_list *parse_rule(xmlDocPtr doc, xmlNodePtr cur) {
 		if (uid) {
 			uid_release(r->uid);
 			r->uid = uid_set(uid);
+			uid_attach(r->uid, UID_OBJ_RULE, r);
 		}
 		xmlFree(rule_uid);
 	}
@@ -597,6 +600,7 @@ struct datastore* config_parse_datastore(xmlDocPtr doc, xmlNodePtr cur) {
 		if (uid) {
 			uid_release(d->uid);
 			d->uid = uid_set(uid);
+			uid_attach(d->uid, UID_OBJ_DATASTORE, d);
 		}
 		xmlFree(datastore_uid);
 	}
@@ -713,6 +717,7 @@ int config_parse(struct conf *c, char * filename) {
 				r->prev = tmpr;
 
 			}
+			rules_snapshot_publish(c->rules);
 			if (pthread_rwlock_unlock(&c->rules_lock)) {
 				pom_log(POM_LOG_ERR "Unable to unlock the rules");
 				abort();
@@ -885,7 +890,8 @@ int config_parse(struct conf *c, char * filename) {
 
 	strncpy(c->filename, filename, NAME_MAX);
 
-	if (c->input && c->input->running) {
+	// The input is not used in benchmark mode
+	if (c->input && c->input->running && !benchmark_mode) {
 		c->input->running = 0;
 		start_input(rbuf);
 
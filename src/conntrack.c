@@ -24,6 +24,7 @@
 #include "timers.h"
 #include "ptype.h"
 #include "expectation.h"
+#include "topn.h"
 
 #define CONNTRACK_SIZE 1048576
 
@@ -43,6 +44,14 @@ static struct conntrack_list *ct_table_rev[CONNTRACK_SIZE];
 
 static pthread_rwlock_t conntrack_global_lock = PTHREAD_RWLOCK_INITIALIZER;
 
+static uint64_t conntrack_next_uid = 0;
+
+/// Protects the top summaries which are updated by the packet processing thread
+static pthread_mutex_t conntrack_top_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int conntrack_top_size = 0;
+static struct topn *conntrack_top[CONNTRACK_TOP_TYPES];
+static char (*conntrack_top_flow_names)[CONNTRACK_TOP_NAME_SIZE] = NULL;
+
 /**
  * @ingroup conntrack_core
  * @return POM_OK on success, POM_ERR on failure.
@@ -224,6 +233,9 @@ int conntrack_create_entry(struct frame *f) {
 	memset(ce, 0, sizeof(struct conntrack_entry));
 
 	ce->full_hash = hash;
+	ce->uid = ++conntrack_next_uid;
+	memcpy(&ce->first_seen, get_current_time_p(), sizeof(struct timeval));
+	memcpy(&ce->last_seen, &ce->first_seen, sizeof(struct timeval));
 
 
 	struct layer *l = f->l;
@@ -601,6 +613,250 @@ int conntrack_get_entry(struct frame *f) {
 
 }
 
+/**
+ * @ingroup conntrack_core
+ * Called once the frame was processed so that each packet is counted once.
+ * @param f Frame with a conntrack entry
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int conntrack_account(struct frame *f) {
+
+	struct conntrack_entry *ce = f->ce;
+	if (!ce)
+		return POM_ERR;
+
+	unsigned int dir = (ce->direction == CE_DIR_REV ? CE_DIR_REV : CE_DIR_FWD);
+
+	memcpy(&ce->last_seen, get_current_time_p(), sizeof(struct timeval));
+	ce->packets[dir]++;
+	ce->bytes[dir] += f->len;
+
+	if (!conntrack_top_size)
+		return POM_OK;
+
+	pthread_mutex_lock(&conntrack_top_lock);
+
+	if (conntrack_top_size) {
+		int replaced;
+		struct topn *t = conntrack_top[conntrack_top_flows];
+		int slot = topn_update(t, &ce->uid, sizeof(ce->uid), f->len, &replaced);
+		if (slot != POM_ERR && t->entries[slot].hits == 1)
+			conntrack_print_key(ce, conntrack_top_flow_names[slot], CONNTRACK_TOP_NAME_SIZE);
+
+		// Use the outermost addresses and ports of the connection
+		int got_addr = 0, got_port = 0;
+		struct conntrack_match_priv *cp;
+		for (cp = ce->match_privs; cp && (!got_addr || !got_port); cp = cp->next) {
+			struct conntrack_reg *r = conntracks[cp->priv_type];
+			if (!r || !r->get_endpoints)
+				continue;
+
+			struct conntrack_endpoints ep;
+			if ((*r->get_endpoints) (cp->priv, dir, &ep) != POM_OK)
+				continue;
+
+			if (ep.kind == CT_ENDPOINT_ADDR && !got_addr) {
+				topn_update(conntrack_top[conntrack_top_sources], ep.src, ep.len, f->len, &replaced);
+				got_addr = 1;
+			} else if (ep.kind == CT_ENDPOINT_PORT && !got_port) {
+				// Ports are only meaningful with their protocol
+				unsigned char key[sizeof(uint16_t) + sizeof(ep.dst)];
+				uint16_t type = cp->priv_type;
+				memcpy(key, &type, sizeof(uint16_t));
+				memcpy(key + sizeof(uint16_t), ep.dst, ep.len);
+				topn_update(conntrack_top[conntrack_top_ports], key, sizeof(uint16_t) + ep.len, f->len, &replaced);
+				got_port = 1;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&conntrack_top_lock);
+
+	return POM_OK;
+}
+
+/**
+ * @ingroup conntrack_core
+ * Any previous content of the summaries is discarded.
+ * @param size Number of flows, sources and ports tracked, 0 to disable the summaries
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int conntrack_top_set_size(unsigned int size) {
+
+	pthread_mutex_lock(&conntrack_top_lock);
+
+	int i;
+	for (i = 0; i < CONNTRACK_TOP_TYPES; i++) {
+		topn_cleanup(conntrack_top[i]);
+		conntrack_top[i] = NULL;
+	}
+	free(conntrack_top_flow_names);
+	conntrack_top_flow_names = NULL;
+	conntrack_top_size = 0;
+
+	if (!size) {
+		pthread_mutex_unlock(&conntrack_top_lock);
+		return POM_OK;
+	}
+
+	conntrack_top_flow_names = malloc(size * CONNTRACK_TOP_NAME_SIZE);
+	if (!conntrack_top_flow_names) {
+		pthread_mutex_unlock(&conntrack_top_lock);
+		pom_log(POM_LOG_ERR "Not enough memory to track the top %u connections", size);
+		return POM_ERR;
+	}
+
+	for (i = 0; i < CONNTRACK_TOP_TYPES; i++) {
+		conntrack_top[i] = topn_alloc(size);
+		if (!conntrack_top[i]) {
+			pthread_mutex_unlock(&conntrack_top_lock);
+			conntrack_top_set_size(0);
+			return POM_ERR;
+		}
+	}
+
+	conntrack_top_size = size;
+
+	pthread_mutex_unlock(&conntrack_top_lock);
+
+	return POM_OK;
+}
+
+/**
+ * @ingroup conntrack_core
+ * This doesn't need the conntrack table to be locked, the cost only depends on the size of the summaries.
+ * @param type Which summary to query
+ * @param entries Array to fill with the heaviest entries first
+ * @param max Size of the array
+ * @return Number of entries returned or POM_ERR on failure.
+ */
+int conntrack_top_get(enum conntrack_top_type type, struct conntrack_top_entry *entries, unsigned int max) {
+
+	if (type >= CONNTRACK_TOP_TYPES || !max)
+		return POM_ERR;
+
+	unsigned int *slots = malloc(sizeof(unsigned int) * max);
+	if (!slots)
+		return POM_ERR;
+
+	pthread_mutex_lock(&conntrack_top_lock);
+
+	if (!conntrack_top_size) {
+		pthread_mutex_unlock(&conntrack_top_lock);
+		free(slots);
+		return 0;
+	}
+
+	struct topn *t = conntrack_top[type];
+	unsigned int count = topn_get_top(t, slots, max);
+
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		struct topn_entry *te = &t->entries[slots[i]];
+		struct conntrack_top_entry *e = &entries[i];
+		memset(e, 0, sizeof(struct conntrack_top_entry));
+		e->bytes = te->count;
+		e->error = te->error;
+		e->packets = te->hits;
+
+		switch (type) {
+			case conntrack_top_flows:
+				strcpy(e->name, conntrack_top_flow_names[slots[i]]);
+				break;
+
+			case conntrack_top_sources:
+				inet_ntop((te->key_len == sizeof(struct in6_addr) ? AF_INET6 : AF_INET), te->key, e->name, sizeof(e->name));
+				break;
+
+			case conntrack_top_ports: {
+				uint16_t match_type, port;
+				memcpy(&match_type, te->key, sizeof(uint16_t));
+				memcpy(&port, te->key + sizeof(uint16_t), sizeof(uint16_t));
+				snprintf(e->name, sizeof(e->name), "%s %u", match_get_name(match_type), ntohs(port));
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&conntrack_top_lock);
+
+	free(slots);
+
+	return count;
+}
+
+/**
+ * @ingroup conntrack_core
+ * The caller must prevent the packet processing from modifying the table, see reader_process_lock().
+ * Whole buckets are processed so slightly more than max entries may be provided.
+ * @param cursor 0 to start from the begining or the value returned by the previous call
+ * @param max Number of entries after which to stop
+ * @param callback Function called for each entry
+ * @param priv Private data for the callback
+ * @return Cursor to provide to the next call or 0 if the whole table was processed.
+ */
+uint32_t conntrack_iterate(uint32_t cursor, unsigned int max, int (*callback) (struct conntrack_entry *ce, void *priv), void *priv) {
+
+	uint32_t end = cursor + CONNTRACK_ITERATE_MAX_BUCKETS;
+	if (end > CONNTRACK_SIZE)
+		end = CONNTRACK_SIZE;
+
+	unsigned int count = 0;
+	for (; cursor < end && count < max; cursor++) {
+		struct conntrack_list *cl;
+		for (cl = ct_table[cursor]; cl; cl = cl->next) {
+			(*callback) (cl->ce, priv);
+			count++;
+		}
+	}
+
+	if (cursor >= CONNTRACK_SIZE)
+		return 0;
+
+	return cursor;
+}
+
+/**
+ * @ingroup conntrack_core
+ * @param ce Conntrack entry to describe
+ * @param buff Buffer to store the description
+ * @param size Size of the buffer
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int conntrack_print_key(struct conntrack_entry *ce, char *buff, size_t size) {
+
+	if (!size)
+		return POM_ERR;
+
+	buff[0] = 0;
+	size_t len = 0;
+
+	struct conntrack_match_priv *cp;
+	for (cp = ce->match_privs; cp && len < size - 1; cp = cp->next) {
+		struct conntrack_reg *r = conntracks[cp->priv_type];
+		int res = snprintf(buff + len, size - len, "%s%s", (len ? ", " : ""), match_get_name(cp->priv_type));
+		if (res < 0)
+			return POM_ERR;
+		len += res;
+		if (len >= size - 1)
+			break;
+
+		if (r && r->print_match_priv) {
+			buff[len++] = ' ';
+			buff[len] = 0;
+			res = (*r->print_match_priv) (cp->priv, buff + len, size - len);
+			if (res < 0)
+				return POM_ERR;
+			len += res;
+		}
+	}
+
+	if (len >= size)
+		buff[size - 1] = 0;
+
+	return POM_OK;
+}
+
 /**
  * @ingroup conntrack_core
  * @param cl Conntrack list to search
@@ -790,11 +1046,10 @@ int conntrack_close_connection(struct conntrack_entry *ce) {
 
 /**
  * @ingroup conntrack_core
- * @param r Rule list to use for packets that are still in the buffer
- * @param lock Lock for the whole list of rules
+ * @param rules Rule snapshot to use for packets that are still in the buffer
  * @return POM_OK on success, POM_ERR on failure.
  */
-int conntrack_close_connections(struct rule_list *r, pthread_rwlock_t *lock) {
+int conntrack_close_connections(struct rule_snapshot *rules) {
 
 	int i;
 
@@ -804,13 +1059,13 @@ int conntrack_close_connections(struct rule_list *r, pthread_rwlock_t *lock) {
 		struct conntrack_list *cl = ct_table[i];
 		while (cl) {
 			conntrack_close_connection(cl->ce);
-			helper_process_queue(r, lock);
+			helper_process_queue(rules);
 			// At this point we want to process all the remaining packets in the buffer
 			
 			struct conntrack_helper_priv *hp = cl->ce->helper_privs;
 			while (hp) {
 				while ((*hp->flush_buffer) (cl->ce, hp->priv) == POM_OK)
-					helper_process_queue(r, lock);
+					helper_process_queue(rules);
 
 				hp = hp->next;
 			}
@@ -843,6 +1098,7 @@ int conntrack_cleanup() {
 		}
 	}
 
+	conntrack_top_set_size(0);
 
 	return POM_OK;
 
@@ -86,6 +86,12 @@ struct conntrack_entry {
 	unsigned int direction; ///< Direction of the packet that matched
 	struct conntrack_entry *parent_ce; ///< Parent entry if this matched an expectation
 
+	struct timeval first_seen; ///< Time of the packet which created the entry
+	struct timeval last_seen; ///< Time of the last packet of the connection
+	uint64_t packets[2]; ///< Number of packets of the connection in each direction
+	uint64_t bytes[2]; ///< Number of bytes of the connection in each direction
+	uint64_t uid; ///< Unique identifier of the connection
+
 };
 
 
@@ -104,6 +110,23 @@ struct conntrack_list {
  * @ingroup conntrack_api
  */
 /*@{*/
+
+/// The endpoints are addresses
+#define CT_ENDPOINT_ADDR 1
+
+/// The endpoints are ports
+#define CT_ENDPOINT_PORT 2
+
+/// Endpoints of a connection as seen by a packet, in network byte order
+struct conntrack_endpoints {
+
+	unsigned int kind; ///< CT_ENDPOINT_ADDR or CT_ENDPOINT_PORT
+	unsigned int len; ///< Length of the source and the destination
+	unsigned char src[16]; ///< Source of the packet
+	unsigned char dst[16]; ///< Destination of the packet
+
+};
+
 /// Structure that holds info about a conntrack parameter
 struct conntrack_param {
 
@@ -124,6 +147,8 @@ struct conntrack_reg {
 	int (*doublecheck) (struct frame *f, unsigned int start, void *priv, unsigned int flags);
 	void* (*alloc_match_priv) (struct frame *f, unsigned int start, struct conntrack_entry *ce);
 	int (*cleanup_match_priv) (void *priv);
+	int (*print_match_priv) (void *priv, char *buff, size_t size); ///< Optional, describe the connection key
+	int (*get_endpoints) (void *priv, unsigned int direction, struct conntrack_endpoints *ep); ///< Optional, provide the endpoints for a CE_DIR_* direction
 	int (*unregister) (struct conntrack_reg *r);
 	struct conntrack_param *params;
 
@@ -200,6 +225,50 @@ int conntrack_remove_helper_priv(void *priv, struct conntrack_entry *ce);
 /// Get the target priv of a conntrack
 void *conntrack_get_target_priv(struct target *t, struct conntrack_entry *ce);
 
+/// Maximum number of buckets scanned by a single conntrack_iterate() call
+#define CONNTRACK_ITERATE_MAX_BUCKETS 65536
+
+/// Maximum length of the name of a top entry
+#define CONNTRACK_TOP_NAME_SIZE 128
+
+/// What the top summaries are tracking
+enum conntrack_top_type {
+	conntrack_top_flows = 0,
+	conntrack_top_sources,
+	conntrack_top_ports,
+};
+
+/// Number of top summaries
+#define CONNTRACK_TOP_TYPES 3
+
+/// Maximum number of entries in each top summary
+#define CONNTRACK_TOP_MAX_SIZE 65536
+
+/// Heavy hitter returned by conntrack_top_get()
+struct conntrack_top_entry {
+
+	char name[CONNTRACK_TOP_NAME_SIZE]; ///< Description of the flow, source or port
+	uint64_t bytes; ///< Estimated number of bytes, never lower than the real one
+	uint64_t error; ///< Maximum overestimation of bytes
+	uint64_t packets; ///< Number of packets since it's tracked
+
+};
+
+/// Account a packet in its conntrack entry
+int conntrack_account(struct frame *f);
+
+/// Set the number of entries tracked by each top summary
+int conntrack_top_set_size(unsigned int size);
+
+/// Get the heaviest flows, sources or ports
+int conntrack_top_get(enum conntrack_top_type type, struct conntrack_top_entry *entries, unsigned int max);
+
+/// Call a function for a bounded number of conntrack entries
+uint32_t conntrack_iterate(uint32_t cursor, unsigned int max, int (*callback) (struct conntrack_entry *ce, void *priv), void *priv);
+
+/// Describe the key of a connection
+int conntrack_print_key(struct conntrack_entry *ce, char *buff, size_t size);
+
 /// Compute the conntrack hash of a packet
 uint32_t conntrack_hash(struct frame *f, unsigned int flags);
 
@@ -222,7 +291,7 @@ int conntrack_do_timer(void * ce);
 struct timer *conntrack_timer_alloc(struct conntrack_entry *ce, struct input *i);
 
 /// Close a connection
-int conntrack_close_connections(struct rule_list *r, pthread_rwlock_t *lock);
+int conntrack_close_connections(struct rule_snapshot *rules);
 
 /// Cleanup the conntrack subsystem
 int conntrack_cleanup();
@@ -34,6 +34,8 @@ int conntrack_register_ipv4(struct conntrack_reg *r) {
 	r->doublecheck = conntrack_doublecheck_ipv4;
 	r->alloc_match_priv = conntrack_alloc_match_priv_ipv4;
 	r->cleanup_match_priv = conntrack_cleanup_match_priv_ipv4;
+	r->print_match_priv = conntrack_print_match_priv_ipv4;
+	r->get_endpoints = conntrack_get_endpoints_ipv4;
 	r->flags = CT_DIR_BOTH;
 	
 	
@@ -121,3 +123,31 @@ static int conntrack_cleanup_match_priv_ipv4(void *priv) {
 	free(priv);
 	return POM_OK;
 }
+
+static int conntrack_print_match_priv_ipv4(void *priv, char *buff, size_t size) {
+
+	struct conntrack_priv_ipv4 *p = priv;
+
+	char saddr[INET_ADDRSTRLEN], daddr[INET_ADDRSTRLEN];
+	inet_ntop(AF_INET, &p->saddr, saddr, sizeof(saddr));
+	inet_ntop(AF_INET, &p->daddr, daddr, sizeof(daddr));
+
+	return snprintf(buff, size, "%s -> %s", saddr, daddr);
+}
+
+static int conntrack_get_endpoints_ipv4(void *priv, unsigned int direction, struct conntrack_endpoints *ep) {
+
+	struct conntrack_priv_ipv4 *p = priv;
+
+	ep->kind = CT_ENDPOINT_ADDR;
+	ep->len = sizeof(uint32_t);
+	if (direction == CE_DIR_REV) {
+		memcpy(ep->src, &p->daddr, ep->len);
+		memcpy(ep->dst, &p->saddr, ep->len);
+	} else {
+		memcpy(ep->src, &p->saddr, ep->len);
+		memcpy(ep->dst, &p->daddr, ep->len);
+	}
+
+	return POM_OK;
+}
@@ -38,6 +38,8 @@ static uint32_t conntrack_get_hash_ipv4(struct frame *f, unsigned int start, uns
 static int conntrack_doublecheck_ipv4(struct frame *f, unsigned int start, void *priv, unsigned int flags);
 static void *conntrack_alloc_match_priv_ipv4(struct frame *f, unsigned int start, struct conntrack_entry *ce);
 static int conntrack_cleanup_match_priv_ipv4(void *priv);
+static int conntrack_print_match_priv_ipv4(void *priv, char *buff, size_t size);
+static int conntrack_get_endpoints_ipv4(void *priv, unsigned int direction, struct conntrack_endpoints *ep);
 
 
 #endif
@@ -29,6 +29,8 @@ int conntrack_register_ipv6(struct conntrack_reg *r) {
 	r->doublecheck = conntrack_doublecheck_ipv6;
 	r->alloc_match_priv = conntrack_alloc_match_priv_ipv6;
 	r->cleanup_match_priv = conntrack_cleanup_match_priv_ipv6;
+	r->print_match_priv = conntrack_print_match_priv_ipv6;
+	r->get_endpoints = conntrack_get_endpoints_ipv6;
 	r->flags = CT_DIR_BOTH;
 	
 	
@@ -126,3 +128,31 @@ static int conntrack_cleanup_match_priv_ipv6(void *priv) {
 	free(priv);
 	return POM_OK;
 }
+
+static int conntrack_print_match_priv_ipv6(void *priv, char *buff, size_t size) {
+
+	struct conntrack_priv_ipv6 *p = priv;
+
+	char saddr[INET6_ADDRSTRLEN], daddr[INET6_ADDRSTRLEN];
+	inet_ntop(AF_INET6, &p->saddr, saddr, sizeof(saddr));
+	inet_ntop(AF_INET6, &p->daddr, daddr, sizeof(daddr));
+
+	return snprintf(buff, size, "%s -> %s", saddr, daddr);
+}
+
+static int conntrack_get_endpoints_ipv6(void *priv, unsigned int direction, struct conntrack_endpoints *ep) {
+
+	struct conntrack_priv_ipv6 *p = priv;
+
+	ep->kind = CT_ENDPOINT_ADDR;
+	ep->len = sizeof(struct in6_addr);
+	if (direction == CE_DIR_REV) {
+		memcpy(ep->src, &p->daddr, ep->len);
+		memcpy(ep->dst, &p->saddr, ep->len);
+	} else {
+		memcpy(ep->src, &p->saddr, ep->len);
+		memcpy(ep->dst, &p->daddr, ep->len);
+	}
+
+	return POM_OK;
+}
@@ -40,6 +40,8 @@ static uint32_t conntrack_get_hash_ipv6(struct frame *f, unsigned int start, uns
 static int conntrack_doublecheck_ipv6(struct frame *f, unsigned int start, void *priv, unsigned int flags);
 static void *conntrack_alloc_match_priv_ipv6(struct frame *f, unsigned int start, struct conntrack_entry *ce);
 static int conntrack_cleanup_match_priv_ipv6(void *priv);
+static int conntrack_print_match_priv_ipv6(void *priv, char *buff, size_t size);
+static int conntrack_get_endpoints_ipv6(void *priv, unsigned int direction, struct conntrack_endpoints *ep);
 
 
 #endif
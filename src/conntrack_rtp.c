@@ -34,6 +34,7 @@ int conntrack_register_rtp(struct conntrack_reg *r) {
 	r->doublecheck = conntrack_doublecheck_rtp;
 	r->alloc_match_priv = conntrack_alloc_match_priv_rtp;
 	r->cleanup_match_priv = conntrack_cleanup_match_priv_rtp;
+	r->print_match_priv = conntrack_print_match_priv_rtp;
 	r->unregister = conntrack_unregister_rtp;
 	r->flags = CT_DIR_ONEWAY;
 
@@ -127,6 +128,13 @@ static int conntrack_cleanup_match_priv_rtp(void *priv) {
 	return POM_OK;
 }
 
+static int conntrack_print_match_priv_rtp(void *priv, char *buff, size_t size) {
+
+	struct conntrack_priv_rtp *p = priv;
+
+	return snprintf(buff, size, "ssrc 0x%08x pt %u", ntohl(p->ssrc), p->payload_type);
+}
+
 static int conntrack_unregister_rtp(struct conntrack_reg *r) {
 
 	ptype_cleanup(rtp_timeout);
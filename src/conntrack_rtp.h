@@ -39,6 +39,7 @@ static uint32_t conntrack_get_hash_rtp(struct frame *f, unsigned int start, unsi
 static int conntrack_doublecheck_rtp(struct frame *f, unsigned int start, void *priv, unsigned int flags);
 static void *conntrack_alloc_match_priv_rtp(struct frame *f, unsigned int start, struct conntrack_entry *ce);
 static int conntrack_cleanup_match_priv_rtp(void *priv);
+static int conntrack_print_match_priv_rtp(void *priv, char *buff, size_t size);
 static int conntrack_unregister_rtp(struct conntrack_reg *r);
 
 #endif
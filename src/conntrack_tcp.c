@@ -34,6 +34,8 @@ int conntrack_register_tcp(struct conntrack_reg *r) {
 	r->doublecheck = conntrack_doublecheck_tcp;
 	r->alloc_match_priv = conntrack_alloc_match_priv_tcp;
 	r->cleanup_match_priv = conntrack_cleanup_match_priv_tcp;
+	r->print_match_priv = conntrack_print_match_priv_tcp;
+	r->get_endpoints = conntrack_get_endpoints_tcp;
 	r->unregister = conntrack_unregister_tcp;
 	r->flags = CT_DIR_BOTH;
 
@@ -217,6 +219,30 @@ static int conntrack_cleanup_match_priv_tcp(void *priv) {
 	return POM_OK;
 }
 
+static int conntrack_print_match_priv_tcp(void *priv, char *buff, size_t size) {
+
+	struct conntrack_priv_tcp *p = priv;
+
+	return snprintf(buff, size, "%u -> %u", ntohs(p->sport), ntohs(p->dport));
+}
+
+static int conntrack_get_endpoints_tcp(void *priv, unsigned int direction, struct conntrack_endpoints *ep) {
+
+	struct conntrack_priv_tcp *p = priv;
+
+	ep->kind = CT_ENDPOINT_PORT;
+	ep->len = sizeof(uint16_t);
+	if (direction == CE_DIR_REV) {
+		memcpy(ep->src, &p->dport, ep->len);
+		memcpy(ep->dst, &p->sport, ep->len);
+	} else {
+		memcpy(ep->src, &p->sport, ep->len);
+		memcpy(ep->dst, &p->dport, ep->len);
+	}
+
+	return POM_OK;
+}
+
 static int conntrack_unregister_tcp(struct conntrack_reg *r) {
 
 	ptype_cleanup(tcp_syn_sent_t);
@@ -56,6 +56,8 @@ static uint32_t conntrack_get_hash_tcp(struct frame *f, unsigned int start, unsi
 static int conntrack_doublecheck_tcp(struct frame *f, unsigned int start, void *priv, unsigned int flags);
 static void *conntrack_alloc_match_priv_tcp(struct frame *f, unsigned int start, struct conntrack_entry *ce);
 static int conntrack_cleanup_match_priv_tcp(void *priv);
+static int conntrack_print_match_priv_tcp(void *priv, char *buff, size_t size);
+static int conntrack_get_endpoints_tcp(void *priv, unsigned int direction, struct conntrack_endpoints *ep);
 static int conntrack_unregister_tcp(struct conntrack_reg *r);
 
 
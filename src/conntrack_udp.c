@@ -36,6 +36,8 @@ int conntrack_register_udp(struct conntrack_reg *r) {
 	r->doublecheck = conntrack_doublecheck_udp;
 	r->alloc_match_priv = conntrack_alloc_match_priv_udp;
 	r->cleanup_match_priv = conntrack_cleanup_match_priv_udp;
+	r->print_match_priv = conntrack_print_match_priv_udp;
+	r->get_endpoints = conntrack_get_endpoints_udp;
 	r->unregister = conntrack_unregister_udp;
 	r->flags = CT_DIR_BOTH;
 	
@@ -155,6 +157,30 @@ static int conntrack_cleanup_match_priv_udp(void *priv) {
 	return POM_OK;
 }
 
+static int conntrack_print_match_priv_udp(void *priv, char *buff, size_t size) {
+
+	struct conntrack_priv_udp *p = priv;
+
+	return snprintf(buff, size, "%u -> %u", ntohs(p->sport), ntohs(p->dport));
+}
+
+static int conntrack_get_endpoints_udp(void *priv, unsigned int direction, struct conntrack_endpoints *ep) {
+
+	struct conntrack_priv_udp *p = priv;
+
+	ep->kind = CT_ENDPOINT_PORT;
+	ep->len = sizeof(uint16_t);
+	if (direction == CE_DIR_REV) {
+		memcpy(ep->src, &p->dport, ep->len);
+		memcpy(ep->dst, &p->sport, ep->len);
+	} else {
+		memcpy(ep->src, &p->sport, ep->len);
+		memcpy(ep->dst, &p->dport, ep->len);
+	}
+
+	return POM_OK;
+}
+
 
 static int conntrack_unregister_udp(struct conntrack_reg *r) {
 
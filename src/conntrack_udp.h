@@ -40,6 +40,8 @@ static uint32_t conntrack_get_hash_udp(struct frame *f, unsigned int start, unsi
 static int conntrack_doublecheck_udp(struct frame *f, unsigned int start, void *priv, unsigned int flags);
 static void *conntrack_alloc_match_priv_udp(struct frame *f, unsigned int start, struct conntrack_entry *ce);
 static int conntrack_cleanup_match_priv_udp(void *priv);
+static int conntrack_print_match_priv_udp(void *priv, char *buff, size_t size);
+static int conntrack_get_endpoints_udp(void *priv, unsigned int direction, struct conntrack_endpoints *ep);
 static int conntrack_unregister_udp(struct conntrack_reg *r);
 
 #endif
@@ -21,12 +21,16 @@
 
 #include "common.h"
 #include "datastore.h"
+#include "datastore_async.h"
 #include "ptype.h"
 #include "main.h"
+#include "perf.h"
 
+#include "ptype_bool.h"
 #include "ptype_string.h"
 #include "ptype_uint64.h"
 #include "ptype_uint16.h"
+#include "ptype_uint32.h"
 
 #include <pthread.h>
 
@@ -49,6 +53,14 @@ const char *datasetfieldsdescr[][2] = {
 
 struct datastore_reg *datastores[MAX_DATASTORE];
 
+unsigned int datastore_batch_pending = 0;
+
+static struct perf_class *datastore_perf_class = NULL;
+
+static int datastore_dataset_queue(struct dataset *ds);
+static int datastore_dataset_flush_batch(struct dataset *ds, int notify);
+static void datastore_dataset_batch_cleanup(struct dataset *ds);
+
 static pthread_rwlock_t datastore_global_lock = PTHREAD_RWLOCK_INITIALIZER;
 
 /**
@@ -95,6 +107,14 @@ int datastore_register(const char *datastore_name) {
 
 			datastores[i]->dl_handle = handle;
 
+			// Parameters common to all the datastores
+			datastore_register_param(my_datastore, "batch_size", DATASTORE_BATCH_SIZE_DEFAULT, "Number of rows queued before writing them in a single transaction, 1 to disable");
+			datastore_register_param(my_datastore, "batch_timeout", DATASTORE_BATCH_TIMEOUT_DEFAULT, "Maximum time in seconds a row stays queued before being written");
+			datastore_register_param(my_datastore, "async", "no", "Write the rows from a dedicated thread instead of the packet processing thread");
+			datastore_register_param(my_datastore, "async_queue", DATASTORE_ASYNC_QUEUE_DEFAULT, "Number of rows the writer thread can queue");
+			datastore_register_param(my_datastore, "async_overflow", "block", "What to do when the queue is full : block, drop or spill");
+			datastore_register_param(my_datastore, "async_spill_dir", "/tmp", "Directory where the rows are spilled when the queue is full");
+
 			pom_log(POM_LOG_DEBUG "Datastore %s registered", datastore_name);
 
 			return i;
@@ -273,7 +293,55 @@ struct datastore *datastore_alloc(int datastore_type) {
 			return NULL;
 		}
 
+	d->batch_size = ptype_alloc("uint32", "rows");
+	d->batch_timeout = ptype_alloc("uint32", "seconds");
+	d->async_mode = ptype_alloc("bool", NULL);
+	d->async_queue = ptype_alloc("uint32", "rows");
+	d->async_overflow = ptype_alloc("string", NULL);
+	d->async_spill_dir = ptype_alloc("string", NULL);
+	if (!d->batch_size || !d->batch_timeout || !d->async_mode || !d->async_queue || !d->async_overflow || !d->async_spill_dir) {
+		pom_log(POM_LOG_ERR "Unable to allocate the generic parameters of the datastore");
+		if (d->batch_size)
+			ptype_cleanup(d->batch_size);
+		if (d->batch_timeout)
+			ptype_cleanup(d->batch_timeout);
+		if (d->async_mode)
+			ptype_cleanup(d->async_mode);
+		if (d->async_queue)
+			ptype_cleanup(d->async_queue);
+		if (d->async_overflow)
+			ptype_cleanup(d->async_overflow);
+		if (d->async_spill_dir)
+			ptype_cleanup(d->async_spill_dir);
+		if (datastores[datastore_type]->cleanup)
+			(*datastores[datastore_type]->cleanup) (d);
+		free(d);
+		return NULL;
+	}
+	datastore_register_param_value(d, "batch_size", d->batch_size);
+	datastore_register_param_value(d, "batch_timeout", d->batch_timeout);
+	datastore_register_param_value(d, "async", d->async_mode);
+	datastore_register_param_value(d, "async_queue", d->async_queue);
+	datastore_register_param_value(d, "async_overflow", d->async_overflow);
+	datastore_register_param_value(d, "async_spill_dir", d->async_spill_dir);
+
+	pthread_mutex_init(&d->backend_lock, NULL);
+
+	if (!datastore_perf_class)
+		datastore_perf_class = perf_register_class("datastore");
+	d->perf_instance = perf_register_instance(datastore_perf_class, d);
+	d->perf_batch_queued = perf_add_item(d->perf_instance, "batch_queued", perf_item_type_gauge, "Number of rows waiting to be written");
+	d->perf_batch_flushes = perf_add_item(d->perf_instance, "batch_flushes", perf_item_type_counter, "Number of batches written");
+	d->perf_batch_rows = perf_add_item(d->perf_instance, "batch_rows", perf_item_type_histogram, "Number of rows written in each batch");
+	d->perf_flush_time = perf_add_item(d->perf_instance, "flush_time", perf_item_type_histogram, "Time spent writing each batch");
+	d->perf_async_queued = perf_add_item(d->perf_instance, "async_queued", perf_item_type_gauge, "Number of rows waiting in the queue of the writer thread");
+	d->perf_async_dropped = perf_add_item(d->perf_instance, "async_dropped", perf_item_type_counter, "Number of rows dropped because the queue was full");
+	d->perf_async_spilled = perf_add_item(d->perf_instance, "async_spilled", perf_item_type_counter, "Number of rows written to the spill file");
+	d->perf_async_blocked = perf_add_item(d->perf_instance, "async_blocked", perf_item_type_counter, "Number of times the packet thread waited for the writer thread");
+	d->perf_async_errors = perf_add_item(d->perf_instance, "async_errors", perf_item_type_counter, "Number of rows the writer thread failed to write");
+
 	d->uid = uid_get_new();
+	uid_attach(d->uid, UID_OBJ_DATASTORE, d);
 
 	datastores[datastore_type]->refcount++;
 		
@@ -491,6 +559,9 @@ int datastore_open(struct datastore *d) {
 	d->serial++;
 	main_config->datastores_serial++;
 
+	if (PTYPE_BOOL_GETVAL(d->async_mode) && datastore_async_start(d) != POM_OK)
+		pom_log(POM_LOG_WARN "Unable to start the writer thread of datastore %s, rows will be written synchronously", d->name);
+
 	pom_log(POM_LOG_DEBUG "Datastore %s opened", d->name);
 
 	return POM_OK;
@@ -608,7 +679,10 @@ struct dataset *datastore_dataset_open(struct datastore *d, char *name, char *ty
 		tmp->dstore = d;
 
 		if (datastores[d->type]->dataset_alloc) {
-			if ((*datastores[d->type]->dataset_alloc) (tmp) == POM_ERR) {
+			pthread_mutex_lock(&d->backend_lock);
+			int res = (*datastores[d->type]->dataset_alloc) (tmp);
+			pthread_mutex_unlock(&d->backend_lock);
+			if (res == POM_ERR) {
 				pom_log(POM_LOG_ERR "Unable to allocate the dataset");
 				goto err;
 			}
@@ -655,7 +729,10 @@ struct dataset *datastore_dataset_open(struct datastore *d, char *name, char *ty
 		tmp->dstore = d;
 
 		if (datastores[d->type]->dataset_alloc) {
-			if ((*datastores[d->type]->dataset_alloc) (tmp) == POM_ERR) {
+			pthread_mutex_lock(&d->backend_lock);
+			int res = (*datastores[d->type]->dataset_alloc) (tmp);
+			pthread_mutex_unlock(&d->backend_lock);
+			if (res == POM_ERR) {
 				pom_log(POM_LOG_ERR "Unable to allocate the dataset");
 				goto err;
 			}
@@ -709,8 +786,11 @@ struct dataset *datastore_dataset_open(struct datastore *d, char *name, char *ty
 
 err:
 	if (tmp && !tmp->open) { // if not open means we were allocating it
-		if (tmp->priv) 
+		if (tmp->priv) {
+			pthread_mutex_lock(&d->backend_lock);
 			(*datastores[d->type]->dataset_cleanup) (tmp);
+			pthread_mutex_unlock(&d->backend_lock);
+		}
 		
 		struct datavalue *query = tmp->query_data;
 		int i;
@@ -734,8 +814,11 @@ int datastore_dataset_create(struct dataset *query) {
 
 	int res = POM_OK;
 
-	if (datastores[d->type] && datastores[d->type]->dataset_create)
+	if (datastores[d->type] && datastores[d->type]->dataset_create) {
+		pthread_mutex_lock(&d->backend_lock);
 		res = (*datastores[d->type]->dataset_create) (query);
+		pthread_mutex_unlock(&d->backend_lock);
+	}
 
 	if (res != POM_OK && query->state == DATASET_STATE_DATASTORE_ERR) 
 		datastore_error_notify(d);
@@ -754,8 +837,11 @@ int datastore_dataset_read(struct dataset *query) {
 
 	int res = POM_ERR;
 
-	if (datastores[d->type] && datastores[d->type]->dataset_read)
+	if (datastores[d->type] && datastores[d->type]->dataset_read) {
+		pthread_mutex_lock(&d->backend_lock);
 		res = (*datastores[d->type]->dataset_read) (query);
+		pthread_mutex_unlock(&d->backend_lock);
+	}
 
 	if (res != POM_OK && query->state == DATASET_STATE_DATASTORE_ERR) 
 		datastore_error_notify(d);
@@ -775,8 +861,23 @@ int datastore_dataset_write(struct dataset *query) {
 
 	int res = POM_ERR;
 
-	if (datastores[d->type] && datastores[d->type]->dataset_write)
+	// Internal datasets need the id of the row right away, don't queue them
+	if (query != d->datasetdb && query != d->datasetfieldsdb) {
+		if (d->async) {
+			res = datastore_async_write(query);
+			if (res != POM_OK && query->state == DATASET_STATE_DATASTORE_ERR)
+				datastore_error_notify(d);
+			return res;
+		}
+		if (PTYPE_UINT32_GETVAL(d->batch_size) > 1)
+			return datastore_dataset_queue(query);
+	}
+
+	if (datastores[d->type] && datastores[d->type]->dataset_write) {
+		pthread_mutex_lock(&d->backend_lock);
 		res = (*datastores[d->type]->dataset_write) (query);
+		pthread_mutex_unlock(&d->backend_lock);
+	}
 
 	if (res != POM_OK && query->state == DATASET_STATE_DATASTORE_ERR) 
 		datastore_error_notify(d);
@@ -785,6 +886,235 @@ int datastore_dataset_write(struct dataset *query) {
 
 }
 
+/**
+ * @ingroup datastore_core
+ * Copy the current row of the dataset in its batch and write the batch when it's full.
+ * The id of the row is not available when it's queued.
+ * A batch which failed to be written after its timeout is reported here,
+ * the state of the dataset is then the one of the failed write.
+ * @param ds Dataset to queue the row for
+ * @return POM_OK on success, POM_ERR on failure or if the previous batch couldn't be written.
+ */
+static int datastore_dataset_queue(struct dataset *ds) {
+
+	struct datastore *d = ds->dstore;
+	struct datavalue *dv = ds->query_data;
+
+	if (ds->batch_count >= ds->batch_alloc) {
+		unsigned int new_alloc = PTYPE_UINT32_GETVAL(d->batch_size);
+		if (new_alloc <= ds->batch_count)
+			new_alloc = ds->batch_count + 1;
+		struct datavalue **batch = realloc(ds->batch, sizeof(struct datavalue *) * new_alloc);
+		if (!batch) {
+			pom_log(POM_LOG_ERR "Not enough memory to queue a row for dataset %s", ds->name);
+			ds->state = DATASET_STATE_ERR;
+			return POM_ERR;
+		}
+		ds->batch = batch;
+		memset(ds->batch + ds->batch_alloc, 0, sizeof(struct datavalue *) * (new_alloc - ds->batch_alloc));
+		ds->batch_alloc = new_alloc;
+	}
+
+	// Rows are kept allocated between batches, only the values are copied
+	struct datavalue *row = ds->batch[ds->batch_count];
+	int i;
+	if (!row) {
+		for (i = 0; dv[i].name; i++);
+		row = malloc(sizeof(struct datavalue) * (i + 1));
+		if (!row) {
+			pom_log(POM_LOG_ERR "Not enough memory to queue a row for dataset %s", ds->name);
+			ds->state = DATASET_STATE_ERR;
+			return POM_ERR;
+		}
+		memcpy(row, dv, sizeof(struct datavalue) * (i + 1));
+		for (i = 0; dv[i].name; i++)
+			row[i].value = ptype_alloc_from(dv[i].value);
+		ds->batch[ds->batch_count] = row;
+	} else {
+		for (i = 0; dv[i].name; i++)
+			ptype_copy(row[i].value, dv[i].value);
+	}
+
+	struct timeval *now = get_current_time_p();
+	if (!ds->batch_count) {
+		memcpy(&ds->batch_start, now, sizeof(struct timeval));
+		__sync_add_and_fetch(&datastore_batch_pending, 1);
+	}
+
+	ds->batch_count++;
+	perf_item_val_inc(d->perf_batch_queued, 1);
+	ds->state = DATASET_STATE_DONE;
+
+	int res = POM_OK;
+	if (ds->batch_count >= PTYPE_UINT32_GETVAL(d->batch_size) || now->tv_sec >= ds->batch_start.tv_sec + PTYPE_UINT32_GETVAL(d->batch_timeout))
+		res = datastore_dataset_flush(ds);
+
+	if (res == POM_OK && ds->batch_state != DATASET_STATE_DONE) {
+		// The row is queued but an earlier one was lost
+		ds->state = ds->batch_state;
+		ds->batch_state = DATASET_STATE_DONE;
+		if (ds->state == DATASET_STATE_DATASTORE_ERR)
+			datastore_error_notify(d);
+		return POM_ERR;
+	}
+
+	return res;
+}
+
+/**
+ * @ingroup datastore_core
+ * Write the queued rows in a single transaction.
+ * @param ds Dataset to flush
+ * @param notify Notify the datastore error to the users of the datastore
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+static int datastore_dataset_flush_batch(struct dataset *ds, int notify) {
+
+	if (!ds->batch_count)
+		return POM_OK;
+
+	struct datastore *d = ds->dstore;
+	unsigned int count = ds->batch_count;
+
+	ds->batch_count = 0;
+	__sync_sub_and_fetch(&datastore_batch_pending, 1);
+	perf_item_val_inc(d->perf_batch_queued, -((int64_t)count));
+
+	int res = datastore_dataset_write_rows(ds, ds->batch, count);
+
+	if (res != POM_OK) {
+		pom_log(POM_LOG_ERR "Error while writing %u queued rows to dataset %s", count, ds->name);
+		if (notify) {
+			ds->batch_state = DATASET_STATE_DONE;
+			if (ds->state == DATASET_STATE_DATASTORE_ERR)
+				datastore_error_notify(d);
+		} else {
+			// Nobody is waiting for the result, report it with the next write
+			ds->batch_state = ds->state;
+		}
+	}
+
+	return res;
+}
+
+/**
+ * @ingroup datastore_core
+ * The rows are written in a transaction when the datastore supports it.
+ * The query_data of the dataset is replaced by each row while writing it.
+ * @param ds Dataset to write to
+ * @param rows Rows to write
+ * @param count Number of rows
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int datastore_dataset_write_rows(struct dataset *ds, struct datavalue **rows, unsigned int count) {
+
+	struct datastore *d = ds->dstore;
+	struct datastore_reg *r = datastores[d->type];
+
+	if (!r || !r->dataset_write)
+		return POM_ERR;
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pthread_mutex_lock(&d->backend_lock);
+
+	int res = POM_OK;
+	if (r->transaction_begin)
+		res = (*r->transaction_begin) (ds);
+
+	if (res == POM_OK) {
+		struct datavalue *orig = ds->query_data;
+		unsigned int i;
+		for (i = 0; i < count && res == POM_OK; i++) {
+			ds->query_data = rows[i];
+			res = (*r->dataset_write) (ds);
+		}
+		ds->query_data = orig;
+
+		if (res == POM_OK && r->transaction_commit) {
+			res = (*r->transaction_commit) (ds);
+		} else if (res != POM_OK && r->transaction_rollback) {
+			// Keep the state of the failed write
+			int state = ds->state;
+			(*r->transaction_rollback) (ds);
+			ds->state = state;
+		}
+	}
+
+	pthread_mutex_unlock(&d->backend_lock);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	perf_item_val_record(d->perf_flush_time, ((uint64_t)(end.tv_sec - start.tv_sec) * 1000000000LLU) + end.tv_nsec - start.tv_nsec);
+	perf_item_val_record(d->perf_batch_rows, count);
+	perf_item_val_inc(d->perf_batch_flushes, 1);
+
+	return res;
+}
+
+/**
+ * @ingroup datastore_core
+ * @param ds Dataset to flush
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int datastore_dataset_flush(struct dataset *ds) {
+
+	return datastore_dataset_flush_batch(ds, 1);
+}
+
+/**
+ * @ingroup datastore_core
+ * @param now Current time or NULL to flush all the queued rows
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int datastore_flush_expired(struct timeval *now) {
+
+	int res = POM_OK;
+
+	main_config_datastores_lock(0);
+
+	struct datastore *d = main_config->datastores;
+	while (d) {
+		datastore_lock_instance(d, 0);
+		struct dataset *ds = d->datasets;
+		while (ds) {
+			struct dataset *next = ds->next;
+			if (ds->open && ds->batch_count && (!now || now->tv_sec >= ds->batch_start.tv_sec + PTYPE_UINT32_GETVAL(d->batch_timeout))) {
+				if (datastore_dataset_flush_batch(ds, 0) != POM_OK)
+					res = POM_ERR;
+			}
+			ds = next;
+		}
+		datastore_unlock_instance(d);
+		d = d->next;
+	}
+
+	main_config_datastores_unlock();
+
+	return res;
+}
+
+/**
+ * @ingroup datastore_core
+ * @param ds Dataset to free the batch from
+ */
+static void datastore_dataset_batch_cleanup(struct dataset *ds) {
+
+	unsigned int i;
+	for (i = 0; i < ds->batch_alloc; i++) {
+		struct datavalue *row = ds->batch[i];
+		if (!row)
+			continue;
+		int j;
+		for (j = 0; row[j].name; j++)
+			ptype_cleanup(row[j].value);
+		free(row);
+	}
+	free(ds->batch);
+	ds->batch = NULL;
+	ds->batch_alloc = 0;
+}
+
 int datastore_dataset_close(struct dataset *ds) {
 
 	struct datastore *d = ds->dstore;
@@ -794,8 +1124,19 @@ int datastore_dataset_close(struct dataset *ds) {
 		return POM_ERR;
 	}
 
-	if (datastores[d->type] && datastores[d->type]->dataset_cleanup)
+	// Don't notify errors here, the dataset is already being closed
+	datastore_dataset_flush_batch(ds, 0);
+	datastore_dataset_batch_cleanup(ds);
+
+	// Wait for the writer thread to be done with the rows of this dataset
+	if (d->async)
+		datastore_async_release(d, ds);
+
+	if (datastores[d->type] && datastores[d->type]->dataset_cleanup) {
+		pthread_mutex_lock(&d->backend_lock);
 		(*datastores[d->type]->dataset_cleanup) (ds);
+		pthread_mutex_unlock(&d->backend_lock);
+	}
 		
 		
 	ds->priv = NULL;
@@ -829,8 +1170,11 @@ int datastore_dataset_destroy(struct dataset *ds) {
 
 	datasets->query_cond = del_cond;
 
-	if (datastores[d->type] && datastores[d->type]->dataset_delete)
+	if (datastores[d->type] && datastores[d->type]->dataset_delete) {
+		pthread_mutex_lock(&d->backend_lock);
 		res = (*datastores[d->type]->dataset_delete) (datasets);
+		pthread_mutex_unlock(&d->backend_lock);
+	}
 	
 	datasets->query_cond = NULL;
 	ptype_cleanup(del_cond->value);
@@ -862,8 +1206,11 @@ int datastore_dataset_destroy(struct dataset *ds) {
 	
 	PTYPE_UINT64_SETVAL(dsfields->query_cond->value, ds->dataset_id);
 
-	if (datastores[d->type] && datastores[d->type]->dataset_delete)
+	if (datastores[d->type] && datastores[d->type]->dataset_delete) {
+		pthread_mutex_lock(&d->backend_lock);
 		res = (*datastores[d->type]->dataset_delete) (dsfields);
+		pthread_mutex_unlock(&d->backend_lock);
+	}
 
 	if (res == POM_ERR) {
 		pom_log(POM_LOG_ERR "Unable to remove the dataset fields from the database");
@@ -872,8 +1219,11 @@ int datastore_dataset_destroy(struct dataset *ds) {
 	res = POM_ERR;
 
 	// Destroy the dataset
-	if (datastores[d->type] && datastores[d->type]->dataset_destroy)
+	if (datastores[d->type] && datastores[d->type]->dataset_destroy) {
+		pthread_mutex_lock(&d->backend_lock);
 		res = (*datastores[d->type]->dataset_destroy) (ds);
+		pthread_mutex_unlock(&d->backend_lock);
+	}
 
 	if (res == POM_ERR)
 		pom_log(POM_LOG_ERR "Unable to destroy the dataset");
@@ -925,6 +1275,10 @@ int datastore_close(struct datastore *d) {
 		dset = dset->next;
 	}
 
+	// All the datasets are closed, nothing is left in the queue
+	if (d->async)
+		datastore_async_stop(d);
+
 	d->started = 0;
 
 	struct datavalue *dv = NULL;
@@ -1051,6 +1405,15 @@ int datastore_cleanup(struct datastore *d) {
 		free(p);
 	}
 
+	ptype_cleanup(d->batch_size);
+	ptype_cleanup(d->batch_timeout);
+	ptype_cleanup(d->async_mode);
+	ptype_cleanup(d->async_queue);
+	ptype_cleanup(d->async_overflow);
+	ptype_cleanup(d->async_spill_dir);
+	pthread_mutex_destroy(&d->backend_lock);
+	perf_unregister_instance(datastore_perf_class, d->perf_instance);
+
 	free(d->name);
 
 	if (d->description)
@@ -43,6 +43,14 @@
 #define DATASET_STATE_ERR -1
 #define DATASET_STATE_DATASTORE_ERR -2 // Error occured at datastore level
 
+/// Default number of rows written in a single transaction
+#define DATASTORE_BATCH_SIZE_DEFAULT "1"
+/// Default maximum time in seconds a row stays queued
+#define DATASTORE_BATCH_TIMEOUT_DEFAULT "2"
+
+/// Default number of rows the asynchronous writer can queue
+#define DATASTORE_ASYNC_QUEUE_DEFAULT "4096"
+
 /// Possible read directions
 #define DATASET_READ_ORDER_ASC 0
 #define DATASET_READ_ORDER_DESC 1
@@ -98,6 +106,12 @@ struct dataset {
 
 	struct datavalue_read_order *query_read_order;
 
+	struct datavalue **batch; ///< Rows queued to be written in a single transaction
+	unsigned int batch_count; ///< Number of rows queued
+	unsigned int batch_alloc; ///< Number of rows allocated in the batch
+	struct timeval batch_start; ///< Time at which the first row of the batch was queued
+	int batch_state; ///< State of the last batch which failed to be written in the background, reported by the next write
+
 	void *priv; ///< Private data of the dataset
 
 	int (*error_notify) (struct dataset *dset);
@@ -139,6 +153,28 @@ struct datastore {
 	struct dataset *datasetdb; ///< Dataset containing that stores the list of datasets in the db
 	struct dataset *datasetfieldsdb; ///< Dataset containing the descriptions of the fields of all the datasets
 
+	struct ptype *batch_size; ///< Number of rows to queue before writing them in a single transaction
+	struct ptype *batch_timeout; ///< Maximum time in seconds a row can stay queued
+
+	struct ptype *async_mode; ///< Write the rows from a dedicated thread
+	struct ptype *async_queue; ///< Number of rows the writer thread can queue
+	struct ptype *async_overflow; ///< What to do when the queue is full
+	struct ptype *async_spill_dir; ///< Where to create the spill file
+
+	struct datastore_async *async; ///< Writer thread of the datastore if running
+	pthread_mutex_t backend_lock; ///< Serialize the calls to the datastore functions between threads
+
+	struct perf_instance *perf_instance; ///< Performance counters of this datastore
+	struct perf_item *perf_batch_queued; ///< Rows currently queued
+	struct perf_item *perf_batch_flushes; ///< Number of batches written
+	struct perf_item *perf_batch_rows; ///< Number of rows in each batch
+	struct perf_item *perf_flush_time; ///< Time spent writing each batch
+	struct perf_item *perf_async_queued; ///< Rows waiting in the queue of the writer thread
+	struct perf_item *perf_async_dropped; ///< Rows dropped because the queue was full
+	struct perf_item *perf_async_spilled; ///< Rows written to the spill file
+	struct perf_item *perf_async_blocked; ///< Number of times the queue was full and the packet thread waited
+	struct perf_item *perf_async_errors; ///< Rows the writer thread failed to write
+
 	struct datastore *next; ///< Used for linking
 	struct datastore *prev; ///< Used for linking
 };
@@ -209,6 +245,28 @@ struct datastore_reg {
 	 */
 	int (*dataset_delete) (struct dataset *query);
 
+	/**
+	 * The transaction_begin function will start a transaction in which
+	 * the following dataset_write calls will be grouped.
+	 * @param ds The dataset being written to
+	 * @return POM_OK on success, POM_ERR on failure.
+	 */
+	int (*transaction_begin) (struct dataset *ds);
+
+	/**
+	 * The transaction_commit function will commit the rows written since transaction_begin.
+	 * @param ds The dataset being written to
+	 * @return POM_OK on success, POM_ERR on failure.
+	 */
+	int (*transaction_commit) (struct dataset *ds);
+
+	/**
+	 * The transaction_rollback function will discard the rows written since transaction_begin.
+	 * @param ds The dataset being written to
+	 * @return POM_OK on success, POM_ERR on failure.
+	 */
+	int (*transaction_rollback) (struct dataset *ds);
+
 	/**
 	 * The dataset_destroy function will remove the dataset from the datastore
 	 * @param ds The dataset to remove
@@ -290,6 +348,18 @@ int datastore_dataset_read(struct dataset *query);
 /// Write an entry to a dataset in a datastore
 int datastore_dataset_write(struct dataset *query);
 
+/// Write the queued entries of a dataset
+int datastore_dataset_flush(struct dataset *ds);
+
+/// Write rows to a dataset in a single transaction
+int datastore_dataset_write_rows(struct dataset *ds, struct datavalue **rows, unsigned int count);
+
+/// Write the queued entries of all the datasets older than the batch timeout
+int datastore_flush_expired(struct timeval *now);
+
+/// Number of datasets having queued entries, only modified atomically
+extern unsigned int datastore_batch_pending;
+
 // Destroy a dataset
 int datastore_dataset_destroy(struct dataset *ds);
 
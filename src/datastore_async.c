@@ -0,0 +1,695 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "common.h"
+#include "datastore_async.h"
+#include "ptype.h"
+#include "perf.h"
+
+#include "ptype_string.h"
+#include "ptype_uint32.h"
+
+#include <pthread.h>
+#include <errno.h>
+
+/// Header of a row in the spill file
+struct datastore_async_spill_hdr {
+
+	uint32_t name_len; ///< Length of the name of the dataset following the header, including the trailing 0
+	uint32_t len; ///< Length of the serialized values following the name
+
+};
+
+static void *datastore_async_thread_func(void *priv);
+static unsigned int datastore_async_max_rows(struct datastore_async *a);
+static void datastore_async_process(struct datastore_async *a, unsigned int tail, unsigned int head);
+static int datastore_async_spill(struct datastore_async *a, struct dataset *ds);
+static void datastore_async_replay(struct datastore_async *a);
+static void datastore_async_wakeup_waiters(struct datastore_async *a);
+static void datastore_async_dataset_copy(struct dataset *dst, struct dataset *src, struct datavalue *row);
+static void datastore_async_drop(struct datastore_async *a, struct dataset *ds, char *reason);
+static void datastore_async_spill_reset(struct datastore_async *a);
+static struct datavalue *datastore_async_row_alloc(struct dataset *ds);
+static void datastore_async_row_cleanup(struct datavalue *row);
+
+/**
+ * @ingroup datastore_core
+ * Called when opening the datastore, before any dataset is opened.
+ * @param d Datastore to start the writer thread for
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int datastore_async_start(struct datastore *d) {
+
+	struct datastore_async *a = malloc(sizeof(struct datastore_async));
+	memset(a, 0, sizeof(struct datastore_async));
+
+	a->d = d;
+	a->size = PTYPE_UINT32_GETVAL(d->async_queue);
+	if (a->size < 2)
+		a->size = 2;
+
+	char *overflow = PTYPE_STRING_GETVAL(d->async_overflow);
+	if (!strcmp(overflow, "drop")) {
+		a->overflow = DATASTORE_ASYNC_OVERFLOW_DROP;
+	} else if (!strcmp(overflow, "spill")) {
+		a->overflow = DATASTORE_ASYNC_OVERFLOW_SPILL;
+	} else {
+		if (strcmp(overflow, "block"))
+			pom_log(POM_LOG_WARN "Unknown overflow behavior \"%s\" for datastore %s, using \"block\"", overflow, d->name);
+		a->overflow = DATASTORE_ASYNC_OVERFLOW_BLOCK;
+	}
+
+	a->queue = malloc(sizeof(struct datastore_async_entry) * a->size);
+	memset(a->queue, 0, sizeof(struct datastore_async_entry) * a->size);
+	a->rows = malloc(sizeof(struct datavalue *) * a->size);
+	a->spill_fd = -1;
+
+	if (a->overflow == DATASTORE_ASYNC_OVERFLOW_SPILL) {
+		a->spill_buff = malloc(DATASTORE_ASYNC_SPILL_VALUE_SIZE);
+		a->replay = malloc(sizeof(struct datastore_async_entry) * a->size);
+		memset(a->replay, 0, sizeof(struct datastore_async_entry) * a->size);
+	}
+
+	pthread_mutex_init(&a->lock, NULL);
+	pthread_cond_init(&a->work_cond, NULL);
+	pthread_cond_init(&a->space_cond, NULL);
+
+	if (pthread_create(&a->thread, NULL, datastore_async_thread_func, a)) {
+		pom_log(POM_LOG_ERR "Unable to create the writer thread of datastore %s", d->name);
+		pthread_mutex_destroy(&a->lock);
+		pthread_cond_destroy(&a->work_cond);
+		pthread_cond_destroy(&a->space_cond);
+		free(a->replay);
+		free(a->spill_buff);
+		free(a->rows);
+		free(a->queue);
+		free(a);
+		return POM_ERR;
+	}
+
+	d->async = a;
+
+	pom_log(POM_LOG_DEBUG "Writer thread of datastore %s started with a queue of %u rows", d->name, a->size);
+
+	return POM_OK;
+}
+
+/**
+ * @ingroup datastore_core
+ * Copy the current row of the dataset in the queue of the writer thread.
+ * Must only be called from the packet processing thread.
+ * @param ds Dataset to write to
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int datastore_async_write(struct dataset *ds) {
+
+	struct datastore *d = ds->dstore;
+	struct datastore_async *a = d->async;
+
+	if (a->error) {
+		ds->state = DATASET_STATE_DATASTORE_ERR;
+		return POM_ERR;
+	}
+
+	ds->state = DATASET_STATE_DONE;
+
+	// Once rows are spilled, keep spilling until they are all written to preserve the order
+	if (a->spill_rows) {
+		pthread_mutex_lock(&a->lock);
+		if (a->spill_rows) {
+			int res = datastore_async_spill(a, ds);
+			pthread_mutex_unlock(&a->lock);
+			return res;
+		}
+		pthread_mutex_unlock(&a->lock);
+	}
+
+	while (a->head - a->tail >= a->size) {
+
+		if (a->overflow == DATASTORE_ASYNC_OVERFLOW_DROP) {
+			datastore_async_drop(a, ds, "the queue is full");
+			return POM_ERR;
+		}
+
+		pthread_mutex_lock(&a->lock);
+
+		if (a->overflow == DATASTORE_ASYNC_OVERFLOW_SPILL) {
+			int res = datastore_async_spill(a, ds);
+			pthread_mutex_unlock(&a->lock);
+			return res;
+		}
+
+		perf_item_val_inc(d->perf_async_blocked, 1);
+		a->producer_waiting++;
+		__sync_synchronize();
+		while (a->head - a->tail >= a->size && !a->error)
+			pthread_cond_wait(&a->space_cond, &a->lock);
+		a->producer_waiting--;
+		pthread_mutex_unlock(&a->lock);
+
+		if (a->error) {
+			ds->state = DATASET_STATE_DATASTORE_ERR;
+			return POM_ERR;
+		}
+	}
+
+	a->dropping = 0;
+
+	struct datastore_async_entry *e = &a->queue[a->head % a->size];
+
+	// Rows stay allocated in the queue and are reused by the next row of the same dataset
+	if (e->ds != ds) {
+		if (e->row)
+			datastore_async_row_cleanup(e->row);
+		e->row = datastore_async_row_alloc(ds);
+		e->ds = ds;
+	}
+
+	int i;
+	for (i = 0; ds->query_data[i].name; i++)
+		ptype_copy(e->row[i].value, ds->query_data[i].value);
+
+	__sync_synchronize();
+	a->head++;
+	__sync_synchronize();
+
+	perf_item_val_inc(d->perf_async_queued, 1);
+
+	if (a->writer_idle) {
+		pthread_mutex_lock(&a->lock);
+		pthread_cond_signal(&a->work_cond);
+		pthread_mutex_unlock(&a->lock);
+	}
+
+	return POM_OK;
+}
+
+/**
+ * @ingroup datastore_core
+ * Wait for the writer thread to write all the queued rows and
+ * forget the rows allocated for the dataset.
+ * @param d Datastore of the dataset
+ * @param ds Dataset being closed
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int datastore_async_release(struct datastore *d, struct dataset *ds) {
+
+	struct datastore_async *a = d->async;
+
+	pthread_mutex_lock(&a->lock);
+	a->producer_waiting++;
+	__sync_synchronize();
+	while (a->head != a->tail || a->spill_rows)
+		pthread_cond_wait(&a->space_cond, &a->lock);
+	a->producer_waiting--;
+	pthread_mutex_unlock(&a->lock);
+
+	// The writer thread doesn't use the rows anymore and the dataset may be freed after that
+	unsigned int i;
+	for (i = 0; i < a->size; i++) {
+		if (a->queue[i].ds == ds) {
+			datastore_async_row_cleanup(a->queue[i].row);
+			a->queue[i].row = NULL;
+			a->queue[i].ds = NULL;
+		}
+		if (a->replay && a->replay[i].ds == ds) {
+			datastore_async_row_cleanup(a->replay[i].row);
+			a->replay[i].row = NULL;
+			a->replay[i].ds = NULL;
+		}
+	}
+
+	return POM_OK;
+}
+
+/**
+ * @ingroup datastore_core
+ * Called when closing the datastore, once all the datasets are closed.
+ * @param d Datastore to stop the writer thread of
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int datastore_async_stop(struct datastore *d) {
+
+	struct datastore_async *a = d->async;
+
+	pthread_mutex_lock(&a->lock);
+	a->stop = 1;
+	pthread_cond_signal(&a->work_cond);
+	pthread_mutex_unlock(&a->lock);
+
+	pthread_join(a->thread, NULL);
+
+	d->async = NULL;
+
+	unsigned int i;
+	for (i = 0; i < a->size; i++) {
+		if (a->queue[i].row)
+			datastore_async_row_cleanup(a->queue[i].row);
+		if (a->replay && a->replay[i].row)
+			datastore_async_row_cleanup(a->replay[i].row);
+	}
+
+	if (a->spill_fd != -1)
+		close(a->spill_fd);
+
+	pthread_mutex_destroy(&a->lock);
+	pthread_cond_destroy(&a->work_cond);
+	pthread_cond_destroy(&a->space_cond);
+
+	free(a->spill_datasets);
+	free(a->replay);
+	free(a->spill_buff);
+	free(a->rows);
+	free(a->queue);
+	free(a);
+
+	pom_log(POM_LOG_DEBUG "Writer thread of datastore %s stopped", d->name);
+
+	return POM_OK;
+}
+
+/**
+ * @ingroup datastore_core
+ * @param priv The struct datastore_async of the thread
+ * @return NULL
+ */
+static void *datastore_async_thread_func(void *priv) {
+
+	struct datastore_async *a = priv;
+
+	while (1) {
+
+		unsigned int tail = a->tail;
+		unsigned int head = a->head;
+		__sync_synchronize();
+
+		if (tail != head) {
+			datastore_async_process(a, tail, head);
+			continue;
+		}
+
+		if (a->spill_rows) {
+			datastore_async_replay(a);
+			continue;
+		}
+
+		pthread_mutex_lock(&a->lock);
+
+		if (a->head == a->tail && !a->spill_rows) {
+
+			// Let datastore_async_release() know that everything was written
+			if (a->producer_waiting)
+				pthread_cond_broadcast(&a->space_cond);
+
+			if (a->stop) {
+				pthread_mutex_unlock(&a->lock);
+				break;
+			}
+
+			a->writer_idle = 1;
+			__sync_synchronize();
+			if (a->head == a->tail && !a->spill_rows)
+				pthread_cond_wait(&a->work_cond, &a->lock);
+			a->writer_idle = 0;
+		}
+
+		pthread_mutex_unlock(&a->lock);
+	}
+
+	return NULL;
+}
+
+/**
+ * @ingroup datastore_core
+ * @param a The writer thread
+ * @return Maximum number of rows to write in a single transaction
+ */
+static unsigned int datastore_async_max_rows(struct datastore_async *a) {
+
+	unsigned int max = PTYPE_UINT32_GETVAL(a->d->batch_size);
+	if (max < 1)
+		max = 1;
+	if (max > a->size)
+		max = a->size;
+
+	return max;
+}
+
+/**
+ * @ingroup datastore_core
+ * Write the consecutive rows of the same dataset found at the tail of the queue.
+ * @param a The writer thread
+ * @param tail Tail of the queue
+ * @param head Head of the queue
+ */
+static void datastore_async_process(struct datastore_async *a, unsigned int tail, unsigned int head) {
+
+	struct datastore *d = a->d;
+	struct dataset *ds = a->queue[tail % a->size].ds;
+	unsigned int max = datastore_async_max_rows(a);
+
+	unsigned int count = 0;
+	while (tail + count != head && count < max && a->queue[(tail + count) % a->size].ds == ds) {
+		a->rows[count] = a->queue[(tail + count) % a->size].row;
+		count++;
+	}
+
+	if (!a->error) {
+		// The packet thread keeps using the dataset, write through a copy of it
+		struct dataset tmp;
+		datastore_async_dataset_copy(&tmp, ds, a->rows[0]);
+		if (datastore_dataset_write_rows(&tmp, a->rows, count) != POM_OK) {
+			pom_log(POM_LOG_ERR "Error while writing %u rows to dataset %s", count, ds->name);
+			perf_item_val_inc(d->perf_async_errors, count);
+			if (tmp.state == DATASET_STATE_DATASTORE_ERR)
+				a->error = 1;
+		}
+	} else {
+		perf_item_val_inc(d->perf_async_errors, count);
+	}
+
+	__sync_synchronize();
+	a->tail = tail + count;
+	__sync_synchronize();
+
+	perf_item_val_inc(d->perf_async_queued, -((int64_t)count));
+
+	if (a->producer_waiting)
+		datastore_async_wakeup_waiters(a);
+
+}
+
+/**
+ * @ingroup datastore_core
+ * Append the current row of the dataset to the spill file.
+ * Must be called with the lock held.
+ * @param a The writer thread
+ * @param ds Dataset to write to
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+static int datastore_async_spill(struct datastore_async *a, struct dataset *ds) {
+
+	struct datastore *d = a->d;
+
+	if (a->spill_fd == -1) {
+		char *dir = PTYPE_STRING_GETVAL(d->async_spill_dir);
+		char *filename = malloc(strlen(dir) + strlen(d->name) + strlen("/pom-datastore--XXXXXX") + 1);
+		strcpy(filename, dir);
+		strcat(filename, "/pom-datastore-");
+		strcat(filename, d->name);
+		strcat(filename, "-XXXXXX");
+		a->spill_fd = mkstemp(filename);
+		if (a->spill_fd == -1) {
+			char errbuff[256];
+			strerror_r(errno, errbuff, sizeof(errbuff) - 1);
+			pom_log(POM_LOG_ERR "Unable to create the spill file %s : %s", filename, errbuff);
+			free(filename);
+			datastore_async_drop(a, ds, "the spill file can't be created");
+			return POM_ERR;
+		}
+		// Nobody else needs to see it
+		unlink(filename);
+		free(filename);
+	}
+
+	// Remember the dataset so the rows can be matched back to it by name
+	unsigned int i;
+	for (i = 0; i < a->spill_datasets_count && a->spill_datasets[i] != ds; i++);
+	if (i == a->spill_datasets_count) {
+		if (a->spill_datasets_count >= a->spill_datasets_alloc) {
+			unsigned int new_alloc = (a->spill_datasets_alloc ? a->spill_datasets_alloc * 2 : 8);
+			struct dataset **spill_datasets = realloc(a->spill_datasets, sizeof(struct dataset *) * new_alloc);
+			if (!spill_datasets) {
+				datastore_async_drop(a, ds, "there is not enough memory to spill it");
+				return POM_ERR;
+			}
+			a->spill_datasets = spill_datasets;
+			a->spill_datasets_alloc = new_alloc;
+		}
+		a->spill_datasets[a->spill_datasets_count++] = ds;
+	}
+
+	struct datastore_async_spill_hdr hdr;
+	memset(&hdr, 0, sizeof(struct datastore_async_spill_hdr));
+	hdr.name_len = strlen(ds->name) + 1;
+
+	off_t pos = a->spill_write + sizeof(struct datastore_async_spill_hdr);
+	if (pwrite(a->spill_fd, ds->name, hdr.name_len, pos) != hdr.name_len)
+		goto err;
+	pos += hdr.name_len;
+
+	for (i = 0; ds->query_data[i].name; i++) {
+		a->spill_buff[DATASTORE_ASYNC_SPILL_VALUE_SIZE - 1] = 0;
+		ptype_serialize(ds->query_data[i].value, a->spill_buff, DATASTORE_ASYNC_SPILL_VALUE_SIZE - 1);
+		size_t len = strlen(a->spill_buff) + 1;
+		if (pwrite(a->spill_fd, a->spill_buff, len, pos) != len)
+			goto err;
+		pos += len;
+		hdr.len += len;
+	}
+
+	if (pwrite(a->spill_fd, &hdr, sizeof(struct datastore_async_spill_hdr), a->spill_write) != sizeof(struct datastore_async_spill_hdr))
+		goto err;
+
+	a->spill_write = pos;
+	a->spill_rows++;
+	a->dropping = 0;
+
+	perf_item_val_inc(d->perf_async_spilled, 1);
+
+	if (a->writer_idle)
+		pthread_cond_signal(&a->work_cond);
+
+	return POM_OK;
+
+err:
+	datastore_async_drop(a, ds, "the spill file can't be written");
+	return POM_ERR;
+}
+
+/**
+ * @ingroup datastore_core
+ * Write the first rows of the spill file belonging to the same dataset.
+ * @param a The writer thread
+ */
+static void datastore_async_replay(struct datastore_async *a) {
+
+	struct datastore *d = a->d;
+	unsigned int max = datastore_async_max_rows(a);
+
+	struct dataset *ds = NULL;
+	unsigned int count = 0;
+	off_t pos;
+	char *values = NULL;
+	size_t values_size = 0;
+	char name[DATASTORE_ASYNC_SPILL_NAME_SIZE];
+
+	pthread_mutex_lock(&a->lock);
+
+	pos = a->spill_read;
+	while (count < max && count < a->spill_rows) {
+
+		struct datastore_async_spill_hdr hdr;
+		if (pread(a->spill_fd, &hdr, sizeof(struct datastore_async_spill_hdr), pos) != sizeof(struct datastore_async_spill_hdr))
+			goto err;
+
+		if (!hdr.name_len || hdr.name_len > sizeof(name) || pread(a->spill_fd, name, hdr.name_len, pos + sizeof(struct datastore_async_spill_hdr)) != hdr.name_len || name[hdr.name_len - 1])
+			goto err;
+
+		if (!ds) {
+			unsigned int i;
+			for (i = 0; i < a->spill_datasets_count && strcmp(a->spill_datasets[i]->name, name); i++);
+			if (i == a->spill_datasets_count)
+				goto err;
+			ds = a->spill_datasets[i];
+		} else if (strcmp(ds->name, name)) {
+			break;
+		}
+
+		if (hdr.len > values_size) {
+			char *new_values = realloc(values, hdr.len);
+			if (!new_values)
+				goto err;
+			values = new_values;
+			values_size = hdr.len;
+		}
+		if (pread(a->spill_fd, values, hdr.len, pos + sizeof(struct datastore_async_spill_hdr) + hdr.name_len) != hdr.len)
+			goto err;
+
+		struct datastore_async_entry *e = &a->replay[count];
+		if (e->ds != ds) {
+			if (e->row)
+				datastore_async_row_cleanup(e->row);
+			e->row = datastore_async_row_alloc(ds);
+			e->ds = ds;
+		}
+
+		char *value = values;
+		int i;
+		for (i = 0; e->row[i].name; i++) {
+			ptype_unserialize(e->row[i].value, value);
+			value += strlen(value) + 1;
+		}
+
+		a->rows[count] = e->row;
+		count++;
+		pos += sizeof(struct datastore_async_spill_hdr) + hdr.name_len + hdr.len;
+	}
+
+	pthread_mutex_unlock(&a->lock);
+	free(values);
+
+	if (!a->error) {
+		struct dataset tmp;
+		datastore_async_dataset_copy(&tmp, ds, a->rows[0]);
+		if (datastore_dataset_write_rows(&tmp, a->rows, count) != POM_OK) {
+			pom_log(POM_LOG_ERR "Error while writing %u spilled rows to dataset %s", count, ds->name);
+			perf_item_val_inc(d->perf_async_errors, count);
+			if (tmp.state == DATASET_STATE_DATASTORE_ERR)
+				a->error = 1;
+		}
+	} else {
+		perf_item_val_inc(d->perf_async_errors, count);
+	}
+
+	pthread_mutex_lock(&a->lock);
+	a->spill_read = pos;
+	a->spill_rows -= count;
+	if (!a->spill_rows)
+		datastore_async_spill_reset(a);
+	if (a->producer_waiting)
+		pthread_cond_broadcast(&a->space_cond);
+	pthread_mutex_unlock(&a->lock);
+
+	return;
+
+err:
+	pom_log(POM_LOG_ERR "Unable to read the spill file of datastore %s, %u rows lost", d->name, a->spill_rows);
+	perf_item_val_inc(d->perf_async_errors, a->spill_rows);
+	a->spill_rows = 0;
+	datastore_async_spill_reset(a);
+	if (a->producer_waiting)
+		pthread_cond_broadcast(&a->space_cond);
+	pthread_mutex_unlock(&a->lock);
+	free(values);
+}
+
+/**
+ * @ingroup datastore_core
+ * @param a The writer thread
+ */
+static void datastore_async_wakeup_waiters(struct datastore_async *a) {
+
+	pthread_mutex_lock(&a->lock);
+	pthread_cond_broadcast(&a->space_cond);
+	pthread_mutex_unlock(&a->lock);
+}
+
+/**
+ * @ingroup datastore_core
+ * Must be called with the lock held once all the spilled rows were written or lost.
+ * @param a The writer thread
+ */
+static void datastore_async_spill_reset(struct datastore_async *a) {
+
+	a->spill_read = 0;
+	a->spill_write = 0;
+	a->spill_datasets_count = 0;
+	if (ftruncate(a->spill_fd, 0))
+		pom_log(POM_LOG_WARN "Unable to truncate the spill file of datastore %s", a->d->name);
+}
+
+/**
+ * @ingroup datastore_core
+ * Account a row which couldn't be queued. Only the first one of a series is logged.
+ * @param a The writer thread
+ * @param ds Dataset the row belongs to
+ * @param reason Why the row is dropped
+ */
+static void datastore_async_drop(struct datastore_async *a, struct dataset *ds, char *reason) {
+
+	perf_item_val_inc(a->d->perf_async_dropped, 1);
+	ds->state = DATASET_STATE_ERR;
+
+	if (!a->dropping) {
+		pom_log(POM_LOG_WARN "Dropping rows of datastore %s because %s", a->d->name, reason);
+		a->dropping = 1;
+	}
+}
+
+/**
+ * @ingroup datastore_core
+ * Only the fields which don't change while the dataset is open are copied.
+ * The private data of the dataset is only used by the backend with the backend lock held.
+ * The values of the packet thread are not shared, the writer thread uses its own rows.
+ * @param dst Dataset used by the writer thread
+ * @param src Dataset used by the packet thread
+ * @param row Row of the writer thread to use as query_data
+ */
+static void datastore_async_dataset_copy(struct dataset *dst, struct dataset *src, struct datavalue *row) {
+
+	memset(dst, 0, sizeof(struct dataset));
+	dst->open = src->open;
+	dst->name = src->name;
+	dst->type = src->type;
+	dst->descr = src->descr;
+	dst->dataset_id = src->dataset_id;
+	dst->query_data = row;
+	dst->priv = src->priv;
+	dst->dstore = src->dstore;
+}
+
+/**
+ * @ingroup datastore_core
+ * The values are not copied so this can be called while the dataset is used.
+ * Like datastore_async_row_cleanup(), the ptypes are allocated with the ptype lock held,
+ * ptype_alloc() takes it by itself.
+ * @param ds Dataset to allocate a row for
+ * @return A row with the same fields as the dataset.
+ */
+static struct datavalue *datastore_async_row_alloc(struct dataset *ds) {
+
+	struct datavalue *dv = ds->query_data;
+
+	int i;
+	for (i = 0; dv[i].name; i++);
+
+	struct datavalue *row = malloc(sizeof(struct datavalue) * (i + 1));
+	memcpy(row, dv, sizeof(struct datavalue) * (i + 1));
+	for (i = 0; dv[i].name; i++)
+		row[i].value = ptype_alloc(ptype_get_name(dv[i].value->type), NULL);
+
+	return row;
+}
+
+/**
+ * @ingroup datastore_core
+ * ptype_cleanup() doesn't take the ptype lock so it's held while freeing the values.
+ * @param row Row to free
+ */
+static void datastore_async_row_cleanup(struct datavalue *row) {
+
+	ptype_lock(1);
+	int i;
+	for (i = 0; row[i].name; i++)
+		ptype_cleanup(row[i].value);
+	ptype_unlock();
+	free(row);
+}
@@ -0,0 +1,90 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __DATASTORE_ASYNC_H__
+#define __DATASTORE_ASYNC_H__
+
+#include "datastore.h"
+
+/// Possible behaviors when the queue of the writer thread is full
+#define DATASTORE_ASYNC_OVERFLOW_BLOCK	0 ///< Wait for the writer thread
+#define DATASTORE_ASYNC_OVERFLOW_DROP	1 ///< Drop the new row
+#define DATASTORE_ASYNC_OVERFLOW_SPILL	2 ///< Save the row in a local file
+
+/// Size of the buffer used to serialize a value in the spill file
+#define DATASTORE_ASYNC_SPILL_VALUE_SIZE 65536
+
+/// Maximum length of a dataset name in the spill file
+#define DATASTORE_ASYNC_SPILL_NAME_SIZE 256
+
+/// A row waiting to be written by the writer thread
+struct datastore_async_entry {
+
+	struct dataset *ds; ///< Dataset the row belongs to
+	struct datavalue *row; ///< Copy of the values, kept allocated for the next row of the same dataset
+
+};
+
+/// Writer thread of a datastore
+struct datastore_async {
+
+	struct datastore *d;
+
+	/**
+	 * Single producer, single consumer ring.
+	 * Only the packet thread increments head and only the writer thread increments tail.
+	 */
+	struct datastore_async_entry *queue;
+	unsigned int size; ///< Number of entries in the ring
+	volatile unsigned int head; ///< Number of rows queued so far
+	volatile unsigned int tail; ///< Number of rows processed so far
+
+	int overflow; ///< What to do when the ring is full
+
+	pthread_t thread;
+	pthread_mutex_t lock; ///< Protect the fields below and the conditions
+	pthread_cond_t work_cond; ///< Signaled when rows are available
+	pthread_cond_t space_cond; ///< Signaled when rows were processed
+	volatile int writer_idle; ///< The writer thread is waiting on work_cond
+	volatile int producer_waiting; ///< Someone is waiting on space_cond
+	int stop; ///< Ask the writer thread to exit once the queue is empty
+	volatile int error; ///< The datastore failed, rows are dropped
+	int dropping; ///< Rows are being dropped, only logged when it starts
+
+	struct datavalue **rows; ///< Rows of the transaction being written
+	struct datastore_async_entry *replay; ///< Rows used to read back the spill file
+
+	int spill_fd; ///< Spill file or -1
+	struct dataset **spill_datasets; ///< Datasets having rows in the spill file, rows refer to them by name
+	unsigned int spill_datasets_count;
+	unsigned int spill_datasets_alloc;
+	off_t spill_read; ///< Offset of the next row to replay
+	off_t spill_write; ///< End of the spill file
+	volatile unsigned int spill_rows; ///< Number of rows in the spill file
+	char *spill_buff; ///< Buffer to serialize the values
+
+};
+
+int datastore_async_start(struct datastore *d);
+int datastore_async_write(struct dataset *ds);
+int datastore_async_release(struct datastore *d, struct dataset *ds);
+int datastore_async_stop(struct datastore *d);
+
+#endif
@@ -0,0 +1,1295 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Each dataset is a directory containing one file per field.
+ * Fixed width values are appended to the column file as is.
+ * Strings and other ptypes are appended to a heap file and the column
+ * file contains their offset in the heap.
+ * Rows are never modified, deleting them sets their flag in the .deleted file.
+ * The .index file contains the minimum and maximum value of each
+ * numeric column for every block of COLUMNAR_BLOCK_ROWS rows.
+ */
+
+#include "datastore_columnar.h"
+
+#include "ptype_bool.h"
+#include "ptype_uint8.h"
+#include "ptype_uint16.h"
+#include "ptype_uint32.h"
+#include "ptype_uint64.h"
+#include "ptype_timestamp.h"
+#include "ptype_ipv4.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+
+static struct ptype *pt_bool, *pt_uint8, *pt_uint16, *pt_uint32, *pt_uint64, *pt_string, *pt_timestamp, *pt_ipv4;
+
+int datastore_register_columnar(struct datastore_reg *r) {
+
+	// Allocate ptypes to keep refcount and get their id
+	pt_bool = ptype_alloc("bool", NULL);
+	pt_uint8 = ptype_alloc("uint8", NULL);
+	pt_uint16 = ptype_alloc("uint16", NULL);
+	pt_uint32 = ptype_alloc("uint32", NULL);
+	pt_uint64 = ptype_alloc("uint64", NULL);
+	pt_string = ptype_alloc("string", NULL);
+	pt_timestamp = ptype_alloc("timestamp", NULL);
+	pt_ipv4 = ptype_alloc("ipv4", NULL);
+
+	if (!pt_bool || !pt_uint8 || !pt_uint16 || !pt_uint32 || !pt_uint64 || !pt_string || !pt_timestamp || !pt_ipv4) {
+		datastore_unregister_columnar(r);
+		return POM_ERR;
+	}
+
+	r->init = datastore_init_columnar;
+	r->open = datastore_open_columnar;
+	r->dataset_alloc = datastore_dataset_alloc_columnar;
+	r->dataset_create = datastore_dataset_create_columnar;
+	r->dataset_read = datastore_dataset_read_columnar;
+	r->dataset_write = datastore_dataset_write_columnar;
+	r->dataset_delete = datastore_dataset_delete_columnar;
+	r->transaction_begin = datastore_transaction_begin_columnar;
+	r->transaction_commit = datastore_transaction_commit_columnar;
+	r->transaction_rollback = datastore_transaction_rollback_columnar;
+	r->dataset_destroy = datastore_dataset_destroy_columnar;
+	r->dataset_cleanup = datastore_dataset_cleanup_columnar;
+	r->cleanup = datastore_cleanup_columnar;
+	r->unregister = datastore_unregister_columnar;
+
+	datastore_register_param(r, "path", "pom_data", "Directory containing the datasets");
+
+	return POM_OK;
+}
+
+
+static int datastore_init_columnar(struct datastore *d) {
+
+	struct datastore_priv_columnar *priv = malloc(sizeof(struct datastore_priv_columnar));
+	memset(priv, 0, sizeof(struct datastore_priv_columnar));
+
+	d->priv = priv;
+
+	priv->path = ptype_alloc("string", NULL);
+
+	if (!priv->path) {
+		datastore_cleanup_columnar(d);
+		return POM_ERR;
+	}
+
+	datastore_register_param_value(d, "path", priv->path);
+
+	return POM_OK;
+}
+
+static int datastore_open_columnar(struct datastore *d) {
+
+	struct datastore_priv_columnar *priv = d->priv;
+
+	char *path = PTYPE_STRING_GETVAL(priv->path);
+
+	if (mkdir(path, 0755) && errno != EEXIST) {
+		char errbuff[256];
+		strerror_r(errno, errbuff, sizeof(errbuff) - 1);
+		pom_log(POM_LOG_ERR "Unable to create directory %s : %s", path, errbuff);
+		return POM_ERR;
+	}
+
+	pom_log(POM_LOG_INFO "Using directory %s to store the datasets", path);
+
+	return POM_OK;
+}
+
+static int datastore_dataset_alloc_columnar(struct dataset *ds) {
+
+	struct datastore_priv_columnar *dpriv = ds->dstore->priv;
+
+	struct dataset_priv_columnar *priv = malloc(sizeof(struct dataset_priv_columnar));
+	memset(priv, 0, sizeof(struct dataset_priv_columnar));
+
+	char *path = PTYPE_STRING_GETVAL(dpriv->path);
+	priv->dir = malloc(strlen(path) + strlen("/") + strlen(ds->name) + 1);
+	strcpy(priv->dir, path);
+	strcat(priv->dir, "/");
+	strcat(priv->dir, ds->name);
+
+	struct datavalue *dv = ds->query_data;
+	for (priv->num_cols = 0; dv[priv->num_cols].name; priv->num_cols++);
+
+	priv->cols = malloc(sizeof(struct columnar_column) * priv->num_cols);
+	memset(priv->cols, 0, sizeof(struct columnar_column) * priv->num_cols);
+
+	int i;
+	for (i = 0; dv[i].name; i++) {
+
+		struct columnar_column *col = &priv->cols[i];
+		col->fd = -1;
+		col->heap_fd = -1;
+		col->numeric = 1;
+
+		if (dv[i].value->type == pt_bool->type) {
+			dv[i].native_type = COLUMNAR_PTYPE_BOOL;
+			col->width = sizeof(uint8_t);
+		} else if (dv[i].value->type == pt_uint8->type) {
+			dv[i].native_type = COLUMNAR_PTYPE_UINT8;
+			col->width = sizeof(uint8_t);
+		} else if (dv[i].value->type == pt_uint16->type) {
+			dv[i].native_type = COLUMNAR_PTYPE_UINT16;
+			col->width = sizeof(uint16_t);
+		} else if (dv[i].value->type == pt_uint32->type) {
+			dv[i].native_type = COLUMNAR_PTYPE_UINT32;
+			col->width = sizeof(uint32_t);
+		} else if (dv[i].value->type == pt_uint64->type) {
+			dv[i].native_type = COLUMNAR_PTYPE_UINT64;
+			col->width = sizeof(uint64_t);
+		} else if (dv[i].value->type == pt_timestamp->type) {
+			dv[i].native_type = COLUMNAR_PTYPE_TIMESTAMP;
+			col->width = sizeof(int64_t);
+		} else if (dv[i].value->type == pt_ipv4->type) {
+			dv[i].native_type = COLUMNAR_PTYPE_IPV4;
+			col->width = sizeof(struct in_addr);
+			col->numeric = 0;
+		} else if (dv[i].value->type == pt_string->type) {
+			dv[i].native_type = COLUMNAR_PTYPE_STRING;
+			col->width = sizeof(uint64_t);
+			col->numeric = 0;
+		} else {
+			dv[i].native_type = COLUMNAR_PTYPE_OTHER;
+			col->width = sizeof(uint64_t);
+			col->numeric = 0;
+		}
+	}
+
+	priv->del_fd = -1;
+	priv->index_fd = -1;
+
+	ds->priv = priv;
+
+	return POM_OK;
+}
+
+static int datastore_dataset_create_columnar(struct dataset *ds) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+
+	if (mkdir(priv->dir, 0755) && errno != EEXIST) {
+		char errbuff[256];
+		strerror_r(errno, errbuff, sizeof(errbuff) - 1);
+		pom_log(POM_LOG_ERR "Failed to create dataset \"%s\" : %s", ds->name, errbuff);
+		ds->state = DATASET_STATE_DATASTORE_ERR;
+		return POM_ERR;
+	}
+
+	// Start from empty files
+	columnar_close_files(ds);
+	if (columnar_open_files(ds, 1) != POM_OK) {
+		pom_log(POM_LOG_ERR "Failed to create dataset \"%s\"", ds->name);
+		return POM_ERR;
+	}
+
+	ds->state = DATASET_STATE_DONE;
+
+	return POM_OK;
+}
+
+static int datastore_dataset_read_columnar(struct dataset *ds) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+	struct datavalue *dv = ds->query_data;
+
+	if (ds->state != DATASET_STATE_MORE) {
+
+		if (!priv->opened && columnar_open_files(ds, 0) != POM_OK)
+			return POM_ERR;
+
+		columnar_unmap(ds);
+		if (priv->read_order) {
+			free(priv->read_order);
+			priv->read_order = NULL;
+		}
+
+		if (columnar_flush(ds) != POM_OK || columnar_map(ds, 0) != POM_OK) {
+			ds->state = DATASET_STATE_DATASTORE_ERR;
+			return POM_ERR;
+		}
+
+		struct datavalue_condition *qc = ds->query_cond;
+		if (qc) {
+			if (priv->cols[qc->field_id].numeric) {
+				priv->cond_num = columnar_ptype_to_num(&dv[qc->field_id], qc->value);
+			} else {
+				if (priv->cond_value)
+					ptype_cleanup(priv->cond_value);
+				priv->cond_value = ptype_alloc_from(dv[qc->field_id].value);
+			}
+		}
+
+		priv->read_pos = 0;
+
+		struct datavalue_read_order *qro = ds->query_read_order;
+		if (qro) {
+			// Gather the matching rows and sort them
+			struct columnar_column *col = &priv->cols[qro->field_id];
+			uint64_t alloc = 0, row;
+			priv->read_order_count = 0;
+			for (row = 0; row < priv->del_map_len; row++) {
+				if (!(row % COLUMNAR_BLOCK_ROWS) && !columnar_block_may_match(ds, row)) {
+					row += COLUMNAR_BLOCK_ROWS - 1;
+					continue;
+				}
+				if (priv->del_map[row] || !columnar_row_matches(ds, row))
+					continue;
+
+				if (priv->read_order_count >= alloc) {
+					alloc = (alloc ? alloc * 2 : 64);
+					priv->read_order = realloc(priv->read_order, sizeof(struct columnar_sort_entry) * alloc);
+				}
+				struct columnar_sort_entry *e = &priv->read_order[priv->read_order_count];
+				memset(e, 0, sizeof(struct columnar_sort_entry));
+				e->row = row;
+				if (col->numeric) {
+					e->num = columnar_get_num(col, row);
+				} else if (dv[qro->field_id].native_type == COLUMNAR_PTYPE_IPV4) {
+					e->num = ntohl(columnar_get_num(col, row));
+				} else {
+					uint64_t offset = columnar_get_num(col, row);
+					e->str = (offset < col->heap_map_len ? col->heap_map + offset : "");
+				}
+				priv->read_order_count++;
+			}
+
+			if (priv->read_order_count) {
+				if (col->numeric || dv[qro->field_id].native_type == COLUMNAR_PTYPE_IPV4)
+					qsort(priv->read_order, priv->read_order_count, sizeof(struct columnar_sort_entry), columnar_compare_num);
+				else
+					qsort(priv->read_order, priv->read_order_count, sizeof(struct columnar_sort_entry), columnar_compare_str);
+			} else if (!priv->read_order) {
+				// Make sure we know the result is sorted
+				priv->read_order = malloc(sizeof(struct columnar_sort_entry));
+			}
+		}
+	}
+
+	if (priv->read_order) {
+		struct datavalue_read_order *qro = ds->query_read_order;
+		while (priv->read_pos < priv->read_order_count) {
+			uint64_t idx = priv->read_pos++;
+			if (qro && qro->direction == DATASET_READ_ORDER_DESC)
+				idx = priv->read_order_count - idx - 1;
+			if (columnar_load_row(ds, priv->read_order[idx].row) != POM_OK)
+				goto err;
+			ds->state = DATASET_STATE_MORE;
+			return POM_OK;
+		}
+	} else {
+		while (priv->read_pos < priv->del_map_len) {
+			uint64_t row = priv->read_pos;
+			if (!(row % COLUMNAR_BLOCK_ROWS) && !columnar_block_may_match(ds, row)) {
+				priv->read_pos += COLUMNAR_BLOCK_ROWS;
+				continue;
+			}
+			priv->read_pos++;
+			if (priv->del_map[row] || !columnar_row_matches(ds, row))
+				continue;
+			if (columnar_load_row(ds, row) != POM_OK)
+				goto err;
+			ds->state = DATASET_STATE_MORE;
+			return POM_OK;
+		}
+	}
+
+	// No more rows
+	columnar_unmap(ds);
+	if (priv->read_order) {
+		free(priv->read_order);
+		priv->read_order = NULL;
+	}
+	ds->state = DATASET_STATE_DONE;
+
+	return POM_OK;
+
+err:
+	columnar_unmap(ds);
+	if (priv->read_order) {
+		free(priv->read_order);
+		priv->read_order = NULL;
+	}
+	ds->state = DATASET_STATE_ERR;
+	return POM_ERR;
+}
+
+static int datastore_dataset_write_columnar(struct dataset *ds) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+
+	if (!priv->opened && columnar_open_files(ds, 0) != POM_OK)
+		return POM_ERR;
+
+	struct datavalue *dv = ds->query_data;
+	int i, flush = 0;
+	for (i = 0; dv[i].name; i++) {
+
+		struct columnar_column *col = &priv->cols[i];
+		char *dst = col->buff + col->buff_len;
+
+		if (col->numeric) {
+			uint64_t num = columnar_ptype_to_num(&dv[i], dv[i].value);
+			switch (col->width) {
+				case sizeof(uint8_t):
+					*(uint8_t *)dst = num;
+					break;
+				case sizeof(uint16_t): {
+					uint16_t val = num;
+					memcpy(dst, &val, sizeof(uint16_t));
+					break;
+				}
+				case sizeof(uint32_t): {
+					uint32_t val = num;
+					memcpy(dst, &val, sizeof(uint32_t));
+					break;
+				}
+				default:
+					memcpy(dst, &num, sizeof(uint64_t));
+					break;
+			}
+			if (num < col->block.min)
+				col->block.min = num;
+			if (num > col->block.max)
+				col->block.max = num;
+
+		} else if (dv[i].native_type == COLUMNAR_PTYPE_IPV4) {
+			struct ptype_ipv4_val *v = dv[i].value->value;
+			memcpy(dst, &v->addr, sizeof(struct in_addr));
+
+		} else {
+			char *value = NULL, *tmp = NULL;
+			if (dv[i].native_type == COLUMNAR_PTYPE_STRING) {
+				value = PTYPE_STRING_GETVAL(dv[i].value);
+			} else {
+				int size, new_size = COLUMNAR_TEMP_BUFFER_SIZE;
+				do {
+					size = new_size;
+					char *new_tmp = realloc(tmp, size + 1);
+					if (!new_tmp) {
+						free(tmp);
+						columnar_cancel_row(ds, i);
+						goto err;
+					}
+					tmp = new_tmp;
+					new_size = ptype_print_val(dv[i].value, tmp, size);
+					new_size = (new_size < 1) ? new_size * 2 : new_size + 1;
+				} while (new_size > size);
+				value = tmp;
+			}
+
+			size_t len = strlen(value) + 1;
+			if (col->heap_buff_len + len > col->heap_buff_size) {
+				size_t heap_buff_size = col->heap_buff_len + len;
+				if (heap_buff_size < COLUMNAR_BUFFER_SIZE)
+					heap_buff_size = COLUMNAR_BUFFER_SIZE;
+				char *heap_buff = realloc(col->heap_buff, heap_buff_size);
+				if (!heap_buff) {
+					if (tmp)
+						free(tmp);
+					columnar_cancel_row(ds, i);
+					goto err;
+				}
+				col->heap_buff = heap_buff;
+				col->heap_buff_size = heap_buff_size;
+			}
+			memcpy(col->heap_buff + col->heap_buff_len, value, len);
+			col->heap_buff_len += len;
+
+			memcpy(dst, &col->heap_size, sizeof(uint64_t));
+			col->heap_size += len;
+
+			if (tmp)
+				free(tmp);
+
+			if (col->heap_buff_len >= COLUMNAR_BUFFER_SIZE)
+				flush = 1;
+		}
+
+		col->buff_len += col->width;
+		if (col->buff_len + col->width > COLUMNAR_BUFFER_SIZE)
+			flush = 1;
+	}
+
+	priv->del_buff[priv->del_buff_len++] = 0;
+	priv->rows++;
+	ds->data_id = priv->rows;
+
+	if (!(priv->rows % COLUMNAR_BLOCK_ROWS) && columnar_write_index(ds) != POM_OK)
+		goto err;
+
+	if (flush && columnar_flush(ds) != POM_OK)
+		goto err;
+
+	ds->state = DATASET_STATE_DONE;
+
+	return POM_OK;
+
+err:
+	pom_log(POM_LOG_ERR "Unable to write to dataset %s", ds->name);
+	ds->state = DATASET_STATE_DATASTORE_ERR;
+	return POM_ERR;
+}
+
+/**
+ * Remove the values of the row being written from the buffers of the first columns.
+ */
+static void columnar_cancel_row(struct dataset *ds, unsigned int cols) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+
+	unsigned int i;
+	for (i = 0; i < cols; i++) {
+		struct columnar_column *col = &priv->cols[i];
+		col->buff_len -= col->width;
+		if (!col->numeric && ds->query_data[i].native_type != COLUMNAR_PTYPE_IPV4) {
+			// The column holds the offset of the value in the heap
+			uint64_t offset;
+			memcpy(&offset, col->buff + col->buff_len, sizeof(uint64_t));
+			col->heap_buff_len -= col->heap_size - offset;
+			col->heap_size = offset;
+		}
+	}
+}
+
+static int datastore_dataset_delete_columnar(struct dataset *ds) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+
+	if (!priv->opened && columnar_open_files(ds, 0) != POM_OK)
+		return POM_ERR;
+
+	struct datavalue_condition *qc = ds->query_cond;
+
+	if (!qc) {
+		// Remove everything
+		unsigned int i;
+		for (i = 0; i < priv->num_cols; i++)
+			priv->cols[i].txn_heap_size = 0;
+		if (columnar_truncate(ds, 0) != POM_OK)
+			goto err;
+		ds->state = DATASET_STATE_DONE;
+		return POM_OK;
+	}
+
+	columnar_unmap(ds);
+	if (columnar_flush(ds) != POM_OK || columnar_map(ds, 1) != POM_OK)
+		goto err;
+
+	struct datavalue *dv = ds->query_data;
+	if (priv->cols[qc->field_id].numeric) {
+		priv->cond_num = columnar_ptype_to_num(&dv[qc->field_id], qc->value);
+	} else {
+		if (priv->cond_value)
+			ptype_cleanup(priv->cond_value);
+		priv->cond_value = ptype_alloc_from(dv[qc->field_id].value);
+	}
+
+	uint64_t row;
+	for (row = 0; row < priv->del_map_len; row++) {
+		if (!(row % COLUMNAR_BLOCK_ROWS) && !columnar_block_may_match(ds, row)) {
+			row += COLUMNAR_BLOCK_ROWS - 1;
+			continue;
+		}
+		if (!priv->del_map[row] && columnar_row_matches(ds, row))
+			priv->del_map[row] = 1;
+	}
+
+	columnar_unmap(ds);
+
+	ds->state = DATASET_STATE_DONE;
+
+	return POM_OK;
+
+err:
+	pom_log(POM_LOG_ERR "Failed to delete entries from dataset \"%s\"", ds->name);
+	ds->state = DATASET_STATE_DATASTORE_ERR;
+	return POM_ERR;
+}
+
+static int datastore_transaction_begin_columnar(struct dataset *ds) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+
+	if (!priv->opened && columnar_open_files(ds, 0) != POM_OK)
+		return POM_ERR;
+
+	// Rows written before the transaction must not be discarded on rollback
+	if (columnar_flush(ds) != POM_OK) {
+		ds->state = DATASET_STATE_DATASTORE_ERR;
+		return POM_ERR;
+	}
+
+	priv->txn_rows = priv->rows;
+	unsigned int i;
+	for (i = 0; i < priv->num_cols; i++)
+		priv->cols[i].txn_heap_size = priv->cols[i].heap_size;
+
+	ds->state = DATASET_STATE_DONE;
+
+	return POM_OK;
+}
+
+static int datastore_transaction_commit_columnar(struct dataset *ds) {
+
+	if (columnar_flush(ds) != POM_OK) {
+		pom_log(POM_LOG_ERR "Unable to commit the transaction on dataset %s", ds->name);
+		ds->state = DATASET_STATE_DATASTORE_ERR;
+		return POM_ERR;
+	}
+
+	ds->state = DATASET_STATE_DONE;
+
+	return POM_OK;
+}
+
+static int datastore_transaction_rollback_columnar(struct dataset *ds) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+
+	if (columnar_truncate(ds, priv->txn_rows) != POM_OK) {
+		pom_log(POM_LOG_ERR "Unable to rollback the transaction on dataset %s", ds->name);
+		ds->state = DATASET_STATE_DATASTORE_ERR;
+		return POM_ERR;
+	}
+
+	return POM_OK;
+}
+
+static int datastore_dataset_destroy_columnar(struct dataset *ds) {
+
+	struct datastore_priv_columnar *dpriv = ds->dstore->priv;
+
+	char *path = PTYPE_STRING_GETVAL(dpriv->path);
+	char *dir = malloc(strlen(path) + strlen("/") + strlen(ds->name) + 1);
+	strcpy(dir, path);
+	strcat(dir, "/");
+	strcat(dir, ds->name);
+
+	char *filename;
+	struct datavalue *dv = ds->query_data;
+	int i;
+	for (i = 0; dv[i].name; i++) {
+		filename = columnar_get_filename(dir, dv[i].name, ".col");
+		unlink(filename);
+		free(filename);
+		filename = columnar_get_filename(dir, dv[i].name, ".heap");
+		unlink(filename);
+		free(filename);
+	}
+
+	filename = columnar_get_filename(dir, COLUMNAR_DELETED_FILE, "");
+	unlink(filename);
+	free(filename);
+	filename = columnar_get_filename(dir, COLUMNAR_INDEX_FILE, "");
+	unlink(filename);
+	free(filename);
+
+	int res = rmdir(dir);
+	free(dir);
+
+	if (res) {
+		char errbuff[256];
+		strerror_r(errno, errbuff, sizeof(errbuff) - 1);
+		pom_log(POM_LOG_ERR "Failed to destroy dataset \"%s\" : %s", ds->name, errbuff);
+		ds->state = DATASET_STATE_ERR;
+		return POM_ERR;
+	}
+
+	ds->state = DATASET_STATE_DONE;
+
+	return POM_OK;
+}
+
+static int datastore_dataset_cleanup_columnar(struct dataset *ds) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+
+	if (priv->opened && columnar_flush(ds) != POM_OK)
+		pom_log(POM_LOG_ERR "Some rows of dataset %s could not be written", ds->name);
+
+	columnar_close_files(ds);
+
+	if (priv->cond_value)
+		ptype_cleanup(priv->cond_value);
+	if (priv->read_order)
+		free(priv->read_order);
+
+	free(priv->cols);
+	free(priv->dir);
+	free(priv);
+
+	return POM_OK;
+}
+
+static int datastore_cleanup_columnar(struct datastore *d) {
+
+	struct datastore_priv_columnar *priv = d->priv;
+
+	if (priv) {
+		ptype_cleanup(priv->path);
+		free(d->priv);
+		d->priv = NULL;
+	}
+
+	return POM_OK;
+}
+
+static int datastore_unregister_columnar(struct datastore_reg *r) {
+
+	ptype_cleanup(pt_bool);
+	ptype_cleanup(pt_uint8);
+	ptype_cleanup(pt_uint16);
+	ptype_cleanup(pt_uint32);
+	ptype_cleanup(pt_uint64);
+	ptype_cleanup(pt_string);
+	ptype_cleanup(pt_timestamp);
+	ptype_cleanup(pt_ipv4);
+
+	return POM_OK;
+}
+
+static char *columnar_get_filename(char *dir, char *field, char *ext) {
+
+	char *filename = malloc(strlen(dir) + strlen("/") + strlen(field) + strlen(ext) + 1);
+	strcpy(filename, dir);
+	strcat(filename, "/");
+	strcat(filename, field);
+	strcat(filename, ext);
+
+	return filename;
+}
+
+/**
+ * Open the files of the dataset, check that they are consistent
+ * and rebuild the missing part of the index.
+ */
+static int columnar_open_files(struct dataset *ds, int create) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+	struct datavalue *dv = ds->query_data;
+
+	int flags = O_RDWR | O_APPEND;
+	if (create)
+		flags |= O_CREAT | O_TRUNC;
+
+	char *filename = NULL;
+	unsigned int i;
+	struct stat st;
+
+	filename = columnar_get_filename(priv->dir, COLUMNAR_DELETED_FILE, "");
+	priv->del_fd = open(filename, flags, 0644);
+	if (priv->del_fd == -1)
+		goto err;
+	free(filename);
+
+	// Index entries are written at a given offset, no O_APPEND here
+	filename = columnar_get_filename(priv->dir, COLUMNAR_INDEX_FILE, "");
+	priv->index_fd = open(filename, flags & ~O_APPEND, 0644);
+	if (priv->index_fd == -1)
+		goto err;
+	free(filename);
+
+	for (i = 0; i < priv->num_cols; i++) {
+		struct columnar_column *col = &priv->cols[i];
+		filename = columnar_get_filename(priv->dir, dv[i].name, ".col");
+		col->fd = open(filename, flags, 0644);
+		if (col->fd == -1)
+			goto err;
+		free(filename);
+
+		if (dv[i].native_type == COLUMNAR_PTYPE_STRING || dv[i].native_type == COLUMNAR_PTYPE_OTHER) {
+			filename = columnar_get_filename(priv->dir, dv[i].name, ".heap");
+			col->heap_fd = open(filename, flags, 0644);
+			if (col->heap_fd == -1)
+				goto err;
+			free(filename);
+		}
+	}
+	filename = NULL;
+
+	// A row is complete once its deleted flag is written, it's the last thing appended
+	if (fstat(priv->del_fd, &st))
+		goto err;
+	priv->rows = st.st_size;
+
+	for (i = 0; i < priv->num_cols; i++) {
+		struct columnar_column *col = &priv->cols[i];
+		if (fstat(col->fd, &st))
+			goto err;
+		if (st.st_size / col->width < priv->rows)
+			priv->rows = st.st_size / col->width;
+		if (col->heap_fd != -1) {
+			if (fstat(col->heap_fd, &st))
+				goto err;
+			col->heap_size = st.st_size;
+		}
+		col->buff = malloc(COLUMNAR_BUFFER_SIZE);
+		if (!col->buff)
+			goto err;
+	}
+	priv->del_buff = malloc(COLUMNAR_BUFFER_SIZE);
+	if (!priv->del_buff)
+		goto err;
+
+	if (fstat(priv->index_fd, &st))
+		goto err;
+	priv->indexed_blocks = st.st_size / (sizeof(struct columnar_minmax) * priv->num_cols);
+
+	priv->opened = 1;
+
+	// Drop partially written rows and index entries
+	for (i = 0; i < priv->num_cols; i++)
+		priv->cols[i].txn_heap_size = priv->cols[i].heap_size;
+	if (columnar_truncate(ds, priv->rows) != POM_OK)
+		goto err;
+
+	return POM_OK;
+
+err:
+	if (filename) {
+		char errbuff[256];
+		strerror_r(errno, errbuff, sizeof(errbuff) - 1);
+		pom_log(POM_LOG_DEBUG "Unable to open %s : %s", filename, errbuff);
+		ds->state = (errno == ENOENT ? DATASET_STATE_ERR : DATASET_STATE_DATASTORE_ERR);
+		free(filename);
+	} else {
+		pom_log(POM_LOG_ERR "Unable to open the files of dataset %s", ds->name);
+		ds->state = DATASET_STATE_DATASTORE_ERR;
+	}
+	priv->opened = 1;
+	columnar_close_files(ds);
+	return POM_ERR;
+}
+
+static void columnar_close_files(struct dataset *ds) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+
+	columnar_unmap(ds);
+
+	unsigned int i;
+	for (i = 0; i < priv->num_cols; i++) {
+		struct columnar_column *col = &priv->cols[i];
+		if (col->fd != -1)
+			close(col->fd);
+		col->fd = -1;
+		if (col->heap_fd != -1)
+			close(col->heap_fd);
+		col->heap_fd = -1;
+		if (col->buff)
+			free(col->buff);
+		col->buff = NULL;
+		col->buff_len = 0;
+		if (col->heap_buff)
+			free(col->heap_buff);
+		col->heap_buff = NULL;
+		col->heap_buff_len = 0;
+		col->heap_buff_size = 0;
+	}
+
+	if (priv->del_fd != -1)
+		close(priv->del_fd);
+	priv->del_fd = -1;
+	if (priv->del_buff)
+		free(priv->del_buff);
+	priv->del_buff = NULL;
+	priv->del_buff_len = 0;
+
+	if (priv->index_fd != -1)
+		close(priv->index_fd);
+	priv->index_fd = -1;
+
+	priv->opened = 0;
+}
+
+static int columnar_append_file(int fd, char *buff, size_t len) {
+
+	while (len > 0) {
+		ssize_t res = write(fd, buff, len);
+		if (res == -1) {
+			if (errno == EINTR)
+				continue;
+			char errbuff[256];
+			strerror_r(errno, errbuff, sizeof(errbuff) - 1);
+			pom_log(POM_LOG_ERR "Error while writing to a column file : %s", errbuff);
+			return POM_ERR;
+		}
+		buff += res;
+		len -= res;
+	}
+
+	return POM_OK;
+}
+
+/**
+ * Append the buffered rows to the files.
+ */
+static int columnar_flush(struct dataset *ds) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+
+	if (!priv->del_buff_len)
+		return POM_OK;
+
+	unsigned int i;
+	for (i = 0; i < priv->num_cols; i++) {
+		struct columnar_column *col = &priv->cols[i];
+		if (col->heap_buff_len) {
+			if (columnar_append_file(col->heap_fd, col->heap_buff, col->heap_buff_len) != POM_OK)
+				return POM_ERR;
+			col->heap_buff_len = 0;
+		}
+		if (columnar_append_file(col->fd, col->buff, col->buff_len) != POM_OK)
+			return POM_ERR;
+		col->buff_len = 0;
+	}
+
+	if (columnar_append_file(priv->del_fd, priv->del_buff, priv->del_buff_len) != POM_OK)
+		return POM_ERR;
+	priv->del_buff_len = 0;
+
+	return POM_OK;
+}
+
+/**
+ * Discard the buffered data and cut the files to the given number of rows.
+ * The heaps are cut to the txn_heap_size of their column.
+ */
+static int columnar_truncate(struct dataset *ds, uint64_t rows) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+
+	columnar_unmap(ds);
+
+	unsigned int i;
+	for (i = 0; i < priv->num_cols; i++) {
+		struct columnar_column *col = &priv->cols[i];
+		col->buff_len = 0;
+		if (ftruncate(col->fd, rows * col->width))
+			return POM_ERR;
+		if (col->heap_fd != -1) {
+			col->heap_buff_len = 0;
+			col->heap_size = col->txn_heap_size;
+			if (ftruncate(col->heap_fd, col->heap_size))
+				return POM_ERR;
+		}
+	}
+
+	priv->del_buff_len = 0;
+	if (ftruncate(priv->del_fd, rows))
+		return POM_ERR;
+
+	priv->rows = rows;
+
+	// Rebuild the index entries missing after a crash
+	uint64_t blocks = rows / COLUMNAR_BLOCK_ROWS;
+	if (priv->indexed_blocks > blocks)
+		priv->indexed_blocks = blocks;
+	if (ftruncate(priv->index_fd, priv->indexed_blocks * sizeof(struct columnar_minmax) * priv->num_cols))
+		return POM_ERR;
+
+	if (columnar_map(ds, 0) != POM_OK)
+		return POM_ERR;
+
+	struct columnar_minmax *minmax = malloc(sizeof(struct columnar_minmax) * priv->num_cols);
+	int res = POM_OK;
+
+	while (priv->indexed_blocks < blocks) {
+		uint64_t first = priv->indexed_blocks * COLUMNAR_BLOCK_ROWS;
+		columnar_scan_block(ds, first, first + COLUMNAR_BLOCK_ROWS, minmax);
+		for (i = 0; i < priv->num_cols; i++)
+			memcpy(&priv->cols[i].block, &minmax[i], sizeof(struct columnar_minmax));
+		if (columnar_write_index(ds) != POM_OK) {
+			res = POM_ERR;
+			break;
+		}
+	}
+
+	// Summary of the incomplete block
+	columnar_scan_block(ds, blocks * COLUMNAR_BLOCK_ROWS, rows, minmax);
+	for (i = 0; i < priv->num_cols; i++)
+		memcpy(&priv->cols[i].block, &minmax[i], sizeof(struct columnar_minmax));
+
+	free(minmax);
+	columnar_unmap(ds);
+
+	return res;
+}
+
+static int columnar_map(struct dataset *ds, int writable) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+
+	if (!priv->rows)
+		return POM_OK;
+
+	unsigned int i;
+	for (i = 0; i < priv->num_cols; i++) {
+		struct columnar_column *col = &priv->cols[i];
+		col->map_len = priv->rows * col->width;
+		col->map = mmap(NULL, col->map_len, PROT_READ, MAP_SHARED, col->fd, 0);
+		if (col->map == MAP_FAILED)
+			goto err;
+		if (col->heap_fd != -1 && col->heap_size) {
+			col->heap_map_len = col->heap_size;
+			col->heap_map = mmap(NULL, col->heap_map_len, PROT_READ, MAP_SHARED, col->heap_fd, 0);
+			if (col->heap_map == MAP_FAILED)
+				goto err;
+		}
+	}
+
+	priv->del_map_len = priv->rows;
+	priv->del_map = mmap(NULL, priv->del_map_len, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, priv->del_fd, 0);
+	if (priv->del_map == MAP_FAILED)
+		goto err;
+
+	if (priv->indexed_blocks) {
+		priv->index_map_len = priv->indexed_blocks * sizeof(struct columnar_minmax) * priv->num_cols;
+		priv->index_map = mmap(NULL, priv->index_map_len, PROT_READ, MAP_SHARED, priv->index_fd, 0);
+		if (priv->index_map == MAP_FAILED)
+			goto err;
+	}
+
+	return POM_OK;
+
+err:
+	pom_log(POM_LOG_ERR "Unable to map the files of dataset %s", ds->name);
+	columnar_unmap(ds);
+	return POM_ERR;
+}
+
+static void columnar_unmap(struct dataset *ds) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+
+	unsigned int i;
+	for (i = 0; i < priv->num_cols; i++) {
+		struct columnar_column *col = &priv->cols[i];
+		if (col->map && col->map != MAP_FAILED)
+			munmap(col->map, col->map_len);
+		col->map = NULL;
+		col->map_len = 0;
+		if (col->heap_map && col->heap_map != MAP_FAILED)
+			munmap(col->heap_map, col->heap_map_len);
+		col->heap_map = NULL;
+		col->heap_map_len = 0;
+	}
+
+	if (priv->del_map && priv->del_map != MAP_FAILED)
+		munmap(priv->del_map, priv->del_map_len);
+	priv->del_map = NULL;
+	priv->del_map_len = 0;
+
+	if (priv->index_map && priv->index_map != MAP_FAILED)
+		munmap(priv->index_map, priv->index_map_len);
+	priv->index_map = NULL;
+	priv->index_map_len = 0;
+}
+
+/**
+ * Compute the min and max of each column for rows first to last - 1.
+ * The files must be mapped.
+ */
+static int columnar_scan_block(struct dataset *ds, uint64_t first, uint64_t last, struct columnar_minmax *minmax) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+
+	unsigned int i;
+	for (i = 0; i < priv->num_cols; i++) {
+		struct columnar_column *col = &priv->cols[i];
+		if (!col->numeric) {
+			// Never skip blocks based on these
+			minmax[i].min = 0;
+			minmax[i].max = UINT64_MAX;
+			continue;
+		}
+		minmax[i].min = UINT64_MAX;
+		minmax[i].max = 0;
+		uint64_t row;
+		for (row = first; row < last; row++) {
+			uint64_t num = columnar_get_num(col, row);
+			if (num < minmax[i].min)
+				minmax[i].min = num;
+			if (num > minmax[i].max)
+				minmax[i].max = num;
+		}
+	}
+
+	return POM_OK;
+}
+
+/**
+ * Save the summary of the block which was just completed.
+ */
+static int columnar_write_index(struct dataset *ds) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+
+	size_t len = sizeof(struct columnar_minmax) * priv->num_cols;
+	struct columnar_minmax *entry = malloc(len);
+
+	unsigned int i;
+	for (i = 0; i < priv->num_cols; i++)
+		memcpy(&entry[i], &priv->cols[i].block, sizeof(struct columnar_minmax));
+
+	ssize_t res = pwrite(priv->index_fd, entry, len, priv->indexed_blocks * len);
+	free(entry);
+
+	if (res != len) {
+		pom_log(POM_LOG_ERR "Unable to write the index of dataset %s", ds->name);
+		return POM_ERR;
+	}
+
+	priv->indexed_blocks++;
+	columnar_reset_block(ds);
+
+	return POM_OK;
+}
+
+static void columnar_reset_block(struct dataset *ds) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+
+	unsigned int i;
+	for (i = 0; i < priv->num_cols; i++) {
+		if (priv->cols[i].numeric) {
+			priv->cols[i].block.min = UINT64_MAX;
+			priv->cols[i].block.max = 0;
+		} else {
+			priv->cols[i].block.min = 0;
+			priv->cols[i].block.max = UINT64_MAX;
+		}
+	}
+}
+
+static uint64_t columnar_get_num(struct columnar_column *col, uint64_t row) {
+
+	unsigned char *val = col->map + (row * col->width);
+
+	switch (col->width) {
+		case sizeof(uint8_t):
+			return *val;
+		case sizeof(uint16_t): {
+			uint16_t num;
+			memcpy(&num, val, sizeof(uint16_t));
+			return num;
+		}
+		case sizeof(uint32_t): {
+			uint32_t num;
+			memcpy(&num, val, sizeof(uint32_t));
+			return num;
+		}
+	}
+
+	uint64_t num;
+	memcpy(&num, val, sizeof(uint64_t));
+	return num;
+}
+
+static uint64_t columnar_ptype_to_num(struct datavalue *dv, struct ptype *value) {
+
+	switch (dv->native_type) {
+		case COLUMNAR_PTYPE_BOOL:
+			return PTYPE_BOOL_GETVAL(value) ? 1 : 0;
+		case COLUMNAR_PTYPE_UINT8:
+			return PTYPE_UINT8_GETVAL(value);
+		case COLUMNAR_PTYPE_UINT16:
+			return PTYPE_UINT16_GETVAL(value);
+		case COLUMNAR_PTYPE_UINT32:
+			return PTYPE_UINT32_GETVAL(value);
+		case COLUMNAR_PTYPE_UINT64:
+			return PTYPE_UINT64_GETVAL(value);
+		case COLUMNAR_PTYPE_TIMESTAMP:
+			return (int64_t) PTYPE_TIMESTAMP_GETVAL(value);
+	}
+
+	return 0;
+}
+
+/**
+ * Use the block index to know if the block of the row can contain rows matching the condition.
+ */
+static int columnar_block_may_match(struct dataset *ds, uint64_t row) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+	struct datavalue_condition *qc = ds->query_cond;
+
+	if (!qc || !priv->cols[qc->field_id].numeric)
+		return 1;
+
+	uint64_t block = row / COLUMNAR_BLOCK_ROWS;
+	uint64_t mapped_blocks = priv->index_map_len / (sizeof(struct columnar_minmax) * priv->num_cols);
+
+	struct columnar_minmax *minmax = NULL;
+	if (block < mapped_blocks)
+		minmax = &priv->index_map[block * priv->num_cols + qc->field_id];
+	else if (block == priv->rows / COLUMNAR_BLOCK_ROWS)
+		minmax = &priv->cols[qc->field_id].block;
+	else
+		return 1;
+
+	uint64_t val = priv->cond_num;
+	switch (qc->op) {
+		case PTYPE_OP_EQ:
+			return val >= minmax->min && val <= minmax->max;
+		case PTYPE_OP_NEQ:
+			return !(minmax->min == val && minmax->max == val);
+		case PTYPE_OP_GT:
+			return minmax->max > val;
+		case PTYPE_OP_GE:
+			return minmax->max >= val;
+		case PTYPE_OP_LT:
+			return minmax->min < val;
+		case PTYPE_OP_LE:
+			return minmax->min <= val;
+	}
+
+	return 1;
+}
+
+static int columnar_row_matches(struct dataset *ds, uint64_t row) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+	struct datavalue_condition *qc = ds->query_cond;
+
+	if (!qc)
+		return 1;
+
+	struct columnar_column *col = &priv->cols[qc->field_id];
+	if (!col->numeric) {
+		if (columnar_load_value(ds, qc->field_id, row, priv->cond_value) != POM_OK)
+			return 0;
+		return ptype_compare_val(qc->op, priv->cond_value, qc->value);
+	}
+
+	uint64_t num = columnar_get_num(col, row);
+	uint64_t val = priv->cond_num;
+
+	switch (qc->op) {
+		case PTYPE_OP_EQ:
+			return num == val;
+		case PTYPE_OP_NEQ:
+			return num != val;
+		case PTYPE_OP_GT:
+			return num > val;
+		case PTYPE_OP_GE:
+			return num >= val;
+		case PTYPE_OP_LT:
+			return num < val;
+		case PTYPE_OP_LE:
+			return num <= val;
+	}
+
+	return 0;
+}
+
+static int columnar_load_value(struct dataset *ds, unsigned int field, uint64_t row, struct ptype *value) {
+
+	struct dataset_priv_columnar *priv = ds->priv;
+	struct columnar_column *col = &priv->cols[field];
+
+	switch (ds->query_data[field].native_type) {
+		case COLUMNAR_PTYPE_BOOL:
+			PTYPE_BOOL_SETVAL(value, columnar_get_num(col, row));
+			break;
+		case COLUMNAR_PTYPE_UINT8:
+			PTYPE_UINT8_SETVAL(value, columnar_get_num(col, row));
+			break;
+		case COLUMNAR_PTYPE_UINT16:
+			PTYPE_UINT16_SETVAL(value, columnar_get_num(col, row));
+			break;
+		case COLUMNAR_PTYPE_UINT32:
+			PTYPE_UINT32_SETVAL(value, columnar_get_num(col, row));
+			break;
+		case COLUMNAR_PTYPE_UINT64:
+			PTYPE_UINT64_SETVAL(value, columnar_get_num(col, row));
+			break;
+		case COLUMNAR_PTYPE_TIMESTAMP:
+			PTYPE_TIMESTAMP_SETVAL(value, (int64_t) columnar_get_num(col, row));
+			break;
+		case COLUMNAR_PTYPE_IPV4: {
+			struct in_addr addr;
+			memcpy(&addr, col->map + (row * col->width), sizeof(struct in_addr));
+			PTYPE_IPV4_SETADDR(value, addr);
+			break;
+		}
+		default: {
+			uint64_t offset = columnar_get_num(col, row);
+			if (offset >= col->heap_map_len) {
+				pom_log(POM_LOG_ERR "Invalid offset for row %llu in field %s of dataset %s", (unsigned long long) row, ds->query_data[field].name, ds->name);
+				return POM_ERR;
+			}
+			char *heap_val = col->heap_map + offset;
+			if (ds->query_data[field].native_type == COLUMNAR_PTYPE_STRING) {
+				PTYPE_STRING_SETVAL(value, heap_val);
+			} else if (ptype_parse_val(value, heap_val) != POM_OK) {
+				return POM_ERR;
+			}
+			break;
+		}
+	}
+
+	return POM_OK;
+}
+
+static int columnar_load_row(struct dataset *ds, uint64_t row) {
+
+	struct datavalue *dv = ds->query_data;
+
+	ds->data_id = row + 1;
+
+	int i;
+	for (i = 0; dv[i].name; i++) {
+		if (columnar_load_value(ds, i, row, dv[i].value) != POM_OK)
+			return POM_ERR;
+	}
+
+	return POM_OK;
+}
+
+static int columnar_compare_num(const void *a, const void *b) {
+
+	const struct columnar_sort_entry *ea = a, *eb = b;
+
+	if (ea->num != eb->num)
+		return (ea->num < eb->num ? -1 : 1);
+
+	return (ea->row < eb->row ? -1 : 1);
+}
+
+static int columnar_compare_str(const void *a, const void *b) {
+
+	const struct columnar_sort_entry *ea = a, *eb = b;
+
+	int res = strcmp(ea->str, eb->str);
+	if (res)
+		return res;
+
+	return (ea->row < eb->row ? -1 : 1);
+}
@@ -0,0 +1,168 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __DATASTORE_COLUMNAR_H__
+#define __DATASTORE_COLUMNAR_H__
+
+
+#include "modules_common.h"
+#include "datastore.h"
+
+#include "ptype_string.h"
+
+/// Number of rows summarized by each entry of the block index
+#define COLUMNAR_BLOCK_ROWS	4096
+
+/// Size of the buffer of each column before it's appended to the file
+#define COLUMNAR_BUFFER_SIZE	65536
+
+/// Size of the buffer used to print the values of unknown ptypes
+#define COLUMNAR_TEMP_BUFFER_SIZE	256
+
+/// File holding the deleted flag of each row
+#define COLUMNAR_DELETED_FILE	".deleted"
+/// File holding the block index
+#define COLUMNAR_INDEX_FILE	".index"
+
+#define COLUMNAR_PTYPE_OTHER	0
+#define COLUMNAR_PTYPE_BOOL	1
+#define COLUMNAR_PTYPE_UINT8	2
+#define COLUMNAR_PTYPE_UINT16	3
+#define COLUMNAR_PTYPE_UINT32	4
+#define COLUMNAR_PTYPE_UINT64	5
+#define COLUMNAR_PTYPE_STRING	6
+#define COLUMNAR_PTYPE_TIMESTAMP	7
+#define COLUMNAR_PTYPE_IPV4	8
+
+/// Minimum and maximum values of a column in a block
+struct columnar_minmax {
+	uint64_t min;
+	uint64_t max;
+};
+
+/// A column of a dataset
+struct columnar_column {
+
+	unsigned int width; ///< Size of a value in the column file
+	int numeric; ///< Values are numbers which can be compared and summarized in the index
+
+	int fd; ///< Column file
+	char *buff; ///< Values waiting to be appended to the column file
+	size_t buff_len;
+
+	int heap_fd; ///< File holding the variable length values, the column file contains their offset
+	uint64_t heap_size; ///< Size of the heap including the buffered data
+	char *heap_buff; ///< Variable length values waiting to be appended to the heap
+	size_t heap_buff_len;
+	size_t heap_buff_size;
+
+	unsigned char *map; ///< Column file mapped while reading
+	size_t map_len;
+	char *heap_map; ///< Heap mapped while reading
+	size_t heap_map_len;
+
+	struct columnar_minmax block; ///< Min and max of the block being written
+
+	uint64_t txn_heap_size; ///< Size of the heap when the transaction started
+
+};
+
+/// A row matching a read query, used to sort the results
+struct columnar_sort_entry {
+	uint64_t row;
+	uint64_t num; ///< Value of numeric columns
+	char *str; ///< Value of the other columns
+};
+
+struct dataset_priv_columnar {
+
+	char *dir; ///< Directory of the dataset
+	unsigned int num_cols;
+	struct columnar_column *cols;
+
+	int opened; ///< The files are opened
+	uint64_t rows; ///< Number of rows including the buffered ones
+
+	int del_fd; ///< One byte per row, true if the row was deleted
+	char *del_buff;
+	size_t del_buff_len;
+	unsigned char *del_map;
+	size_t del_map_len;
+
+	int index_fd; ///< Min and max of each column for every complete block
+	uint64_t indexed_blocks; ///< Number of blocks in the index
+	struct columnar_minmax *index_map;
+	size_t index_map_len;
+
+	uint64_t read_pos; ///< Next row to look at
+	uint64_t cond_num; ///< Value of the condition for numeric columns
+	struct ptype *cond_value; ///< Used to compare the other columns
+	struct columnar_sort_entry *read_order; ///< Matching rows when the result is sorted
+	uint64_t read_order_count;
+
+	uint64_t txn_rows; ///< Number of rows when the transaction started
+
+};
+
+struct datastore_priv_columnar {
+
+	struct ptype *path;
+
+};
+
+int datastore_register_columnar(struct datastore_reg *r);
+static int datastore_init_columnar(struct datastore *d);
+static int datastore_open_columnar(struct datastore *d);
+static int datastore_dataset_alloc_columnar(struct dataset *ds);
+static int datastore_dataset_create_columnar(struct dataset *ds);
+static int datastore_dataset_read_columnar(struct dataset *ds);
+static int datastore_dataset_write_columnar(struct dataset *ds);
+static int datastore_dataset_delete_columnar(struct dataset *ds);
+static int datastore_transaction_begin_columnar(struct dataset *ds);
+static int datastore_transaction_commit_columnar(struct dataset *ds);
+static int datastore_transaction_rollback_columnar(struct dataset *ds);
+static int datastore_dataset_destroy_columnar(struct dataset *ds);
+static int datastore_dataset_cleanup_columnar(struct dataset *ds);
+static int datastore_cleanup_columnar(struct datastore *d);
+static int datastore_unregister_columnar(struct datastore_reg *r);
+
+static char *columnar_get_filename(char *dir, char *field, char *ext);
+static int columnar_open_files(struct dataset *ds, int create);
+static void columnar_close_files(struct dataset *ds);
+static int columnar_append_file(int fd, char *buff, size_t len);
+static int columnar_flush(struct dataset *ds);
+static void columnar_cancel_row(struct dataset *ds, unsigned int cols);
+static int columnar_truncate(struct dataset *ds, uint64_t rows);
+static int columnar_map(struct dataset *ds, int writable);
+static void columnar_unmap(struct dataset *ds);
+static int columnar_scan_block(struct dataset *ds, uint64_t first, uint64_t last, struct columnar_minmax *minmax);
+static int columnar_write_index(struct dataset *ds);
+static void columnar_reset_block(struct dataset *ds);
+static uint64_t columnar_get_num(struct columnar_column *col, uint64_t row);
+static uint64_t columnar_ptype_to_num(struct datavalue *dv, struct ptype *value);
+static int columnar_block_may_match(struct dataset *ds, uint64_t row);
+static int columnar_row_matches(struct dataset *ds, uint64_t row);
+static int columnar_load_value(struct dataset *ds, unsigned int field, uint64_t row, struct ptype *value);
+static int columnar_load_row(struct dataset *ds, uint64_t row);
+static int columnar_compare_num(const void *a, const void *b);
+static int columnar_compare_str(const void *a, const void *b);
+
+#endif
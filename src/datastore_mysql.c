@@ -76,6 +76,9 @@ int datastore_register_mysql(struct datastore_reg *r) {
 	r->dataset_read = datastore_dataset_read_mysql;
 	r->dataset_write = datastore_dataset_write_mysql;
 	r->dataset_delete = datastore_dataset_delete_mysql;
+	r->transaction_begin = datastore_transaction_begin_mysql;
+	r->transaction_commit = datastore_transaction_commit_mysql;
+	r->transaction_rollback = datastore_transaction_rollback_mysql;
 	r->dataset_destroy = datastore_dataset_destroy_mysql;
 	r->dataset_cleanup = datastore_dataset_cleanup_mysql;
 	r->close = datastore_close_mysql;
@@ -652,6 +655,8 @@ static int datastore_dataset_write_mysql(struct dataset *ds) {
 		} else if (dv[i].native_type == MYSQL_PTYPE_OTHER) {
 			value = ptype_print_val_alloc(dv[i].value);
 		} else {
+			// The values may not be the ones used when binding at alloc time
+			b[i].buffer = dv[i].value->value;
 			continue;
 		}
 
@@ -788,6 +793,47 @@ static int datastore_dataset_delete_mysql(struct dataset* ds) {
 	return res;
 }
 
+static int datastore_transaction_begin_mysql(struct dataset *ds) {
+
+	struct datastore_priv_mysql *priv = ds->dstore->priv;
+
+	if (mysql_query(priv->connection, "START TRANSACTION")) {
+		ds->state = mysql_get_ds_state_error(priv->connection);
+		pom_log(POM_LOG_ERR "Unable to begin a transaction on dataset %s : %s", ds->name, mysql_error(priv->connection));
+		return POM_ERR;
+	}
+
+	return POM_OK;
+}
+
+static int datastore_transaction_commit_mysql(struct dataset *ds) {
+
+	struct datastore_priv_mysql *priv = ds->dstore->priv;
+
+	if (mysql_commit(priv->connection)) {
+		ds->state = mysql_get_ds_state_error(priv->connection);
+		pom_log(POM_LOG_ERR "Unable to commit the transaction on dataset %s : %s", ds->name, mysql_error(priv->connection));
+		return POM_ERR;
+	}
+
+	ds->state = DATASET_STATE_DONE;
+
+	return POM_OK;
+}
+
+static int datastore_transaction_rollback_mysql(struct dataset *ds) {
+
+	struct datastore_priv_mysql *priv = ds->dstore->priv;
+
+	if (mysql_rollback(priv->connection)) {
+		ds->state = mysql_get_ds_state_error(priv->connection);
+		pom_log(POM_LOG_ERR "Unable to rollback the transaction on dataset %s : %s", ds->name, mysql_error(priv->connection));
+		return POM_ERR;
+	}
+
+	return POM_OK;
+}
+
 static int datastore_dataset_destroy_mysql(struct dataset *ds) {
 
 	struct datastore_priv_mysql *priv = ds->dstore->priv;
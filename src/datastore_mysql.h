@@ -71,6 +71,9 @@ static int datastore_dataset_create_mysql(struct dataset *ds);
 static int datastore_dataset_read_mysql(struct dataset *ds);
 static int datastore_dataset_write_mysql( struct dataset *ds);
 static int datastore_dataset_delete_mysql(struct dataset *ds);
+static int datastore_transaction_begin_mysql(struct dataset *ds);
+static int datastore_transaction_commit_mysql(struct dataset *ds);
+static int datastore_transaction_rollback_mysql(struct dataset *ds);
 static int datastore_dataset_destroy_mysql(struct dataset *ds);
 static int datastore_dataset_cleanup_mysql(struct dataset *ds);
 static int datastore_close_mysql(struct datastore *d);
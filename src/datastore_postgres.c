@@ -70,6 +70,9 @@ int datastore_register_postgres(struct datastore_reg *r) {
 	r->dataset_read = datastore_dataset_read_postgres;
 	r->dataset_write = datastore_dataset_write_postgres;
 	r->dataset_delete = datastore_dataset_delete_postgres;
+	r->transaction_begin = datastore_transaction_begin_postgres;
+	r->transaction_commit = datastore_transaction_commit_postgres;
+	r->transaction_rollback = datastore_transaction_rollback_postgres;
 	r->dataset_destroy = datastore_dataset_destroy_postgres;
 	r->dataset_cleanup = datastore_dataset_cleanup_postgres;
 	r->close = datastore_close_postgres;
@@ -666,7 +669,10 @@ static int datastore_dataset_write_postgres(struct dataset *ds) {
 	struct datastore_priv_postgres *dpriv = ds->dstore->priv;
 	struct dataset_priv_postgres *priv = ds->priv;
 
-	if (postgres_exec(ds, "BEGIN;") == POM_ERR) {
+	// Batched writes are already part of a transaction
+	int in_transaction = dpriv->in_transaction;
+
+	if (!in_transaction && postgres_exec(ds, "BEGIN;") == POM_ERR) {
 		if (dpriv->connection)
 			pom_log(POM_LOG_ERR "Failed to begin write transaction to dataset %s : %s", ds->name, PQerrorMessage(dpriv->connection));
 		return POM_ERR;
@@ -762,11 +768,18 @@ static int datastore_dataset_write_postgres(struct dataset *ds) {
 		pom_log(POM_LOG_ERR "Failed to write to dataset \"%s\" : %s", ds->name, PQresultErrorMessage(res));
 		ds->state = postgres_get_ds_state_error(ds, res);
 		PQclear(res);
-		PQexec(dpriv->connection, "ROLLBACK");
+		if (!in_transaction)
+			PQclear(PQexec(dpriv->connection, "ROLLBACK"));
 		return POM_ERR;
 	}
 	PQclear(res);
 
+	if (in_transaction) {
+		// The id of the batched rows is not needed, save a round trip
+		ds->state = DATASET_STATE_DONE;
+		return POM_OK;
+	}
+
 	// Find out the last inserted pkid
 	res = PQexecParams(dpriv->connection, priv->write_query_get_id, 0, NULL, NULL, NULL, NULL, 1);
 	if (PQresultStatus(res) != PGRES_TUPLES_OK) {
@@ -872,6 +885,52 @@ static int datastore_dataset_delete_postgres(struct dataset* ds) {
 	return res;
 }
 
+static int datastore_transaction_begin_postgres(struct dataset *ds) {
+
+	struct datastore_priv_postgres *priv = ds->dstore->priv;
+
+	if (postgres_exec(ds, "BEGIN;") == POM_ERR) {
+		if (priv->connection)
+			pom_log(POM_LOG_ERR "Failed to begin a transaction on dataset %s : %s", ds->name, PQerrorMessage(priv->connection));
+		return POM_ERR;
+	}
+
+	priv->in_transaction = 1;
+
+	return POM_OK;
+}
+
+static int datastore_transaction_commit_postgres(struct dataset *ds) {
+
+	struct datastore_priv_postgres *priv = ds->dstore->priv;
+
+	priv->in_transaction = 0;
+
+	PGresult *res = PQexec(priv->connection, "COMMIT;");
+	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+		pom_log(POM_LOG_ERR "Failed to commit the transaction on dataset \"%s\" : %s", ds->name, PQresultErrorMessage(res));
+		ds->state = postgres_get_ds_state_error(ds, res);
+		PQclear(res);
+		return POM_ERR;
+	}
+	PQclear(res);
+
+	ds->state = DATASET_STATE_DONE;
+
+	return POM_OK;
+}
+
+static int datastore_transaction_rollback_postgres(struct dataset *ds) {
+
+	struct datastore_priv_postgres *priv = ds->dstore->priv;
+
+	priv->in_transaction = 0;
+
+	PQclear(PQexec(priv->connection, "ROLLBACK;"));
+
+	return POM_OK;
+}
+
 static int datastore_dataset_destroy_postgres(struct dataset *ds) {
 
 	int size = 0, new_size = 64;
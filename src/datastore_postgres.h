@@ -51,6 +51,8 @@ struct datastore_priv_postgres {
 
 	int integer_datetimes; // True if postgres server has timestamps as int64
 
+	int in_transaction; ///< True when batched writes are grouped in a transaction
+
 };
 
 
@@ -97,6 +99,9 @@ static int datastore_dataset_create_postgres(struct dataset *ds);
 static int datastore_dataset_read_postgres(struct dataset *ds);
 static int datastore_dataset_write_postgres( struct dataset *ds);
 static int datastore_dataset_delete_postgres( struct dataset *ds);
+static int datastore_transaction_begin_postgres(struct dataset *ds);
+static int datastore_transaction_commit_postgres(struct dataset *ds);
+static int datastore_transaction_rollback_postgres(struct dataset *ds);
 static int datastore_dataset_destroy_postgres(struct dataset *ds);
 static int datastore_dataset_cleanup_postgres(struct dataset *ds);
 static int datastore_close_postgres(struct datastore *d);
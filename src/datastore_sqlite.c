@@ -64,6 +64,9 @@ int datastore_register_sqlite(struct datastore_reg *r) {
 	r->dataset_read = datastore_dataset_read_sqlite;
 	r->dataset_write = datastore_dataset_write_sqlite;
 	r->dataset_delete = datastore_dataset_delete_sqlite;
+	r->transaction_begin = datastore_transaction_begin_sqlite;
+	r->transaction_commit = datastore_transaction_commit_sqlite;
+	r->transaction_rollback = datastore_transaction_rollback_sqlite;
 	r->dataset_destroy = datastore_dataset_destroy_sqlite;
 	r->dataset_cleanup = datastore_dataset_cleanup_sqlite;
 	r->close = datastore_close_sqlite;
@@ -612,6 +615,21 @@ static int datastore_dataset_delete_sqlite(struct dataset* ds) {
 	return res;
 }
 
+static int datastore_transaction_begin_sqlite(struct dataset *ds) {
+
+	return sqlite_exec_transaction(ds, "BEGIN");
+}
+
+static int datastore_transaction_commit_sqlite(struct dataset *ds) {
+
+	return sqlite_exec_transaction(ds, "COMMIT");
+}
+
+static int datastore_transaction_rollback_sqlite(struct dataset *ds) {
+
+	return sqlite_exec_transaction(ds, "ROLLBACK");
+}
+
 static int datastore_dataset_destroy_sqlite(struct dataset *ds) {
 
 	struct datastore_priv_sqlite *priv = ds->dstore->priv;
@@ -732,6 +750,22 @@ static size_t sqlite_escape_string(char *to, char *from, size_t len) {
 	return out_len;
 }
 
+static int sqlite_exec_transaction(struct dataset *ds, char *query) {
+
+	struct datastore_priv_sqlite *priv = ds->dstore->priv;
+
+	int res = sqlite3_exec(priv->db, query, NULL, NULL, NULL);
+	if (res != SQLITE_OK) {
+		ds->state = sqlite_get_ds_state_error(res);
+		pom_log(POM_LOG_ERR "Unable to execute %s on dataset %s : %s", query, ds->name, sqlite3_errmsg(priv->db));
+		return POM_ERR;
+	}
+
+	ds->state = DATASET_STATE_DONE;
+
+	return POM_OK;
+}
+
 static int sqlite_busy_callback(void *priv, int retries) {
 	pom_log(POM_LOG_DEBUG "Database is busy. Retry #%i ...", retries);
 
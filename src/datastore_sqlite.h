@@ -60,6 +60,9 @@ static int datastore_dataset_create_sqlite(struct dataset *ds);
 static int datastore_dataset_read_sqlite(struct dataset *ds);
 static int datastore_dataset_write_sqlite(struct dataset *ds);
 static int datastore_dataset_delete_sqlite(struct dataset *ds);
+static int datastore_transaction_begin_sqlite(struct dataset *ds);
+static int datastore_transaction_commit_sqlite(struct dataset *ds);
+static int datastore_transaction_rollback_sqlite(struct dataset *ds);
 static int datastore_dataset_destroy_sqlite(struct dataset *ds);
 static int datastore_dataset_cleanup_sqlite(struct dataset *ds);
 static int datastore_close_sqlite(struct datastore *d);
@@ -68,6 +71,7 @@ static int datastore_unregister_sqlite(struct datastore_reg *r);
 
 static int sqlite_get_ds_state_error(int res);
 static size_t sqlite_escape_string(char *to, char *from, size_t len);
+static int sqlite_exec_transaction(struct dataset *ds, char *query);
 static int sqlite_busy_callback(void *priv, int retries);
 
 #endif
@@ -0,0 +1,251 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "eventloop.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+
+static int eventloop_epfd = -1;
+
+int eventloop_init() {
+
+	eventloop_epfd = epoll_create(EVENTLOOP_MAX_EVENTS);
+	if (eventloop_epfd == -1) {
+		char errbuff[256];
+		memset(errbuff, 0, sizeof(errbuff));
+		strerror_r(errno, errbuff, sizeof(errbuff) - 1);
+		pom_log(POM_LOG_ERR "Unable to create the epoll fd : %s", errbuff);
+		return POM_ERR;
+	}
+
+	return POM_OK;
+}
+
+static int eventloop_ctl(int op, struct eventloop_fd *efd) {
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.events = efd->events;
+	ev.data.ptr = efd;
+
+	if (epoll_ctl(eventloop_epfd, op, efd->fd, &ev))
+		return POM_ERR;
+
+	return POM_OK;
+}
+
+int eventloop_add(struct eventloop_fd *efd) {
+
+	if (eventloop_ctl(EPOLL_CTL_ADD, efd) != POM_OK) {
+		char errbuff[256];
+		memset(errbuff, 0, sizeof(errbuff));
+		strerror_r(errno, errbuff, sizeof(errbuff) - 1);
+		pom_log(POM_LOG_ERR "Unable to watch fd %d : %s", efd->fd, errbuff);
+		return POM_ERR;
+	}
+
+	return POM_OK;
+}
+
+/**
+ * This function can be called from any thread.
+ * It doesn't log anything so it can be used with locks held.
+ * @param efd File descriptor to update
+ * @param events New events to watch
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int eventloop_modify(struct eventloop_fd *efd, uint32_t events) {
+
+	efd->events = events;
+	return eventloop_ctl(EPOLL_CTL_MOD, efd);
+}
+
+/**
+ * It doesn't log anything so it can be used with locks held.
+ * @param efd File descriptor to stop watching, must not be closed yet
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int eventloop_remove(struct eventloop_fd *efd) {
+
+	return eventloop_ctl(EPOLL_CTL_DEL, efd);
+}
+
+/**
+ * Wait for events and call the handler of every ready file descriptor.
+ * @param timeout Maximum time to wait in milliseconds
+ * @return Number of file descriptors handled or POM_ERR on failure.
+ */
+int eventloop_process(int timeout) {
+
+	struct epoll_event events[EVENTLOOP_MAX_EVENTS];
+
+	int count = epoll_wait(eventloop_epfd, events, EVENTLOOP_MAX_EVENTS, timeout);
+	if (count == -1) {
+		if (errno == EINTR)
+			return 0;
+		char errbuff[256];
+		memset(errbuff, 0, sizeof(errbuff));
+		strerror_r(errno, errbuff, sizeof(errbuff) - 1);
+		pom_log(POM_LOG_ERR "Error while waiting for events : %s", errbuff);
+		return POM_ERR;
+	}
+
+	int i;
+	for (i = 0; i < count; i++) {
+		struct eventloop_fd *efd = events[i].data.ptr;
+		(*efd->handler) (efd, events[i].events);
+	}
+
+	return count;
+}
+
+int eventloop_cleanup() {
+
+	if (eventloop_epfd != -1)
+		close(eventloop_epfd);
+	eventloop_epfd = -1;
+
+	return POM_OK;
+}
+
+#else // HAVE_SYS_EPOLL_H
+
+static struct eventloop_fd *eventloop_head = NULL;
+static unsigned int eventloop_count = 0;
+
+static struct pollfd *eventloop_pollfds = NULL;
+static struct eventloop_fd **eventloop_efds = NULL;
+static unsigned int eventloop_size = 0;
+
+int eventloop_init() {
+
+	return POM_OK;
+}
+
+int eventloop_add(struct eventloop_fd *efd) {
+
+	efd->prev = NULL;
+	efd->next = eventloop_head;
+	if (eventloop_head)
+		eventloop_head->prev = efd;
+	eventloop_head = efd;
+	eventloop_count++;
+
+	return POM_OK;
+}
+
+int eventloop_modify(struct eventloop_fd *efd, uint32_t events) {
+
+	// Will be used the next time we poll
+	efd->events = events;
+
+	return POM_OK;
+}
+
+int eventloop_remove(struct eventloop_fd *efd) {
+
+	if (efd->prev)
+		efd->prev->next = efd->next;
+	else
+		eventloop_head = efd->next;
+
+	if (efd->next)
+		efd->next->prev = efd->prev;
+
+	efd->prev = NULL;
+	efd->next = NULL;
+	eventloop_count--;
+
+	// Make sure it's not handled if it was polled already
+	unsigned int i;
+	for (i = 0; i < eventloop_size; i++) {
+		if (eventloop_efds[i] == efd)
+			eventloop_efds[i] = NULL;
+	}
+
+	return POM_OK;
+}
+
+int eventloop_process(int timeout) {
+
+	if (eventloop_count > eventloop_size) {
+		eventloop_pollfds = realloc(eventloop_pollfds, sizeof(struct pollfd) * eventloop_count);
+		eventloop_efds = realloc(eventloop_efds, sizeof(struct eventloop_fd *) * eventloop_count);
+		if (!eventloop_pollfds || !eventloop_efds) {
+			pom_log(POM_LOG_ERR "Not enough memory to poll the file descriptors");
+			eventloop_size = 0;
+			return POM_ERR;
+		}
+		eventloop_size = eventloop_count;
+	}
+
+	unsigned int nfds = 0;
+	struct eventloop_fd *efd;
+	for (efd = eventloop_head; efd; efd = efd->next) {
+		eventloop_pollfds[nfds].fd = efd->fd;
+		eventloop_pollfds[nfds].events = efd->events;
+		eventloop_pollfds[nfds].revents = 0;
+		eventloop_efds[nfds] = efd;
+		nfds++;
+	}
+
+	int count = poll(eventloop_pollfds, nfds, timeout);
+	if (count == -1) {
+		if (errno == EINTR)
+			return 0;
+		char errbuff[256];
+		memset(errbuff, 0, sizeof(errbuff));
+		strerror_r(errno, errbuff, sizeof(errbuff) - 1);
+		pom_log(POM_LOG_ERR "Error while waiting for events : %s", errbuff);
+		return POM_ERR;
+	}
+
+	unsigned int i;
+	for (i = 0; i < nfds; i++) {
+		if (!eventloop_pollfds[i].revents || !eventloop_efds[i])
+			continue;
+		efd = eventloop_efds[i];
+		(*efd->handler) (efd, eventloop_pollfds[i].revents);
+	}
+
+	for (i = 0; i < nfds; i++)
+		eventloop_efds[i] = NULL;
+
+	return count;
+}
+
+int eventloop_cleanup() {
+
+	free(eventloop_pollfds);
+	eventloop_pollfds = NULL;
+	free(eventloop_efds);
+	eventloop_efds = NULL;
+	eventloop_size = 0;
+
+	eventloop_head = NULL;
+	eventloop_count = 0;
+
+	return POM_OK;
+}
+
+#endif // HAVE_SYS_EPOLL_H
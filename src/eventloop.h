@@ -0,0 +1,68 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __EVENTLOOP_H__
+#define __EVENTLOOP_H__
+
+#include "common.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#define EVENTLOOP_IN	EPOLLIN
+#define EVENTLOOP_OUT	EPOLLOUT
+#define EVENTLOOP_ERR	(EPOLLERR | EPOLLHUP)
+#else
+#include <poll.h>
+#define EVENTLOOP_IN	POLLIN
+#define EVENTLOOP_OUT	POLLOUT
+#define EVENTLOOP_ERR	(POLLERR | POLLHUP)
+#endif
+
+/// Maximum number of ready file descriptors handled per wakeup
+#define EVENTLOOP_MAX_EVENTS	64
+
+/// Maximum time to wait for events in milliseconds
+#define EVENTLOOP_TIMEOUT	1000
+
+/**
+ * File descriptor watched by the event loop.
+ * It is usually embedded in the structure of its owner. It must not be
+ * freed while eventloop_process() is running unless it's from its own handler.
+ */
+struct eventloop_fd {
+	int fd; ///< File descriptor to watch
+	uint32_t events; ///< EVENTLOOP_* events being watched
+	int (*handler) (struct eventloop_fd *efd, uint32_t events); ///< Called with the ready events
+	void *priv; ///< Private data of the owner
+
+#ifndef HAVE_SYS_EPOLL_H
+	struct eventloop_fd *prev, *next;
+#endif
+};
+
+int eventloop_init();
+int eventloop_add(struct eventloop_fd *efd);
+int eventloop_modify(struct eventloop_fd *efd, uint32_t events);
+int eventloop_remove(struct eventloop_fd *efd);
+int eventloop_process(int timeout);
+int eventloop_cleanup();
+
+#endif
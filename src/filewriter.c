@@ -0,0 +1,705 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "common.h"
+#include "filewriter.h"
+#include "perf.h"
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <limits.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/**
+ * @defgroup filewriter_api Asynchronous file writer API
+ * Targets dumping payloads can register the file descriptors returned
+ * by target_file_open() to have their writes performed by background
+ * threads. Data is buffered per file and written in large chunks.
+ * When no thread is running, writes are performed synchronously.
+ * A filter can be attached to a file to transform the appended data
+ * (e.g. decompress it) in the writer threads instead of the caller.
+ */
+
+static pthread_mutex_t filewriter_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t filewriter_work_cond = PTHREAD_COND_INITIALIZER; ///< Signaled when a file is ready to be written
+static pthread_cond_t filewriter_space_cond = PTHREAD_COND_INITIALIZER; ///< Signaled when buffered data was written
+static pthread_cond_t filewriter_idle_cond = PTHREAD_COND_INITIALIZER; ///< Signaled when a file has nothing left to write
+
+static struct filewriter_file **filewriter_files = NULL; ///< Registered files indexed by fd
+static unsigned int filewriter_files_size = 0;
+
+static struct filewriter_file *filewriter_ready_head = NULL, *filewriter_ready_tail = NULL;
+
+static pthread_t filewriter_threads[FILEWRITER_MAX_THREADS];
+static unsigned int filewriter_threads_count = 0;
+static int filewriter_running = 0;
+
+static size_t filewriter_queued = 0; ///< Bytes currently buffered
+static size_t filewriter_max_buffered = 32 * 1024 * 1024;
+
+static struct perf_class *filewriter_perf_class = NULL;
+static struct perf_instance *filewriter_perf_instance = NULL;
+static struct perf_item *filewriter_perf_queued = NULL;
+static struct perf_item *filewriter_perf_written = NULL;
+static struct perf_item *filewriter_perf_writes = NULL;
+static struct perf_item *filewriter_perf_dropped = NULL;
+static struct perf_item *filewriter_perf_dropped_bytes = NULL;
+static struct perf_item *filewriter_perf_stalls = NULL;
+static struct perf_item *filewriter_perf_latency = NULL;
+
+static void *filewriter_thread_func(void *arg);
+
+/**
+ * @ingroup filewriter_api
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int filewriter_init() {
+
+	filewriter_perf_class = perf_register_class("filewriter");
+	filewriter_perf_instance = perf_register_instance(filewriter_perf_class, NULL);
+	filewriter_perf_queued = perf_add_item(filewriter_perf_instance, "queued_bytes", perf_item_type_gauge, "Bytes waiting to be written");
+	filewriter_perf_written = perf_add_item(filewriter_perf_instance, "written_bytes", perf_item_type_counter, "Bytes written to the files");
+	filewriter_perf_writes = perf_add_item(filewriter_perf_instance, "writes", perf_item_type_counter, "Number of write calls performed");
+	filewriter_perf_dropped = perf_add_item(filewriter_perf_instance, "dropped_writes", perf_item_type_counter, "Number of writes dropped because of an error");
+	filewriter_perf_dropped_bytes = perf_add_item(filewriter_perf_instance, "dropped_bytes", perf_item_type_counter, "Bytes dropped because of an error");
+	filewriter_perf_stalls = perf_add_item(filewriter_perf_instance, "stalls", perf_item_type_counter, "Number of times processing waited for buffer space");
+	filewriter_perf_latency = perf_add_item(filewriter_perf_instance, "write_latency", perf_item_type_histogram, "Time spent in each write call");
+
+	return POM_OK;
+}
+
+/**
+ * @ingroup filewriter_api
+ * Start or restart the writer threads. Pending data is written before restarting.
+ * @param threads Number of threads to start, 0 to write synchronously
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int filewriter_start(unsigned int threads) {
+
+	if (threads > FILEWRITER_MAX_THREADS) {
+		pom_log(POM_LOG_ERR "Cannot start more than %u file writer threads", FILEWRITER_MAX_THREADS);
+		return POM_ERR;
+	}
+
+	filewriter_stop();
+
+	pthread_mutex_lock(&filewriter_lock);
+	filewriter_running = 1;
+
+	unsigned int i;
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&filewriter_threads[i], NULL, filewriter_thread_func, NULL)) {
+			pom_log(POM_LOG_ERR "Error while creating a file writer thread");
+			break;
+		}
+		filewriter_threads_count++;
+	}
+
+	if (!filewriter_threads_count)
+		filewriter_running = 0;
+
+	pthread_mutex_unlock(&filewriter_lock);
+
+	if (i < threads) {
+		filewriter_stop();
+		return POM_ERR;
+	}
+
+	if (threads)
+		pom_log(POM_LOG_DEBUG "Started %u file writer threads", threads);
+
+	return POM_OK;
+}
+
+/**
+ * @ingroup filewriter_api
+ * Write all the pending data and stop the writer threads.
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int filewriter_stop() {
+
+	pthread_mutex_lock(&filewriter_lock);
+	filewriter_running = 0;
+	pthread_cond_broadcast(&filewriter_work_cond);
+	pthread_cond_broadcast(&filewriter_space_cond);
+	unsigned int count = filewriter_threads_count;
+	pthread_mutex_unlock(&filewriter_lock);
+
+	unsigned int i;
+	for (i = 0; i < count; i++)
+		pthread_join(filewriter_threads[i], NULL);
+
+	pthread_mutex_lock(&filewriter_lock);
+	filewriter_threads_count = 0;
+	pthread_mutex_unlock(&filewriter_lock);
+
+	return POM_OK;
+}
+
+/**
+ * @ingroup filewriter_api
+ * @param max_buffered Maximum amount of data buffered before processing has to wait
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int filewriter_set_max_buffered(size_t max_buffered) {
+
+	pthread_mutex_lock(&filewriter_lock);
+	filewriter_max_buffered = max_buffered;
+	pthread_cond_broadcast(&filewriter_space_cond);
+	pthread_mutex_unlock(&filewriter_lock);
+
+	return POM_OK;
+}
+
+/**
+ * @ingroup filewriter_api
+ * Write the pending data, stop the threads and forget about the registered files.
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int filewriter_cleanup() {
+
+	filewriter_stop();
+
+	unsigned int i;
+	for (i = 0; i < filewriter_files_size; i++) {
+		struct filewriter_file *file = filewriter_files[i];
+		if (!file)
+			continue;
+		if (file->filter_close)
+			file->filter_close(file->filter_priv);
+		free(file);
+	}
+
+	free(filewriter_files);
+	filewriter_files = NULL;
+	filewriter_files_size = 0;
+
+	if (filewriter_perf_instance)
+		perf_unregister_instance(filewriter_perf_class, filewriter_perf_instance);
+	filewriter_perf_instance = NULL;
+
+	return POM_OK;
+}
+
+/**
+ * @ingroup filewriter_api
+ * Writes to this file descriptor done with filewriter_write() will be buffered.
+ * @param fd File descriptor to register
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int filewriter_register(int fd) {
+
+	if (fd < 0)
+		return POM_ERR;
+
+	pthread_mutex_lock(&filewriter_lock);
+
+	if (fd >= filewriter_files_size) {
+		unsigned int size = filewriter_files_size ? filewriter_files_size : 64;
+		while (size <= fd)
+			size *= 2;
+		filewriter_files = realloc(filewriter_files, sizeof(struct filewriter_file *) * size);
+		memset(filewriter_files + filewriter_files_size, 0, sizeof(struct filewriter_file *) * (size - filewriter_files_size));
+		filewriter_files_size = size;
+	}
+
+	if (filewriter_files[fd]) {
+		pthread_mutex_unlock(&filewriter_lock);
+		pom_log(POM_LOG_WARN "File descriptor %u is already registered in the file writer", fd);
+		return POM_ERR;
+	}
+
+	struct filewriter_file *file = malloc(sizeof(struct filewriter_file));
+	memset(file, 0, sizeof(struct filewriter_file));
+	file->fd = fd;
+	filewriter_files[fd] = file;
+
+	pthread_mutex_unlock(&filewriter_lock);
+
+	return POM_OK;
+}
+
+/**
+ * @ingroup filewriter_api
+ * Attach a filter to a registered file. Data appended afterwards goes through the filter.
+ * Data written at a specific offset is not filtered.
+ * @param fd File descriptor of the file
+ * @param filter Function transforming and writing the data
+ * @param filter_close Function called when the file is closed or NULL
+ * @param priv Private data passed to both functions
+ * @return POM_OK on success, POM_ERR if the file isn't registered or already has a filter.
+ */
+int filewriter_set_filter(int fd, filewriter_filter_func filter, filewriter_filter_close_func filter_close, void *priv) {
+
+	pthread_mutex_lock(&filewriter_lock);
+
+	if (fd < 0 || fd >= filewriter_files_size || !filewriter_files[fd] || filewriter_files[fd]->filter) {
+		pthread_mutex_unlock(&filewriter_lock);
+		return POM_ERR;
+	}
+
+	struct filewriter_file *file = filewriter_files[fd];
+	file->filter = filter;
+	file->filter_close = filter_close;
+	file->filter_priv = priv;
+
+	pthread_mutex_unlock(&filewriter_lock);
+
+	return POM_OK;
+}
+
+/// Add a file to the ready queue. Must be called with the lock held
+static void filewriter_schedule(struct filewriter_file *file) {
+
+	if (file->scheduled || file->busy)
+		return;
+
+	file->scheduled = 1;
+	file->next_ready = NULL;
+	if (filewriter_ready_tail)
+		filewriter_ready_tail->next_ready = file;
+	else
+		filewriter_ready_head = file;
+	filewriter_ready_tail = file;
+
+	pthread_cond_signal(&filewriter_work_cond);
+}
+
+/// Get the file matching this fd or wait until it's idle if no thread is running. Must be called with the lock held
+static struct filewriter_file *filewriter_get_file(int fd) {
+
+	if (fd < 0 || fd >= filewriter_files_size)
+		return NULL;
+
+	struct filewriter_file *file = filewriter_files[fd];
+	if (!file)
+		return NULL;
+
+	// Threads are being stopped, make sure the remaining data is written before writing synchronously
+	while (!filewriter_running && (file->head || file->busy || file->scheduled))
+		pthread_cond_wait(&filewriter_idle_cond, &filewriter_lock);
+
+	return file;
+}
+
+static ssize_t filewriter_queue(int fd, const void *buf, size_t count, off_t offset) {
+
+	if (!count)
+		return 0;
+
+	pthread_mutex_lock(&filewriter_lock);
+
+	struct filewriter_file *file = filewriter_get_file(fd);
+	if (!file || !filewriter_running) {
+		pthread_mutex_unlock(&filewriter_lock);
+		if (offset == -1) {
+			if (file && file->filter) {
+				if (file->filter(file->filter_priv, fd, (char *) buf, count) != POM_OK)
+					return -1;
+				return count;
+			}
+			return write(fd, buf, count);
+		}
+		return pwrite(fd, buf, count, offset);
+	}
+
+	if (file->error) {
+		int err = file->error;
+		pthread_mutex_unlock(&filewriter_lock);
+		perf_item_val_inc(filewriter_perf_dropped, 1);
+		perf_item_val_inc(filewriter_perf_dropped_bytes, count);
+		errno = err;
+		return -1;
+	}
+
+	// Apply back-pressure when too much data is waiting, a single write bigger than the limit is allowed
+	if (filewriter_queued && filewriter_queued + count > filewriter_max_buffered) {
+		perf_item_val_inc(filewriter_perf_stalls, 1);
+		while (filewriter_running && filewriter_queued && filewriter_queued + count > filewriter_max_buffered)
+			pthread_cond_wait(&filewriter_space_cond, &filewriter_lock);
+
+		if (!filewriter_running) {
+			// Threads were stopped while waiting
+			pthread_mutex_unlock(&filewriter_lock);
+			return filewriter_queue(fd, buf, count, offset);
+		}
+	}
+
+	struct filewriter_chunk *chunk = file->tail;
+	if (offset != -1 || !chunk || chunk->offset != -1 || chunk->size - chunk->len < count) {
+		chunk = malloc(sizeof(struct filewriter_chunk));
+		memset(chunk, 0, sizeof(struct filewriter_chunk));
+		chunk->offset = offset;
+		chunk->size = count;
+		if (offset == -1 && chunk->size < FILEWRITER_CHUNK_SIZE)
+			chunk->size = FILEWRITER_CHUNK_SIZE;
+		chunk->data = malloc(chunk->size);
+
+		if (file->tail)
+			file->tail->next = chunk;
+		else
+			file->head = chunk;
+		file->tail = chunk;
+	}
+
+	memcpy(chunk->data + chunk->len, buf, count);
+	chunk->len += count;
+
+	filewriter_queued += count;
+	perf_item_val_inc(filewriter_perf_queued, count);
+
+	filewriter_schedule(file);
+
+	pthread_mutex_unlock(&filewriter_lock);
+
+	return count;
+}
+
+/**
+ * @ingroup filewriter_api
+ * Append data to a file. Behaves like write(2) for unregistered file descriptors.
+ * @param fd File descriptor to write to
+ * @param buf Data to write
+ * @param count Size of the data
+ * @return The amount of data written or queued, -1 on error.
+ */
+ssize_t filewriter_write(int fd, const void *buf, size_t count) {
+
+	return filewriter_queue(fd, buf, count, -1);
+}
+
+/**
+ * @ingroup filewriter_api
+ * Write data at a specific offset once the previously queued data is written.
+ * @param fd File descriptor to write to
+ * @param buf Data to write
+ * @param count Size of the data
+ * @param offset Where to write the data in the file
+ * @return The amount of data written or queued, -1 on error.
+ */
+ssize_t filewriter_pwrite(int fd, const void *buf, size_t count, off_t offset) {
+
+	return filewriter_queue(fd, buf, count, offset);
+}
+
+/**
+ * @ingroup filewriter_api
+ * Wait until all the data queued for a file has been written.
+ * @param fd File descriptor to flush
+ * @return POM_OK on success, POM_ERR if some data could not be written.
+ */
+int filewriter_flush(int fd) {
+
+	pthread_mutex_lock(&filewriter_lock);
+
+	struct filewriter_file *file = filewriter_get_file(fd);
+	if (!file) {
+		pthread_mutex_unlock(&filewriter_lock);
+		return POM_OK;
+	}
+
+	while (file->head || file->busy || file->scheduled)
+		pthread_cond_wait(&filewriter_idle_cond, &filewriter_lock);
+
+	int res = (file->error ? POM_ERR : POM_OK);
+
+	pthread_mutex_unlock(&filewriter_lock);
+
+	return res;
+}
+
+/**
+ * @ingroup filewriter_api
+ * Close the file once all the queued data is written and unregister it.
+ * @param fd File descriptor to close
+ * @return 0 on success, -1 on error.
+ */
+int filewriter_close(int fd) {
+
+	pthread_mutex_lock(&filewriter_lock);
+
+	struct filewriter_file *file = filewriter_get_file(fd);
+	if (!file) {
+		pthread_mutex_unlock(&filewriter_lock);
+		return close(fd);
+	}
+
+	if (!filewriter_running) {
+		filewriter_files[fd] = NULL;
+		pthread_mutex_unlock(&filewriter_lock);
+		if (file->filter_close)
+			file->filter_close(file->filter_priv);
+		free(file);
+		return close(fd);
+	}
+
+	file->close = 1;
+	if (!file->busy && !file->scheduled)
+		filewriter_schedule(file);
+
+	pthread_mutex_unlock(&filewriter_lock);
+
+	return 0;
+}
+
+/// Write a chain of chunks to a file, returns the errno of the first error or 0
+static int filewriter_write_chunks(int fd, struct filewriter_chunk *chunk, size_t *dropped, unsigned int *dropped_writes) {
+
+	int err = 0;
+
+	while (chunk) {
+
+		if (err) {
+			*dropped += chunk->len;
+			(*dropped_writes)++;
+			chunk = chunk->next;
+			continue;
+		}
+
+		// Gather consecutive appended chunks in a single call
+		struct iovec iov[IOV_MAX];
+		int iovcnt = 0;
+		size_t total = 0;
+		struct filewriter_chunk *next = chunk;
+
+		if (chunk->offset == -1) {
+			while (next && next->offset == -1 && iovcnt < IOV_MAX) {
+				iov[iovcnt].iov_base = next->data;
+				iov[iovcnt].iov_len = next->len;
+				total += next->len;
+				iovcnt++;
+				next = next->next;
+			}
+		} else {
+			iov[0].iov_base = chunk->data;
+			iov[0].iov_len = chunk->len;
+			total = chunk->len;
+			iovcnt = 1;
+			next = chunk->next;
+		}
+
+		size_t done = 0;
+		int cur = 0;
+		while (done < total) {
+			struct timespec start, end;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+
+			ssize_t res;
+			if (chunk->offset == -1)
+				res = writev(fd, iov + cur, iovcnt - cur);
+			else
+				res = pwrite(fd, (char *)iov[0].iov_base + done, total - done, chunk->offset + done);
+
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			perf_item_val_record(filewriter_perf_latency, ((uint64_t)(end.tv_sec - start.tv_sec) * 1000000000LLU) + end.tv_nsec - start.tv_nsec);
+			perf_item_val_inc(filewriter_perf_writes, 1);
+
+			if (res == -1) {
+				if (errno == EINTR)
+					continue;
+				err = errno;
+				break;
+			}
+
+			done += res;
+			perf_item_val_inc(filewriter_perf_written, res);
+
+			if (chunk->offset != -1)
+				continue;
+
+			// Skip the iovecs fully written and adjust the partially written one
+			while (cur < iovcnt && res >= iov[cur].iov_len) {
+				res -= iov[cur].iov_len;
+				cur++;
+			}
+			if (cur < iovcnt) {
+				iov[cur].iov_base = (char *)iov[cur].iov_base + res;
+				iov[cur].iov_len -= res;
+			}
+		}
+
+		if (err) {
+			*dropped += total - done;
+			(*dropped_writes)++;
+		}
+
+		chunk = next;
+	}
+
+	return err;
+}
+
+/**
+ * @ingroup filewriter_api
+ * Write the output of a filter. Must only be called from a filter.
+ * @param fd File descriptor given to the filter
+ * @param buf Data to write
+ * @param count Size of the data
+ * @return POM_OK on success, POM_ERR with errno set on error.
+ */
+int filewriter_output(int fd, const void *buf, size_t count) {
+
+	struct filewriter_chunk chunk;
+	memset(&chunk, 0, sizeof(struct filewriter_chunk));
+	chunk.data = (char *) buf;
+	chunk.len = count;
+	chunk.size = count;
+	chunk.offset = -1;
+
+	size_t dropped = 0;
+	unsigned int dropped_writes = 0;
+	int err = filewriter_write_chunks(fd, &chunk, &dropped, &dropped_writes);
+	if (err) {
+		errno = err;
+		return POM_ERR;
+	}
+
+	return POM_OK;
+}
+
+/// Pass the appended chunks to the filter of the file, returns the errno of the first error or 0
+static int filewriter_filter_chunks(struct filewriter_file *file, struct filewriter_chunk *chunk, size_t *dropped, unsigned int *dropped_writes) {
+
+	int err = 0;
+
+	while (chunk) {
+
+		struct filewriter_chunk *next = chunk->next;
+
+		if (!err) {
+			if (chunk->offset != -1) {
+				chunk->next = NULL;
+				err = filewriter_write_chunks(file->fd, chunk, dropped, dropped_writes);
+				chunk->next = next;
+			} else {
+				errno = 0;
+				if (file->filter(file->filter_priv, file->fd, chunk->data, chunk->len) != POM_OK) {
+					err = (errno ? errno : EIO);
+					*dropped += chunk->len;
+					(*dropped_writes)++;
+				}
+			}
+		} else {
+			*dropped += chunk->len;
+			(*dropped_writes)++;
+		}
+
+		chunk = next;
+	}
+
+	return err;
+}
+
+static void *filewriter_thread_func(void *arg) {
+
+	pthread_mutex_lock(&filewriter_lock);
+
+	while (1) {
+
+		while (!filewriter_ready_head && filewriter_running)
+			pthread_cond_wait(&filewriter_work_cond, &filewriter_lock);
+
+		// Only exit once everything was written
+		if (!filewriter_ready_head)
+			break;
+
+		struct filewriter_file *file = filewriter_ready_head;
+		filewriter_ready_head = file->next_ready;
+		if (!filewriter_ready_head)
+			filewriter_ready_tail = NULL;
+		file->scheduled = 0;
+		file->busy = 1;
+
+		struct filewriter_chunk *chunks = file->head;
+		file->head = NULL;
+		file->tail = NULL;
+		int err = file->error;
+
+		pthread_mutex_unlock(&filewriter_lock);
+
+		size_t len = 0, dropped = 0;
+		unsigned int dropped_writes = 0;
+		struct filewriter_chunk *tmp = chunks;
+		while (tmp) {
+			len += tmp->len;
+			tmp = tmp->next;
+		}
+
+		if (!err) {
+			if (file->filter)
+				err = filewriter_filter_chunks(file, chunks, &dropped, &dropped_writes);
+			else
+				err = filewriter_write_chunks(file->fd, chunks, &dropped, &dropped_writes);
+			if (err) {
+				char errbuff[256];
+				memset(errbuff, 0, sizeof(errbuff));
+				strerror_r(err, errbuff, sizeof(errbuff) - 1);
+				pom_log(POM_LOG_ERR "Error while writing to fd %u : %s. Further data will be dropped", file->fd, errbuff);
+			}
+		} else {
+			dropped = len;
+		}
+
+		if (dropped) {
+			perf_item_val_inc(filewriter_perf_dropped, dropped_writes);
+			perf_item_val_inc(filewriter_perf_dropped_bytes, dropped);
+		}
+
+		while (chunks) {
+			tmp = chunks;
+			chunks = chunks->next;
+			free(tmp->data);
+			free(tmp);
+		}
+
+		perf_item_val_inc(filewriter_perf_queued, -(int64_t)len);
+
+		pthread_mutex_lock(&filewriter_lock);
+
+		filewriter_queued -= len;
+		pthread_cond_broadcast(&filewriter_space_cond);
+
+		file->busy = 0;
+		if (err)
+			file->error = err;
+
+		if (file->head) {
+			// More data was queued in the mean time
+			filewriter_schedule(file);
+		} else if (file->close) {
+			if (file->filter_close)
+				file->filter_close(file->filter_priv);
+			close(file->fd);
+			filewriter_files[file->fd] = NULL;
+			free(file);
+		}
+
+		pthread_cond_broadcast(&filewriter_idle_cond);
+
+	}
+
+	pthread_mutex_unlock(&filewriter_lock);
+
+	return NULL;
+}
@@ -0,0 +1,82 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __FILEWRITER_H__
+#define __FILEWRITER_H__
+
+/// Default size of the chunks used to buffer appended data
+#define FILEWRITER_CHUNK_SIZE 65536
+
+/// Maximum number of writer threads
+#define FILEWRITER_MAX_THREADS 64
+
+/// Data waiting to be written to a file
+struct filewriter_chunk {
+
+	char *data;
+	size_t len; ///< Amount of data in the chunk
+	size_t size; ///< Allocated size of the chunk
+	off_t offset; ///< Where to write the data or -1 to append it
+	struct filewriter_chunk *next;
+
+};
+
+/**
+ * Transform appended data before it's written, called by the writer threads.
+ * The filter writes its output with filewriter_output().
+ * @return POM_OK on success, POM_ERR with errno set on write error.
+ */
+typedef int (*filewriter_filter_func) (void *priv, int fd, char *buf, size_t count);
+
+/// Called when a file with a filter is closed
+typedef int (*filewriter_filter_close_func) (void *priv);
+
+/// A file registered with the file writer
+struct filewriter_file {
+
+	int fd;
+	int close; ///< Close the file once everything is written
+	int busy; ///< A writer thread is currently processing the file
+	int scheduled; ///< The file is in the ready queue
+	int error; ///< Errno of the last failed write, further writes are dropped
+	struct filewriter_chunk *head, *tail;
+	struct filewriter_file *next_ready;
+
+	filewriter_filter_func filter; ///< Optional filter applied to appended data
+	filewriter_filter_close_func filter_close;
+	void *filter_priv;
+
+};
+
+int filewriter_init();
+int filewriter_start(unsigned int threads);
+int filewriter_stop();
+int filewriter_set_max_buffered(size_t max_buffered);
+int filewriter_cleanup();
+
+int filewriter_register(int fd);
+int filewriter_set_filter(int fd, filewriter_filter_func filter, filewriter_filter_close_func filter_close, void *priv);
+int filewriter_output(int fd, const void *buf, size_t count);
+ssize_t filewriter_write(int fd, const void *buf, size_t count);
+ssize_t filewriter_pwrite(int fd, const void *buf, size_t count, off_t offset);
+int filewriter_flush(int fd);
+int filewriter_close(int fd);
+
+#endif
@@ -272,17 +272,16 @@ int helper_queue_frame(struct frame *f) {
 
 /**
  * @ingroup helper_core
- * @param list Rule list to use when processing queued packets
- * @param lock Lock on the whole rule list
+ * @param rules Rule snapshot to use when processing queued packets
  * @return POM_OK on success, POM_ERR on failure
  */
-int helper_process_queue(struct rule_list *list, pthread_rwlock_t *lock) {
+int helper_process_queue(struct rule_snapshot *rules) {
 
 	if (!frame_head)
 		return POM_OK;
 
 	while (frame_head) {
-		do_rules(frame_head->f, list, lock);
+		do_rules(frame_head->f, rules);
 		free(frame_head->f->buff_base);
 		free(frame_head->f);
 		struct helper_frame *tmpf = frame_head;
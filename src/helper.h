@@ -124,7 +124,7 @@ int helper_need_help(struct frame *f, unsigned int start, unsigned int len, stru
 int helper_queue_frame(struct frame *f);
 
 /// Process queued frames
-int helper_process_queue(struct rule_list *list, pthread_rwlock_t *lock);
+int helper_process_queue(struct rule_snapshot *rules);
 
 /// Unregister a helper
 int helper_unregister(int helper_type);
@@ -42,11 +42,15 @@
 #include "ptype_string.h"
 #include "ptype_bool.h"
 #include "ptype_uint32.h"
+#include "checksum.h"
 
 
 /// We use a bigger buffer size of the demux interface. This way we can cope with some burst.
 #define DEMUX_BUFFER_SIZE 2097152 // 2Megs
 
+/// Size of the buffer MPEG packets are read into. Whole packets that fit in the demux buffer.
+#define TS_BUFF_SIZE ((DEMUX_BUFFER_SIZE / MPEG_TS_LEN) * MPEG_TS_LEN)
+
 static int match_ethernet_id, match_docsis_id, match_atm_id;
 
 static struct input_mode *mode_normal, *mode_scan, *mode_docsis3, *mode_file;
@@ -54,48 +58,6 @@ static struct ptype *p_frequency, *p_modulation, *p_outlayer, *p_startfreq, *p_f
 
 static struct input_adapt_reg_docsis adapts[DOCSIS_MAX_ADAPT];
 
-/*
- * This is taken from the linux kernel.
- * This mysterious table is just the CRC of each possible byte. It can be
- * computed using the standard bit-at-a-time methods. The polynomial can
- * be seen in entry 128, 0x8408. This corresponds to x^0 + x^5 + x^12.
- * Add the implicit x^16, and you have the standard CRC-CCITT.
- */
-uint16_t const crc_ccitt_table[256] = {
-	0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x6536, 0x74bf,
-	0x8c48, 0x9dc1, 0xaf5a, 0xbed3, 0xca6c, 0xdbe5, 0xe97e, 0xf8f7,
-	0x1081, 0x0108, 0x3393, 0x221a, 0x56a5, 0x472c, 0x75b7, 0x643e,
-	0x9cc9, 0x8d40, 0xbfdb, 0xae52, 0xdaed, 0xcb64, 0xf9ff, 0xe876,
-	0x2102, 0x308b, 0x0210, 0x1399, 0x6726, 0x76af, 0x4434, 0x55bd,
-	0xad4a, 0xbcc3, 0x8e58, 0x9fd1, 0xeb6e, 0xfae7, 0xc87c, 0xd9f5,
-	0x3183, 0x200a, 0x1291, 0x0318, 0x77a7, 0x662e, 0x54b5, 0x453c,
-	0xbdcb, 0xac42, 0x9ed9, 0x8f50, 0xfbef, 0xea66, 0xd8fd, 0xc974,
-	0x4204, 0x538d, 0x6116, 0x709f, 0x0420, 0x15a9, 0x2732, 0x36bb,
-	0xce4c, 0xdfc5, 0xed5e, 0xfcd7, 0x8868, 0x99e1, 0xab7a, 0xbaf3,
-	0x5285, 0x430c, 0x7197, 0x601e, 0x14a1, 0x0528, 0x37b3, 0x263a,
-	0xdecd, 0xcf44, 0xfddf, 0xec56, 0x98e9, 0x8960, 0xbbfb, 0xaa72,
-	0x6306, 0x728f, 0x4014, 0x519d, 0x2522, 0x34ab, 0x0630, 0x17b9,
-	0xef4e, 0xfec7, 0xcc5c, 0xddd5, 0xa96a, 0xb8e3, 0x8a78, 0x9bf1,
-	0x7387, 0x620e, 0x5095, 0x411c, 0x35a3, 0x242a, 0x16b1, 0x0738,
-	0xffcf, 0xee46, 0xdcdd, 0xcd54, 0xb9eb, 0xa862, 0x9af9, 0x8b70,
-	0x8408, 0x9581, 0xa71a, 0xb693, 0xc22c, 0xd3a5, 0xe13e, 0xf0b7,
-	0x0840, 0x19c9, 0x2b52, 0x3adb, 0x4e64, 0x5fed, 0x6d76, 0x7cff,
-	0x9489, 0x8500, 0xb79b, 0xa612, 0xd2ad, 0xc324, 0xf1bf, 0xe036,
-	0x18c1, 0x0948, 0x3bd3, 0x2a5a, 0x5ee5, 0x4f6c, 0x7df7, 0x6c7e,
-	0xa50a, 0xb483, 0x8618, 0x9791, 0xe32e, 0xf2a7, 0xc03c, 0xd1b5,
-	0x2942, 0x38cb, 0x0a50, 0x1bd9, 0x6f66, 0x7eef, 0x4c74, 0x5dfd,
-	0xb58b, 0xa402, 0x9699, 0x8710, 0xf3af, 0xe226, 0xd0bd, 0xc134,
-	0x39c3, 0x284a, 0x1ad1, 0x0b58, 0x7fe7, 0x6e6e, 0x5cf5, 0x4d7c,
-	0xc60c, 0xd785, 0xe51e, 0xf497, 0x8028, 0x91a1, 0xa33a, 0xb2b3,
-	0x4a44, 0x5bcd, 0x6956, 0x78df, 0x0c60, 0x1de9, 0x2f72, 0x3efb,
-	0xd68d, 0xc704, 0xf59f, 0xe416, 0x90a9, 0x8120, 0xb3bb, 0xa232,
-	0x5ac5, 0x4b4c, 0x79d7, 0x685e, 0x1ce1, 0x0d68, 0x3ff3, 0x2e7a,
-	0xe70e, 0xf687, 0xc41c, 0xd595, 0xa12a, 0xb0a3, 0x8238, 0x93b1,
-	0x6b46, 0x7acf, 0x4854, 0x59dd, 0x2d62, 0x3ceb, 0x0e70, 0x1ff9,
-	0xf78f, 0xe606, 0xd49d, 0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330,
-	0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
-};
-
 /// Register input_docsis
 int input_register_docsis(struct input_reg *r) {
 
@@ -183,7 +145,7 @@ int input_register_docsis(struct input_reg *r) {
 	input_register_param(mode_docsis3, "tuning_timeout", "3", p_tuning_timeout, "Timeout to wait until giving up when waiting for a lock");
 	input_register_param(mode_docsis3, "outlayer", "ethernet", p_outlayer, "Type of the output layer wanted");
 
-	input_register_param(mode_file, "file",  "dump.ts", p_file, "File to read MPEG packets from");
+	input_register_param(mode_file, "file",  "dump.ts", p_file, "File to read MPEG packets from. Several files separated by commas are read in parallel like bonded channels");
 	input_register_param(mode_file, "outlayer", "ethernet", p_outlayer, "Type of the output layer wanted");
 	input_register_param(mode_file, "validate_checksum", "yes", p_validate_checksum, "Perform checksum validation");
 
@@ -206,6 +168,10 @@ static int input_init_docsis(struct input *i) {
 		p->adapts[j].dvr_fd = -1;
 	}
 
+	pthread_mutex_init(&p->queue_lock, NULL);
+	pthread_cond_init(&p->queue_cond, NULL);
+	pthread_cond_init(&p->queue_space_cond, NULL);
+
 	// Add counters
 	p->perf_mpeg_tot_pkts = perf_add_item(i->perfs, "mpeg_tot_pkts", perf_item_type_counter, "Total number of MPEG packets for the DOCSIS PID");
 	p->perf_mpeg_missed_pkts = perf_add_item(i->perfs, "mpeg_missed_pkts", perf_item_type_counter, "Number of MPEG packets lost");
@@ -227,6 +193,10 @@ static int input_cleanup_docsis(struct input *i) {
 		free(p->adapts[j].packet_buff_base);
 	}
 
+	pthread_mutex_destroy(&p->queue_lock);
+	pthread_cond_destroy(&p->queue_cond);
+	pthread_cond_destroy(&p->queue_space_cond);
+
 	free(i->input_priv);
 	return POM_OK;
 
@@ -331,7 +301,8 @@ static int input_open_adapt_docsis(struct input *i, unsigned int adapt_id) {
 	strcpy(dvr, adapter);
 	strcat(dvr, "/dvr0");
 
-	p->adapts[adapt_id].dvr_fd = open(dvr, O_RDONLY);
+	// A blocking read() on the dvr waits until the whole buffer is filled
+	p->adapts[adapt_id].dvr_fd = open(dvr, O_RDONLY | O_NONBLOCK);
 	if (p->adapts[adapt_id].dvr_fd == -1) {
 		pom_log(POM_LOG_ERR "Unable to open dvr interface %s", dvr);
 		goto err;
@@ -393,6 +364,10 @@ static int input_open_adapt_docsis(struct input *i, unsigned int adapt_id) {
 	p->adapts[adapt_id].packet_buff = (void*) (((long)p->adapts[adapt_id].packet_buff_base & ~3) + 4);
 	p->adapts[adapt_id].packet_buff_len = frame_len - ((long)p->adapts[adapt_id].packet_buff - (long)p->adapts[adapt_id].packet_buff_base);
 
+	p->adapts[adapt_id].ts_buff = malloc(TS_BUFF_SIZE);
+	p->adapts[adapt_id].ts_buff_pos = 0;
+	p->adapts[adapt_id].ts_buff_len = 0;
+
 	// Add signal related perf items
 	char signal_str[] = "signalX";
 	signal_str[strlen(signal_str) - 1] = adapt_id + '0';
@@ -452,6 +427,11 @@ err:
 		p->adapts[adapt_id].packet_buff_base = NULL;
 	}
 
+	if (p->adapts[adapt_id].ts_buff) {
+		free(p->adapts[adapt_id].ts_buff);
+		p->adapts[adapt_id].ts_buff = NULL;
+	}
+
 	p->adapts[adapt_id].packet_pos = 0;
 
 	return POM_ERR;
@@ -479,39 +459,42 @@ static int input_open_docsis(struct input *i) {
 	}
 
 	if (i->mode == mode_file) {
-		p->adapts[0].dvr_fd = open(PTYPE_STRING_GETVAL(p_file), O_RDONLY);
-		if (p->adapts[0].dvr_fd == -1) {
-			pom_log(POM_LOG_ERR "Unable to open the file %s", PTYPE_STRING_GETVAL(p_file));
-			return POM_ERR;
-		}
 
-		struct stat buff;
-		if (fstat(p->adapts[0].dvr_fd, &buff)) {
-			pom_log(POM_LOG_ERR "Unable to stat() the file %s", PTYPE_STRING_GETVAL(p_file));
-			close(p->adapts[0].dvr_fd);
-			p->adapts[0].dvr_fd = -1;
-			return POM_ERR;
+		// Several files are replayed in parallel like bonded channels
+		char *files = strdup(PTYPE_STRING_GETVAL(p_file));
+		char *str, *token, *saveptr = NULL;
+		for (str = files; (token = strtok_r(str, ",", &saveptr)); str = NULL) {
+			if (p->num_adapts_open >= DOCSIS_MAX_ADAPT) {
+				pom_log(POM_LOG_ERR "Too many files, at most %u can be read at once", DOCSIS_MAX_ADAPT);
+				free(files);
+				input_close_docsis(i);
+				return POM_ERR;
+			}
+
+			if (input_open_file_docsis(i, p->num_adapts_open, token) == POM_ERR) {
+				free(files);
+				input_close_docsis(i);
+				return POM_ERR;
+			}
+			p->num_adapts_open++;
 		}
-		memset(&p->packet_time, 0, sizeof(struct timeval));
-		p->packet_time.tv_sec = buff.st_ctime;
-		memcpy(&p->packet_time_last_sync, &p->packet_time, sizeof(struct timeval));
-
-		// This buffer will be swapped with buffers in frame structures
-		// Need to add 4 bytes for alignment purposes
-		int frame_len = DOCSIS_SNAPLEN + 4;
-		p->adapts[0].packet_buff_base = malloc(frame_len);
-		// Recalculate correct offset for the buffer as it may have been moved to skip the docsis header
-		// We should not take the align_offset in account here as the ethernet header will align perfectly
-		p->adapts[0].packet_buff = (void*) (((long)p->adapts[0].packet_buff_base & ~3) + 4);
-		p->adapts[0].packet_buff_len = frame_len - ((long)p->adapts[0].packet_buff - (long)p->adapts[0].packet_buff_base);
-
-		if (input_docsis_check_downstream(i, 0) == POM_ERR) {
-			pom_log(POM_LOG_ERR "Could not find a SYNC packet in the file %s", PTYPE_STRING_GETVAL(p_file));
-			input_close_docsis(i);
+		free(files);
+
+		if (!p->num_adapts_open) {
+			pom_log(POM_LOG_ERR "No file to read MPEG packets from");
 			return POM_ERR;
 		}
 
-		p->num_adapts_open = 1;
+		if (p->num_adapts_open > 1) {
+			p->threaded = 1;
+			int j;
+			for (j = 0; j < p->num_adapts_open; j++) {
+				if (input_start_adapt_thread_docsis(i, j) == POM_ERR) {
+					input_close_docsis(i);
+					return POM_ERR;
+				}
+			}
+		}
 
 		pom_log("Docsis stream opened successfully");
 
@@ -575,6 +558,15 @@ static int input_open_docsis(struct input *i) {
 				input_close_docsis(i);
 				return POM_ERR;
 			}
+
+			if (i->mode == mode_docsis3) {
+				// Each adapter is read by its own thread
+				p->threaded = 1;
+				if (input_start_adapt_thread_docsis(i, 0) == POM_ERR) {
+					input_close_docsis(i);
+					return POM_ERR;
+				}
+			}
 		
 			pom_log("%sDOCSIS stream locked on adapter %u with frequency %uHz with %uQAM", (eurodocsis ? "Euro" : "US"), 0, frequency, (modulation == QAM_64 ? 64 : 256));
 
@@ -641,7 +633,7 @@ static int input_docsis_check_downstream(struct input *i, unsigned int adapt_id)
 
 	struct input_priv_docsis *p = i->input_priv;
 
-	unsigned char buffer[MPEG_TS_LEN];
+	unsigned char *buffer = NULL;
 	int count = 0, res;
 	time_t sync_start = time(NULL);
 
@@ -649,26 +641,30 @@ static int input_docsis_check_downstream(struct input *i, unsigned int adapt_id)
 	struct timeval tv;
 
 	while (time(NULL) - sync_start <= 2) {
-		
-		FD_ZERO(&set);
-		FD_SET(p->adapts[adapt_id].dvr_fd, &set);
-		
-		tv.tv_sec = 1;
-		tv.tv_usec = 0;
 
-		res = select(p->adapts[adapt_id].dvr_fd + 1, &set, NULL, NULL, &tv);
-		
-		if (res == -1) {
-			char errbuff[256];
-			strerror_r(errno, errbuff, 256);
-			pom_log(POM_LOG_ERR "Error select() : %s", errbuff);
-			break;
-		} else if (res == 0) {
-			pom_log(POM_LOG_ERR "Timeout while waiting for data");
-			break;
+		// No need to wait if a whole MPEG packet is already buffered
+		if (p->adapts[adapt_id].ts_buff_len - p->adapts[adapt_id].ts_buff_pos < MPEG_TS_LEN) {
+
+			FD_ZERO(&set);
+			FD_SET(p->adapts[adapt_id].dvr_fd, &set);
+
+			tv.tv_sec = 1;
+			tv.tv_usec = 0;
+
+			res = select(p->adapts[adapt_id].dvr_fd + 1, &set, NULL, NULL, &tv);
+
+			if (res == -1) {
+				char errbuff[256];
+				strerror_r(errno, errbuff, 256);
+				pom_log(POM_LOG_ERR "Error select() : %s", errbuff);
+				break;
+			} else if (res == 0) {
+				pom_log(POM_LOG_ERR "Timeout while waiting for data");
+				break;
+			}
 		}
 
-		res = input_docsis_read_mpeg_frame(buffer, p, adapt_id);
+		res = input_docsis_read_mpeg_frame(&buffer, p, adapt_id);
 
 		switch (res) {
 			case -2:
@@ -720,8 +716,8 @@ static int input_docsis_check_downstream(struct input *i, unsigned int adapt_id)
 			continue;
 	
 		if (i->mode == mode_file) { // Save the first timestamp when reading from a file
-			memcpy(&p->last_sync_tstamp, buffer + mac_start + 26, sizeof(uint32_t));
-			p->last_sync_tstamp = ntohl(p->last_sync_tstamp);
+			memcpy(&p->adapts[adapt_id].last_sync_tstamp, buffer + mac_start + 26, sizeof(uint32_t));
+			p->adapts[adapt_id].last_sync_tstamp = ntohl(p->adapts[adapt_id].last_sync_tstamp);
 			p->adapts[adapt_id].last_seq = (buffer[3] & 0xF);
 			return POM_OK;
 		}
@@ -764,6 +760,10 @@ static int input_docsis_tune(struct input_priv_docsis *p, uint32_t frequency, ui
 
 	// Let's do some tuning
 
+	// Whatever was buffered belongs to the previous frequency
+	p->adapts[adapt_id].ts_buff_pos = 0;
+	p->adapts[adapt_id].ts_buff_len = 0;
+
 	if (ioctl(p->adapts[adapt_id].frontend_fd, FE_SET_FRONTEND, &frp) < 0){
 		pom_log(POM_LOG_ERR "Error while setting tuning parameters");
 		return -1;
@@ -831,44 +831,95 @@ static int input_docsis_tune(struct input_priv_docsis *p, uint32_t frequency, ui
 }
 
 /**
- * Fill buff with an MPEG packet of MPEG_TS_LEN bytes and check it's validity.
+ * Read as many MPEG packets as possible from the dvr into the buffer of the adapter.
+ * Partial packets left at the end of the buffer are moved to its begining first.
+ * Returns the number of bytes read, 0 if no data is available yet, -2 if there was an error while reading and -3 on EOF
+ */
+
+static int input_docsis_fill_ts_buff(struct input_priv_docsis *p, unsigned int adapt_id) {
+
+	struct input_adapt_docsis *adapt = &p->adapts[adapt_id];
+
+	unsigned int remaining = adapt->ts_buff_len - adapt->ts_buff_pos;
+	if (remaining && adapt->ts_buff_pos)
+		memmove(adapt->ts_buff, adapt->ts_buff + adapt->ts_buff_pos, remaining);
+	adapt->ts_buff_pos = 0;
+	adapt->ts_buff_len = remaining;
+
+	ssize_t r = read(adapt->dvr_fd, adapt->ts_buff + adapt->ts_buff_len, TS_BUFF_SIZE - adapt->ts_buff_len);
+	if (r < 0) {
+		if (errno == EAGAIN) {
+			return 0;
+		} else if (errno == EOVERFLOW) {
+			pom_log(POM_LOG_DEBUG "Overflow in the kernel buffer while reading MPEG packets from adapter %u. Lots of packets were missed", adapt_id);
+			// Whatever was buffered is not contiguous with what comes next
+			adapt->ts_buff_len = 0;
+			// Approximation but whole buffer is being discarded in the kernel
+			if (adapt->perf_mpeg_tot_pkts && adapt->perf_mpeg_missed_pkts) {
+				perf_item_val_inc(adapt->perf_mpeg_missed_pkts, DEMUX_BUFFER_SIZE / MPEG_TS_LEN);
+				perf_item_val_inc(adapt->perf_mpeg_tot_pkts, DEMUX_BUFFER_SIZE / MPEG_TS_LEN);
+			}
+			perf_item_val_inc(p->perf_mpeg_missed_pkts, DEMUX_BUFFER_SIZE / MPEG_TS_LEN);
+			perf_item_val_inc(p->perf_mpeg_tot_pkts, DEMUX_BUFFER_SIZE / MPEG_TS_LEN);
+			return 0;
+		} else if (errno == EINTR) {
+			pom_log(POM_LOG_DEBUG "Read interrupted by signal");
+			return -3;
+		}
+		pom_log(POM_LOG_ERR "Error while reading dvr of adapter %u", adapt_id);
+		return -2;
+	} else if (r == 0) {
+		return -3; // End of file
+	}
+
+	adapt->ts_buff_len += r;
+
+	return r;
+}
+
+/**
+ * Point buff to the next MPEG packet of MPEG_TS_LEN bytes and check it's validity.
+ * The packet stays valid until the next call for the same adapter.
  * Returns 0 on success, 1 if PUSI is set, -1 if it's and invalid packet, -2 if there was an error while reading and -3 on EOF
  */
 
-static int input_docsis_read_mpeg_frame(unsigned char *buff, struct input_priv_docsis *p, unsigned int adapt_id) {
+static int input_docsis_read_mpeg_frame(unsigned char **buff_ptr, struct input_priv_docsis *p, unsigned int adapt_id) {
 	
+		struct input_adapt_docsis *adapt = &p->adapts[adapt_id];
 
-		// Fill the mpeg buffer
-		ssize_t len = 0, r = 0;
-
-		do {
-
-			r = read(p->adapts[adapt_id].dvr_fd, buff + len, MPEG_TS_LEN - len);
-			if (r < 0) {
-				if (errno == EOVERFLOW) {
-					pom_log(POM_LOG_DEBUG "Overflow in the kernel buffer while reading MPEG packets from adapter %u. Lots of packets were missed", adapt_id);
-					len = 0;
-					r = 0;
-					// Approximation but whole buffer is being discarded in the kernel
-					if (p->adapts[adapt_id].perf_mpeg_tot_pkts && p->adapts[adapt_id].perf_mpeg_missed_pkts) {
-						perf_item_val_inc(p->adapts[adapt_id].perf_mpeg_missed_pkts, DEMUX_BUFFER_SIZE / MPEG_TS_LEN);
-						perf_item_val_inc(p->adapts[adapt_id].perf_mpeg_tot_pkts, DEMUX_BUFFER_SIZE / MPEG_TS_LEN);				
-					}
-					perf_item_val_inc(p->perf_mpeg_missed_pkts, DEMUX_BUFFER_SIZE / MPEG_TS_LEN);
-					perf_item_val_inc(p->perf_mpeg_tot_pkts, DEMUX_BUFFER_SIZE / MPEG_TS_LEN);
-					continue;
-				} else if (errno == EINTR) {
+		// Refill the buffer if it doesn't hold a whole packet anymore
+		while (adapt->ts_buff_len - adapt->ts_buff_pos < MPEG_TS_LEN) {
+
+			int res = input_docsis_fill_ts_buff(p, adapt_id);
+			if (res < 0)
+				return res;
+
+			if (res > 0)
+				continue;
+
+			// Nothing available yet, wait for the dvr
+			// Adapter threads wake up every second to check if they must exit
+			if (p->threads_stop)
+				return -3;
+			fd_set set;
+			FD_ZERO(&set);
+			FD_SET(adapt->dvr_fd, &set);
+			struct timeval tv;
+			tv.tv_sec = 1;
+			tv.tv_usec = 0;
+			if (select(adapt->dvr_fd + 1, &set, NULL, NULL, &tv) == -1) {
+				if (errno == EINTR) {
 					pom_log(POM_LOG_DEBUG "Read interrupted by signal");
 					return -3;
 				}
-				pom_log(POM_LOG_ERR "Error while reading dvr of adapter %u", adapt_id);
+				pom_log(POM_LOG_ERR "Error while waiting for the dvr of adapter %u", adapt_id);
 				return -2;
-			} else if (r == 0) {
-				return -3; // End of file
 			}
-			len += r;
-		} while (len < MPEG_TS_LEN);
+		}
 
+		unsigned char *buff = adapt->ts_buff + adapt->ts_buff_pos;
+		adapt->ts_buff_pos += MPEG_TS_LEN;
+		*buff_ptr = buff;
 
 		// Let's see if we should care about that packet
 
@@ -1007,114 +1058,39 @@ static int input_read_docsis(struct input *i, struct frame *f) {
 		return input_scan_docsis(i);
 
 
-	int adapt_id = 0; // Will store from what adapter the packet comes
-	int timeout = 0;
-
-	while (dlen == 0) {
-
-		if (i->mode == mode_docsis3) {
-			fd_set rfds;
-			struct timeval tv;
-
-			FD_ZERO(&rfds);
-			tv.tv_sec = 1;
-			tv.tv_usec = 0;
-
-			int j;
-			int max_fd = 0;
-			for (j = 0; j < p->num_adapts_open; j++) {
-				FD_SET(p->adapts[j].dvr_fd, &rfds);
-				if (p->adapts[j].dvr_fd > max_fd)
-					max_fd = p->adapts[j].dvr_fd;
-			}
+	unsigned int adapt_id = 0; // Will store from what adapter the packet comes
+	struct timeval tv;
 
-		
-			int res = select(max_fd + 1, &rfds, NULL, NULL, &tv);
-			if (res == -1) {
-				if (errno == EINTR) {
-					// Signal caught
-					return POM_OK;
-				}
-				pom_log(POM_LOG_ERR "Error on select()");
-				return POM_ERR;
-			} else if (res > 0) {
-				timeout = 0;
-				for (adapt_id = 0; adapt_id < p->num_adapts_open; adapt_id++) {
-					if (FD_ISSET(p->adapts[adapt_id].dvr_fd, &rfds)) {
-						dlen = input_read_from_adapt_docsis(i, f, adapt_id);
+	if (p->threaded) {
+		// Frames are reassembled by the adapter threads
+		dlen = input_dequeue_docsis(i, f, &adapt_id, &tv);
+		if (dlen <= 0) {
+			f->len = 0;
+			return (dlen < 0 ? POM_ERR : POM_OK);
+		}
 
-						if (!i->running)
-							return POM_OK;
+	} else {
 
-						if (dlen < 0) // Got an error
-							return POM_ERR;
+		while (dlen == 0) {
+			dlen = input_read_from_adapt_docsis(i, adapt_id);
 
-						if (dlen > 0) // Got a full packet
-							break;
-					}
-				}
-			} else {
-				timeout++;
-				if (timeout > 10) {
-					pom_log(POM_LOG_ERR "Timeout occured while waiting for data on all adaptors");
-					return POM_ERR;
-				}
+			if (p->adapts[adapt_id].eof) {
+				f->len = 0;
+				input_close(i);
+				return POM_OK;
 			}
 
-		} else if (i->mode == mode_normal || i->mode == mode_file) {
-			dlen = input_read_from_adapt_docsis(i, f, adapt_id);
-
 			if (!i->running)
 				return POM_OK;
 
 			if (dlen < 0)
 				return POM_ERR;
 		}
-		
-	}
-
-
-
-	// We have a full packet at this point
-	
-
-	// Reset f->buff before writing in it
-	int frame_len = DOCSIS_SNAPLEN + 4;
-	f->buff = (void*) (((long)f->buff_base & ~3) + 4);
-	f->bufflen = frame_len - ((long)f->buff - (long)f->buff_base);
 
-	// Temporarily put the leftovers in the frame buffer
-	if (dlen < p->adapts[adapt_id].packet_pos) {
-		int pos = dlen;
-		// Skip stuff bytes
-		while (pos < p->adapts[adapt_id].packet_pos && p->adapts[adapt_id].packet_buff[pos] == 0xff)
-			pos++;
-	
-		int remaining = p->adapts[adapt_id].packet_pos - pos;
-
-		memcpy(f->buff, p->adapts[adapt_id].packet_buff + pos, remaining);
-		p->adapts[adapt_id].packet_pos = remaining;
-
-
-		// Save arrival time of next packet
-		gettimeofday(&p->adapts[adapt_id].packet_rcvd_time, NULL);
-
-	} else {
-		p->adapts[adapt_id].packet_pos = 0;
+		// We have a full packet at this point
+		input_take_frame_docsis(i, adapt_id, dlen, &f->buff_base, &f->buff, &f->bufflen, &tv);
 	}
 
-	// Swap buffers
-	unsigned char *buff_base = f->buff_base;
-	unsigned char *buff = f->buff;
-	unsigned int bufflen = f->bufflen;
-	f->buff_base = p->adapts[adapt_id].packet_buff_base;
-	f->buff = p->adapts[adapt_id].packet_buff;
-	f->bufflen = p->adapts[adapt_id].packet_buff_len;
-
-	p->adapts[adapt_id].packet_buff_base = buff_base;
-	p->adapts[adapt_id].packet_buff = buff;
-	p->adapts[adapt_id].packet_buff_len = bufflen;
-
 
 	if (p->adapts[adapt_id].perf_docsis_pkts)
 		perf_item_val_inc(p->adapts[adapt_id].perf_docsis_pkts, 1);
@@ -1138,14 +1114,13 @@ static int input_read_docsis(struct input *i, struct frame *f) {
 	// Validate checksum
 	
 	if (PTYPE_BOOL_GETVAL(p_validate_checksum)) {
-		uint16_t crc = 0xffff, crc_len = offsetof(struct docsis_hdr, hcs);
+		uint16_t crc, crc_len = offsetof(struct docsis_hdr, hcs);
 		uint8_t *crc_buff = f->buff;
 		if (dhdr->ehdr_on)
 			crc_len += dhdr->mac_parm;
 
-		for (; crc_len; crc_len--)
-			crc = (crc >> 8) ^ crc_ccitt_table[(crc ^ (*crc_buff++)) & 0xff];
-		crc ^= 0xffff;
+		crc = checksum_crc_ccitt(0xffff, crc_buff, crc_len) ^ 0xffff;
+		crc_buff += crc_len;
 
 		if (crc != *((uint16_t*)crc_buff)) {
 			f->len = 0;
@@ -1246,10 +1221,7 @@ static int input_read_docsis(struct input *i, struct frame *f) {
 
 	}
 
-	if (i->mode == mode_file)
-		memcpy(&f->tv, &p->packet_time, sizeof(struct timeval));
-	else
-		memcpy(&f->tv, &p->adapts[adapt_id].packet_rcvd_time, sizeof(struct timeval));
+	memcpy(&f->tv, &tv, sizeof(struct timeval));
 
 	f->len = dlen;
 	f->first_layer = p->output_layer;
@@ -1261,13 +1233,13 @@ static int input_read_docsis(struct input *i, struct frame *f) {
  * Return -1 on error, lenght of DOCSIS packet or 0 if DOCSIS packet is incomplete.
  **/
 
-static int input_read_from_adapt_docsis(struct input *i, struct frame *f, unsigned int adapt_id) {
+static int input_read_from_adapt_docsis(struct input *i, unsigned int adapt_id) {
 
 	struct input_priv_docsis *p = i->input_priv;
 
 	struct input_adapt_docsis *adapt = &p->adapts[adapt_id];
 
-	unsigned char mpeg_buff[MPEG_TS_LEN];
+	unsigned char *mpeg_buff = NULL;
 
 
 	if (adapt->packet_pos == 0) { // Begining of a new packet
@@ -1309,14 +1281,14 @@ static int input_read_from_adapt_docsis(struct input *i, struct frame *f, unsign
 	}
 
 	
-	int res = input_docsis_read_mpeg_frame(mpeg_buff, p, adapt_id);
+	int res = input_docsis_read_mpeg_frame(&mpeg_buff, p, adapt_id);
 
 	if (res == -1) { // Invalid MPEG packet. Discard it
 		return POM_OK;
 	}
 
 	if (i->mode == mode_file && res == -3) { // EOF
-		input_close(i);
+		adapt->eof = 1;
 		return POM_OK;
 	}
 
@@ -1336,27 +1308,27 @@ static int input_read_from_adapt_docsis(struct input *i, struct frame *f, unsign
 			uint32_t new_tstamp, tstamp_diff;
 			memcpy(&new_tstamp, mpeg_buff + mac_start + 26, sizeof(new_tstamp));
 			new_tstamp = ntohl(new_tstamp);
-			if (new_tstamp > p->last_sync_tstamp)
-				tstamp_diff = new_tstamp - p->last_sync_tstamp;
+			if (new_tstamp > adapt->last_sync_tstamp)
+				tstamp_diff = new_tstamp - adapt->last_sync_tstamp;
 			else
-				tstamp_diff = p->last_sync_tstamp - new_tstamp;
+				tstamp_diff = adapt->last_sync_tstamp - new_tstamp;
 			// Compute in 0.01 usec
 			// A tick is 6.25usec / 64
 			tstamp_diff = tstamp_diff * 625 / 6400;
-			p->packet_time_last_sync.tv_usec += tstamp_diff;
-			if (p->packet_time_last_sync.tv_usec >= 1000000) {
-				p->packet_time_last_sync.tv_sec++;
-				p->packet_time_last_sync.tv_usec -= 1000000;
+			adapt->packet_time_last_sync.tv_usec += tstamp_diff;
+			if (adapt->packet_time_last_sync.tv_usec >= 1000000) {
+				adapt->packet_time_last_sync.tv_sec++;
+				adapt->packet_time_last_sync.tv_usec -= 1000000;
 			}
-			memcpy(&p->packet_time, &p->packet_time_last_sync, sizeof(struct timeval));
-			p->last_sync_tstamp = new_tstamp;
+			memcpy(&adapt->packet_time, &adapt->packet_time_last_sync, sizeof(struct timeval));
+			adapt->last_sync_tstamp = new_tstamp;
 
 		} else {
 			// Aproximate
-			p->packet_time.tv_usec += MPEG_XMIT_TIME;
-			if (p->packet_time.tv_usec >= 1000000) {
-				p->packet_time.tv_sec++;
-				p->packet_time.tv_usec -= 1000000;
+			adapt->packet_time.tv_usec += MPEG_XMIT_TIME;
+			if (adapt->packet_time.tv_usec >= 1000000) {
+				adapt->packet_time.tv_sec++;
+				adapt->packet_time.tv_usec -= 1000000;
 			}
 		}
 	}
@@ -1457,6 +1429,324 @@ static int input_read_from_adapt_docsis(struct input *i, struct frame *f, unsign
 
 }
 
+/**
+ * Reset the buffer pointed by buff_base before writing the frame in it.
+ * The buffer is then swapped with the one of the adapter, the leftovers of the next frame are kept in the new buffer of the adapter.
+ **/
+static void input_take_frame_docsis(struct input *i, unsigned int adapt_id, int dlen, void **buff_base, void **buff, unsigned int *bufflen, struct timeval *tv) {
+
+	struct input_priv_docsis *p = i->input_priv;
+	struct input_adapt_docsis *adapt = &p->adapts[adapt_id];
+
+	if (i->mode == mode_file)
+		memcpy(tv, &adapt->packet_time, sizeof(struct timeval));
+	else
+		memcpy(tv, &adapt->packet_rcvd_time, sizeof(struct timeval));
+
+	int frame_len = DOCSIS_SNAPLEN + 4;
+	*buff = (void*) (((long)*buff_base & ~3) + 4);
+	*bufflen = frame_len - ((long)*buff - (long)*buff_base);
+
+	// Temporarily put the leftovers in the new buffer
+	if (dlen < adapt->packet_pos) {
+		int pos = dlen;
+		// Skip stuff bytes
+		while (pos < adapt->packet_pos && adapt->packet_buff[pos] == 0xff)
+			pos++;
+
+		int remaining = adapt->packet_pos - pos;
+
+		memcpy(*buff, adapt->packet_buff + pos, remaining);
+		adapt->packet_pos = remaining;
+
+		// Save arrival time of next packet
+		gettimeofday(&adapt->packet_rcvd_time, NULL);
+
+	} else {
+		adapt->packet_pos = 0;
+	}
+
+	// Swap buffers
+	void *tmp_base = *buff_base, *tmp = *buff;
+	unsigned int tmp_len = *bufflen;
+	*buff_base = adapt->packet_buff_base;
+	*buff = adapt->packet_buff;
+	*bufflen = adapt->packet_buff_len;
+
+	adapt->packet_buff_base = tmp_base;
+	adapt->packet_buff = tmp;
+	adapt->packet_buff_len = tmp_len;
+
+}
+
+/**
+ * Open a recorded MPEG stream and check that it contains DOCSIS SYNC messages.
+ * Returns POM_OK on success and POM_ERR on failure.
+ **/
+static int input_open_file_docsis(struct input *i, unsigned int adapt_id, char *filename) {
+
+	struct input_priv_docsis *p = i->input_priv;
+	struct input_adapt_docsis *adapt = &p->adapts[adapt_id];
+
+	adapt->dvr_fd = open(filename, O_RDONLY);
+	if (adapt->dvr_fd == -1) {
+		pom_log(POM_LOG_ERR "Unable to open the file %s", filename);
+		return POM_ERR;
+	}
+
+	struct stat buff;
+	if (fstat(adapt->dvr_fd, &buff)) {
+		pom_log(POM_LOG_ERR "Unable to stat() the file %s", filename);
+		close(adapt->dvr_fd);
+		adapt->dvr_fd = -1;
+		return POM_ERR;
+	}
+	memset(&adapt->packet_time, 0, sizeof(struct timeval));
+	adapt->packet_time.tv_sec = buff.st_ctime;
+	memcpy(&adapt->packet_time_last_sync, &adapt->packet_time, sizeof(struct timeval));
+
+	// This buffer will be swapped with buffers in frame structures
+	// Need to add 4 bytes for alignment purposes
+	int frame_len = DOCSIS_SNAPLEN + 4;
+	adapt->packet_buff_base = malloc(frame_len);
+	// Recalculate correct offset for the buffer as it may have been moved to skip the docsis header
+	// We should not take the align_offset in account here as the ethernet header will align perfectly
+	adapt->packet_buff = (void*) (((long)adapt->packet_buff_base & ~3) + 4);
+	adapt->packet_buff_len = frame_len - ((long)adapt->packet_buff - (long)adapt->packet_buff_base);
+
+	adapt->ts_buff = malloc(TS_BUFF_SIZE);
+	adapt->ts_buff_pos = 0;
+	adapt->ts_buff_len = 0;
+
+	if (input_docsis_check_downstream(i, adapt_id) == POM_ERR) {
+		pom_log(POM_LOG_ERR "Could not find a SYNC packet in the file %s", filename);
+		return POM_ERR;
+	}
+
+	return POM_OK;
+}
+
+/**
+ * Allocate the frame queue of the adapter and start its thread.
+ * Returns POM_OK on success and POM_ERR on failure.
+ **/
+static int input_start_adapt_thread_docsis(struct input *i, unsigned int adapt_id) {
+
+	struct input_priv_docsis *p = i->input_priv;
+	struct input_adapt_docsis *adapt = &p->adapts[adapt_id];
+
+	adapt->queue = malloc(sizeof(struct input_frame_docsis) * DOCSIS_ADAPT_QUEUE_LEN);
+	if (!adapt->queue) {
+		pom_log(POM_LOG_ERR "Unable to allocate the frame queue of adapter %u", adapt_id);
+		return POM_ERR;
+	}
+	memset(adapt->queue, 0, sizeof(struct input_frame_docsis) * DOCSIS_ADAPT_QUEUE_LEN);
+
+	// These buffers will be swapped with buffers in frame structures
+	unsigned int j;
+	for (j = 0; j < DOCSIS_ADAPT_QUEUE_LEN; j++) {
+		adapt->queue[j].buff_base = malloc(DOCSIS_SNAPLEN + 4);
+		if (!adapt->queue[j].buff_base) {
+			pom_log(POM_LOG_ERR "Unable to allocate the frame queue of adapter %u", adapt_id);
+			return POM_ERR;
+		}
+	}
+	adapt->queue_start = 0;
+	adapt->queue_count = 0;
+	adapt->input = i;
+
+	adapt->thread_state = DOCSIS_THREAD_RUNNING;
+	if (pthread_create(&adapt->thread, NULL, input_adapt_thread_docsis, adapt)) {
+		adapt->thread_state = DOCSIS_THREAD_NONE;
+		pom_log(POM_LOG_ERR "Unable to create the thread of adapter %u", adapt_id);
+		return POM_ERR;
+	}
+
+	return POM_OK;
+}
+
+/**
+ * Read the MPEG packets of one adapter, reassemble the DOCSIS frames and queue them.
+ * Blocks when the queue is full, the kernel buffer absorbs the stream in the meantime.
+ **/
+static void *input_adapt_thread_docsis(void *arg) {
+
+	struct input_adapt_docsis *adapt = arg;
+	struct input *i = adapt->input;
+	struct input_priv_docsis *p = i->input_priv;
+	unsigned int adapt_id = adapt - p->adapts;
+
+	int state = DOCSIS_THREAD_DONE;
+
+	while (!p->threads_stop) {
+
+		int dlen = input_read_from_adapt_docsis(i, adapt_id);
+
+		if (dlen < 0) {
+			if (!p->threads_stop)
+				state = DOCSIS_THREAD_ERROR;
+			break;
+		}
+
+		if (adapt->eof)
+			break;
+
+		if (!dlen)
+			continue;
+
+		pthread_mutex_lock(&p->queue_lock);
+		while (adapt->queue_count >= DOCSIS_ADAPT_QUEUE_LEN && !p->threads_stop)
+			pthread_cond_wait(&p->queue_space_cond, &p->queue_lock);
+		unsigned int pos = (adapt->queue_start + adapt->queue_count) % DOCSIS_ADAPT_QUEUE_LEN;
+		pthread_mutex_unlock(&p->queue_lock);
+
+		if (p->threads_stop)
+			break;
+
+		// The slot is not visible to the reader until the count is increased
+		struct input_frame_docsis *slot = &adapt->queue[pos];
+		input_take_frame_docsis(i, adapt_id, dlen, &slot->buff_base, &slot->buff, &slot->bufflen, &slot->tv);
+		slot->len = dlen;
+
+		pthread_mutex_lock(&p->queue_lock);
+		adapt->queue_count++;
+		pthread_cond_signal(&p->queue_cond);
+		pthread_mutex_unlock(&p->queue_lock);
+	}
+
+	pthread_mutex_lock(&p->queue_lock);
+	adapt->thread_state = state;
+	pthread_cond_broadcast(&p->queue_cond);
+	pthread_mutex_unlock(&p->queue_lock);
+
+	return NULL;
+}
+
+/**
+ * Merge the frames of the adapter threads by arrival time.
+ * The oldest frame is processed once every running adapter has queued a frame.
+ * With live streams, it's processed anyway after DOCSIS_MERGE_DELAY so a quiet adapter doesn't stall the others.
+ * Returns the length of the frame, 0 if none is available yet and POM_ERR on failure.
+ **/
+static int input_dequeue_docsis(struct input *i, struct frame *f, unsigned int *adapt_id, struct timeval *tv) {
+
+	struct input_priv_docsis *p = i->input_priv;
+
+	struct timeval now, limit;
+	gettimeofday(&now, NULL);
+	struct timespec deadline;
+	deadline.tv_sec = now.tv_sec + DOCSIS_QUEUE_WAIT / 1000;
+	deadline.tv_nsec = (now.tv_usec + (DOCSIS_QUEUE_WAIT % 1000) * 1000) * 1000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&p->queue_lock);
+
+	struct input_adapt_docsis *oldest;
+
+	while (1) {
+
+		oldest = NULL;
+		int running = 0, waiting = 0, j;
+
+		for (j = 0; j < p->num_adapts_open; j++) {
+			struct input_adapt_docsis *adapt = &p->adapts[j];
+
+			if (adapt->thread_state == DOCSIS_THREAD_ERROR) {
+				pthread_mutex_unlock(&p->queue_lock);
+				pom_log(POM_LOG_ERR "Error while reading from adapter %u", j);
+				return POM_ERR;
+			}
+
+			if (adapt->thread_state == DOCSIS_THREAD_RUNNING)
+				running++;
+
+			if (!adapt->queue_count) {
+				if (adapt->thread_state == DOCSIS_THREAD_RUNNING)
+					waiting = 1;
+				continue;
+			}
+
+			if (!oldest || timercmp(&adapt->queue[adapt->queue_start].tv, &oldest->queue[oldest->queue_start].tv, <))
+				oldest = adapt;
+		}
+
+		if (oldest) {
+			if (!waiting)
+				break;
+
+			if (i->mode != mode_file) {
+				struct timeval delay = { 0, DOCSIS_MERGE_DELAY };
+				timeradd(&oldest->queue[oldest->queue_start].tv, &delay, &limit);
+				gettimeofday(&now, NULL);
+				if (!timercmp(&now, &limit, <))
+					break;
+
+				// Wake up when the frame has waited long enough
+				if (limit.tv_sec < deadline.tv_sec || (limit.tv_sec == deadline.tv_sec && limit.tv_usec * 1000 < deadline.tv_nsec)) {
+					deadline.tv_sec = limit.tv_sec;
+					deadline.tv_nsec = limit.tv_usec * 1000;
+				}
+			}
+
+		} else if (!running) {
+			// All the files were read
+			pthread_mutex_unlock(&p->queue_lock);
+			input_close(i);
+			return 0;
+		}
+
+		if (p->threads_stop) {
+			pthread_mutex_unlock(&p->queue_lock);
+			return 0;
+		}
+
+		if (pthread_cond_timedwait(&p->queue_cond, &p->queue_lock, &deadline) == ETIMEDOUT) {
+			if (oldest)
+				continue;
+
+			pthread_mutex_unlock(&p->queue_lock);
+
+			p->queue_timeouts++;
+			if (p->queue_timeouts > DOCSIS_QUEUE_TIMEOUTS) {
+				pom_log(POM_LOG_ERR "Timeout occured while waiting for data on all adaptors");
+				return POM_ERR;
+			}
+
+			// Let the input thread check if it must stop
+			return 0;
+		}
+	}
+
+	p->queue_timeouts = 0;
+
+	struct input_frame_docsis *slot = &oldest->queue[oldest->queue_start];
+
+	// Swap buffers
+	void *buff_base = f->buff_base, *buff = f->buff;
+	unsigned int bufflen = f->bufflen;
+	f->buff_base = slot->buff_base;
+	f->buff = slot->buff;
+	f->bufflen = slot->bufflen;
+	slot->buff_base = buff_base;
+	slot->buff = buff;
+	slot->bufflen = bufflen;
+
+	int dlen = slot->len;
+	memcpy(tv, &slot->tv, sizeof(struct timeval));
+	*adapt_id = oldest - p->adapts;
+
+	oldest->queue_start = (oldest->queue_start + 1) % DOCSIS_ADAPT_QUEUE_LEN;
+	oldest->queue_count--;
+	pthread_cond_broadcast(&p->queue_space_cond);
+
+	pthread_mutex_unlock(&p->queue_lock);
+
+	return dlen;
+}
+
 /**
  * Returns POM_OK on success and POM_ERR on failure.
  **/
@@ -1466,6 +1756,38 @@ static int input_close_docsis(struct input *i) {
 	if (!p)
 		return POM_ERR;
 
+	int j;
+
+	if (p->threaded) {
+		pthread_mutex_lock(&p->queue_lock);
+		p->threads_stop = 1;
+		pthread_cond_broadcast(&p->queue_cond);
+		pthread_cond_broadcast(&p->queue_space_cond);
+		pthread_mutex_unlock(&p->queue_lock);
+
+		for (j = 0; j < DOCSIS_MAX_ADAPT; j++) {
+			struct input_adapt_docsis *adapt = &p->adapts[j];
+			if (adapt->thread_state != DOCSIS_THREAD_NONE) {
+				pthread_join(adapt->thread, NULL);
+				adapt->thread_state = DOCSIS_THREAD_NONE;
+			}
+
+			if (adapt->queue) {
+				unsigned int k;
+				for (k = 0; k < DOCSIS_ADAPT_QUEUE_LEN; k++)
+					free(adapt->queue[k].buff_base);
+				free(adapt->queue);
+				adapt->queue = NULL;
+			}
+			adapt->queue_start = 0;
+			adapt->queue_count = 0;
+		}
+
+		p->threaded = 0;
+		p->threads_stop = 0;
+		p->queue_timeouts = 0;
+	}
+
 
 	if (i->mode == mode_scan) {
 		pom_log(POM_LOG_WARN "No DOCSIS stream found");
@@ -1587,7 +1909,6 @@ static int input_close_docsis(struct input *i) {
 
 	}
 
-	int j;
 	for (j = 0; j < DOCSIS_MAX_ADAPT; j++) {
 		if (p->adapts[j].dvr_fd != -1) {
 			close(p->adapts[j].dvr_fd);
@@ -1599,8 +1920,16 @@ static int input_close_docsis(struct input *i) {
 			p->adapts[j].packet_buff_base = NULL;
 		}
 
-		// Reset temporary buffer
+		if (p->adapts[j].ts_buff) {
+			free(p->adapts[j].ts_buff);
+			p->adapts[j].ts_buff = NULL;
+		}
+
+		// Reset temporary buffers
 		p->adapts[j].packet_pos = 0;
+		p->adapts[j].ts_buff_pos = 0;
+		p->adapts[j].ts_buff_len = 0;
+		p->adapts[j].eof = 0;
 	}
 
 
@@ -1759,6 +2088,9 @@ static int input_parse_mdd_docsis(struct input *i, unsigned int adapt_id, unsign
 							return POM_ERR;
 						}
 
+						if (input_start_adapt_thread_docsis(i, adapt_id) == POM_ERR)
+							return POM_ERR;
+
 						pom_log(POM_LOG_INFO "New DOCSIS stream found and aquired on %uHz (%uQAM)%s on adapter %u", freq, (adapt_modulation == QAM_64 ? 64 : 256), (pri_capable ? ", primary capable" : ""), adapt_id);
 					} else {
 						// Print info
@@ -45,6 +45,23 @@
 /// Transmition time of a MPEG frame in usec assuming QAM256 and 6952000 sym/sec
 #define MPEG_XMIT_TIME 188 * 1000000 / 6952000
 
+/// Number of reassembled frames each adapter thread can queue
+#define DOCSIS_ADAPT_QUEUE_LEN 512
+
+/// Maximum time in usec a frame waits for frames of the other adapters before being processed
+#define DOCSIS_MERGE_DELAY 50000
+
+/// Time in msec the input waits for frames of the adapter threads before returning
+#define DOCSIS_QUEUE_WAIT 100
+
+/// Number of consecutive waits without any frame before giving up
+#define DOCSIS_QUEUE_TIMEOUTS 100
+
+#define DOCSIS_THREAD_NONE	0	///< The adapter has no thread
+#define DOCSIS_THREAD_RUNNING	1	///< The adapter thread is reading
+#define DOCSIS_THREAD_DONE	2	///< The adapter thread reached the end of its file
+#define DOCSIS_THREAD_ERROR	3	///< The adapter thread stopped on an error
+
 #define DOCSIS_WARN_ENCRYPTED	0x1	///< Was encrypted traffic found and a warning issued 
 #define DOCSIS_WARN_DOCSIS3	0x2	///< DOCSIS 3 stream detected
 
@@ -55,6 +72,17 @@ struct input_adapt_reg_docsis {
 
 };
 
+/// A DOCSIS frame reassembled by an adapter thread
+struct input_frame_docsis {
+
+	void *buff_base; ///< Buffer swapped with the one of the frame
+	void *buff; ///< Aligned buffer
+	unsigned int bufflen; ///< Length of the aligned buffer
+	unsigned int len; ///< Length of the DOCSIS frame
+	struct timeval tv; ///< Arrival time of the frame
+
+};
+
 struct input_adapt_docsis {
 
 	char *frontend_name; ///< Name of the frontend device
@@ -70,6 +98,20 @@ struct input_adapt_docsis {
 	unsigned char *packet_buff; ///< Aligned buffer for a packet
 	unsigned int packet_buff_len; ///< Length of the buffer
 	struct timeval packet_rcvd_time; ///< Time when the packet arrived
+	unsigned char *ts_buff; ///< MPEG packets read in bulk from the dvr
+	unsigned int ts_buff_pos; ///< Position of the next MPEG packet in the buffer
+	unsigned int ts_buff_len; ///< Amount of data in the buffer
+	int eof; ///< Set when the end of the file was reached in file mode
+
+	// variables used in mode file to compute packet arrival time
+	uint32_t last_sync_tstamp;
+	struct timeval packet_time, packet_time_last_sync;
+
+	struct input *input; ///< Input the adapter belongs to
+	pthread_t thread; ///< Thread reading and reassembling the frames of the adapter
+	int thread_state; ///< One of DOCSIS_THREAD_*
+	struct input_frame_docsis *queue; ///< Frames reassembled by the thread
+	unsigned int queue_start, queue_count; ///< Position of the oldest frame and number of frames in the queue
 
 	struct perf_item *perf_mpeg_tot_pkts; ///< Total MPEG packet read
 	struct perf_item *perf_mpeg_missed_pkts; ///< Number of missed MPEG packets
@@ -102,9 +144,13 @@ struct input_priv_docsis {
 	unsigned int scan_srate; ///< Symbol rate to use
 	fe_modulation_t scan_modulation; ///< Modulation to use
 
-	// variables used in mode file to compute packet arrival time
-	uint32_t last_sync_tstamp;
-	struct timeval packet_time, packet_time_last_sync;
+	// adapter threads
+	int threaded; ///< Set when each adapter is read by its own thread
+	int threads_stop; ///< Ask the adapter threads to exit
+	pthread_mutex_t queue_lock; ///< Protects the frame queues and the thread states
+	pthread_cond_t queue_cond; ///< Signaled when a frame is queued or when a thread exits
+	pthread_cond_t queue_space_cond; ///< Signaled when a frame is dequeued
+	unsigned int queue_timeouts; ///< Consecutive waits without any frame
 
 	// stats stuff
 	struct perf_item *perf_docsis_tot_pkts; ///< Total number of DOCSIS packet read
@@ -138,7 +184,22 @@ static int input_scan_docsis(struct input *i);
 static int input_read_docsis(struct input *i, struct frame *f);
 
 /// Read the next mpeg packet from an adapater.
-static int input_read_from_adapt_docsis(struct input *i, struct frame *f, unsigned int adapt_id);
+static int input_read_from_adapt_docsis(struct input *i, unsigned int adapt_id);
+
+/// Move a reassembled frame out of the buffer of an adapter.
+static void input_take_frame_docsis(struct input *i, unsigned int adapt_id, int dlen, void **buff_base, void **buff, unsigned int *bufflen, struct timeval *tv);
+
+/// Open a file of MPEG packets as an adapter.
+static int input_open_file_docsis(struct input *i, unsigned int adapt_id, char *filename);
+
+/// Start the thread reading from an adapter.
+static int input_start_adapt_thread_docsis(struct input *i, unsigned int adapt_id);
+
+/// Read and reassemble the frames of an adapter.
+static void *input_adapt_thread_docsis(void *arg);
+
+/// Get the oldest frame reassembled by the adapter threads.
+static int input_dequeue_docsis(struct input *i, struct frame *f, unsigned int *adapt_id, struct timeval *tv);
 
 /// Close the cable interface.
 static int input_close_docsis(struct input *i);
@@ -150,7 +211,10 @@ static int input_cleanup_docsis(struct input *i);
 static int input_unregister_docsis(struct input_reg *r);
 
 /// Reads an MPEG packet from the cable interface.
-static int input_docsis_read_mpeg_frame(unsigned char *buff, struct input_priv_docsis *p, unsigned int adapt_id);
+static int input_docsis_read_mpeg_frame(unsigned char **buff, struct input_priv_docsis *p, unsigned int adapt_id);
+
+/// Refill the MPEG packet buffer of an adapter.
+static int input_docsis_fill_ts_buff(struct input_priv_docsis *p, unsigned int adapt_id);
 
 /// Tune to the given frequency, symbole rate and modulation.
 static int input_docsis_tune(struct input_priv_docsis *p, uint32_t frequency, uint32_t symboleRate, fe_modulation_t modulation, unsigned int adapt_id);
@@ -123,7 +123,7 @@ static int input_open_pcap(struct input *i) {
 
 	if (i->mode == mode_file) {
 		char *filename = PTYPE_STRING_GETVAL(p_filename);
-		p->p = pcap_open_offline(filename, errbuf);
+		p->p = input_open_offline_pcap(filename, errbuf);
 		if (!p->p) {
 			pom_log(POM_LOG_ERR "Error opening file %s for reading", filename);
 			return POM_ERR;
@@ -169,7 +169,7 @@ static int input_open_pcap(struct input *i) {
 			strcat(filename, "/");
 		strcat(filename, p->dir_cur_file->filename);
 
-		p->p = pcap_open_offline(filename, errbuf);
+		p->p = input_open_offline_pcap(filename, errbuf);
 		if (!p->p) {
 			pom_log(POM_LOG_ERR "Error opening file %s for reading", filename);
 			return POM_ERR;
@@ -438,7 +438,14 @@ static int input_browse_dir_pcap(struct input_priv_pcap *priv) {
 		char *ext = PTYPE_STRING_GETVAL(p_dir_file_ext);
 		int ext_len = strlen(ext);
 		int fname_len = strlen(buf->d_name);
-		if (ext_len < fname_len && memcmp(buf->d_name + fname_len - ext_len, ext, ext_len) == 0) {
+		int match = (ext_len < fname_len && memcmp(buf->d_name + fname_len - ext_len, ext, ext_len) == 0);
+#ifdef HAVE_ZLIB
+		// Also pick up the compressed files written by target_pcap
+		int cext_len = strlen(PCAP_COMPRESS_EXT);
+		if (!match && ext_len + cext_len < fname_len && !strcmp(buf->d_name + fname_len - cext_len, PCAP_COMPRESS_EXT))
+			match = !memcmp(buf->d_name + fname_len - cext_len - ext_len, ext, ext_len);
+#endif
+		if (match) {
 			struct input_priv_file_pcap *tmp = priv->dir_files;
 			int found = 0;
 			while (tmp) {
@@ -465,7 +472,7 @@ static int input_browse_dir_pcap(struct input_priv_pcap *priv) {
 
 
 				// Get the time of the first packet
-				pcap_t *p = pcap_open_offline(fname, errbuf);
+				pcap_t *p = input_open_offline_pcap(fname, errbuf);
 				if (!p) {
 					cur->next = priv->dir_files;
 					priv->dir_files = cur; // Add at the begning in order not to process it again
@@ -558,7 +565,7 @@ static int input_open_next_file_pcap(struct input_priv_pcap *p) {
 
 		char errbuf[PCAP_ERRBUF_SIZE + 1];
 		errbuf[0] = 0;
-		p->p = pcap_open_offline(filename, errbuf);
+		p->p = input_open_offline_pcap(filename, errbuf);
 		if (!p->p) {
 			pom_log(POM_LOG_ERR "Error opening file %s for reading. Skipping", filename);
 			continue;
@@ -602,3 +609,25 @@ static int input_update_dropped_pcap(struct perf_item *itm, void *priv) {
 
 	return POM_OK;
 }
+
+/**
+ * Open a pcap file for reading, uncompressing it if needed.
+ */
+static pcap_t *input_open_offline_pcap(char *filename, char *errbuf) {
+
+#ifdef HAVE_ZLIB
+	if (pcap_compress_is_compressed(filename)) {
+		FILE *f = pcap_uncompress_fopen(filename);
+		if (!f) {
+			snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s: %s", filename, strerror(errno));
+			return NULL;
+		}
+		pcap_t *p = pcap_fopen_offline(f, errbuf);
+		if (!p)
+			fclose(f);
+		return p;
+	}
+#endif
+
+	return pcap_open_offline(filename, errbuf);
+}
@@ -28,6 +28,7 @@
 
 #include "input.h"
 #include "perf.h"
+#include "pcap_compress.h"
 
 #include <pcap.h>
 
@@ -68,6 +69,7 @@ static int input_interrupt_pcap(struct input *i);
 static int input_browse_dir_pcap(struct input_priv_pcap *priv);
 static int input_open_next_file_pcap(struct input_priv_pcap *p);
 static int input_update_dropped_pcap(struct perf_item *itm, void *priv);
+static pcap_t *input_open_offline_pcap(char *filename, char *errbuf);
 
 #endif
 
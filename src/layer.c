@@ -18,7 +18,7 @@
  *
  */
 
-#include <regex.h>
+#include <ctype.h>
 
 #include "common.h"
 #include "layer.h"
@@ -28,10 +28,12 @@
 static struct layer** pool;
 static int poolsize, poolused;
 
-static regex_t parse_regex;
-
 static struct layer_field_pool field_pool[MAX_MATCH];
 
+static struct layer_template_cache_entry template_cache[LAYER_TEMPLATE_CACHE_SIZE];
+static unsigned int template_cache_next; ///< Entry replaced when the cache is full
+static pthread_mutex_t template_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * @return POM_OK on success, POM_ERR on failure.
  */
@@ -41,13 +43,6 @@ int layer_init() {
 	poolused = 0;
 	poolsize = 0;
 
-	char *exp = "\\${[a-zA-Z0-9]*\\.[a-zA-Z0-9%]*}";
-
-	if (regcomp(&parse_regex, exp, REG_ICASE)) {
-		pom_log(POM_LOG_ERR "Unable to compile regex for layer parsing");
-		return POM_ERR;
-	}
-
 	return POM_OK;
 
 }
@@ -109,7 +104,12 @@ int layer_cleanup() {
 		}
 	}
 
-	regfree(&parse_regex);
+	for (i = 0; i < LAYER_TEMPLATE_CACHE_SIZE; i++) {
+		free(template_cache[i].expr);
+		layer_template_cleanup(template_cache[i].tmpl);
+	}
+	memset(template_cache, 0, sizeof(template_cache));
+	template_cache_next = 0;
 
 	return POM_OK;
 
@@ -174,103 +174,285 @@ int layer_field_pool_get(struct layer* l) {
 }
 
 /**
- * @param l List of layers to use for replacing parsed values
+ * Add a token to a template.
+ * @param tmpl Template to add the token to
+ * @param kind LAYER_TEMPLATE_* kind of the token
+ * @param str Literal text or name of the layer
+ * @param len Length of str
+ * @param field_name Name of the field or strftime() format, NULL for literals
+ * @param field_len Length of field_name
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+static int layer_template_add_token(struct layer_template *tmpl, unsigned int kind, char *str, size_t len, char *field_name, size_t field_len) {
+
+	struct layer_template_token *tokens = realloc(tmpl->tokens, sizeof(struct layer_template_token) * (tmpl->count + 1));
+	if (!tokens)
+		return POM_ERR;
+	tmpl->tokens = tokens;
+
+	struct layer_template_token *tok = &tmpl->tokens[tmpl->count];
+	memset(tok, 0, sizeof(struct layer_template_token));
+	tok->kind = kind;
+	tok->layer_type = -1;
+	tok->field_id = -1;
+
+	tok->str = malloc(len + 1);
+	if (!tok->str)
+		return POM_ERR;
+	memcpy(tok->str, str, len);
+	tok->str[len] = 0;
+	tok->len = len;
+
+	if (field_name) {
+		tok->field_name = malloc(field_len + 1);
+		if (!tok->field_name) {
+			free(tok->str);
+			return POM_ERR;
+		}
+		memcpy(tok->field_name, field_name, field_len);
+		tok->field_name[field_len] = 0;
+	}
+
+	tmpl->count++;
+
+	return POM_OK;
+}
+
+/**
+ * Find the layer type and the field id of a field token.
+ * The layer may not be registered yet in which case it will be tried again later.
+ * @param tok Token to resolve
+ * @return POM_OK if it was resolved, POM_ERR if not.
+ */
+static int layer_template_resolve(struct layer_template_token *tok) {
+
+	if (tok->layer_type != -1)
+		return (tok->field_id != -1 ? POM_OK : POM_ERR);
+
+	int type = match_get_type(tok->str);
+	if (type == POM_ERR)
+		return POM_ERR;
+	tok->layer_type = type;
+
+	int i;
+	for (i = 0; i < MAX_LAYER_FIELDS; i++) {
+		struct match_field_reg *field = match_get_field(type, i);
+		if (!field)
+			break;
+		if (!strcmp(field->name, tok->field_name)) {
+			tok->field_id = i;
+			return POM_OK;
+		}
+	}
+
+	return POM_ERR;
+}
+
+/**
+ * Variables have the form ${layer.field} or ${time.format} where format is given to strftime().
+ * @param expr Expression to compile
+ * @return The template or NULL on failure.
+ */
+struct layer_template *layer_template_compile(char *expr) {
+
+	struct layer_template *tmpl = malloc(sizeof(struct layer_template));
+	if (!tmpl) {
+		pom_log(POM_LOG_ERR "Not enough memory to allocate a template");
+		return NULL;
+	}
+	memset(tmpl, 0, sizeof(struct layer_template));
+
+	char *literal = expr, *cur = expr;
+	while ((cur = strstr(cur, "${"))) {
+
+		char *name = cur + 2, *end = name;
+		while (isalnum(*end))
+			end++;
+		if (*end != '.') {
+			cur++;
+			continue;
+		}
+
+		char *field = end + 1;
+		end = field;
+		while (isalnum(*end) || *end == '%')
+			end++;
+		if (*end != '}') {
+			cur++;
+			continue;
+		}
+
+		if (cur > literal && layer_template_add_token(tmpl, LAYER_TEMPLATE_LITERAL, literal, cur - literal, NULL, 0) == POM_ERR)
+			goto err;
+
+		unsigned int kind = LAYER_TEMPLATE_FIELD;
+		if (field - name - 1 == strlen("time") && !strncmp(name, "time", strlen("time")))
+			kind = LAYER_TEMPLATE_TIME;
+
+		if (layer_template_add_token(tmpl, kind, name, field - name - 1, field, end - field) == POM_ERR)
+			goto err;
+
+		if (kind == LAYER_TEMPLATE_FIELD)
+			layer_template_resolve(&tmpl->tokens[tmpl->count - 1]);
+
+		literal = end + 1;
+		cur = literal;
+	}
+
+	if (*literal && layer_template_add_token(tmpl, LAYER_TEMPLATE_LITERAL, literal, strlen(literal), NULL, 0) == POM_ERR)
+		goto err;
+
+	return tmpl;
+
+err:
+	pom_log(POM_LOG_ERR "Not enough memory to compile template %s", expr);
+	layer_template_cleanup(tmpl);
+	return NULL;
+}
+
+static void layer_template_append(char *buff, size_t size, size_t *pos, char *str, size_t len) {
+
+	if (*pos + len >= size)
+		len = size - *pos - 1;
+
+	memcpy(buff + *pos, str, len);
+	*pos += len;
+}
+
+/**
+ * Values which are not found are replaced by their name without the enclosing ${}.
+ * @param tmpl Template to render
+ * @param l List of layers to use for replacing the fields
  * @param tv Time of the packet
- * @param expr Expression to parse
  * @param buff Preallocated buffer to save the result
  * @param size Size of the preallocated buffer
  * @return POM_OK on success, POM_ERR on failure.
  */
-int layer_field_parse(struct layer *l, struct timeval *tv, char *expr, char *buff, size_t size) {
+int layer_template_render(struct layer_template *tmpl, struct layer *l, struct timeval *tv, char *buff, size_t size) {
 
-	regmatch_t pmatch;
+	if (!size)
+		return POM_ERR;
 
-	if (regexec(&parse_regex, expr, 1, &pmatch, 0)) {
-		strncpy(buff, expr, size);
-		return POM_OK;
-	}
+	size_t pos = 0;
 
-	memset(buff, 0, size);
+	unsigned int i;
+	for (i = 0; i < tmpl->count; i++) {
+		struct layer_template_token *tok = &tmpl->tokens[i];
 
-	int pos = 0;
-	do {
-		if (size < strlen(buff) + pmatch.rm_so)
-			break;
-		strncat(buff, expr + pos, pmatch.rm_so);
-		size_t len = pmatch.rm_eo - pmatch.rm_so;
-		char *expr_start = expr + pos + pmatch.rm_so + 2;
-		char *match = malloc(len);
-		memset(match, 0, len);
-		strncpy(match, expr_start, len - 3);
-		char *expr_sep = strchr(match, '.');
-		*expr_sep = 0;
-		expr_sep++;
-
-		int found = 0;
-
-		if (tv && !strcmp(match, "time")) {
+		if (tok->kind == LAYER_TEMPLATE_LITERAL) {
+			layer_template_append(buff, size, &pos, tok->str, tok->len);
+			continue;
+		}
+
+		if (tok->kind == LAYER_TEMPLATE_TIME && tv) {
 			struct tm tmp;
 			localtime_r((time_t*)&tv->tv_sec, &tmp);
 			char outstr[64];
-			memset(outstr, 0, sizeof(outstr));
-			if (strftime(outstr, sizeof(outstr) - 1, expr_sep, &tmp)) {
-
-				char *slash = NULL;
-				while ((slash = strchr(outstr, '/')))
+			size_t len = strftime(outstr, sizeof(outstr), tok->field_name, &tmp);
+			if (len) {
+				char *slash = outstr;
+				while ((slash = strchr(slash, '/')))
 					*slash = '_';
-
-				strncat(buff, outstr, size - strlen(buff) - 1);
-
-				found = 1;
-			
+				layer_template_append(buff, size, &pos, outstr, len);
+				continue;
 			}
 
+		} else if (tok->kind == LAYER_TEMPLATE_FIELD && layer_template_resolve(tok) == POM_OK) {
+			struct layer *tmpl_l;
+			for (tmpl_l = l; tmpl_l && tmpl_l->type != tok->layer_type; tmpl_l = tmpl_l->next);
 
-		} else {
-		
-			struct layer *tmpl = l;
-			while (tmpl) {
-				if (!strcmp(match, match_get_name(tmpl->type))) {
-					int i;
-					for (i = 0; i < MAX_LAYER_FIELDS; i++) {
-						struct match_field_reg *field = match_get_field(tmpl->type, i);
-						if (!field)
-							break;
-						if (!strcmp(field->name, expr_sep)) {
-							char vbuff[1024];
-							memset(vbuff, 0, sizeof(vbuff));
-							ptype_print_val(tmpl->fields[i], vbuff, sizeof(vbuff) - 1);
-							pom_log(POM_LOG_TSHOOT "Matched %s.%s -> %s", match, expr_sep, vbuff);
-							found = 1;
-							if (size < strlen(buff) + strlen(vbuff))
-								break;
-							strncat(buff, vbuff, size - strlen(buff) - 1);
-							break;
-						}
-					}
-					break;
-				}
-				tmpl = tmpl->next;
+			if (tmpl_l && tmpl_l->fields[tok->field_id]) {
+				char vbuff[1024];
+				memset(vbuff, 0, sizeof(vbuff));
+				ptype_print_val(tmpl_l->fields[tok->field_id], vbuff, sizeof(vbuff) - 1);
+				layer_template_append(buff, size, &pos, vbuff, strlen(vbuff));
+				continue;
 			}
 		}
 
-		if (!found) {
-			if (strlen(buff) + strlen(match) + strlen(expr_sep) + 1 < size) {
-				strcat(buff, match);
-				strcat(buff, ".");
-				strcat(buff, expr_sep);
-			}
-		}
+		// Not found, print its name instead
+		layer_template_append(buff, size, &pos, tok->str, tok->len);
+		layer_template_append(buff, size, &pos, ".", 1);
+		layer_template_append(buff, size, &pos, tok->field_name, strlen(tok->field_name));
+	}
 
-		free(match);
-		pos += pmatch.rm_eo;
-	} while (!regexec(&parse_regex, expr + pos, 1, &pmatch, 0));
-	
-	if (size > strlen(buff) + strlen(expr + pos))
-		strcat(buff, expr + pos);
+	buff[pos] = 0;
 
 	return POM_OK;
+}
+
+/**
+ * @param tmpl Template to cleanup
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int layer_template_cleanup(struct layer_template *tmpl) {
+
+	if (!tmpl)
+		return POM_OK;
 
+	unsigned int i;
+	for (i = 0; i < tmpl->count; i++) {
+		free(tmpl->tokens[i].str);
+		free(tmpl->tokens[i].field_name);
+	}
+	free(tmpl->tokens);
+	free(tmpl);
+
+	return POM_OK;
 }
 
+/**
+ * Targets which use the same expression for many packets should compile it once with layer_template_compile() instead.
+ * The last expressions parsed are kept compiled so they are not parsed again.
+ * @param l List of layers to use for replacing parsed values
+ * @param tv Time of the packet
+ * @param expr Expression to parse
+ * @param buff Preallocated buffer to save the result
+ * @param size Size of the preallocated buffer
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int layer_field_parse(struct layer *l, struct timeval *tv, char *expr, char *buff, size_t size) {
+
+	pthread_mutex_lock(&template_cache_lock);
+
+	struct layer_template_cache_entry *entry = NULL;
+	unsigned int i;
+	for (i = 0; i < LAYER_TEMPLATE_CACHE_SIZE && template_cache[i].expr; i++) {
+		if (!strcmp(template_cache[i].expr, expr)) {
+			entry = &template_cache[i];
+			break;
+		}
+	}
+
+	if (!entry) {
+		struct layer_template *tmpl = layer_template_compile(expr);
+		if (!tmpl) {
+			pthread_mutex_unlock(&template_cache_lock);
+			return POM_ERR;
+		}
+
+		char *expr_copy = strdup(expr);
+		if (!expr_copy) {
+			// Render it without keeping it
+			int res = layer_template_render(tmpl, l, tv, buff, size);
+			pthread_mutex_unlock(&template_cache_lock);
+			layer_template_cleanup(tmpl);
+			return res;
+		}
+
+		entry = &template_cache[template_cache_next];
+		template_cache_next = (template_cache_next + 1) % LAYER_TEMPLATE_CACHE_SIZE;
+		free(entry->expr);
+		layer_template_cleanup(entry->tmpl);
+		entry->expr = expr_copy;
+		entry->tmpl = tmpl;
+	}
+
+	// Rendering may resolve the fields of the template
+	int res = layer_template_render(entry->tmpl, l, tv, buff, size);
 
+	pthread_mutex_unlock(&template_cache_lock);
+
+	return res;
+
+}
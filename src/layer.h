@@ -62,6 +62,38 @@ struct layer {
 };
 
 
+/// Literal text of a template
+#define LAYER_TEMPLATE_LITERAL	0
+/// Time of the packet formatted by strftime()
+#define LAYER_TEMPLATE_TIME	1
+/// Value of a field of a layer
+#define LAYER_TEMPLATE_FIELD	2
+
+/// Part of a precompiled template
+struct layer_template_token {
+	unsigned int kind; ///< LAYER_TEMPLATE_* kind of token
+	char *str; ///< Literal text or name of the layer
+	size_t len; ///< Length of str
+	char *field_name; ///< Name of the field or strftime() format
+	int layer_type; ///< Type of the layer or -1 if it isn't registered yet
+	int field_id; ///< Index of the field in the layer or -1 if it wasn't found
+};
+
+/// Expression parsed once so it can be rendered for many packets
+struct layer_template {
+	unsigned int count; ///< Number of tokens
+	struct layer_template_token *tokens; ///< Tokens of the expression
+};
+
+/// Number of expressions kept compiled by layer_field_parse()
+#define LAYER_TEMPLATE_CACHE_SIZE 16
+
+/// Expression compiled by layer_field_parse()
+struct layer_template_cache_entry {
+	char *expr; ///< Expression which was compiled
+	struct layer_template *tmpl; ///< Its template
+};
+
 /// info of a single frame
 
 struct frame {
@@ -99,5 +131,14 @@ int layer_cleanup();
 /// Parse the provided expression and save it into the buffer
 int layer_field_parse(struct layer *l, struct timeval *tv, char *expr, char *buff, size_t size);
 
+/// Parse an expression once so it can be rendered for many packets
+struct layer_template *layer_template_compile(char *expr);
+
+/// Replace the variables of a template and save the result into the buffer
+int layer_template_render(struct layer_template *tmpl, struct layer *l, struct timeval *tv, char *buff, size_t size);
+
+/// Cleanup a template
+int layer_template_cleanup(struct layer_template *tmpl);
+
 /*@}*/
 #endif
@@ -27,6 +27,10 @@
 #include "mgmtsrv.h"
 #include "ptype.h"
 #include "datastore.h"
+#include "benchmark.h"
+#include "checksum.h"
+#include "filewriter.h"
+#include "eventloop.h"
 
 #ifdef USE_XMLRPC
 #include "xmlrpcsrv.h"
@@ -78,6 +82,14 @@ static pthread_t input_thread;
 
 static int finish = 0, sighup = 0;
 
+static int disable_mgmtsrv = 0;
+#ifdef USE_XMLRPC
+static int disable_xmlrpcsrv = 1;
+#endif
+#ifdef USE_NETSNMP
+static int disable_snmpagent = 1;
+#endif
+
 static struct perf_class *core_perf_class = NULL;
 static struct perf_instance *core_perf_instance = NULL;
 struct perf_item *core_perf_uptime = NULL;
@@ -173,6 +185,10 @@ void print_usage() {
 		" -S, --enable-snmpagent     enable the Net-SNMP sub agent\n"
 #endif
 		"     --pid-file             specify the file where to write the PID\n"
+		"     --benchmark=FILE       replay a pcap file from memory with the given config and print the processing speed\n"
+		"     --benchmark-loops=N    number of times the pcap file is replayed in benchmark mode (default 10)\n"
+		"     --benchmark-json       print the benchmark results in JSON and the logs on stderr\n"
+		"     --benchmark-checksum   compare the speed of the checksum functions to the byte at a time loops and exit\n"
 		"\n"
 		);
 	
@@ -279,34 +295,39 @@ void print_help() {
 }
 
 
-void *mgmtsrv_thread_func(void *params) {
+/**
+ * Serve the CLI and the SNMP subagent from a single event loop.
+ * The XML-RPC connections are only accepted here, they are served by the XML-RPC thread.
+ */
+void *mgmt_thread_func(void *params) {
 
 	while (!finish) {
-		mgmtsrv_process();
-	}
-	return NULL;
-}
 
-#ifdef USE_XMLRPC
-void *xmlrpcsrv_thread_func(void *params) {
+		int timeout = EVENTLOOP_TIMEOUT;
 
-	while (!finish) {
-		xmlrpcsrv_process();
-	}
-	return NULL;
-}
+#ifdef USE_NETSNMP
+		if (!disable_snmpagent)
+			snmpagent_prepare(&timeout);
 #endif
 
-#ifdef USE_NETSNMP
-void *snmpagent_thread_func(void *params) {
+		if (eventloop_process(timeout) == POM_ERR)
+			break;
 
-	while (!finish) {
-		snmpagent_process();
+		if (!disable_mgmtsrv)
+			mgmtsrv_process();
+
+#ifdef USE_XMLRPC
+		if (!disable_xmlrpcsrv)
+			xmlrpcsrv_process();
+#endif
+
+#ifdef USE_NETSNMP
+		if (!disable_snmpagent)
+			snmpagent_process();
+#endif
 	}
 	return NULL;
-
 }
-#endif
 
 int start_input(struct ringbuffer *r) {
 
@@ -541,19 +562,31 @@ int main(int argc, char *argv[]) {
 	console_output = 1;
 
 	char *cfgfile = "pom.xml.conf";
-	int disable_mgmtsrv = 0;
 	char *cli_port = "4655";
 #ifdef USE_XMLRPC
-	int disable_xmlrpcsrv = 1;
 	char *xmlrpc_port = "8080";
-#endif
-#ifdef USE_NETSNMP
-	int disable_snmpagent = 1;
 #endif
 	char *pidfile = NULL;
+	char *benchmark_file = NULL;
+	unsigned int benchmark_loops = 10;
+	int benchmark_json = 0;
+	int benchmark_checksum_mode = 0;
+
+	// Keep track of what was initialized for the cleanup
+	int eventloop_started = 0, mgmtsrv_started = 0, xmlrpcsrv_started = 0, snmpagent_started = 0;
+	int mgmt_enabled = 0;
+	pthread_t mgmt_thread;
+
+	int exit_status = 0;
 
 	int c;
 
+	// The JSON results must be the only thing printed on stdout, this is needed before the first log
+	for (c = 1; c < argc; c++) {
+		if (!strcmp(argv[c], "--benchmark-json"))
+			console_stderr = 1;
+	}
+
 	while (1) {
 		static struct option long_options[] = {
 			{ "help", 0, 0, 'h' },
@@ -572,6 +605,10 @@ int main(int argc, char *argv[]) {
 			{ "enable-snmpagent", 0, 0, 'S'},
 #endif
 			{ "pid-file", 1, 0, 2},
+			{ "benchmark", 1, 0, 3},
+			{ "benchmark-loops", 1, 0, 4},
+			{ "benchmark-json", 0, 0, 5},
+			{ "benchmark-checksum", 0, 0, 6},
 			{ 0, 0, 0, 0}
 		};
 
@@ -599,6 +636,24 @@ int main(int argc, char *argv[]) {
 				pidfile = optarg;
 				pom_log("PID file is %s", optarg);
 				break;
+			case 3:
+				benchmark_file = optarg;
+				benchmark_mode = 1;
+				disable_mgmtsrv = 1;
+				break;
+			case 4:
+				if (sscanf(optarg, "%u", &benchmark_loops) != 1 || !benchmark_loops) {
+					printf("Invalid number of benchmark loops \"%s\"\n", optarg);
+					return 1;
+				}
+				break;
+			case 5:
+				benchmark_json = 1;
+				console_stderr = 1;
+				break;
+			case 6:
+				benchmark_checksum_mode = 1;
+				break;
 			case 'h':
 				ptype_init();
 				match_init();
@@ -682,6 +737,13 @@ int main(int argc, char *argv[]) {
 		return 1;
 	}
 
+	if (benchmark_checksum_mode) {
+		checksum_init();
+		int res = benchmark_checksum(benchmark_loops, benchmark_json);
+		pom_log_cleanup();
+		return (res == POM_OK ? 0 : 1);
+	}
+
 	// Write to the pidfile
 	if (pidfile) {
 		FILE* pid_fd = fopen(pidfile, "w");
@@ -700,6 +762,7 @@ int main(int argc, char *argv[]) {
 
 	// Init the stuff
 	uid_init();
+	checksum_init();
 	ptype_init();
 	layer_init();
 	match_init();
@@ -714,11 +777,17 @@ int main(int argc, char *argv[]) {
 	core_perf_uptime = perf_add_item(core_perf_instance, "uptime", perf_item_type_uptime, "UpTime of packet-o-matic");
 	perf_item_val_reset(core_perf_uptime);
 
+	filewriter_init();
+
 
 	struct ptype *param_autosave_on_exit = ptype_alloc("bool", NULL);
 	struct ptype *param_quit_on_input_error = ptype_alloc("bool", NULL);
 	struct ptype *param_reset_counters_on_restart = ptype_alloc("bool", NULL);
-	if (!param_autosave_on_exit || !param_quit_on_input_error || !param_reset_counters_on_restart) {
+	struct ptype *param_perf_timing = ptype_alloc("bool", NULL);
+	struct ptype *param_filewriter_threads = ptype_alloc("uint32", NULL);
+	struct ptype *param_filewriter_max_buffered = ptype_alloc("uint32", "bytes");
+	struct ptype *param_conntrack_top_size = ptype_alloc("uint32", NULL);
+	if (!param_autosave_on_exit || !param_quit_on_input_error || !param_reset_counters_on_restart || !param_perf_timing || !param_filewriter_threads || !param_filewriter_max_buffered || !param_conntrack_top_size) {
 		// This is the very first module to be loaded
 		pom_log(POM_LOG_ERR "Cannot allocate ptype bool. Aborting");
 		pom_log(POM_LOG_ERR "Did you set LD_LIBRARY_PATH correctly ?\r\n");
@@ -727,6 +796,10 @@ int main(int argc, char *argv[]) {
 	core_register_param("autosave_config_on_exit", "yes", param_autosave_on_exit, "Automatically save the configuration when exiting", NULL);
 	core_register_param("quit_on_input_error", "no", param_quit_on_input_error, "Quit when there is an error on the input", NULL);
 	core_register_param("reset_counters_on_item_restart", "yes", param_reset_counters_on_restart, "Reset counters when restarting/reenabling an item", NULL);
+	core_register_param("perf_timing", "no", param_perf_timing, "Record the time spent in each processing stage and target", perf_timing_core_param_callback);
+	core_register_param("filewriter_threads", "0", param_filewriter_threads, "Number of threads writing the dumped files in the background, 0 to write them synchronously", filewriter_threads_core_param_callback);
+	core_register_param("filewriter_max_buffered", "33554432", param_filewriter_max_buffered, "Maximum amount of data waiting to be written before processing is slowed down", filewriter_max_buffered_core_param_callback);
+	core_register_param("conntrack_top_size", "0", param_conntrack_top_size, "Number of connections, sources and ports tracked by the conntrack top summaries, 0 to disable them", conntrack_top_size_core_param_callback);
 
 
 	rbuf = malloc(sizeof(struct ringbuffer));
@@ -754,45 +827,47 @@ int main(int argc, char *argv[]) {
 
 	main_config = config_alloc();
 
-	pthread_t mgmtsrv_thread;
+	if (eventloop_init() == POM_ERR) {
+		pom_log(POM_LOG_ERR "Error while initializing the event loop. Aborting");
+		goto err;
+	}
+	eventloop_started = 1;
+
 	if (!disable_mgmtsrv) {
 		if (mgmtsrv_init(cli_port) == POM_ERR) {
 			pom_log(POM_LOG_ERR "Error when initializing the management console. Aborting");
 			goto err;
 		}
-		if (pthread_create(&mgmtsrv_thread, NULL, mgmtsrv_thread_func, NULL)) {
-			pom_log(POM_LOG_ERR "Error when creating the management console thread. Aborting");
-			goto err;
-		}
+		mgmtsrv_started = 1;
 	}
 
 #ifdef USE_XMLRPC
-	pthread_t xmlrpcsrv_thread;
 	if (!disable_xmlrpcsrv) {
 		if (xmlrpcsrv_init(xmlrpc_port) == POM_ERR) {
 			pom_log(POM_LOG_ERR "Error while initializing the XML-RPC interface. Aborting");
 			goto err;
 		}
-		if (pthread_create(&xmlrpcsrv_thread, NULL, xmlrpcsrv_thread_func, NULL)) {
-			pom_log(POM_LOG_ERR "Error when creating the XML-RPC thread. Aborting");
-			goto err;
-		}
+		xmlrpcsrv_started = 1;
 	}
 #endif
 
 #ifdef USE_NETSNMP
-	pthread_t snmpagent_thread;
 	if (!disable_snmpagent) {
 		if (snmpagent_init() == POM_ERR) {
 			pom_log(POM_LOG_ERR "Error while initializing the SNMP interface. Aborting");
 			goto err;
 		}
-		if (pthread_create(&snmpagent_thread, NULL, snmpagent_thread_func, NULL)) {
-			pom_log(POM_LOG_ERR "Error when creating the SNMP thread. Aborting");
+		snmpagent_started = 1;
+	}
+#endif
+
+	if (mgmtsrv_started || xmlrpcsrv_started || snmpagent_started) {
+		if (pthread_create(&mgmt_thread, NULL, mgmt_thread_func, NULL)) {
+			pom_log(POM_LOG_ERR "Error when creating the management thread. Aborting");
 			goto err;
 		}
+		mgmt_enabled = 1;
 	}
-#endif
 
 	// Check if the config file exists
 	struct stat st;
@@ -813,6 +888,14 @@ int main(int argc, char *argv[]) {
 
 	rbuf->i = main_config->input;
 
+	if (benchmark_mode) {
+		// Never overwrite the config used for the benchmark
+		ptype_parse_val(param_autosave_on_exit, "no");
+		if (benchmark_run(benchmark_file, benchmark_loops, benchmark_json) != POM_OK)
+			exit_status = 1;
+		goto finish;
+	}
+
 	pom_log("packet-o-matic " POM_VERSION " started");
 
 	if (pthread_mutex_lock(&rbuf->mutex)) {
@@ -828,7 +911,7 @@ int main(int argc, char *argv[]) {
 		}
 
 		if (sighup) { // Process SIGHUP actions
-			main_process_sighup(main_config->rules, &main_config->rules_lock);
+			main_process_sighup();
 			sighup = 0;
 		}
 
@@ -872,13 +955,18 @@ int main(int argc, char *argv[]) {
 		}
 	
 		if (rbuf->buffer[rbuf->read_pos]->len > 0) { // Need to queue that in the buffer
-			timers_process(main_config->rules, &main_config->rules_lock); // Process events
-			do_rules(rbuf->buffer[rbuf->read_pos], main_config->rules, &main_config->rules_lock);
-			helper_process_queue(main_config->rules, &main_config->rules_lock); // Process frames that needed some help
+			struct rule_snapshot *rules = rules_snapshot_get();
+			timers_process(rules); // Process events
+			do_rules(rbuf->buffer[rbuf->read_pos], rules);
+			helper_process_queue(rules); // Process frames that needed some help
+			rules_snapshot_release();
 		}
 
+		if (datastore_batch_pending) // Flush the batched dataset writes that timed out
+			datastore_flush_expired(now);
+
 		if (sighup) { // Process SIGHUP actions
-			main_process_sighup(main_config->rules, &main_config->rules_lock);
+			main_process_sighup();
 			sighup = 0;
 		}
 
@@ -905,7 +993,8 @@ int main(int argc, char *argv[]) {
 		while (!rbuf->usage) {
 			if (rbuf->state == rb_state_stopping || rbuf->state == rb_state_closed) {
 				// Process remaining queued frames
-				conntrack_close_connections(main_config->rules, &main_config->rules_lock);
+				conntrack_close_connections(rules_snapshot_get());
+				rules_snapshot_release();
 				expectation_cleanup_all();
 			}
 
@@ -915,7 +1004,7 @@ int main(int argc, char *argv[]) {
 			}
 
 			if (sighup) { // Process SIGHUP actions
-				main_process_sighup(main_config->rules, &main_config->rules_lock);
+				main_process_sighup();
 				sighup = 0;
 			}
 
@@ -927,6 +1016,14 @@ int main(int argc, char *argv[]) {
 			switch (pthread_cond_timedwait(&rbuf->underrun_cond, &rbuf->mutex, &tp)) {
 				case ETIMEDOUT:
 					//pom_log(POM_LOG_TSHOOT "Timeout occured while waiting for next frame to be available");
+					if (datastore_batch_pending && !rbuf->usage) {
+						// No traffic, write what is left in the batches without blocking the input
+						pthread_mutex_unlock(&rbuf->mutex);
+						pthread_mutex_lock(&reader_mutex);
+						datastore_flush_expired(NULL);
+						pthread_mutex_unlock(&reader_mutex);
+						pthread_mutex_lock(&rbuf->mutex);
+					}
 				case 0:
 					break;
 				default:
@@ -953,29 +1050,16 @@ finish:
 	if (rbuf->i && rbuf->state == rb_state_open)
 		stop_input(rbuf);
 
-	if (!disable_mgmtsrv) {
-		pom_log(POM_LOG_INFO "Waiting for CLI mgmt thread to finish ...");
-		pthread_join(mgmtsrv_thread, NULL);
-	}
-
-#ifdef USE_XMLRPC
-	if (!disable_xmlrpcsrv) {
-		pom_log(POM_LOG_INFO "Waiting for XML-RPC thread to finish ...");
-		pthread_join(xmlrpcsrv_thread, NULL);
-	}
-#endif
-
-#ifdef USE_NETSNMP
-	if (!disable_snmpagent) {
-		pom_log(POM_LOG_INFO "Waiting for NET-SNMP subagent thread to finish ...");
-		pthread_join(snmpagent_thread, NULL);
+	if (mgmt_enabled) {
+		pom_log(POM_LOG_INFO "Waiting for the management thread to finish ...");
+		pthread_join(mgmt_thread, NULL);
 	}
-#endif
 
 	pom_log("Total packets read : %lu, dropped %lu (%.2f%%)", perf_item_val_get_raw(rbuf->perf_total_packets), perf_item_val_get_raw(rbuf->perf_dropped_packets), 100.0 / perf_item_val_get_raw(rbuf->perf_total_packets) * perf_item_val_get_raw(rbuf->perf_dropped_packets));
 
 	// Process remaining queued frames
-	conntrack_close_connections(main_config->rules, &main_config->rules_lock);
+	conntrack_close_connections(rules_snapshot_get());
+	rules_snapshot_release();
 
 	expectation_cleanup_all();
 
@@ -983,19 +1067,24 @@ err:
 
 	perf_unregister_instance(core_perf_class, core_perf_instance);
 
-	if (!disable_mgmtsrv)
+	if (mgmtsrv_started)
 		mgmtsrv_cleanup();
 #ifdef USE_XMLRPC	
-	if (!disable_xmlrpcsrv)
+	if (xmlrpcsrv_started)
 		xmlrpcsrv_cleanup();
 #endif
 
 #ifdef USE_NETSNMP
-	if (!disable_snmpagent)
+	if (snmpagent_started)
 		snmpagent_cleanup();
 #endif
+	if (eventloop_started)
+		eventloop_cleanup();
+
 	config_cleanup(main_config);
 
+	rules_cleanup();
+
 	datastore_unregister_all();
 
 	helper_unregister_all();
@@ -1021,8 +1110,13 @@ err:
 	ptype_cleanup(param_autosave_on_exit);
 	ptype_cleanup(param_quit_on_input_error);
 	ptype_cleanup(param_reset_counters_on_restart);
+	ptype_cleanup(param_perf_timing);
+	ptype_cleanup(param_filewriter_threads);
+	ptype_cleanup(param_filewriter_max_buffered);
+	ptype_cleanup(param_conntrack_top_size);
 	core_param_unregister_all();
 
+	filewriter_cleanup();
 	perf_cleanup();
 	ptype_unregister_all();
 
@@ -1030,7 +1124,7 @@ err:
 
 	pom_log_cleanup();
 
-	return 0;
+	return exit_status;
 }
 
 int ringbuffer_init(struct ringbuffer *r) {
@@ -1118,6 +1212,80 @@ int ringbuffer_core_param_callback(char *new_value, char *msg, size_t size) {
 
 }
 
+int perf_timing_core_param_callback(char *new_value, char *msg, size_t size) {
+
+	struct ptype *val = ptype_alloc("bool", NULL);
+	if (!val) {
+		strncpy(msg, "Unable to allocate a bool ptype", size);
+		return POM_ERR;
+	}
+
+	if (ptype_parse_val(val, new_value) == POM_ERR) {
+		ptype_cleanup(val);
+		snprintf(msg, size, "Invalid value %s", new_value);
+		return POM_ERR;
+	}
+
+	int enable = PTYPE_BOOL_GETVAL(val);
+	ptype_cleanup(val);
+
+	if (perf_timing_enable(enable) == POM_ERR) {
+		strncpy(msg, "Unable to enable timing", size);
+		return POM_ERR;
+	}
+
+	return POM_OK;
+
+}
+
+int filewriter_threads_core_param_callback(char *new_value, char *msg, size_t size) {
+
+	unsigned int threads = 0;
+	if (sscanf(new_value, "%u", &threads) != 1 || threads > FILEWRITER_MAX_THREADS) {
+		snprintf(msg, size, "Invalid value %s, it must be between 0 and %u", new_value, FILEWRITER_MAX_THREADS);
+		return POM_ERR;
+	}
+
+	if (filewriter_start(threads) == POM_ERR) {
+		strncpy(msg, "Unable to start the file writer threads", size);
+		return POM_ERR;
+	}
+
+	return POM_OK;
+
+}
+
+int filewriter_max_buffered_core_param_callback(char *new_value, char *msg, size_t size) {
+
+	unsigned int max_buffered = 0;
+	if (sscanf(new_value, "%u", &max_buffered) != 1) {
+		snprintf(msg, size, "Invalid value %s", new_value);
+		return POM_ERR;
+	}
+
+	filewriter_set_max_buffered(max_buffered);
+
+	return POM_OK;
+
+}
+
+int conntrack_top_size_core_param_callback(char *new_value, char *msg, size_t size) {
+
+	unsigned int top_size = 0;
+	if (sscanf(new_value, "%u", &top_size) != 1 || top_size > CONNTRACK_TOP_MAX_SIZE) {
+		snprintf(msg, size, "Invalid value %s, it must be between 0 and %u", new_value, CONNTRACK_TOP_MAX_SIZE);
+		return POM_ERR;
+	}
+
+	if (conntrack_top_set_size(top_size) == POM_ERR) {
+		strncpy(msg, "Unable to allocate the conntrack top summaries", size);
+		return POM_ERR;
+	}
+
+	return POM_OK;
+
+}
+
 int reader_process_lock() {
 	return pthread_mutex_lock(&reader_mutex);
 }
@@ -1136,11 +1304,22 @@ int halt() {
 }
 
 
+/// Set while a writer holds the rule lock, a new snapshot is published when it releases it
+static int rules_write_locked = 0;
+
+/**
+ * The packet processing thread doesn't use this lock. It works on the
+ * rule snapshot published when the write lock is released.
+ * @param write Set to 1 if rules or targets will be added or removed, 0 if not
+ * @return POM_OK on success, POM_ERR on failure.
+ */
 int main_config_rules_lock(int write) {
 
 	int result = 0;
 	if (write) {
 		result = pthread_rwlock_wrlock(&main_config->rules_lock);
+		if (!result)
+			rules_write_locked = 1;
 	} else {
 		result = pthread_rwlock_rdlock(&main_config->rules_lock);
 	}
@@ -1157,6 +1336,11 @@ int main_config_rules_lock(int write) {
 
 int main_config_rules_unlock() {
 
+	if (rules_write_locked) {
+		rules_write_locked = 0;
+		rules_snapshot_publish(main_config->rules);
+	}
+
 	if (pthread_rwlock_unlock(&main_config->rules_lock)) {
 		pom_log(POM_LOG_ERR "Error while unlocking the rule lock");
 		abort();
@@ -1211,28 +1395,15 @@ void libxml_error_handler(void *ctx, const char *msg, ...) {
 	return;
 }
 
-int main_process_sighup(struct rule_list *r, pthread_rwlock_t *rule_lock) {
+int main_process_sighup() {
 
-	if (pthread_rwlock_rdlock(rule_lock)) {
-		pom_log(POM_LOG_ERR "Unable to lock the given rules");
-		abort();
-		return POM_ERR;
-	}
+	struct rule_snapshot *rules = rules_snapshot_get();
 
-	while (r) {
-		struct target *t = r->target;
-		while (t) {
-			target_sighup(t);
-			t = t->next;
-		}
-		r = r->next;
-	}
+	unsigned int i;
+	for (i = 0; rules && i < rules->targets_count; i++)
+		target_sighup(rules->targets[i]);
 
-	if (pthread_rwlock_unlock(rule_lock)) {
-		pom_log(POM_LOG_ERR "Unable to lock the given rules");
-		abort();
-		return POM_ERR;
-	}
+	rules_snapshot_release();
 
 
 	return POM_OK;
@@ -70,6 +70,10 @@ int ringbuffer_deinit(struct ringbuffer *r);
 int ringbuffer_alloc(struct ringbuffer *r, struct input *i);
 int ringbuffer_cleanup(struct ringbuffer *r);
 int ringbuffer_core_param_callback(char *new_value, char *msg, size_t size);
+int perf_timing_core_param_callback(char *new_value, char *msg, size_t size);
+int filewriter_threads_core_param_callback(char *new_value, char *msg, size_t size);
+int filewriter_max_buffered_core_param_callback(char *new_value, char *msg, size_t size);
+int conntrack_top_size_core_param_callback(char *new_value, char *msg, size_t size);
 
 int start_input(struct ringbuffer *r);
 int stop_input(struct ringbuffer *r);
@@ -78,6 +82,7 @@ int reader_process_lock();
 int reader_process_unlock();
 
 void *input_thread_func(void *params);
+void *mgmt_thread_func(void *params);
 
 int halt();
 
@@ -88,6 +93,6 @@ int main_config_datastores_unlock();
 
 void libxml_error_handler(void *ctx, const char *msg, ...);
 
-int main_process_sighup(struct rule_list *r, pthread_rwlock_t *rule_lock);
+int main_process_sighup();
 
 #endif
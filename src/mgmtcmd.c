@@ -25,6 +25,8 @@
 #include "match.h"
 #include "version.h"
 #include "core_param.h"
+#include "main.h"
+#include "perf.h"
 
 #include <dirent.h>
 
@@ -37,7 +39,7 @@
 
 #include "ptype_uint64.h"
 
-#define MGMT_COMMANDS_NUM 18
+#define MGMT_COMMANDS_NUM 20
 
 static struct mgmt_command mgmt_commands[MGMT_COMMANDS_NUM] = {
 
@@ -168,6 +170,18 @@ static struct mgmt_command mgmt_commands[MGMT_COMMANDS_NUM] = {
 		.callback_func = mgmtcmd_version_show,
 	},
 
+	{
+		.words = { "perf", "timing", "show", NULL },
+		.help = "Show the time spent in each processing stage and target",
+		.callback_func = mgmtcmd_perf_timing_show,
+	},
+
+	{
+		.words = { "perf", "filewriter", "show", NULL },
+		.help = "Show the statistics of the background file writer",
+		.callback_func = mgmtcmd_perf_filewriter_show,
+	},
+
 };
 
 int mgmtcmd_register_all() {
@@ -679,6 +693,77 @@ int mgmtcmd_version_show(struct mgmt_connection *c, int argc, char*argv[]) {
 	return POM_OK;
 }
 
+int mgmtcmd_perf_timing_show(struct mgmt_connection *c, int argc, char *argv[]) {
+
+	if (!perf_timing_enabled)
+		mgmtsrv_send(c, "Timing is disabled, use 'core parameter set perf_timing yes' to enable it\r\n");
+
+	char buff[256];
+
+	struct perf_class *stages = perf_find_class("stages");
+	if (stages && stages->instances) {
+		mgmtsrv_send(c, "Processing stages :\r\n");
+		struct perf_instance *inst = stages->instances;
+		perf_instance_lock(inst, 0);
+		struct perf_item *itm = inst->items;
+		while (itm) {
+			perf_item_val_get_human_histo(itm, buff, sizeof(buff) - 1);
+			mgmtsrv_send(c, "   %-12s : %s\r\n", itm->name, buff);
+			itm = itm->next;
+		}
+		perf_instance_unlock(inst);
+	}
+
+	main_config_rules_lock(0);
+
+	struct rule_list *rl = main_config->rules;
+	unsigned int rule_num = 0;
+	while (rl) {
+		struct target *t = rl->target;
+		unsigned int target_num = 0;
+		while (t) {
+			perf_item_val_get_human_histo(t->perf_process_time, buff, sizeof(buff) - 1);
+			mgmtsrv_send(c, "Rule %u, target %u (%s) : %s\r\n", rule_num, target_num, target_get_name(t->type), buff);
+			t = t->next;
+			target_num++;
+		}
+		rl = rl->next;
+		rule_num++;
+	}
+
+	main_config_rules_unlock();
+
+	return POM_OK;
+}
+
+int mgmtcmd_perf_filewriter_show(struct mgmt_connection *c, int argc, char *argv[]) {
+
+	struct perf_class *fw = perf_find_class("filewriter");
+	if (!fw || !fw->instances) {
+		mgmtsrv_send(c, "File writer statistics not available\r\n");
+		return POM_OK;
+	}
+
+	char buff[256];
+
+	struct perf_instance *inst = fw->instances;
+	perf_instance_lock(inst, 0);
+	struct perf_item *itm = inst->items;
+	while (itm) {
+		if (itm->type == perf_item_type_histogram)
+			perf_item_val_get_human_histo(itm, buff, sizeof(buff) - 1);
+		else if (strstr(itm->name, "bytes"))
+			perf_item_val_get_human_1024(itm, buff, sizeof(buff) - 1);
+		else
+			perf_item_val_get_human(itm, buff, sizeof(buff) - 1);
+		mgmtsrv_send(c, "   %-14s : %s\r\n", itm->name, buff);
+		itm = itm->next;
+	}
+	perf_instance_unlock(inst);
+
+	return POM_OK;
+}
+
 int mgmtcmd_ptype_unload(struct mgmt_connection *c, int argc, char *argv[]) {
 
 
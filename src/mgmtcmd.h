@@ -51,6 +51,8 @@ struct mgmt_command_arg* mgmtcmd_ptype_load_completion(int argc, char *argv[]);
 int mgmtcmd_ptype_unload(struct mgmt_connection *c, int argc, char *argv[]);
 struct mgmt_command_arg* mgmtcmd_ptype_unload_completion(int argc, char *argv[]);
 int mgmtcmd_version_show(struct mgmt_connection *c, int argc, char*argv[]);
+int mgmtcmd_perf_timing_show(struct mgmt_connection *c, int argc, char *argv[]);
+int mgmtcmd_perf_filewriter_show(struct mgmt_connection *c, int argc, char *argv[]);
 
 struct mgmt_command_arg* mgmtcmd_list_modules(char *type);
 struct mgmt_command_arg *mgmtcmd_completion_int_range(int start, int count);
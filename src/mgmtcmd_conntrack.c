@@ -21,7 +21,7 @@
 #include "mgmtcmd_conntrack.h"
 #include "conntrack.h"
 
-#define MGMT_CONNTRACK_COMMANDS_NUM 6
+#define MGMT_CONNTRACK_COMMANDS_NUM 7
 
 static struct mgmt_command mgmt_conntrack_commands[MGMT_CONNTRACK_COMMANDS_NUM] = {
 
@@ -70,6 +70,14 @@ static struct mgmt_command mgmt_conntrack_commands[MGMT_CONNTRACK_COMMANDS_NUM]
 		.callback_func = mgmtcmd_conntrack_unload,
 		.completion = mgmtcmd_conntrack_loaded_completion,
 	},
+
+	{
+		.words = { "conntrack", "top", NULL },
+		.help = "Show the heaviest connections, sources or ports",
+		.usage = "conntrack top <flows|sources|ports> [count]",
+		.callback_func = mgmtcmd_conntrack_top,
+		.completion = mgmtcmd_conntrack_top_completion,
+	},
 		
 };
 
@@ -358,3 +366,77 @@ struct mgmt_command_arg* mgmtcmd_conntrack_loaded_completion(int argc, char *arg
 
 	return res;
 }
+
+int mgmtcmd_conntrack_top(struct mgmt_connection *c, int argc, char *argv[]) {
+
+	if (argc < 1 || argc > 2)
+		return MGMT_USAGE;
+
+	enum conntrack_top_type type;
+	if (!strcmp(argv[0], "flows"))
+		type = conntrack_top_flows;
+	else if (!strcmp(argv[0], "sources"))
+		type = conntrack_top_sources;
+	else if (!strcmp(argv[0], "ports"))
+		type = conntrack_top_ports;
+	else
+		return MGMT_USAGE;
+
+	unsigned int count = MGMT_CONNTRACK_TOP_DEFAULT;
+	if (argc == 2 && (sscanf(argv[1], "%u", &count) != 1 || !count))
+		return MGMT_USAGE;
+
+	if (count > CONNTRACK_TOP_MAX_SIZE)
+		count = CONNTRACK_TOP_MAX_SIZE;
+
+	struct conntrack_top_entry *entries = malloc(sizeof(struct conntrack_top_entry) * count);
+	if (!entries) {
+		mgmtsrv_send(c, "Not enough memory\r\n");
+		return POM_OK;
+	}
+
+	int res = conntrack_top_get(type, entries, count);
+	if (res == POM_ERR) {
+		free(entries);
+		mgmtsrv_send(c, "Unable to get the top %s\r\n", argv[0]);
+		return POM_OK;
+	}
+
+	if (!res) {
+		free(entries);
+		mgmtsrv_send(c, "Nothing tracked yet. Is the core parameter conntrack_top_size set ?\r\n");
+		return POM_OK;
+	}
+
+	mgmtsrv_send(c, "%20s %20s %14s  %s\r\n", "Bytes", "Max error", "Packets", "Name");
+
+	int i;
+	for (i = 0; i < res; i++)
+		mgmtsrv_send(c, "%20llu %20llu %14llu  %s\r\n", (unsigned long long) entries[i].bytes, (unsigned long long) entries[i].error, (unsigned long long) entries[i].packets, entries[i].name);
+
+	free(entries);
+
+	return POM_OK;
+}
+
+struct mgmt_command_arg* mgmtcmd_conntrack_top_completion(int argc, char *argv[]) {
+
+	if (argc != 2)
+		return NULL;
+
+	char *types[] = { "flows", "sources", "ports" };
+
+	struct mgmt_command_arg *res = NULL;
+
+	int i;
+	for (i = 0; i < sizeof(types) / sizeof(char *); i++) {
+		struct mgmt_command_arg *item = malloc(sizeof(struct mgmt_command_arg));
+		memset(item, 0, sizeof(struct mgmt_command_arg));
+		item->word = malloc(strlen(types[i]) + 1);
+		strcpy(item->word, types[i]);
+		item->next = res;
+		res = item;
+	}
+
+	return res;
+}
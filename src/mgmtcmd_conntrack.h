@@ -26,6 +26,9 @@
 #include "mgmtsrv.h"
 #include "mgmtcmd.h"
 
+/// Number of entries shown by conntrack top when no count is given
+#define MGMT_CONNTRACK_TOP_DEFAULT 10
+
 int mgmtcmd_conntrack_register_all();
 int mgmtcmd_conntrack_show(struct mgmt_connection *c, int argc, char *argv[]);
 int mgmtcmd_conntrack_parameter_set(struct mgmt_connection *c, int argc, char *argv[]);
@@ -36,5 +39,7 @@ struct mgmt_command_arg* mgmtcmd_conntrack_load_completion(int argc, char *argv[
 int mgmtcmd_conntrack_help(struct mgmt_connection *c, int argc, char *argv[]);
 int mgmtcmd_conntrack_unload(struct mgmt_connection *c, int argc, char *argv[]);
 struct mgmt_command_arg* mgmtcmd_conntrack_loaded_completion(int argc, char *argv[]);
+int mgmtcmd_conntrack_top(struct mgmt_connection *c, int argc, char *argv[]);
+struct mgmt_command_arg* mgmtcmd_conntrack_top_completion(int argc, char *argv[]);
 
 #endif
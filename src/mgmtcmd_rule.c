@@ -344,7 +344,7 @@ int mgmtcmd_rule_set(struct mgmt_connection *c, int argc, char *argv[]) {
 
 	// rule parsed, let's replace it
 	main_config_rules_lock(1);
-	node_destroy(rl->node, 0);
+	rules_retire_node(rl->node);
 	rl->node = start;
 	main_config->rules_serial++;
 	rl->serial++;
@@ -496,7 +496,7 @@ int mgmtcmd_rule_remove(struct mgmt_connection *c, int argc, char *argv[]) {
 	if (rl->next)
 		rl->next->prev = rl->prev;
 
-	rule_list_cleanup(rl);
+	rules_retire_rule(rl);
 
 	main_config->rules_serial++;
 	main_config_rules_unlock();
@@ -446,12 +446,6 @@ int mgmtcmd_target_remove(struct mgmt_connection *c, int argc, char *argv[]) {
 		mgmtsrv_send(c, "Target not found\r\n");
 		return POM_OK;
 	}
-	target_lock_instance(t, 1);
-
-	if (t->started) {
-		target_close(t);
-	}
-
 	rl->target_serial++;
 	main_config->target_serial++;
 
@@ -463,7 +457,7 @@ int mgmtcmd_target_remove(struct mgmt_connection *c, int argc, char *argv[]) {
 	if (t->next)
 		t->next->prev = t->prev;
 
-	target_cleanup_module(t);
+	rules_retire_target(t);
 
 	main_config_rules_unlock();
 
@@ -28,13 +28,25 @@
 #include "mgmtvty.h"
 
 #include <signal.h>
-#include <sys/select.h>
+#include <pthread.h>
 
 struct mgmt_command *cmds;
 
 static struct mgmt_connection *conn_head;
 static struct mgmt_connection *conn_tail;
 
+/**
+ * Protects the connection list and the output buffers.
+ * Only the event loop thread adds or removes connections but debug messages
+ * are sent from any thread. Never call pom_log() while holding it.
+ */
+static pthread_mutex_t mgmtsrv_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int mgmtsrv_write(struct mgmt_connection *c, const void *buff, size_t len);
+static int mgmtsrv_vsend(struct mgmt_connection *c, char *format, va_list arg_list);
+static int mgmtsrv_send_locked(struct mgmt_connection *c, char *format, ...);
+static int mgmtsrv_flush(struct mgmt_connection *c);
+
 static char *mgmt_password = NULL;
 
 int mgmtsrv_init(const char *port) {
@@ -113,11 +125,30 @@ int mgmtsrv_init(const char *port) {
 			continue;
 		}
 
+		int flags = fcntl(sockfd, F_GETFL);
+		if (flags < 0 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) < 0) {
+			pom_log(POM_LOG_ERR "Unable to set non blocking flag for socket %d", sockfd);
+			close(sockfd);
+			tmpres = tmpres->ai_next;
+			continue;
+		}
+
 		struct mgmt_connection *conn = malloc(sizeof(struct mgmt_connection));
 		memset(conn, 0, sizeof(struct mgmt_connection));
 		conn->fd = sockfd;
 		conn->flags = MGMT_FLAG_LISTENING;
 
+		conn->efd.fd = sockfd;
+		conn->efd.events = EVENTLOOP_IN;
+		conn->efd.handler = mgmtsrv_listen_handler;
+		conn->efd.priv = conn;
+		if (eventloop_add(&conn->efd) != POM_OK) {
+			close(sockfd);
+			free(conn);
+			tmpres = tmpres->ai_next;
+			continue;
+		}
+
 		pom_log("Management console listening on %s:%s", host, port);
 	
 		if (!conn_head) {
@@ -148,24 +179,25 @@ int mgmtsrv_init(const char *port) {
 }
 
 
+/**
+ * Close the connections with an error and free the closed ones.
+ * Called by the event loop thread after each iteration.
+ * @return POM_OK on success, POM_ERR on failure.
+ */
 int mgmtsrv_process() {
 
-	fd_set fds;
+	struct mgmt_connection *cc = conn_head;
+	while (cc) {
+		struct mgmt_connection *next = cc->next;
 
-	FD_ZERO(&fds);
-	int max_fd = 0;
+		if ((cc->flags & MGMT_FLAG_ERROR) && cc->state != MGMT_STATE_CLOSED) {
+			pom_log(POM_LOG_DEBUG "Output buffer of connection %u is full or unwritable", cc->fd);
+			mgmtsrv_close_connection(cc);
+		}
 
-	struct mgmt_connection *cc = conn_head;
-	while(cc) {
 		if (cc->state == MGMT_STATE_CLOSED) { // cleanup this connection entry if it was closed earlier
-			
-			int i;
-			for (i = 0; i < MGMT_CMD_HISTORY_SIZE; i++)
-				if (cc->history[i])
-					free(cc->history[i]);
-			free(cc->curcmd);
 
-			struct mgmt_connection *tmp = cc->next;
+			pthread_mutex_lock(&mgmtsrv_lock);
 			if (!cc->prev)
 				conn_head = cc->next;
 			 else 
@@ -175,39 +207,56 @@ int mgmtsrv_process() {
 				conn_tail = cc->prev;
 			else
 				cc->next->prev = cc->prev;
+			pthread_mutex_unlock(&mgmtsrv_lock);
 
+			int i;
+			for (i = 0; i < MGMT_CMD_HISTORY_SIZE; i++)
+				if (cc->history[i])
+					free(cc->history[i]);
+			free(cc->curcmd);
+			free(cc->out_buff);
 			free(cc);
-			cc = tmp;
-			continue;
 		}
 
-
-		FD_SET(cc->fd, &fds);
-		if (cc->fd > max_fd)
-			max_fd = cc->fd;
-		cc = cc->next;
+		cc = next;
 	}
 
-	struct timeval tv;
-	tv.tv_sec = 1;
-	tv.tv_usec = 0;
+	return POM_OK;
 
-	if (select(max_fd + 1, &fds, NULL, NULL, &tv) <= 0)
-		return POM_OK;
+}
 
-	cc = conn_head;
-	while(cc) {
+/**
+ * Accept all the pending connections on a listening socket.
+ */
+int mgmtsrv_listen_handler(struct eventloop_fd *efd, uint32_t events) {
 
-		if (FD_ISSET(cc->fd, &fds)) {
-			if (cc->flags & MGMT_FLAG_LISTENING)
-				return mgmtsrv_accept_connection(cc);
-			return mgmtsrv_read_socket(cc);
-		}
-		cc = cc->next;
-	}
+	struct mgmt_connection *c = efd->priv;
+
+	while (mgmtsrv_accept_connection(c) == POM_OK);
 
 	return POM_OK;
+}
+
+/**
+ * Flush the pending output and process the input of a connection.
+ */
+int mgmtsrv_connection_handler(struct eventloop_fd *efd, uint32_t events) {
+
+	struct mgmt_connection *c = efd->priv;
+
+	if (c->state == MGMT_STATE_CLOSED)
+		return POM_OK;
+
+	if (events & EVENTLOOP_OUT) {
+		pthread_mutex_lock(&mgmtsrv_lock);
+		mgmtsrv_flush(c);
+		pthread_mutex_unlock(&mgmtsrv_lock);
+	}
+
+	if (events & (EVENTLOOP_IN | EVENTLOOP_ERR))
+		return mgmtsrv_read_socket(c);
 
+	return POM_OK;
 }
 
 int mgmtsrv_accept_connection(struct mgmt_connection *c) {
@@ -221,21 +270,25 @@ int mgmtsrv_accept_connection(struct mgmt_connection *c) {
 	new_cc->fd = accept(c->fd, (struct sockaddr *) &remote_addr, &remote_addr_len);
 
 	if (new_cc->fd < 0) {
+		int my_errno = errno;
 		free(new_cc);
-		pom_log(POM_LOG_ERR "Error while accepting new connection");
+		if (my_errno != EAGAIN && my_errno != EWOULDBLOCK)
+			pom_log(POM_LOG_ERR "Error while accepting new connection");
 		return POM_ERR;
 	}
 
 	int flags = fcntl(new_cc->fd, F_GETFL);
 	if (flags < 0) {
-		free(new_cc);
 		pom_log("Error while getting flags of fd %d", new_cc->fd);
+		close(new_cc->fd);
+		free(new_cc);
 		return POM_ERR;
 	}
 
 	if (fcntl(new_cc->fd, F_SETFL, (flags | O_NONBLOCK)) < 0) {
-		free(new_cc);
 		pom_log(POM_LOG_ERR "Unable to set non blocking flag for socket %d", new_cc->fd);
+		close(new_cc->fd);
+		free(new_cc);
 		return POM_ERR;
 	}
 
@@ -251,6 +304,18 @@ int mgmtsrv_accept_connection(struct mgmt_connection *c) {
 
 	new_cc->state = MGMT_STATE_INIT;
 
+	new_cc->efd.fd = new_cc->fd;
+	new_cc->efd.events = EVENTLOOP_IN;
+	new_cc->efd.handler = mgmtsrv_connection_handler;
+	new_cc->efd.priv = new_cc;
+	if (eventloop_add(&new_cc->efd) != POM_OK) {
+		close(new_cc->fd);
+		free(new_cc->curcmd);
+		free(new_cc);
+		return POM_ERR;
+	}
+
+	pthread_mutex_lock(&mgmtsrv_lock);
 	if (conn_tail) {
 		conn_tail->next = new_cc;
 		new_cc->prev = conn_tail;
@@ -259,39 +324,45 @@ int mgmtsrv_accept_connection(struct mgmt_connection *c) {
 	}
 
 	conn_tail = new_cc;
+	pthread_mutex_unlock(&mgmtsrv_lock);
+
 	pom_log("Accepted management connection from %s on socket %u", host, new_cc->fd);
 
+	mgmtvty_init(new_cc);
 
-	return mgmtvty_init(new_cc);
+	return POM_OK;
 
 }
 
 int mgmtsrv_read_socket(struct mgmt_connection *c) {
 
-	
 	ssize_t res = 0;
-	unsigned int len = 0;
 	unsigned char buffer[READ_BUFF_LEN];
 
-	errno = EAGAIN; // Solaris is too lazy to set it itself
-	while ((res = read(c->fd, buffer + len,  READ_BUFF_LEN - len)) > 0) {
-		len += res;
-	}
+	while (c->state != MGMT_STATE_CLOSED) {
 
-	if (res == 0) {
-		pom_log(POM_LOG_DEBUG "Connection %u closed by foreign host", c->fd);
-		mgmtsrv_close_connection(c);
-		return POM_OK;
-	}
+		res = read(c->fd, buffer, READ_BUFF_LEN);
 
-	int my_errno = errno;
-	if (my_errno != EAGAIN) {
-		pom_log(POM_LOG_DEBUG "Error while reading from socket %u", c->fd);
-		mgmtsrv_close_connection(c);
-		return POM_OK;
-	}
+		if (res > 0) {
+			mgmtvty_process(c, buffer, res);
+			continue;
+		}
 
-	mgmtvty_process(c, buffer, len);
+		if (res == 0) {
+			pom_log(POM_LOG_DEBUG "Connection %u closed by foreign host", c->fd);
+			mgmtsrv_close_connection(c);
+			break;
+		}
+
+		if (errno == EINTR)
+			continue;
+
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			pom_log(POM_LOG_DEBUG "Error while reading from socket %u", c->fd);
+			mgmtsrv_close_connection(c);
+		}
+		break;
+	}
 
 	return POM_OK;
 }
@@ -513,10 +584,15 @@ int mgmtsrv_match_command(char *words[MGMT_MAX_CMD_WORDS_ARGS], struct mgmt_comm
 
 int mgmtsrv_close_connection(struct mgmt_connection *c) {
 
+	eventloop_remove(&c->efd);
 
+	pthread_mutex_lock(&mgmtsrv_lock);
 	c->state = MGMT_STATE_CLOSED;
-	pom_log("Management connection with socket %u closed", c->fd);
 	close(c->fd);
+	c->out_len = 0;
+	pthread_mutex_unlock(&mgmtsrv_lock);
+
+	pom_log("Management connection with socket %u closed", c->fd);
 
 	return POM_OK;
 
@@ -525,18 +601,28 @@ int mgmtsrv_close_connection(struct mgmt_connection *c) {
 int mgmtsrv_cleanup() {
 
 
-	struct mgmt_connection *tmp;
-	while (conn_head) {
-		if (!(conn_head->flags & MGMT_FLAG_LISTENING))
-			mgmtsrv_send(conn_head, "\r\nShutdown request received. Thanks for using packet-o-matic !\r\n");
-		close(conn_head->fd);
+	// Detach the connections so debug messages are not sent to them anymore
+	pthread_mutex_lock(&mgmtsrv_lock);
+	struct mgmt_connection *tmp, *cc = conn_head;
+	conn_head = NULL;
+	conn_tail = NULL;
+	pthread_mutex_unlock(&mgmtsrv_lock);
+
+	while (cc) {
+		if (cc->state != MGMT_STATE_CLOSED) {
+			if (!(cc->flags & MGMT_FLAG_LISTENING))
+				mgmtsrv_send(cc, "\r\nShutdown request received. Thanks for using packet-o-matic !\r\n");
+			eventloop_remove(&cc->efd);
+			close(cc->fd);
+		}
 		int i;
 		for (i = 0; i < MGMT_CMD_HISTORY_SIZE; i++)
-			if (conn_head->history[i])
-				free(conn_head->history[i]);
-		free(conn_head->curcmd);
-		tmp = conn_head;
-		conn_head = conn_head->next;
+			if (cc->history[i])
+				free(cc->history[i]);
+		free(cc->curcmd);
+		free(cc->out_buff);
+		tmp = cc;
+		cc = cc->next;
 		free(tmp);
 
 	}
@@ -548,7 +634,108 @@ int mgmtsrv_cleanup() {
 }
 
 
-int mgmtsrv_send(struct mgmt_connection *c, char* format, ...) {
+/**
+ * Send data to a connection or buffer it if the socket is not writable.
+ * The connection is flagged to be closed if it has too much data buffered.
+ * Must be called with mgmtsrv_lock held.
+ */
+static int mgmtsrv_write(struct mgmt_connection *c, const void *buff, size_t len) {
+
+	if (c->state == MGMT_STATE_CLOSED || (c->flags & MGMT_FLAG_ERROR))
+		return POM_ERR;
+
+	const char *data = buff;
+
+	if (!c->out_len) { // Nothing pending, try to send it right away
+		while (len) {
+			ssize_t res = send(c->fd, data, len, 0);
+			if (res < 0) {
+				if (errno == EINTR)
+					continue;
+				if (errno != EAGAIN && errno != EWOULDBLOCK) {
+					c->flags |= MGMT_FLAG_ERROR;
+					return POM_ERR;
+				}
+				break;
+			}
+			data += res;
+			len -= res;
+		}
+
+		if (!len)
+			return POM_OK;
+	}
+
+	if (c->out_len + len > MGMT_OUTPUT_BUFF_MAX) {
+		c->flags |= MGMT_FLAG_ERROR;
+		return POM_ERR;
+	}
+
+	if (c->out_len + len > c->out_size) {
+		size_t new_size = (c->out_size ? c->out_size : MGMT_PRINT_BUFF_SIZE);
+		while (new_size < c->out_len + len)
+			new_size *= 2;
+		char *new_buff = realloc(c->out_buff, new_size);
+		if (!new_buff) {
+			c->flags |= MGMT_FLAG_ERROR;
+			return POM_ERR;
+		}
+		c->out_buff = new_buff;
+		c->out_size = new_size;
+	}
+
+	memcpy(c->out_buff + c->out_len, data, len);
+	c->out_len += len;
+
+	if (!(c->efd.events & EVENTLOOP_OUT) && eventloop_modify(&c->efd, EVENTLOOP_IN | EVENTLOOP_OUT) != POM_OK) {
+		c->flags |= MGMT_FLAG_ERROR;
+		return POM_ERR;
+	}
+
+	return POM_OK;
+}
+
+/**
+ * Send as much of the buffered output as the socket accepts.
+ * Must be called with mgmtsrv_lock held.
+ */
+static int mgmtsrv_flush(struct mgmt_connection *c) {
+
+	size_t pos = 0;
+	while (pos < c->out_len) {
+		ssize_t res = send(c->fd, c->out_buff + pos, c->out_len - pos, 0);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				c->flags |= MGMT_FLAG_ERROR;
+				return POM_ERR;
+			}
+			break;
+		}
+		pos += res;
+	}
+
+	c->out_len -= pos;
+	if (c->out_len)
+		memmove(c->out_buff, c->out_buff + pos, c->out_len);
+
+	// Tell the client about the messages it missed once it caught up
+	if (c->debug_dropped && c->out_len <= MGMT_OUTPUT_DEBUG_MAX) {
+		unsigned int dropped = c->debug_dropped;
+		c->debug_dropped = 0;
+		mgmtsrv_send_locked(c, "\r%u debug messages dropped\r\n", dropped);
+		if (!(c->flags & MGMT_FLAG_PROCESSING))
+			mgmtsrv_send_locked(c, "%s%s", MGMT_CMD_PROMPT, c->curcmd);
+	}
+
+	if (!c->out_len)
+		eventloop_modify(&c->efd, EVENTLOOP_IN);
+
+	return POM_OK;
+}
+
+static int mgmtsrv_vsend(struct mgmt_connection *c, char *format, va_list arg_list) {
 
 	// Do not echo anything if we are processing password
 	if (c->state == MGMT_STATE_PASSWORD)
@@ -556,11 +743,54 @@ int mgmtsrv_send(struct mgmt_connection *c, char* format, ...) {
 
 	char buff[MGMT_PRINT_BUFF_SIZE];
 
+	int len = vsnprintf(buff, MGMT_PRINT_BUFF_SIZE, format, arg_list);
+	if (len < 0)
+		return POM_ERR;
+	if (len >= MGMT_PRINT_BUFF_SIZE)
+		len = MGMT_PRINT_BUFF_SIZE - 1;
+
+	if (mgmtsrv_write(c, buff, len) != POM_OK)
+		return POM_ERR;
+
+	return len;
+}
+
+static int mgmtsrv_send_locked(struct mgmt_connection *c, char *format, ...) {
+
 	va_list arg_list;
 	va_start(arg_list, format);
-	int len = vsnprintf(buff, MGMT_PRINT_BUFF_SIZE, format, arg_list);
+	int res = mgmtsrv_vsend(c, format, arg_list);
 	va_end(arg_list);
-	return send(c->fd, buff, len, 0);
+
+	return res;
+}
+
+int mgmtsrv_send(struct mgmt_connection *c, char* format, ...) {
+
+	pthread_mutex_lock(&mgmtsrv_lock);
+	va_list arg_list;
+	va_start(arg_list, format);
+	int res = mgmtsrv_vsend(c, format, arg_list);
+	va_end(arg_list);
+	pthread_mutex_unlock(&mgmtsrv_lock);
+
+	return res;
+}
+
+/**
+ * Send data as is, even while the password is being entered.
+ * @param c Connection to send the data to
+ * @param buff Data to send
+ * @param len Length of the data
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int mgmtsrv_send_raw(struct mgmt_connection *c, const void *buff, size_t len) {
+
+	pthread_mutex_lock(&mgmtsrv_lock);
+	int res = mgmtsrv_write(c, buff, len);
+	pthread_mutex_unlock(&mgmtsrv_lock);
+
+	return res;
 }
 
 int mgmtsrv_set_password(const char *password) {
@@ -587,35 +817,53 @@ const char *mgmtsrv_get_password() {
 int mgmtsrv_send_debug(struct log_entry *entry) {
 
 
+	pthread_mutex_lock(&mgmtsrv_lock);
+
 	struct mgmt_connection *c = conn_head;
 	int i;
 
 	while (c) {
-		if (c->debug_level >= entry->level && c->state == MGMT_STATE_AUTHED) {
+		if (c->debug_level >= entry->level && c->state == MGMT_STATE_AUTHED && !(c->flags & MGMT_FLAG_ERROR)) {
+
+			if (c->out_len > MGMT_OUTPUT_DEBUG_MAX) {
+				// Client doesn't keep up, don't make it worse
+				c->debug_dropped++;
+				c = c->next;
+				continue;
+			}
+
 			if (! (c->flags & MGMT_FLAG_PROCESSING)) {
 				int cmdlen = strlen(c->curcmd) + strlen(MGMT_CMD_PROMPT);
 				int loglen = strlen(entry->data);
 				int pos = c->cursor_pos + strlen(MGMT_CMD_PROMPT);
 
 				if (loglen > cmdlen) {
-					mgmtsrv_send(c, "\r");
+					mgmtsrv_send_locked(c, "\r");
 				} else {
 					for (i = pos; i < cmdlen; i++)
-						mgmtsrv_send(c, " ");
-					mgmtsrv_send(c, "\r");
+						mgmtsrv_send_locked(c, " ");
+					mgmtsrv_send_locked(c, "\r");
 				}
 			}
 
-			mgmtsrv_send(c, "%s: %s\r\n", entry->file, entry->data);
+			if (c->debug_dropped) {
+				mgmtsrv_send_locked(c, "%u debug messages dropped\r\n", c->debug_dropped);
+				c->debug_dropped = 0;
+			}
+
+			mgmtsrv_send_locked(c, "%s: %s\r\n", entry->file, entry->data);
 
 			if (! (c->flags & MGMT_FLAG_PROCESSING)) {
-				mgmtsrv_send(c, "%s%s", MGMT_CMD_PROMPT, c->curcmd);
+				mgmtsrv_send_locked(c, "%s%s", MGMT_CMD_PROMPT, c->curcmd);
 				for (i = strlen(c->curcmd); i > c->cursor_pos; i--)
-					mgmtsrv_send(c, "\b");
+					mgmtsrv_send_locked(c, "\b");
 			}
 		}
 		c = c->next;
 	}
+
+	pthread_mutex_unlock(&mgmtsrv_lock);
+
 	return POM_OK;
 
 }
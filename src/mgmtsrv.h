@@ -23,6 +23,7 @@
 #define __MGMTSRV_H__
 
 #include "common.h"
+#include "eventloop.h"
 
 #include <sys/socket.h>
 #include <fcntl.h>
@@ -47,9 +48,16 @@
 
 #define MGMT_FLAG_LISTENING	0x1	// this is a listening socket
 #define MGMT_FLAG_PROCESSING	0x2	// one function is being processed
+#define MGMT_FLAG_ERROR		0x4	// the connection must be closed by the event loop
 
 #define MGMT_PRINT_BUFF_SIZE 2048
 
+// Maximum amount of output buffered for a connection which doesn't read fast enough
+#define MGMT_OUTPUT_BUFF_MAX (1024 * 1024)
+
+// Debug messages are dropped when more than this amount of output is buffered
+#define MGMT_OUTPUT_DEBUG_MAX (MGMT_OUTPUT_BUFF_MAX / 2)
+
 enum {
 	MGMT_STATE_INIT,
 	MGMT_STATE_PASSWORD,
@@ -71,6 +79,10 @@ struct mgmt_connection {
 	struct mgmt_connection *next;
 	uint16_t win_x, win_y; // size of the remote window
 	int debug_level;
+	struct eventloop_fd efd; // registration in the event loop
+	char *out_buff; // output waiting for the socket to be writable
+	size_t out_len, out_size; // used and allocated size of the output buffer
+	unsigned int debug_dropped; // debug messages dropped since the output buffer was full
 
 };
 
@@ -99,6 +111,8 @@ struct mgmt_command {
 int mgmtsrv_init(const char *port);
 int mgmtsrv_process();
 int mgmtsrv_read_socket(struct mgmt_connection *c);
+int mgmtsrv_listen_handler(struct eventloop_fd *efd, uint32_t events);
+int mgmtsrv_connection_handler(struct eventloop_fd *efd, uint32_t events);
 int mgmtsrv_cleanup();
 
 int mgmtsrv_accept_connection(struct mgmt_connection *c);
@@ -108,6 +122,7 @@ int mgmtsrv_match_command(char *words[MGMT_MAX_CMD_WORDS], struct mgmt_command *
 int mgmtsrv_close_connection(struct mgmt_connection *c);
 
 int mgmtsrv_send(struct mgmt_connection *c, char* format, ...);
+int mgmtsrv_send_raw(struct mgmt_connection *c, const void *buff, size_t len);
 
 int mgmtsrv_set_password(const char *password);
 const char *mgmtsrv_get_password();
@@ -43,7 +43,7 @@ int mgmtvty_init(struct mgmt_connection *c) {
 	mgmtsrv_send(c, "%s", "\nThis is packet-o-matic " POM_VERSION "\nCopyright Guy Martin 2006-2010\n\nType '?' for command list.\n");
 
 	char commands[] = { IAC, WILL, TELOPT_ECHO, IAC, WILL, TELOPT_SGA, IAC, DO, TELOPT_NAWS, IAC, DONT, TELOPT_LINEMODE };
-	send(c->fd, commands, sizeof(commands), 0);
+	mgmtsrv_send_raw(c, commands, sizeof(commands));
 
 	if (!mgmtsrv_get_password()) {
 		mgmtsrv_send(c, "%s", MGMT_CMD_PROMPT);
@@ -292,7 +292,7 @@ int mgmtvty_process_telnet_option(struct mgmt_connection *c, unsigned char *opt,
 				case DONT: {
 					// The remote client sux, closing connection (ok this is against RFC but I don't feel like supporting this as well)
 					char *error_msg = "\r\nYou're telnet client doesn't support the TELNET ECHO mode. Closing connection\r\n";
-					send(c->fd, error_msg, strlen(error_msg), 0);
+					mgmtsrv_send_raw(c, error_msg, strlen(error_msg));
 					break;
 				}
 			}
@@ -325,7 +325,7 @@ int mgmtvty_process_telnet_option(struct mgmt_connection *c, unsigned char *opt,
 				case DONT: {
 					// The remote client sux, closing connection (ok this is against RFC but I don't feel like supporting this as well)
 					char *error_msg = "\r\nYou're telnet client doesn't support the TELNET SUPPRESS GO AHEAD option. Closing connection\r\n";
-					send(c->fd, error_msg, strlen(error_msg), 0);
+					mgmtsrv_send_raw(c, error_msg, strlen(error_msg));
 					break;
 				}
 			}
@@ -346,7 +346,7 @@ int mgmtvty_process_telnet_option(struct mgmt_connection *c, unsigned char *opt,
 					return POM_OK;
 
 			}
-			send(c->fd, deny_msg, 3, 0);
+			mgmtsrv_send_raw(c, deny_msg, 3);
 
 		}
 	}
@@ -26,6 +26,7 @@
 
 #include "rules.h"
 #include "perf.h"
+#include "filewriter.h"
 // Common stuff used in modules
 #include <stdlib.h>
 #include <stdio.h>
@@ -0,0 +1,704 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#define _GNU_SOURCE // For fopencookie()
+
+#include "pcap_compress.h"
+
+#ifdef HAVE_ZLIB
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <zlib.h>
+
+/// A block of the file compressed by the threads
+struct pcap_compress_job {
+
+	char *in; ///< Uncompressed data
+	size_t in_len;
+	uint64_t offset; ///< Offset of the block in the uncompressed file
+	unsigned char *out; ///< The gzip member
+	size_t out_len;
+	int done; ///< The member is ready to be written
+
+	struct pcap_compress_job *next_queued; ///< Next job to compress
+	struct pcap_compress_job *next_pending; ///< Next job to write, in file order
+
+};
+
+/// A compressed file being written
+struct pcap_compress {
+
+	int fd;
+	int level;
+
+	char *buff; ///< Block being filled
+	size_t buff_len;
+	uint64_t offset; ///< Amount of uncompressed data received so far
+
+	pthread_t *threads;
+	unsigned int num_threads;
+	pthread_mutex_t lock; ///< Protect the fields below
+	pthread_cond_t work_cond; ///< Signaled when a job is queued or when the threads must stop
+	pthread_cond_t done_cond; ///< Signaled when a job was written
+	struct pcap_compress_job *queue_head, *queue_tail;
+	struct pcap_compress_job *pending_head, *pending_tail;
+	unsigned int jobs; ///< Number of jobs not written yet
+	int writing; ///< A thread is writing the pending jobs
+	int stop;
+	int error; ///< Errno of the first error
+
+	z_stream z; ///< Used when there is no thread
+
+};
+
+/// Position of a gzip member in a compressed file
+struct pcap_uncompress_member {
+
+	off_t pos; ///< Position of the member in the file
+	uint64_t offset; ///< Offset of its block in the uncompressed file
+
+};
+
+/// A compressed file being read
+struct pcap_uncompress {
+
+	int fd;
+	z_stream z;
+	unsigned char in[65536];
+	uint64_t offset; ///< Offset of the next byte returned in the uncompressed file
+	int eof;
+
+	struct pcap_uncompress_member *members; ///< Map of the members, built on the first seek
+	size_t members_count;
+	int members_scanned; ///< 1 if the map is valid, -1 if the file has no map
+
+};
+
+static void pcap_compress_put32(unsigned char *buff, uint32_t val) {
+
+	buff[0] = val;
+	buff[1] = val >> 8;
+	buff[2] = val >> 16;
+	buff[3] = val >> 24;
+}
+
+static uint32_t pcap_compress_get32(const unsigned char *buff) {
+
+	return buff[0] | (buff[1] << 8) | (buff[2] << 16) | ((uint32_t) buff[3] << 24);
+}
+
+/**
+ * Compress a block into a gzip member.
+ */
+static int pcap_compress_job_run(z_stream *z, struct pcap_compress_job *job) {
+
+	size_t max = deflateBound(z, job->in_len) + PCAP_COMPRESS_HEADER_SIZE + PCAP_COMPRESS_TRAILER_SIZE;
+	job->out = malloc(max);
+	if (!job->out)
+		return ENOMEM;
+
+	unsigned char *hdr = job->out;
+	memset(hdr, 0, PCAP_COMPRESS_HEADER_SIZE);
+	hdr[0] = 0x1f;
+	hdr[1] = 0x8b;
+	hdr[2] = Z_DEFLATED;
+	hdr[3] = 0x4; // FEXTRA
+	hdr[9] = 0xff; // Unknown OS
+	hdr[10] = (4 + PCAP_COMPRESS_SUBFIELD_LEN) & 0xff;
+	hdr[11] = (4 + PCAP_COMPRESS_SUBFIELD_LEN) >> 8;
+	hdr[12] = PCAP_COMPRESS_SI1;
+	hdr[13] = PCAP_COMPRESS_SI2;
+	hdr[14] = PCAP_COMPRESS_SUBFIELD_LEN;
+	hdr[15] = 0;
+	// Member size at 16 is filled below
+	pcap_compress_put32(hdr + 20, job->offset);
+	pcap_compress_put32(hdr + 24, job->offset >> 32);
+
+	deflateReset(z);
+	z->next_in = (unsigned char *) job->in;
+	z->avail_in = job->in_len;
+	z->next_out = job->out + PCAP_COMPRESS_HEADER_SIZE;
+	z->avail_out = max - PCAP_COMPRESS_HEADER_SIZE - PCAP_COMPRESS_TRAILER_SIZE;
+
+	if (deflate(z, Z_FINISH) != Z_STREAM_END)
+		return EIO;
+
+	size_t len = PCAP_COMPRESS_HEADER_SIZE + z->total_out;
+	pcap_compress_put32(job->out + len, crc32(crc32(0, Z_NULL, 0), (unsigned char *) job->in, job->in_len));
+	pcap_compress_put32(job->out + len + 4, job->in_len);
+	job->out_len = len + PCAP_COMPRESS_TRAILER_SIZE;
+	pcap_compress_put32(hdr + 16, job->out_len);
+
+	free(job->in);
+	job->in = NULL;
+
+	return 0;
+}
+
+static int pcap_compress_write_full(int fd, const unsigned char *buff, size_t len) {
+
+	while (len > 0) {
+		ssize_t res = write(fd, buff, len);
+		if (res == -1) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		buff += res;
+		len -= res;
+	}
+
+	return 0;
+}
+
+static void pcap_compress_job_free(struct pcap_compress_job *job) {
+
+	if (job->in)
+		free(job->in);
+	if (job->out)
+		free(job->out);
+	free(job);
+}
+
+/**
+ * Write the members which are ready, in file order. Must be called with the lock held.
+ */
+static void pcap_compress_write_pending(struct pcap_compress *c) {
+
+	if (c->writing)
+		return; // The other thread will write our job as well
+
+	c->writing = 1;
+
+	while (c->pending_head && c->pending_head->done) {
+		struct pcap_compress_job *job = c->pending_head;
+		c->pending_head = job->next_pending;
+		if (!c->pending_head)
+			c->pending_tail = NULL;
+
+		pthread_mutex_unlock(&c->lock);
+		int err = 0;
+		if (job->out)
+			err = pcap_compress_write_full(c->fd, job->out, job->out_len);
+		pcap_compress_job_free(job);
+		pthread_mutex_lock(&c->lock);
+
+		if (err && !c->error)
+			c->error = err;
+		c->jobs--;
+		pthread_cond_broadcast(&c->done_cond);
+	}
+
+	c->writing = 0;
+}
+
+static void *pcap_compress_thread_func(void *priv) {
+
+	struct pcap_compress *c = priv;
+
+	z_stream z;
+	memset(&z, 0, sizeof(z_stream));
+	int zerr = deflateInit2(&z, c->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+
+	pthread_mutex_lock(&c->lock);
+
+	while (1) {
+
+		while (!c->queue_head && !c->stop)
+			pthread_cond_wait(&c->work_cond, &c->lock);
+
+		struct pcap_compress_job *job = c->queue_head;
+		if (!job)
+			break;
+
+		c->queue_head = job->next_queued;
+		if (!c->queue_head)
+			c->queue_tail = NULL;
+
+		pthread_mutex_unlock(&c->lock);
+		int err = (zerr == Z_OK ? pcap_compress_job_run(&z, job) : ENOMEM);
+		pthread_mutex_lock(&c->lock);
+
+		if (err) {
+			if (!c->error)
+				c->error = err;
+			free(job->out);
+			job->out = NULL;
+		}
+		job->done = 1;
+
+		pcap_compress_write_pending(c);
+	}
+
+	pthread_mutex_unlock(&c->lock);
+
+	if (zerr == Z_OK)
+		deflateEnd(&z);
+
+	return NULL;
+}
+
+/**
+ * Hand the current block to the threads or compress it right away.
+ */
+static int pcap_compress_submit(struct pcap_compress *c) {
+
+	struct pcap_compress_job *job = malloc(sizeof(struct pcap_compress_job));
+	if (!job)
+		return ENOMEM;
+	memset(job, 0, sizeof(struct pcap_compress_job));
+
+	job->in = c->buff;
+	job->in_len = c->buff_len;
+	job->offset = c->offset - c->buff_len;
+	c->buff = NULL;
+	c->buff_len = 0;
+
+	if (!c->num_threads) {
+		int err = pcap_compress_job_run(&c->z, job);
+		if (!err)
+			err = pcap_compress_write_full(c->fd, job->out, job->out_len);
+		pcap_compress_job_free(job);
+		return err;
+	}
+
+	pthread_mutex_lock(&c->lock);
+
+	// Don't let more than two blocks per thread wait
+	while (c->jobs >= c->num_threads * 2 && !c->error)
+		pthread_cond_wait(&c->done_cond, &c->lock);
+
+	int err = c->error;
+	if (err) {
+		pthread_mutex_unlock(&c->lock);
+		pcap_compress_job_free(job);
+		return err;
+	}
+
+	c->jobs++;
+
+	if (c->queue_tail)
+		c->queue_tail->next_queued = job;
+	else
+		c->queue_head = job;
+	c->queue_tail = job;
+
+	if (c->pending_tail)
+		c->pending_tail->next_pending = job;
+	else
+		c->pending_head = job;
+	c->pending_tail = job;
+
+	pthread_cond_signal(&c->work_cond);
+	pthread_mutex_unlock(&c->lock);
+
+	return 0;
+}
+
+static ssize_t pcap_compress_cookie_write(void *cookie, const char *buf, size_t size) {
+
+	struct pcap_compress *c = cookie;
+
+	size_t done = 0;
+	while (done < size) {
+		if (!c->buff) {
+			c->buff = malloc(PCAP_COMPRESS_BLOCK_SIZE);
+			if (!c->buff) {
+				errno = ENOMEM;
+				return -1;
+			}
+		}
+
+		size_t len = size - done;
+		if (len > PCAP_COMPRESS_BLOCK_SIZE - c->buff_len)
+			len = PCAP_COMPRESS_BLOCK_SIZE - c->buff_len;
+		memcpy(c->buff + c->buff_len, buf + done, len);
+		c->buff_len += len;
+		c->offset += len;
+		done += len;
+
+		if (c->buff_len == PCAP_COMPRESS_BLOCK_SIZE) {
+			int err = pcap_compress_submit(c);
+			if (err) {
+				errno = err;
+				return -1;
+			}
+		}
+	}
+
+	return size;
+}
+
+static int pcap_compress_cookie_seek(void *cookie, off64_t *offset, int whence) {
+
+	struct pcap_compress *c = cookie;
+
+	// Only telling the current position is supported
+	if (whence != SEEK_CUR || *offset != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	*offset = c->offset;
+
+	return 0;
+}
+
+static int pcap_compress_cookie_close(void *cookie) {
+
+	struct pcap_compress *c = cookie;
+
+	int err = 0;
+	if (c->buff_len)
+		err = pcap_compress_submit(c);
+
+	if (c->num_threads) {
+		pthread_mutex_lock(&c->lock);
+		c->stop = 1;
+		pthread_cond_broadcast(&c->work_cond);
+		pthread_mutex_unlock(&c->lock);
+
+		unsigned int i;
+		for (i = 0; i < c->num_threads; i++)
+			pthread_join(c->threads[i], NULL);
+
+		if (!err)
+			err = c->error;
+
+		pthread_mutex_destroy(&c->lock);
+		pthread_cond_destroy(&c->work_cond);
+		pthread_cond_destroy(&c->done_cond);
+		free(c->threads);
+	} else {
+		deflateEnd(&c->z);
+	}
+
+	if (c->buff)
+		free(c->buff);
+
+	if (close(c->fd) && !err)
+		err = errno;
+
+	free(c);
+
+	if (err) {
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Create a compressed file.
+ * @param filename Name of the file
+ * @param level Compression level from 1 to 9
+ * @param threads Number of threads compressing the blocks, 0 to compress them while writing
+ * @return A stream whose content will be compressed or NULL on error.
+ */
+FILE *pcap_compress_fopen(const char *filename, int level, unsigned int threads) {
+
+	struct pcap_compress *c = malloc(sizeof(struct pcap_compress));
+	if (!c)
+		return NULL;
+	memset(c, 0, sizeof(struct pcap_compress));
+	c->level = level;
+
+	c->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (c->fd == -1) {
+		free(c);
+		return NULL;
+	}
+
+	if (threads) {
+		pthread_mutex_init(&c->lock, NULL);
+		pthread_cond_init(&c->work_cond, NULL);
+		pthread_cond_init(&c->done_cond, NULL);
+		c->threads = malloc(sizeof(pthread_t) * threads);
+		for (c->num_threads = 0; c->num_threads < threads; c->num_threads++) {
+			if (pthread_create(&c->threads[c->num_threads], NULL, pcap_compress_thread_func, c))
+				break;
+		}
+	}
+
+	if (!c->num_threads && deflateInit2(&c->z, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		pcap_compress_cookie_close(c);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	cookie_io_functions_t funcs = {
+		.read = NULL,
+		.write = pcap_compress_cookie_write,
+		.seek = pcap_compress_cookie_seek,
+		.close = pcap_compress_cookie_close,
+	};
+
+	FILE *f = fopencookie(c, "w", funcs);
+	if (!f) {
+		pcap_compress_cookie_close(c);
+		return NULL;
+	}
+
+	return f;
+}
+
+/**
+ * Read the map of the members from their headers.
+ */
+static int pcap_uncompress_scan(struct pcap_uncompress *u) {
+
+	size_t size = 0;
+	off_t pos = 0;
+	unsigned char hdr[PCAP_COMPRESS_HEADER_SIZE];
+
+	while (1) {
+		ssize_t res = pread(u->fd, hdr, PCAP_COMPRESS_HEADER_SIZE, pos);
+		if (res == 0)
+			break;
+
+		if (res != PCAP_COMPRESS_HEADER_SIZE || hdr[0] != 0x1f || hdr[1] != 0x8b || !(hdr[3] & 0x4) ||
+			hdr[12] != PCAP_COMPRESS_SI1 || hdr[13] != PCAP_COMPRESS_SI2 || hdr[14] != PCAP_COMPRESS_SUBFIELD_LEN) {
+			// Not written by us
+			u->members_scanned = -1;
+			return -1;
+		}
+
+		if (u->members_count >= size) {
+			size = (size ? size * 2 : 256);
+			u->members = realloc(u->members, sizeof(struct pcap_uncompress_member) * size);
+		}
+
+		struct pcap_uncompress_member *m = &u->members[u->members_count];
+		m->pos = pos;
+		m->offset = pcap_compress_get32(hdr + 20) | ((uint64_t) pcap_compress_get32(hdr + 24) << 32);
+		u->members_count++;
+
+		uint32_t member_size = pcap_compress_get32(hdr + 16);
+		if (member_size < PCAP_COMPRESS_HEADER_SIZE) {
+			u->members_scanned = -1;
+			return -1;
+		}
+		pos += member_size;
+	}
+
+	u->members_scanned = 1;
+
+	return 0;
+}
+
+/**
+ * Restart decompressing from a given position of the file.
+ */
+static int pcap_uncompress_restart(struct pcap_uncompress *u, off_t pos, uint64_t offset) {
+
+	if (lseek(u->fd, pos, SEEK_SET) == -1)
+		return -1;
+
+	inflateReset(&u->z);
+	u->z.avail_in = 0;
+	u->offset = offset;
+	u->eof = 0;
+
+	return 0;
+}
+
+static ssize_t pcap_uncompress_cookie_read(void *cookie, char *buf, size_t size) {
+
+	struct pcap_uncompress *u = cookie;
+
+	u->z.next_out = (unsigned char *) buf;
+	u->z.avail_out = size;
+
+	while (u->z.avail_out && !u->eof) {
+
+		if (!u->z.avail_in) {
+			ssize_t len = read(u->fd, u->in, sizeof(u->in));
+			if (len == -1) {
+				if (errno == EINTR)
+					continue;
+				return -1;
+			}
+			if (len == 0) {
+				u->eof = 1;
+				break;
+			}
+			u->z.next_in = u->in;
+			u->z.avail_in = len;
+		}
+
+		int res = inflate(&u->z, Z_NO_FLUSH);
+		if (res == Z_STREAM_END) {
+			// Continue with the next member
+			unsigned char *next_in = u->z.next_in;
+			unsigned int avail_in = u->z.avail_in;
+			inflateReset(&u->z);
+			u->z.next_in = next_in;
+			u->z.avail_in = avail_in;
+		} else if (res != Z_OK && res != Z_BUF_ERROR) {
+			errno = EIO;
+			return -1;
+		}
+	}
+
+	size_t len = size - u->z.avail_out;
+	u->offset += len;
+
+	return len;
+}
+
+static int pcap_uncompress_cookie_seek(void *cookie, off64_t *offset, int whence) {
+
+	struct pcap_uncompress *u = cookie;
+
+	uint64_t target;
+	if (whence == SEEK_SET)
+		target = *offset;
+	else if (whence == SEEK_CUR)
+		target = u->offset + *offset;
+	else {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (target != u->offset) {
+
+		if (!u->members_scanned)
+			pcap_uncompress_scan(u);
+
+		if (u->members_scanned == 1 && u->members_count) {
+			// Find the last member starting before the target
+			size_t low = 0, high = u->members_count;
+			while (high - low > 1) {
+				size_t mid = low + (high - low) / 2;
+				if (u->members[mid].offset <= target)
+					low = mid;
+				else
+					high = mid;
+			}
+			if (target < u->offset || u->members[low].offset > u->offset)
+				if (pcap_uncompress_restart(u, u->members[low].pos, u->members[low].offset))
+					return -1;
+		} else if (target < u->offset) {
+			if (pcap_uncompress_restart(u, 0, 0))
+				return -1;
+		}
+
+		// Skip the data before the target
+		char skip[4096];
+		while (u->offset < target) {
+			size_t len = target - u->offset;
+			if (len > sizeof(skip))
+				len = sizeof(skip);
+			ssize_t res = pcap_uncompress_cookie_read(u, skip, len);
+			if (res <= 0) {
+				if (res == 0)
+					errno = EINVAL;
+				return -1;
+			}
+		}
+	}
+
+	*offset = u->offset;
+
+	return 0;
+}
+
+static int pcap_uncompress_cookie_close(void *cookie) {
+
+	struct pcap_uncompress *u = cookie;
+
+	inflateEnd(&u->z);
+	int res = close(u->fd);
+	if (u->members)
+		free(u->members);
+	free(u);
+
+	return res;
+}
+
+/**
+ * Open a compressed file for reading.
+ * @param filename Name of the file
+ * @return A stream returning the uncompressed content or NULL on error.
+ */
+FILE *pcap_uncompress_fopen(const char *filename) {
+
+	struct pcap_uncompress *u = malloc(sizeof(struct pcap_uncompress));
+	if (!u)
+		return NULL;
+	memset(u, 0, sizeof(struct pcap_uncompress));
+
+	u->fd = open(filename, O_RDONLY);
+	if (u->fd == -1) {
+		free(u);
+		return NULL;
+	}
+
+	// Accept any gzip file
+	if (inflateInit2(&u->z, 15 + 16) != Z_OK) {
+		close(u->fd);
+		free(u);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	cookie_io_functions_t funcs = {
+		.read = pcap_uncompress_cookie_read,
+		.write = NULL,
+		.seek = pcap_uncompress_cookie_seek,
+		.close = pcap_uncompress_cookie_close,
+	};
+
+	FILE *f = fopencookie(u, "r", funcs);
+	if (!f) {
+		pcap_uncompress_cookie_close(u);
+		return NULL;
+	}
+
+	return f;
+}
+
+/**
+ * Check if a file is compressed with gzip.
+ * @return 1 if it is, 0 if not and -1 on error.
+ */
+int pcap_compress_is_compressed(const char *filename) {
+
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	unsigned char magic[2];
+	ssize_t res = read(fd, magic, sizeof(magic));
+	close(fd);
+
+	if (res == -1)
+		return -1;
+
+	return (res == sizeof(magic) && magic[0] == 0x1f && magic[1] == 0x8b);
+}
+
+#endif
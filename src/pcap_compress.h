@@ -0,0 +1,67 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __PCAP_COMPRESS_H__
+#define __PCAP_COMPRESS_H__
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Compressed pcap files are a sequence of independent gzip members so they
+ * can be read by any gzip tool. Each member holds a block of the pcap file
+ * and its header carries an extra field with the size of the member and
+ * the offset of the block in the uncompressed file. Readers use it to seek
+ * without decompressing the whole file.
+ */
+
+/// Extension added to the name of compressed files
+#define PCAP_COMPRESS_EXT		".gz"
+
+/// Default amount of uncompressed data in each gzip member
+#define PCAP_COMPRESS_BLOCK_SIZE	(1024 * 1024)
+
+/// Id of the gzip extra subfield
+#define PCAP_COMPRESS_SI1		'P'
+#define PCAP_COMPRESS_SI2		'C'
+
+/// Size of the subfield data : member size (4 bytes) and block offset (8 bytes), little endian
+#define PCAP_COMPRESS_SUBFIELD_LEN	12
+
+/// Size of the gzip header of each member including the extra field
+#define PCAP_COMPRESS_HEADER_SIZE	(10 + 2 + 4 + PCAP_COMPRESS_SUBFIELD_LEN)
+
+/// Size of the gzip trailer of each member
+#define PCAP_COMPRESS_TRAILER_SIZE	8
+
+#ifdef HAVE_ZLIB
+
+FILE *pcap_compress_fopen(const char *filename, int level, unsigned int threads);
+FILE *pcap_uncompress_fopen(const char *filename);
+int pcap_compress_is_compressed(const char *filename);
+
+#endif
+
+#endif
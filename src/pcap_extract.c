@@ -0,0 +1,726 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Extract the packets of one connection from the segments written by
+ * target_pcap in segment mode or query the files written in archive mode.
+ * The pcap file of each index is the file with the same name and the
+ * PCAP_INDEX_SEGMENT_EXT extension.
+ */
+
+#include "pcap_index.h"
+#include "pcap_compress.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+/// Size of the pcap file header
+#define PCAP_FILE_HEADER_SIZE	24
+/// Size of the pcap record header
+#define PCAP_RECORD_HEADER_SIZE	16
+/// Magic of the pcap files in host byte order
+#define PCAP_MAGIC		0xa1b2c3d4
+#define PCAP_MAGIC_SWAPPED	0xd4c3b2a1
+
+/// Largest record we accept
+#define PCAP_MAX_RECORD_SIZE	262144
+
+/// Link types understood when filtering the packets of an archive
+#define PCAP_LINKTYPE_ETHERNET	1
+#define PCAP_LINKTYPE_RAW	12
+#define PCAP_LINKTYPE_RAW_ALT	101
+#define PCAP_LINKTYPE_LINUX_SLL	113
+
+/// What to look for in an archive
+struct pcap_query {
+
+	int family; ///< AF_INET or AF_INET6 if an address was given, 0 otherwise
+	unsigned char addr[16];
+	int has_port;
+	uint16_t port; ///< In network byte order
+	uint64_t start; ///< Start time in microseconds
+	uint64_t end; ///< End time in microseconds
+
+	unsigned char key_addr[PCAP_ARCHIVE_KEY_SIZE];
+	uint32_t key_addr_len;
+	unsigned char key_port[PCAP_ARCHIVE_KEY_SIZE];
+	uint32_t key_port_len;
+
+	int warned_linktype; ///< Warned that the packets can't be filtered
+};
+
+struct pcap_index {
+
+	char *filename;
+	struct pcap_index_header hdr;
+	struct pcap_index_flow *flows;
+	uint64_t *offsets;
+
+};
+
+void print_usage() {
+
+	printf(	"Usage : pom-pcap-extract [options] INDEX...\n"
+		"\n"
+		"Options :\n"
+		" -l, --list                 list the connections found in the indexes\n"
+		" -f, --flow=ID              extract the packets of the connection ID\n"
+		" -q, --query                extract the packets of archive indexes matching the criterias below\n"
+		" -a, --addr=ADDR            packets from or to this IPv4 or IPv6 address\n"
+		" -p, --port=PORT            packets from or to this TCP or UDP port\n"
+		" -s, --start=TIME           packets captured after this time\n"
+		" -e, --end=TIME             packets captured before this time\n"
+		" -o, --output=FILE          file where the packets are written (default stdout)\n"
+		" -h, --help                 display the help\n"
+		"\n"
+		"The indexes must be given in the order the files were written.\n"
+		"TIME is either a number of seconds since the epoch or \"YYYY-MM-DD HH:MM[:SS]\" in local time.\n"
+		);
+}
+
+static int index_read(struct pcap_index *idx, char *filename) {
+
+	memset(idx, 0, sizeof(struct pcap_index));
+	idx->filename = filename;
+
+	FILE *f = fopen(filename, "r");
+	if (!f) {
+		fprintf(stderr, "Unable to open index %s : %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	if (fread(&idx->hdr, sizeof(struct pcap_index_header), 1, f) != 1 || memcmp(idx->hdr.magic, PCAP_INDEX_MAGIC, sizeof(idx->hdr.magic))) {
+		fprintf(stderr, "File %s is not a valid index\n", filename);
+		fclose(f);
+		return -1;
+	}
+
+	idx->flows = malloc(sizeof(struct pcap_index_flow) * (idx->hdr.flows + 1));
+	idx->offsets = malloc(sizeof(uint64_t) * (idx->hdr.records + 1));
+
+	if (!idx->flows || !idx->offsets ||
+		fread(idx->flows, sizeof(struct pcap_index_flow), idx->hdr.flows, f) != idx->hdr.flows ||
+		fread(idx->offsets, sizeof(uint64_t), idx->hdr.records, f) != idx->hdr.records) {
+		fprintf(stderr, "Index %s is truncated\n", filename);
+		fclose(f);
+		return -1;
+	}
+
+	fclose(f);
+
+	return 0;
+}
+
+static void index_cleanup(struct pcap_index *idx) {
+
+	if (idx->flows)
+		free(idx->flows);
+	if (idx->offsets)
+		free(idx->offsets);
+}
+
+static struct pcap_index_flow *index_find_flow(struct pcap_index *idx, uint64_t id) {
+
+	// Connections are sorted by id
+	uint32_t low = 0, high = idx->hdr.flows;
+	while (low < high) {
+		uint32_t mid = low + (high - low) / 2;
+		if (idx->flows[mid].id == id)
+			return &idx->flows[mid];
+		if (idx->flows[mid].id < id)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return NULL;
+}
+
+static FILE *segment_open(char *index, char *index_ext, int *swapped, unsigned char *file_hdr) {
+
+	char *segment = malloc(strlen(index) + strlen(PCAP_INDEX_SEGMENT_EXT) + strlen(PCAP_COMPRESS_EXT) + 1);
+	strcpy(segment, index);
+	size_t len = strlen(segment);
+	size_t ext_len = strlen(index_ext);
+	if (len >= ext_len && !strcmp(segment + len - ext_len, index_ext))
+		segment[len - ext_len] = 0;
+	strcat(segment, PCAP_INDEX_SEGMENT_EXT);
+
+	FILE *f = fopen(segment, "r");
+#ifdef HAVE_ZLIB
+	if (!f && errno == ENOENT) {
+		// The segment may have been written compressed
+		len = strlen(segment);
+		strcat(segment, PCAP_COMPRESS_EXT);
+		f = pcap_uncompress_fopen(segment);
+		if (!f && errno == ENOENT)
+			segment[len] = 0;
+	}
+#endif
+	if (!f) {
+		fprintf(stderr, "Unable to open segment %s : %s\n", segment, strerror(errno));
+		free(segment);
+		return NULL;
+	}
+
+	uint32_t magic = 0;
+	if (fread(file_hdr, PCAP_FILE_HEADER_SIZE, 1, f) != 1) {
+		fprintf(stderr, "Segment %s is truncated\n", segment);
+		goto err;
+	}
+	memcpy(&magic, file_hdr, sizeof(magic));
+
+	if (magic == PCAP_MAGIC) {
+		*swapped = 0;
+	} else if (magic == PCAP_MAGIC_SWAPPED) {
+		*swapped = 1;
+	} else {
+		fprintf(stderr, "Segment %s is not a pcap file\n", segment);
+		goto err;
+	}
+
+	free(segment);
+	return f;
+
+err:
+	fclose(f);
+	free(segment);
+	return NULL;
+}
+
+static int extract_flow(struct pcap_index *idxs, int count, uint64_t id, FILE *out) {
+
+	unsigned char *record = malloc(PCAP_RECORD_HEADER_SIZE + PCAP_MAX_RECORD_SIZE);
+	int header_written = 0;
+	uint64_t packets = 0;
+
+	int i;
+	for (i = 0; i < count; i++) {
+		struct pcap_index_flow *flow = index_find_flow(&idxs[i], id);
+		if (!flow)
+			continue;
+
+		if (flow->first + flow->count > idxs[i].hdr.records) {
+			fprintf(stderr, "Index %s is corrupted\n", idxs[i].filename);
+			goto err;
+		}
+
+		unsigned char file_hdr[PCAP_FILE_HEADER_SIZE];
+		int swapped = 0;
+		FILE *seg = segment_open(idxs[i].filename, PCAP_INDEX_EXT, &swapped, file_hdr);
+		if (!seg)
+			goto err;
+
+		if (!header_written) {
+			if (fwrite(file_hdr, PCAP_FILE_HEADER_SIZE, 1, out) != 1) {
+				fclose(seg);
+				goto write_err;
+			}
+			header_written = 1;
+		}
+
+		uint32_t j;
+		for (j = 0; j < flow->count; j++) {
+			uint64_t offset = idxs[i].offsets[flow->first + j];
+			if (fseeko(seg, offset, SEEK_SET) || fread(record, PCAP_RECORD_HEADER_SIZE, 1, seg) != 1) {
+				fprintf(stderr, "Unable to read the record at offset %"PRIu64" in the segment of %s\n", offset, idxs[i].filename);
+				fclose(seg);
+				goto err;
+			}
+
+			uint32_t caplen;
+			memcpy(&caplen, record + 8, sizeof(caplen));
+			if (swapped)
+				caplen = ((caplen & 0xff) << 24) | ((caplen & 0xff00) << 8) | ((caplen & 0xff0000) >> 8) | (caplen >> 24);
+
+			if (caplen > PCAP_MAX_RECORD_SIZE || (caplen && fread(record + PCAP_RECORD_HEADER_SIZE, caplen, 1, seg) != 1)) {
+				fprintf(stderr, "Invalid record at offset %"PRIu64" in the segment of %s\n", offset, idxs[i].filename);
+				fclose(seg);
+				goto err;
+			}
+
+			if (fwrite(record, PCAP_RECORD_HEADER_SIZE + caplen, 1, out) != 1) {
+				fclose(seg);
+				goto write_err;
+			}
+			packets++;
+		}
+
+		fclose(seg);
+	}
+
+	free(record);
+
+	if (!packets) {
+		fprintf(stderr, "Connection %"PRIu64" not found\n", id);
+		return -1;
+	}
+
+	fprintf(stderr, "Extracted %"PRIu64" packets\n", packets);
+
+	return 0;
+
+write_err:
+	fprintf(stderr, "Unable to write the output : %s\n", strerror(errno));
+err:
+	free(record);
+	return -1;
+}
+
+static void list_flows(struct pcap_index *idxs, int count) {
+
+	printf("%-20s %-10s %s\n", "ID", "PACKETS", "NAME");
+
+	int i;
+	for (i = 0; i < count; i++) {
+		printf("# %s\n", idxs[i].filename);
+		uint32_t j;
+		for (j = 0; j < idxs[i].hdr.flows; j++) {
+			struct pcap_index_flow *flow = &idxs[i].flows[j];
+			flow->name[PCAP_INDEX_NAME_SIZE - 1] = 0;
+			printf("%-20"PRIu64" %-10u %s\n", flow->id, flow->count, flow->name);
+		}
+	}
+}
+
+static int parse_time(char *str, uint64_t *res) {
+
+	struct tm tm;
+	memset(&tm, 0, sizeof(struct tm));
+
+	char extra;
+	int items = sscanf(str, "%d-%d-%d %d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+	if (items >= 5) {
+		tm.tm_year -= 1900;
+		tm.tm_mon -= 1;
+		tm.tm_isdst = -1;
+		time_t t = mktime(&tm);
+		if (t == (time_t) -1)
+			return -1;
+		*res = (uint64_t) t * 1000000;
+		return 0;
+	}
+
+	uint64_t secs;
+	if (sscanf(str, "%"SCNu64"%c", &secs, &extra) == 1) {
+		*res = secs * 1000000;
+		return 0;
+	}
+
+	return -1;
+}
+
+static uint32_t swap32(uint32_t val) {
+
+	return ((val & 0xff) << 24) | ((val & 0xff00) << 8) | ((val & 0xff0000) >> 8) | (val >> 24);
+}
+
+/**
+ * Check the addresses and ports of a packet when the link type is known.
+ * @return 1 if the packet matches or can't be parsed, 0 if it doesn't match
+ */
+static int packet_match(struct pcap_query *q, uint32_t linktype, unsigned char *data, uint32_t len) {
+
+	if (!q->family && !q->has_port)
+		return 1;
+
+	unsigned int pos = 0;
+	uint16_t ethertype = 0;
+
+	switch (linktype) {
+		case PCAP_LINKTYPE_ETHERNET:
+			pos = 12;
+			while (1) {
+				if (len < pos + 2)
+					return 0;
+				ethertype = (data[pos] << 8) | data[pos + 1];
+				pos += 2;
+				if (ethertype != 0x8100 && ethertype != 0x88a8)
+					break;
+				pos += 2; // Skip the vlan tag
+			}
+			break;
+		case PCAP_LINKTYPE_LINUX_SLL:
+			if (len < 16)
+				return 0;
+			ethertype = (data[14] << 8) | data[15];
+			pos = 16;
+			break;
+		case PCAP_LINKTYPE_RAW:
+		case PCAP_LINKTYPE_RAW_ALT:
+			if (len < 1)
+				return 0;
+			ethertype = ((data[0] >> 4) == 6 ? 0x86dd : 0x0800);
+			break;
+		default:
+			if (!q->warned_linktype) {
+				fprintf(stderr, "Link type %u not supported, the whole blocks matching the index are extracted\n", linktype);
+				q->warned_linktype = 1;
+			}
+			return 1;
+	}
+
+	unsigned char *src, *dst;
+	unsigned int addr_len, l4;
+	unsigned char proto;
+
+	if (ethertype == 0x0800) {
+		if (len < pos + 20)
+			return 0;
+		unsigned char *ip = data + pos;
+		proto = ip[9];
+		src = ip + 12;
+		dst = ip + 16;
+		addr_len = 4;
+		l4 = pos + ((ip[0] & 0xf) * 4);
+		if (((ip[6] & 0x1f) << 8 | ip[7]) != 0) // Not the first fragment
+			proto = 0;
+		if (q->family == AF_INET6)
+			return 0;
+	} else if (ethertype == 0x86dd) {
+		if (len < pos + 40)
+			return 0;
+		unsigned char *ip = data + pos;
+		proto = ip[6];
+		src = ip + 8;
+		dst = ip + 24;
+		addr_len = 16;
+		l4 = pos + 40;
+		if (q->family == AF_INET)
+			return 0;
+	} else {
+		return 0;
+	}
+
+	if (q->family && memcmp(src, q->addr, addr_len) && memcmp(dst, q->addr, addr_len))
+		return 0;
+
+	if (q->has_port) {
+		if ((proto != 6 && proto != 17) || len < l4 + 4)
+			return 0;
+		if (memcmp(data + l4, &q->port, 2) && memcmp(data + l4 + 2, &q->port, 2))
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Extract the packets of the blocks which may match the query.
+ */
+static int query_archive(struct pcap_query *q, char *index, FILE *out, int *header_written, uint64_t *packets) {
+
+	FILE *f = fopen(index, "r");
+	if (!f) {
+		fprintf(stderr, "Unable to open index %s : %s\n", index, strerror(errno));
+		return -1;
+	}
+
+	struct pcap_archive_header hdr;
+	if (fread(&hdr, sizeof(struct pcap_archive_header), 1, f) != 1 || memcmp(hdr.magic, PCAP_ARCHIVE_MAGIC, sizeof(hdr.magic)) || !hdr.bloom_size) {
+		fprintf(stderr, "File %s is not a valid archive index\n", index);
+		fclose(f);
+		return -1;
+	}
+
+	size_t entry_size = sizeof(struct pcap_archive_block) + hdr.bloom_size;
+	uint32_t blocks = hdr.blocks;
+	if (!blocks) {
+		// The file may still be written to, use what was indexed so far
+		struct stat st;
+		if (!fstat(fileno(f), &st) && st.st_size > sizeof(struct pcap_archive_header))
+			blocks = (st.st_size - sizeof(struct pcap_archive_header)) / entry_size;
+	}
+
+	unsigned char *entry = malloc(entry_size);
+	unsigned char *record = malloc(PCAP_RECORD_HEADER_SIZE + PCAP_MAX_RECORD_SIZE);
+	FILE *seg = NULL;
+	int swapped = 0;
+	uint32_t linktype = 0;
+	int res = 0;
+
+	uint32_t i;
+	for (i = 0; i < blocks; i++) {
+
+		if (fread(entry, entry_size, 1, f) != 1) {
+			fprintf(stderr, "Index %s is truncated\n", index);
+			res = -1;
+			break;
+		}
+
+		struct pcap_archive_block *block = (struct pcap_archive_block *) entry;
+		unsigned char *bloom = entry + sizeof(struct pcap_archive_block);
+
+		if (block->last_time < q->start || block->first_time > q->end)
+			continue;
+		if (q->family && !pcap_archive_bloom_test(bloom, hdr.bloom_size, q->key_addr, q->key_addr_len))
+			continue;
+		if (q->has_port && !pcap_archive_bloom_test(bloom, hdr.bloom_size, q->key_port, q->key_port_len))
+			continue;
+
+		if (!seg) {
+			unsigned char file_hdr[PCAP_FILE_HEADER_SIZE];
+			seg = segment_open(index, PCAP_ARCHIVE_EXT, &swapped, file_hdr);
+			if (!seg) {
+				res = -1;
+				break;
+			}
+			memcpy(&linktype, file_hdr + 20, sizeof(linktype));
+			if (swapped)
+				linktype = swap32(linktype);
+			if (!*header_written) {
+				if (fwrite(file_hdr, PCAP_FILE_HEADER_SIZE, 1, out) != 1) {
+					fprintf(stderr, "Unable to write the output : %s\n", strerror(errno));
+					res = -1;
+					break;
+				}
+				*header_written = 1;
+			}
+		}
+
+		if (fseeko(seg, block->start, SEEK_SET)) {
+			fprintf(stderr, "Unable to seek to offset %"PRIu64" in the file of %s\n", block->start, index);
+			res = -1;
+			break;
+		}
+
+		uint64_t pos = block->start;
+		while (pos < block->end) {
+			if (fread(record, PCAP_RECORD_HEADER_SIZE, 1, seg) != 1) {
+				fprintf(stderr, "Unable to read the record at offset %"PRIu64" in the file of %s\n", pos, index);
+				res = -1;
+				break;
+			}
+
+			uint32_t hdr_vals[4];
+			memcpy(hdr_vals, record, sizeof(hdr_vals));
+			if (swapped) {
+				int j;
+				for (j = 0; j < 4; j++)
+					hdr_vals[j] = swap32(hdr_vals[j]);
+			}
+			uint32_t caplen = hdr_vals[2];
+
+			if (caplen > PCAP_MAX_RECORD_SIZE || (caplen && fread(record + PCAP_RECORD_HEADER_SIZE, caplen, 1, seg) != 1)) {
+				fprintf(stderr, "Invalid record at offset %"PRIu64" in the file of %s\n", pos, index);
+				res = -1;
+				break;
+			}
+			pos += PCAP_RECORD_HEADER_SIZE + caplen;
+
+			uint64_t ts = ((uint64_t) hdr_vals[0] * 1000000) + hdr_vals[1];
+			if (ts < q->start || ts > q->end)
+				continue;
+
+			if (!packet_match(q, linktype, record + PCAP_RECORD_HEADER_SIZE, caplen))
+				continue;
+
+			if (fwrite(record, PCAP_RECORD_HEADER_SIZE + caplen, 1, out) != 1) {
+				fprintf(stderr, "Unable to write the output : %s\n", strerror(errno));
+				res = -1;
+				break;
+			}
+			(*packets)++;
+		}
+
+		if (res)
+			break;
+	}
+
+	if (seg)
+		fclose(seg);
+	fclose(f);
+	free(entry);
+	free(record);
+
+	return res;
+}
+
+int main(int argc, char *argv[]) {
+
+	int list = 0, extract = 0, query = 0;
+	uint64_t flow_id = 0;
+	char *output = NULL;
+
+	struct pcap_query q;
+	memset(&q, 0, sizeof(struct pcap_query));
+	q.end = UINT64_MAX;
+
+	int c;
+
+	while (1) {
+		static struct option long_options[] = {
+			{ "list", 0, 0, 'l'},
+			{ "flow", 1, 0, 'f'},
+			{ "query", 0, 0, 'q'},
+			{ "addr", 1, 0, 'a'},
+			{ "port", 1, 0, 'p'},
+			{ "start", 1, 0, 's'},
+			{ "end", 1, 0, 'e'},
+			{ "output", 1, 0, 'o'},
+			{ "help", 0, 0, 'h'},
+			{ 0, 0, 0, 0}
+		};
+
+		c = getopt_long(argc, argv, "lf:qa:p:s:e:o:h", long_options, NULL);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+			case 'l':
+				list = 1;
+				break;
+			case 'f':
+				if (sscanf(optarg, "%"SCNu64, &flow_id) != 1) {
+					fprintf(stderr, "Invalid connection id \"%s\"\n", optarg);
+					return 1;
+				}
+				extract = 1;
+				break;
+			case 'q':
+				query = 1;
+				break;
+			case 'a':
+				if (inet_pton(AF_INET, optarg, q.addr) == 1) {
+					q.family = AF_INET;
+					q.key_addr_len = pcap_archive_key(q.key_addr, PCAP_ARCHIVE_KEY_IPV4, q.addr, 4);
+				} else if (inet_pton(AF_INET6, optarg, q.addr) == 1) {
+					q.family = AF_INET6;
+					q.key_addr_len = pcap_archive_key(q.key_addr, PCAP_ARCHIVE_KEY_IPV6, q.addr, 16);
+				} else {
+					fprintf(stderr, "Invalid address \"%s\"\n", optarg);
+					return 1;
+				}
+				break;
+			case 'p': {
+				unsigned int port;
+				if (sscanf(optarg, "%u", &port) != 1 || port > 65535) {
+					fprintf(stderr, "Invalid port \"%s\"\n", optarg);
+					return 1;
+				}
+				q.has_port = 1;
+				q.port = htons(port);
+				q.key_port_len = pcap_archive_key(q.key_port, PCAP_ARCHIVE_KEY_PORT, &q.port, sizeof(q.port));
+				break;
+			}
+			case 's':
+				if (parse_time(optarg, &q.start)) {
+					fprintf(stderr, "Invalid time \"%s\"\n", optarg);
+					return 1;
+				}
+				break;
+			case 'e':
+				if (parse_time(optarg, &q.end)) {
+					fprintf(stderr, "Invalid time \"%s\"\n", optarg);
+					return 1;
+				}
+				q.end += 999999; // Include the whole last second
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			case 'h':
+				print_usage();
+				return 0;
+			case '?':
+			default:
+				print_usage();
+				return 1;
+		}
+	}
+
+	if (optind >= argc || list + extract + query != 1) {
+		print_usage();
+		return 1;
+	}
+
+	int count = argc - optind;
+	int res = 0, i;
+
+	if (query) {
+		FILE *out = stdout;
+		if (output) {
+			out = fopen(output, "w");
+			if (!out) {
+				fprintf(stderr, "Unable to open %s : %s\n", output, strerror(errno));
+				return 1;
+			}
+		}
+
+		int header_written = 0;
+		uint64_t packets = 0;
+		for (i = 0; i < count && !res; i++)
+			res = query_archive(&q, argv[optind + i], out, &header_written, &packets);
+
+		if (fclose(out) && !res) {
+			fprintf(stderr, "Unable to write the output : %s\n", strerror(errno));
+			res = -1;
+		}
+
+		if (!res)
+			fprintf(stderr, "Extracted %"PRIu64" packets\n", packets);
+
+		return (res ? 1 : 0);
+	}
+
+	struct pcap_index *idxs = malloc(sizeof(struct pcap_index) * count);
+	memset(idxs, 0, sizeof(struct pcap_index) * count);
+
+	for (i = 0; i < count && !res; i++)
+		res = index_read(&idxs[i], argv[optind + i]);
+
+	if (!res) {
+		if (list) {
+			list_flows(idxs, count);
+		} else {
+			FILE *out = stdout;
+			if (output) {
+				out = fopen(output, "w");
+				if (!out) {
+					fprintf(stderr, "Unable to open %s : %s\n", output, strerror(errno));
+					res = -1;
+				}
+			}
+
+			if (out) {
+				res = extract_flow(idxs, count, flow_id, out);
+				if (fclose(out) && !res) {
+					fprintf(stderr, "Unable to write the output : %s\n", strerror(errno));
+					res = -1;
+				}
+			}
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		index_cleanup(&idxs[i]);
+	free(idxs);
+
+	return (res ? 1 : 0);
+}
@@ -0,0 +1,159 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __PCAP_INDEX_H__
+#define __PCAP_INDEX_H__
+
+#include <stdint.h>
+#include <string.h>
+#include "jhash.h"
+
+/*
+ * Each segment written by target_pcap in segment mode is a regular pcap file
+ * which comes with an index file. The index is written in host byte order
+ * when the segment is closed :
+ *  - struct pcap_index_header
+ *  - struct pcap_index_flow, one per connection seen in the segment, sorted by id
+ *  - uint64_t offsets of the packet records, grouped by connection
+ */
+
+#define PCAP_INDEX_MAGIC	"POMPIDX1"
+
+/// Size of the name of a connection, including the terminating null byte
+#define PCAP_INDEX_NAME_SIZE	64
+
+/// Extension of the segment files
+#define PCAP_INDEX_SEGMENT_EXT	".cap"
+/// Extension of the index files
+#define PCAP_INDEX_EXT		".idx"
+
+struct pcap_index_header {
+
+	char magic[8];
+	uint32_t flows; ///< Number of connections in the segment
+	uint32_t reserved;
+	uint64_t records; ///< Number of packet records in the segment
+
+};
+
+struct pcap_index_flow {
+
+	uint64_t id; ///< Unique id of the connection, the same in every segment
+	uint64_t first; ///< Position of its first offset in the offset table
+	uint32_t count; ///< Number of its packets in the segment
+	uint32_t reserved;
+	char name[PCAP_INDEX_NAME_SIZE]; ///< Name of the connection as configured with the flow_name parameter
+
+};
+
+/*
+ * Files written by target_pcap in archive mode also come with an index.
+ * The packets are grouped in blocks which never span more than one time
+ * bucket. The index is written in host byte order while the file grows :
+ *  - struct pcap_archive_header
+ *  - for each block, struct pcap_archive_block followed by its bloom filter
+ *
+ * The bloom filter of a block contains the addresses and the ports of its
+ * packets so that a query can skip the blocks which can't match.
+ */
+
+#define PCAP_ARCHIVE_MAGIC	"POMPARC1"
+
+/// Extension of the archive index files
+#define PCAP_ARCHIVE_EXT	".aidx"
+
+/// Number of bits set in the bloom filter for each key
+#define PCAP_ARCHIVE_BLOOM_HASHES	4
+
+/// Kinds of keys stored in the bloom filters
+#define PCAP_ARCHIVE_KEY_PORT	1
+#define PCAP_ARCHIVE_KEY_IPV4	4
+#define PCAP_ARCHIVE_KEY_IPV6	6
+
+/// Maximum size of a key, one byte for the kind plus an IPv6 address
+#define PCAP_ARCHIVE_KEY_SIZE	17
+
+struct pcap_archive_header {
+
+	char magic[8];
+	uint32_t blocks; ///< Number of blocks, 0 if the file wasn't closed properly
+	uint32_t bloom_size; ///< Size of the bloom filter of each block in bytes
+	uint32_t interval; ///< Duration of the time buckets in seconds
+	uint32_t reserved;
+
+};
+
+struct pcap_archive_block {
+
+	uint64_t start; ///< Offset of the first packet record of the block
+	uint64_t end; ///< Offset following the last packet record of the block
+	uint64_t first_time; ///< Time of the first packet in microseconds
+	uint64_t last_time; ///< Time of the last packet in microseconds
+	uint32_t packets;
+	uint32_t reserved;
+
+};
+
+/**
+ * Build the bloom filter key of an address or a port in network byte order.
+ * @param key Buffer of at least PCAP_ARCHIVE_KEY_SIZE bytes
+ * @param kind One of PCAP_ARCHIVE_KEY_*
+ * @param value The address or the port
+ * @param len Length of the value
+ * @return The length of the key
+ */
+static inline uint32_t pcap_archive_key(unsigned char *key, unsigned char kind, const void *value, uint32_t len) {
+
+	key[0] = kind;
+	memcpy(key + 1, value, len);
+	return len + 1;
+}
+
+static inline void pcap_archive_bloom_add(unsigned char *bloom, uint32_t size, const unsigned char *key, uint32_t len) {
+
+	uint32_t bits = size * 8;
+	uint32_t h1 = jhash(key, len, 0);
+	uint32_t h2 = jhash(key, len, h1) | 1;
+
+	int i;
+	for (i = 0; i < PCAP_ARCHIVE_BLOOM_HASHES; i++) {
+		uint32_t bit = (h1 + i * h2) % bits;
+		bloom[bit >> 3] |= 1 << (bit & 0x7);
+	}
+}
+
+static inline int pcap_archive_bloom_test(const unsigned char *bloom, uint32_t size, const unsigned char *key, uint32_t len) {
+
+	uint32_t bits = size * 8;
+	uint32_t h1 = jhash(key, len, 0);
+	uint32_t h2 = jhash(key, len, h1) | 1;
+
+	int i;
+	for (i = 0; i < PCAP_ARCHIVE_BLOOM_HASHES; i++) {
+		uint32_t bit = (h1 + i * h2) % bits;
+		if (!(bloom[bit >> 3] & (1 << (bit & 0x7))))
+			return 0;
+	}
+
+	return 1;
+}
+
+#endif
@@ -25,9 +25,75 @@
 
 struct perf_class *perfs_head = NULL;
 
+/// Protects the list of classes and the list of instances of each class
+static pthread_rwlock_t perf_global_lock = PTHREAD_RWLOCK_INITIALIZER;
+/// Id of the next registered instance, never reused
+static uint32_t perf_next_instance_id = 1;
+
+/// Set when the hot path timings should be recorded
+int perf_timing_enabled = 0;
+/// Number of nanoseconds per tick, fixed point with 16 bits of fraction
+static uint64_t perf_ticks_mult = 0;
+
+/// Counter slot used by the current thread, -1 if not assigned yet
+static __thread int perf_thread_slot = -1;
+/// Next slot to hand out to a thread
+static unsigned int perf_next_slot = 0;
+
+
+static inline struct perf_item_slot *perf_item_get_slot(struct perf_item *itm) {
+
+	if (perf_thread_slot == -1)
+		perf_thread_slot = __sync_fetch_and_add(&perf_next_slot, 1) % PERF_ITEM_SLOTS;
+
+	return &itm->slots[perf_thread_slot];
+}
+
+static uint64_t perf_item_slots_sum(struct perf_item *itm) {
+
+	uint64_t val = 0;
+	int i;
+	for (i = 0; i < PERF_ITEM_SLOTS; i++)
+		val += itm->slots[i].value;
+
+	return val;
+}
+
+static inline unsigned int perf_histogram_bucket(uint64_t val) {
+
+	if (val < PERF_HISTO_SUB_BUCKETS)
+		return val;
+
+	unsigned int shift = 63 - __builtin_clzll(val) - PERF_HISTO_SUB_BITS;
+	return ((shift + 1) << PERF_HISTO_SUB_BITS) + ((val >> shift) & (PERF_HISTO_SUB_BUCKETS - 1));
+}
+
+static uint64_t perf_histogram_bucket_max(unsigned int bucket) {
+
+	if (bucket < PERF_HISTO_SUB_BUCKETS)
+		return bucket;
+
+	unsigned int shift = (bucket >> PERF_HISTO_SUB_BITS) - 1;
+	uint64_t low = (uint64_t)(PERF_HISTO_SUB_BUCKETS + (bucket & (PERF_HISTO_SUB_BUCKETS - 1))) << shift;
+	return low + ((1LLU << shift) - 1);
+}
+
+static void perf_item_free(struct perf_item *itm) {
+
+	free(itm->name);
+	free(itm->descr);
+	free(itm->slots);
+	if (itm->histo)
+		free(itm->histo);
+	pthread_rwlock_destroy(&itm->lock);
+	free(itm);
+}
+
 
 struct perf_class *perf_register_class(char *class_name) {
 
+	pthread_rwlock_wrlock(&perf_global_lock);
+
 	struct perf_class *tmp = perfs_head;
 	while (tmp) {
 		if (!strcasecmp(class_name, tmp->name))
@@ -36,6 +102,7 @@ struct perf_class *perf_register_class(char *class_name) {
 	}
 	
 	if (tmp) {
+		pthread_rwlock_unlock(&perf_global_lock);
 		pom_log(POM_LOG_WARN "Perf class %s already registered", class_name);
 		return tmp;
 	}
@@ -49,6 +116,8 @@ struct perf_class *perf_register_class(char *class_name) {
 	tmp->next = perfs_head;
 	perfs_head = tmp;
 
+	pthread_rwlock_unlock(&perf_global_lock);
+
 	pom_log(POM_LOG_DEBUG "Registered class %s", class_name);
 
 	return tmp;
@@ -57,6 +126,8 @@ struct perf_class *perf_register_class(char *class_name) {
 
 struct perf_instance *perf_register_instance(struct perf_class *class, void *object) {
 
+	pthread_rwlock_wrlock(&perf_global_lock);
+
 	struct perf_instance *tmp = class->instances;
 	while (tmp) {
 		if (tmp->object == object)
@@ -65,6 +136,7 @@ struct perf_instance *perf_register_instance(struct perf_class *class, void *obj
 	}
 
 	if (tmp) {
+		pthread_rwlock_unlock(&perf_global_lock);
 		pom_log(POM_LOG_WARN "Object 0x%llX already added to class %s", object, class->name);
 		return tmp;
 	}
@@ -74,12 +146,14 @@ struct perf_instance *perf_register_instance(struct perf_class *class, void *obj
 	memset(tmp, 0, sizeof(struct perf_instance));
 	
 	if (pthread_rwlock_init(&tmp->lock, NULL)) {
+		pthread_rwlock_unlock(&perf_global_lock);
 		pom_log(POM_LOG_ERR "Unable to initialize the performance instance lock");
 		free(tmp);
 		return NULL;
 	}
 
 	tmp->object = object;
+	tmp->id = perf_next_instance_id++; // Instances are kept sorted by decreasing id
 
 	tmp->next = class->instances;
 	if (tmp->next)
@@ -87,6 +161,8 @@ struct perf_instance *perf_register_instance(struct perf_class *class, void *obj
 
 	class->instances = tmp;
 
+	pthread_rwlock_unlock(&perf_global_lock);
+
 	return tmp;
 
 }
@@ -169,12 +245,27 @@ struct perf_item *perf_add_item(struct perf_instance *instance, char *name, enum
 	tmp = malloc(sizeof(struct perf_item));
 	memset(tmp, 0, sizeof(struct perf_item));
 
+	if (posix_memalign((void **)&tmp->slots, PERF_CACHE_LINE_SIZE, sizeof(struct perf_item_slot) * PERF_ITEM_SLOTS)) {
+		pom_log(POM_LOG_ERR "Unable to allocate the performance item counter slots");
+		free(tmp);
+		perf_instance_unlock(instance);
+		return NULL;
+	}
+	memset(tmp->slots, 0, sizeof(struct perf_item_slot) * PERF_ITEM_SLOTS);
+
 	if (pthread_rwlock_init(&tmp->lock, NULL)) {
 		pom_log(POM_LOG_ERR "Unable to initialize the performance item lock");
+		free(tmp->slots);
 		free(tmp);
+		perf_instance_unlock(instance);
 		return NULL;
 	}
 
+	if (type == perf_item_type_histogram) {
+		tmp->histo = malloc(sizeof(struct perf_histogram));
+		memset(tmp->histo, 0, sizeof(struct perf_histogram));
+	}
+
 	tmp->name = strdup(name);
 	tmp->type = type;
 	tmp->descr = strdup(descr);
@@ -200,9 +291,9 @@ int perf_item_set_update_hook(struct perf_item *itm, int (*update_hook) (struct
 
 	perf_item_lock(itm, 1);
 
-	if (itm->type == perf_item_type_uptime) {
+	if (itm->type == perf_item_type_uptime || itm->type == perf_item_type_histogram) {
 		perf_item_unlock(itm);
-		pom_log(POM_LOG_ERR "Cannot set an update hook on an uptime item");
+		pom_log(POM_LOG_ERR "Cannot set an update hook on an uptime or histogram item");
 		return POM_ERR;
 	}
 
@@ -227,10 +318,7 @@ int perf_remove_item(struct perf_instance *instance, struct perf_item *itm) {
 	if (itm->next)
 		itm->next->prev = itm->prev;
 
-	free(itm->name);
-	free(itm->descr);
-	pthread_rwlock_destroy(&itm->lock);
-	free(itm);
+	perf_item_free(itm);
 
 	perf_instance_unlock(instance);
 
@@ -239,6 +327,7 @@ int perf_remove_item(struct perf_instance *instance, struct perf_item *itm) {
 
 int perf_unregister_instance(struct perf_class *class, struct perf_instance *instance) {
 
+	pthread_rwlock_wrlock(&perf_global_lock);
 
 	struct perf_instance *tmp = class->instances;
 	while (tmp) {
@@ -248,6 +337,7 @@ int perf_unregister_instance(struct perf_class *class, struct perf_instance *ins
 	}
 
 	if (!tmp) {
+		pthread_rwlock_unlock(&perf_global_lock);
 		pom_log(POM_LOG_WARN "Instance 0x%llX not found in class %s", instance, class->name);
 		return POM_ERR;
 	}
@@ -257,10 +347,7 @@ int perf_unregister_instance(struct perf_class *class, struct perf_instance *ins
 	while (itm) {
 		struct perf_item *del_item = itm;
 		itm = itm->next;
-		free(del_item->name);
-		free(del_item->descr);
-		pthread_rwlock_destroy(&del_item->lock);
-		free(del_item);
+		perf_item_free(del_item);
 	}
 
 	if (!tmp->prev)
@@ -273,6 +360,8 @@ int perf_unregister_instance(struct perf_class *class, struct perf_instance *ins
 
 	perf_instance_unlock(instance);
 
+	pthread_rwlock_unlock(&perf_global_lock);
+
 	pthread_rwlock_destroy(&tmp->lock);
 	free(tmp);
 
@@ -304,8 +393,14 @@ int perf_item_val_reset(struct perf_item *itm) {
 		gettimeofday(&tv, NULL);
 		// Time is stored in centisecs
 		itm->value = ((uint64_t)tv.tv_sec * 100LLU) + ((uint64_t)tv.tv_usec / 10000LLU);
+	} else if (itm->type == perf_item_type_histogram) {
+		memset(itm->histo, 0, sizeof(struct perf_histogram));
 	} else {
 		itm->value = 0;
+		// Increments done concurrently by the other threads are kept
+		int i;
+		for (i = 0; i < PERF_ITEM_SLOTS; i++)
+			__sync_lock_test_and_set(&itm->slots[i].value, 0);
 	}
 
 	perf_item_unlock(itm);
@@ -327,22 +422,28 @@ int perf_instance_items_val_reset(struct perf_instance *instance) {
 	return POM_OK;
 }
 
+/**
+ * Increment the slot of the calling thread.
+ * Returns the new value of that slot only, the total is read with perf_item_val_get_raw().
+ */
 uint64_t perf_item_val_inc(struct perf_item *itm, int64_t inc) {
 
-	perf_item_lock(itm, 1);
-	if (itm->type == perf_item_type_uptime) {
-		pom_log(POM_LOG_WARN "Cannot increment item of type uptime");
+	// No locking here, this is called many times per packet
+	// Each thread updates its own slot, they are summed up when the value is read
+
+	if (itm->type == perf_item_type_uptime || itm->type == perf_item_type_histogram) {
+		pom_log(POM_LOG_WARN "Cannot increment item of type uptime or histogram");
+		return 0;
 	} else if (itm->update_hook) {
 		pom_log(POM_LOG_WARN "Cannot increment item when it has an update hook");
-	} else {
-		itm->value += inc;
+		return 0;
 	}
 
 	if (itm->type == perf_item_type_counter && inc < 0)
 		pom_log(POM_LOG_WARN "Trying to decrease the value of a counter");
 
-	perf_item_unlock(itm);
-	return itm->value;
+	// Slots may be shared if there are more threads than slots
+	return __sync_add_and_fetch(&perf_item_get_slot(itm)->value, inc);
 }
 
 int perf_item_val_uptime_stop(struct perf_item *itm) {
@@ -418,6 +519,13 @@ uint64_t perf_item_val_get_raw(struct perf_item *itm) {
 		return val;
 	}
 
+	if (itm->type == perf_item_type_histogram) {
+		// Raw value of an histogram is the number of values recorded
+		val = itm->histo->count;
+		perf_item_unlock(itm);
+		return val;
+	}
+
 	if (itm->update_hook) {
 		perf_item_unlock(itm);
 		// We need a write lock
@@ -428,7 +536,7 @@ uint64_t perf_item_val_get_raw(struct perf_item *itm) {
 
 	}
 
-	val = itm->value;
+	val = itm->value + perf_item_slots_sum(itm);
 	perf_item_unlock(itm);
 
 	return val;
@@ -515,3 +623,226 @@ int perf_item_val_get_human_1024(struct perf_item *itm, char *val, size_t size)
 	
 	return 0;
 }
+
+int perf_item_val_record(struct perf_item *itm, uint64_t val) {
+
+	// Lock-less as well, this is called in the packet path
+
+	if (itm->type != perf_item_type_histogram) {
+		pom_log(POM_LOG_WARN "Cannot record a value in a non histogram item");
+		return POM_ERR;
+	}
+
+	struct perf_histogram *h = itm->histo;
+	__sync_fetch_and_add(&h->buckets[perf_histogram_bucket(val)], 1);
+	__sync_fetch_and_add(&h->count, 1);
+	__sync_fetch_and_add(&h->sum, val);
+
+	uint64_t max = h->max;
+	while (val > max) {
+		uint64_t prev = __sync_val_compare_and_swap(&h->max, max, val);
+		if (prev == max)
+			break;
+		max = prev;
+	}
+
+	return POM_OK;
+}
+
+uint64_t perf_item_val_record_time(struct perf_item *itm, uint64_t start) {
+
+	// Timing was disabled when start was taken
+	if (!start)
+		return 0;
+
+	uint64_t now = perf_ticks_raw();
+	if (now > start)
+		perf_item_val_record(itm, ((now - start) * perf_ticks_mult) >> 16);
+
+	return now;
+}
+
+uint64_t perf_item_val_get_percentile(struct perf_item *itm, unsigned int pct) {
+
+	if (itm->type != perf_item_type_histogram || pct > 100)
+		return 0;
+
+	struct perf_histogram *h = itm->histo;
+
+	// Count again from the buckets as more values might have been recorded meanwhile
+	uint64_t total = 0;
+	int i;
+	for (i = 0; i < PERF_HISTO_BUCKETS; i++)
+		total += h->buckets[i];
+
+	if (!total)
+		return 0;
+
+	uint64_t target = (total * pct + 99) / 100, cur = 0;
+	if (!target)
+		target = 1;
+
+	for (i = 0; i < PERF_HISTO_BUCKETS; i++) {
+		cur += h->buckets[i];
+		if (cur >= target)
+			break;
+	}
+
+	uint64_t val = perf_histogram_bucket_max(i);
+	if (val > h->max)
+		val = h->max;
+
+	return val;
+}
+
+uint64_t perf_item_val_get_max(struct perf_item *itm) {
+
+	if (itm->type != perf_item_type_histogram)
+		return 0;
+
+	return itm->histo->max;
+}
+
+uint64_t perf_item_val_get_mean(struct perf_item *itm) {
+
+	if (itm->type != perf_item_type_histogram || !itm->histo->count)
+		return 0;
+
+	return itm->histo->sum / itm->histo->count;
+}
+
+static int perf_human_nsec(uint64_t val, char *buff, size_t size) {
+
+	if (val < 10000)
+		return snprintf(buff, size, "%lluns", (long long unsigned int)val);
+	if (val < 10000000)
+		return snprintf(buff, size, "%lluus", (long long unsigned int)(val + 500) / 1000);
+	return snprintf(buff, size, "%llums", (long long unsigned int)(val + 500000) / 1000000);
+
+}
+
+int perf_item_val_get_human_histo(struct perf_item *itm, char *val, size_t size) {
+
+	if (itm->type != perf_item_type_histogram)
+		return 0;
+
+	char count[32], mean[32], p50[32], p90[32], p99[32], max[32];
+	perf_item_val_get_human(itm, count, sizeof(count));
+	perf_human_nsec(perf_item_val_get_mean(itm), mean, sizeof(mean));
+	perf_human_nsec(perf_item_val_get_percentile(itm, 50), p50, sizeof(p50));
+	perf_human_nsec(perf_item_val_get_percentile(itm, 90), p90, sizeof(p90));
+	perf_human_nsec(perf_item_val_get_percentile(itm, 99), p99, sizeof(p99));
+	perf_human_nsec(perf_item_val_get_max(itm), max, sizeof(max));
+
+	return snprintf(val, size, "%s samples, mean %s, p50 %s, p90 %s, p99 %s, max %s", count, mean, p50, p90, p99, max);
+}
+
+int perf_histogram_merge(struct perf_histogram *dst, struct perf_histogram *src) {
+
+	int i;
+	for (i = 0; i < PERF_HISTO_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+
+	dst->count += src->count;
+	dst->sum += src->sum;
+	if (src->max > dst->max)
+		dst->max = src->max;
+
+	return POM_OK;
+}
+
+struct perf_class *perf_find_class(char *class_name) {
+
+	pthread_rwlock_rdlock(&perf_global_lock);
+
+	struct perf_class *tmp = perfs_head;
+	while (tmp) {
+		if (!strcasecmp(class_name, tmp->name))
+			break;
+		tmp = tmp->next;
+	}
+
+	pthread_rwlock_unlock(&perf_global_lock);
+
+	return tmp;
+}
+
+/**
+ * Call a function for each item of a bounded number of instances of a class.
+ * Instances are provided from the newest to the oldest and the items
+ * of an instance are never split across two calls.
+ * @param class Class whose items are wanted
+ * @param cursor 0 to start from the begining or the value returned by the previous call
+ * @param max Number of items after which to stop
+ * @param callback Function called for each item with its instance locked
+ * @param priv Private data for the callback
+ * @return Cursor to provide to the next call or 0 if all the instances were processed.
+ */
+uint32_t perf_class_iterate(struct perf_class *class, uint32_t cursor, unsigned int max, int (*callback) (struct perf_instance *inst, struct perf_item *itm, void *priv), void *priv) {
+
+	pthread_rwlock_rdlock(&perf_global_lock);
+
+	unsigned int count = 0;
+	uint32_t next = 0;
+
+	struct perf_instance *inst;
+	for (inst = class->instances; inst; inst = inst->next) {
+
+		if (cursor && inst->id >= cursor) // Already provided
+			continue;
+
+		if (count >= max)
+			break;
+
+		perf_instance_lock(inst, 0);
+		struct perf_item *itm;
+		for (itm = inst->items; itm; itm = itm->next) {
+			(*callback) (inst, itm, priv);
+			count++;
+		}
+		perf_instance_unlock(inst);
+
+		next = inst->id;
+	}
+
+	pthread_rwlock_unlock(&perf_global_lock);
+
+	if (!inst)
+		return 0;
+
+	return next;
+}
+
+static int perf_timing_calibrate() {
+
+	struct timespec ts_start, ts_end;
+	clock_gettime(CLOCK_MONOTONIC, &ts_start);
+	uint64_t start = perf_ticks_raw();
+
+	struct timespec delay = { 0, 10000000 };
+	nanosleep(&delay, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts_end);
+	uint64_t end = perf_ticks_raw();
+
+	uint64_t nsecs = ((uint64_t)(ts_end.tv_sec - ts_start.tv_sec) * 1000000000LLU) + ts_end.tv_nsec - ts_start.tv_nsec;
+	if (end <= start) {
+		pom_log(POM_LOG_WARN "Unable to calibrate the timestamp counter");
+		return POM_ERR;
+	}
+
+	perf_ticks_mult = (nsecs << 16) / (end - start);
+	pom_log(POM_LOG_DEBUG "Timestamp counter calibrated at %llu ticks per usec", (long long unsigned int)((end - start) * 1000 / nsecs));
+
+	return POM_OK;
+}
+
+int perf_timing_enable(int enable) {
+
+	if (enable && !perf_ticks_mult && perf_timing_calibrate() == POM_ERR)
+		return POM_ERR;
+
+	perf_timing_enabled = enable;
+
+	return POM_OK;
+}
@@ -26,18 +26,47 @@
 
 #define PERF_UPTIME_STOPPED (1LLU << 63)
 
+/// Number of per thread counter slots for each perf item
+#define PERF_ITEM_SLOTS 16
+/// Size of a cache line, used to pad the counter slots
+#define PERF_CACHE_LINE_SIZE 64
+
+/// A counter slot, padded to its own cache line to avoid false sharing between threads
+struct perf_item_slot {
+	uint64_t value;
+	char pad[PERF_CACHE_LINE_SIZE - sizeof(uint64_t)];
+};
+
 enum perf_item_type {
 	perf_item_type_counter = 0,
 	perf_item_type_gauge,
-	perf_item_type_uptime
+	perf_item_type_uptime,
+	perf_item_type_histogram
+};
+
+/// Number of bits used for the linear sub buckets of each power of two
+#define PERF_HISTO_SUB_BITS 3
+#define PERF_HISTO_SUB_BUCKETS (1 << PERF_HISTO_SUB_BITS)
+/// Total number of buckets needed to cover 64 bit values
+#define PERF_HISTO_BUCKETS ((64 - PERF_HISTO_SUB_BITS + 1) * PERF_HISTO_SUB_BUCKETS)
+
+/// Log-linear histogram, each power of two is divided in PERF_HISTO_SUB_BUCKETS buckets
+struct perf_histogram {
+	uint64_t buckets[PERF_HISTO_BUCKETS];
+	uint64_t count; ///< Number of values recorded
+	uint64_t sum; ///< Sum of all the values recorded
+	uint64_t max; ///< Highest value recorded
 };
 
+
 struct perf_item {
 
 	char *name;
 	enum perf_item_type type;
 	char *descr;
 	uint64_t value;
+	struct perf_item_slot *slots; ///< Per thread slots summed with value when read
+	struct perf_histogram *histo; ///< Recorded values for histogram items
 	pthread_rwlock_t lock;
 	struct perf_instance *instance;
 
@@ -50,7 +79,7 @@ struct perf_item {
 
 struct perf_instance {
 
-	uint32_t id;
+	uint32_t id; ///< Unique id, used as a cursor when iterating
 	void *object;
 	pthread_rwlock_t lock;
 	struct perf_item *items;
@@ -87,4 +116,41 @@ uint64_t perf_item_val_get_raw(struct perf_item *itm);
 int perf_item_val_get_human(struct perf_item *itm, char *val, size_t size);
 int perf_item_val_get_human_1024(struct perf_item *itm, char *val, size_t size);
 
+int perf_item_val_record(struct perf_item *itm, uint64_t val);
+uint64_t perf_item_val_record_time(struct perf_item *itm, uint64_t start);
+uint64_t perf_item_val_get_percentile(struct perf_item *itm, unsigned int pct);
+uint64_t perf_item_val_get_max(struct perf_item *itm);
+uint64_t perf_item_val_get_mean(struct perf_item *itm);
+int perf_item_val_get_human_histo(struct perf_item *itm, char *val, size_t size);
+int perf_histogram_merge(struct perf_histogram *dst, struct perf_histogram *src);
+
+struct perf_class *perf_find_class(char *class_name);
+uint32_t perf_class_iterate(struct perf_class *class, uint32_t cursor, unsigned int max, int (*callback) (struct perf_instance *inst, struct perf_item *itm, void *priv), void *priv);
+
+int perf_timing_enable(int enable);
+extern int perf_timing_enabled;
+
+/// Read the timestamp counter
+static inline uint64_t perf_ticks_raw() {
+
+#if defined(__x86_64__) || defined(__i386__)
+	uint32_t lo, hi;
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t)hi << 32) | lo;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000LLU) + ts.tv_nsec;
+#endif
+}
+
+/// Read the timestamp counter, returns 0 when timing is disabled
+static inline uint64_t perf_ticks() {
+
+	if (!perf_timing_enabled)
+		return 0;
+
+	return perf_ticks_raw();
+}
+
 #endif
@@ -18,8 +18,8 @@
  *
  */
 
-#ifndef __PTYPE_IPV4_H__
-#define __PTYPE_IPV4_H__
+#ifndef __PTYPE_IPV6_H__
+#define __PTYPE_IPV6_H__
 
 #include "modules_common.h"
 #include "ptype.h"
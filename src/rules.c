@@ -26,6 +26,7 @@
 #include "ptype_bool.h"
 
 #include <pthread.h>
+#include <unistd.h>
 
 #include "ptype_uint64.h"
 
@@ -33,16 +34,61 @@ static int match_undefined_id;
 
 static struct perf_class *rules_perf_class = NULL;
 
+static struct perf_class *stages_perf_class = NULL;
+static struct perf_instance *stages_perfs = NULL;
+static struct perf_item *perf_stage_identify = NULL;
+static struct perf_item *perf_stage_rules = NULL;
+static struct perf_item *perf_stage_expectation = NULL;
+static struct perf_item *perf_stage_conntrack = NULL;
+static struct perf_item *perf_stage_targets = NULL;
+
+/// Snapshot currently used by the readers
+static struct rule_snapshot *volatile rules_snapshot = NULL;
+/// Current epoch, incremented each time a snapshot is replaced
+static volatile uint64_t rules_epoch = 1;
+/// Threads that entered a read side section at least once
+static struct rules_reader *rules_readers = NULL;
+static pthread_mutex_t rules_readers_lock = PTHREAD_MUTEX_INITIALIZER;
+/// Read side state of the current thread
+static __thread struct rules_reader *rules_reader_self = NULL;
+/// Objects to free once the next snapshot is published
+static struct rules_retired *rules_retired_head = NULL;
+
 int rules_init() {
 
 	match_undefined_id = match_register("undefined");
 
 	rules_perf_class = perf_register_class("rules");
 
+	// Timings of each processing stage, only recorded when enabled with perf_timing
+	stages_perf_class = perf_register_class("stages");
+	stages_perfs = perf_register_instance(stages_perf_class, NULL);
+	perf_stage_identify = perf_add_item(stages_perfs, "identify", perf_item_type_histogram, "Time spent identifying the layers of each packet");
+	perf_stage_rules = perf_add_item(stages_perfs, "rules", perf_item_type_histogram, "Time spent evaluating the rules for each packet");
+	perf_stage_expectation = perf_add_item(stages_perfs, "expectation", perf_item_type_histogram, "Time spent processing expectations for each packet");
+	perf_stage_conntrack = perf_add_item(stages_perfs, "conntrack", perf_item_type_histogram, "Time spent looking up the conntrack entry of each packet");
+	perf_stage_targets = perf_add_item(stages_perfs, "targets", perf_item_type_histogram, "Time spent processing the targets for each packet");
+
 	return POM_OK;
 
 }
 
+int rules_cleanup() {
+
+	perf_unregister_instance(stages_perf_class, stages_perfs);
+
+	free(rules_snapshot);
+	rules_snapshot = NULL;
+
+	while (rules_readers) {
+		struct rules_reader *tmp = rules_readers;
+		rules_readers = rules_readers->next;
+		free(tmp);
+	}
+
+	return POM_OK;
+}
+
 int dump_invalid_packet(struct frame *f) {
 
 	struct layer *l = f->l;
@@ -234,8 +280,16 @@ int rule_node_match(struct frame *f, struct layer **l, struct rule_node *n, stru
 	return 1;
 }
 
-int do_rules(struct frame *f, struct rule_list *rules, pthread_rwlock_t *rule_lock) {
+/**
+ * The caller must be in a read side section in which it got the snapshot.
+ * @param f Frame to process
+ * @param rules Rule snapshot returned by rules_snapshot_get()
+ * @return POM_OK on success, POM_ERR on failure
+ */
+int do_rules(struct frame *f, struct rule_snapshot *rules) {
+
 
+	uint64_t ts = perf_ticks();
 
 	// We need to discard the previous pool of layer before doing anything else
 	layer_pool_discard();
@@ -300,45 +354,46 @@ int do_rules(struct frame *f, struct rule_list *rules, pthread_rwlock_t *rule_lo
 		l = l->next;
 	}
 
+	ts = perf_item_val_record_time(perf_stage_identify, ts);
 
 	// Now, check each rule and see if it matches
 
-
-	if (rule_lock && pthread_rwlock_rdlock(rule_lock)) {
-		pom_log(POM_LOG_ERR "Unable to lock the given rules");
-		return POM_ERR;
-	}
-
-	struct rule_list *r = rules;
-	if (r == NULL) {
-		pthread_rwlock_unlock(rule_lock);
+	if (!rules || !rules->count)
 		return POM_OK;
-	}
 
-	while (r) {
+	unsigned int i, j;
+
+	for (i = 0; i < rules->count; i++) {
+		struct rule_snapshot_entry *e = &rules->rules[i];
+		struct rule_list *r = e->rule;
 		r->result = 0;
 
-		if (r->node && r->enabled) {
+		if (e->node && e->enabled) {
 			// If there is a conntrack_entry, it means one of the target added it's priv, so the packet needs to be processed
 			struct layer *start_l = f->l;
-			r->result = rule_node_match(f, &start_l, r->node, NULL); // Get the result to fully populate layers
-			if (r->result < 0) { // Invalid packet or packet needs help
-				pthread_rwlock_unlock(rule_lock);
+			r->result = rule_node_match(f, &start_l, e->node, NULL); // Get the result to fully populate layers
+			if (r->result < 0) // Invalid packet or packet needs help
 				return POM_OK;
-			}
 			if (r->result) {
 			//	pom_log(POM_LOG_TSHOOT "Rule matched");
 				perf_item_val_inc(r->perf_pkts, 1);
 				perf_item_val_inc(r->perf_bytes, f->len);
 			}
 		}
-		r = r->next;
 
 	}
 
+	ts = perf_item_val_record_time(perf_stage_rules, ts);
+
 	expectation_process(f);
 
-	if (conntrack_get_entry(f) == POM_OK) { // We got a conntrack_entry, process the corresponding targets
+	ts = perf_item_val_record_time(perf_stage_expectation, ts);
+
+	int ct_res = conntrack_get_entry(f);
+
+	ts = perf_item_val_record_time(perf_stage_conntrack, ts);
+
+	if (ct_res == POM_OK) { // We got a conntrack_entry, process the corresponding targets
 		struct conntrack_target_priv *cp = f->ce->target_privs;
 		while (cp) {
 			// need buffer as the present cp can be deleted by target_process if an error occurs
@@ -355,38 +410,27 @@ int do_rules(struct frame *f, struct rule_list *rules, pthread_rwlock_t *rule_lo
 	}
 	
 	// Process the matched rules
-	r = rules;
-	while (r) {
-		struct target *t = r->target;
-		if (r->result) {
-			while (t) {
-				if (!t->matched) {
-					target_process(t, f);
-					t->matched = 1;
-				}
-				t = t->next;
+	for (i = 0; i < rules->count; i++) {
+		struct rule_snapshot_entry *e = &rules->rules[i];
+		if (!e->rule->result)
+			continue;
+		for (j = 0; j < e->targets_count; j++) {
+			struct target *t = e->targets[j];
+			if (!t->matched) {
+				target_process(t, f);
+				t->matched = 1;
 			}
 		}
-		r = r->next;
-
 	}
 
-	// reset matched_conntrack value
-	
-	r = rules;
-	while (r) {
-		struct target *t = r->target;
-		while (t) {
-			t->matched = 0;
-			t = t->next;
-		}
-		r = r->next;
-	}
+	perf_item_val_record_time(perf_stage_targets, ts);
 
-	if (rule_lock && pthread_rwlock_unlock(rule_lock)) {
-		pom_log(POM_LOG_ERR "Unable to unlock the given rule_lock");
-		return POM_ERR;
-	}
+	if (f->ce) // The conntrack may have been created by a target
+		conntrack_account(f);
+
+	// reset matched_conntrack value
+	for (i = 0; i < rules->targets_count; i++)
+		rules->targets[i]->matched = 0;
 
 	return POM_OK;
 }
@@ -864,6 +908,7 @@ struct rule_list* rule_list_alloc(struct rule_node *n) {
 	memset(rl, 0, sizeof(struct rule_list));
 
 	rl->uid = uid_get_new();
+	uid_attach(rl->uid, UID_OBJ_RULE, rl);
 
 	rl->node = n;
 
@@ -876,6 +921,31 @@ struct rule_list* rule_list_alloc(struct rule_node *n) {
 
 }
 
+/**
+ * The rules must be locked by the caller.
+ * @param uid Uid of the rule
+ * @return The rule or NULL if there is no such rule in the configuration.
+ */
+struct rule_list *rule_list_get(uint32_t uid) {
+
+	return uid_get_obj(uid, UID_OBJ_RULE);
+}
+
+/**
+ * The rules must be locked by the caller.
+ * @param rl Rule the target belongs to
+ * @param uid Uid of the target
+ * @return The target or NULL if the rule doesn't have such target.
+ */
+struct target *rule_list_get_target(struct rule_list *rl, uint32_t uid) {
+
+	struct target *t = uid_get_obj(uid, UID_OBJ_TARGET);
+	if (!t || t->parent_serial != &rl->target_serial)
+		return NULL;
+
+	return t;
+}
+
 int rule_list_cleanup(struct rule_list *rl) {
 
 	node_destroy(rl->node, 0);
@@ -931,3 +1001,231 @@ int rule_list_disable(struct rule_list *rl) {
 	
 	return POM_OK;
 }
+
+/**
+ * Enter a read side section and get the current rule snapshot.
+ * The snapshot and everything it references stay valid until the
+ * matching call to rules_snapshot_release(). Sections can be nested.
+ * @return The current snapshot, NULL if there is no rule.
+ */
+struct rule_snapshot *rules_snapshot_get() {
+
+	struct rules_reader *self = rules_reader_self;
+
+	if (!self) {
+		self = malloc(sizeof(struct rules_reader));
+		memset(self, 0, sizeof(struct rules_reader));
+		pthread_mutex_lock(&rules_readers_lock);
+		self->next = rules_readers;
+		rules_readers = self;
+		pthread_mutex_unlock(&rules_readers_lock);
+		rules_reader_self = self;
+	}
+
+	if (!self->depth++) {
+		self->epoch = rules_epoch;
+		// The epoch must be visible to the writers before we read the snapshot
+		__sync_synchronize();
+	}
+
+	return rules_snapshot;
+}
+
+/**
+ * Leave the read side section entered with rules_snapshot_get().
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int rules_snapshot_release() {
+
+	struct rules_reader *self = rules_reader_self;
+
+	if (!self || !self->depth) {
+		pom_log(POM_LOG_ERR "Rule snapshot released without being acquired");
+		return POM_ERR;
+	}
+
+	if (!--self->depth) {
+		__sync_synchronize();
+		self->epoch = 0;
+	}
+
+	return POM_OK;
+}
+
+/**
+ * Wait until every reader left the sections it entered before the call.
+ */
+static void rules_snapshot_synchronize() {
+
+	uint64_t epoch = __sync_add_and_fetch(&rules_epoch, 1);
+
+	pthread_mutex_lock(&rules_readers_lock);
+	struct rules_reader *r;
+	for (r = rules_readers; r; r = r->next) {
+		if (r == rules_reader_self) // Writers can't wait for themselves
+			continue;
+		while (1) {
+			uint64_t reader_epoch = r->epoch;
+			if (!reader_epoch || reader_epoch >= epoch)
+				break;
+			usleep(100);
+		}
+	}
+	pthread_mutex_unlock(&rules_readers_lock);
+}
+
+/**
+ * Create a snapshot of the rules, make it visible to the readers and free
+ * the previous one along with the retired objects once no reader uses them.
+ * The rules must be write locked by the caller.
+ * @param rules Rule list to create the snapshot from
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int rules_snapshot_publish(struct rule_list *rules) {
+
+	unsigned int count = 0, targets_count = 0;
+	struct rule_list *rl;
+	struct target *t;
+
+	for (rl = rules; rl; rl = rl->next) {
+		count++;
+		for (t = rl->target; t; t = t->next)
+			targets_count++;
+	}
+
+	struct rule_snapshot *rs = NULL;
+	if (count) {
+		size_t size = sizeof(struct rule_snapshot) + count * sizeof(struct rule_snapshot_entry) + targets_count * sizeof(struct target *);
+		rs = malloc(size);
+		if (!rs) {
+			pom_log(POM_LOG_ERR "Not enough memory to create the rule snapshot");
+			return POM_ERR;
+		}
+		memset(rs, 0, size);
+		rs->count = count;
+		rs->rules = (struct rule_snapshot_entry *) (rs + 1);
+		rs->targets = (struct target **) (rs->rules + count);
+		rs->targets_count = targets_count;
+
+		unsigned int i = 0, j = 0;
+		for (rl = rules; rl; rl = rl->next) {
+			struct rule_snapshot_entry *e = &rs->rules[i++];
+			e->rule = rl;
+			e->node = rl->node;
+			e->enabled = rl->enabled;
+			e->targets = &rs->targets[j];
+			for (t = rl->target; t; t = t->next) {
+				rs->targets[j++] = t;
+				e->targets_count++;
+			}
+		}
+	}
+
+	struct rule_snapshot *old = rules_snapshot;
+	// Make sure the content of the snapshot is visible before the snapshot itself
+	__sync_synchronize();
+	rules_snapshot = rs;
+	__sync_synchronize();
+
+	struct rules_retired *retired = rules_retired_head;
+	rules_retired_head = NULL;
+
+	if (!old && !retired)
+		return POM_OK;
+
+	rules_snapshot_synchronize();
+
+	free(old);
+
+	while (retired) {
+		struct rules_retired *tmp = retired;
+		retired = retired->next;
+		switch (tmp->type) {
+			case RULES_RETIRED_NODE:
+				node_destroy(tmp->obj, 0);
+				break;
+			case RULES_RETIRED_RULE:
+				rule_list_cleanup(tmp->obj);
+				break;
+			case RULES_RETIRED_TARGET:
+				target_lock_instance(tmp->obj, 1);
+				target_cleanup_module(tmp->obj);
+				break;
+		}
+		free(tmp);
+	}
+
+	return POM_OK;
+}
+
+static int rules_retire(int type, void *obj) {
+
+	struct rules_retired *tmp = malloc(sizeof(struct rules_retired));
+	if (!tmp) {
+		pom_log(POM_LOG_ERR "Not enough memory to retire a rule object");
+		return POM_ERR;
+	}
+	tmp->type = type;
+	tmp->obj = obj;
+	tmp->next = rules_retired_head;
+	rules_retired_head = tmp;
+
+	return POM_OK;
+}
+
+/**
+ * Destroy a rule node once the readers can't use it anymore.
+ * The rules must be write locked by the caller.
+ * @param node Node which was replaced in its rule
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int rules_retire_node(struct rule_node *node) {
+
+	if (!node)
+		return POM_OK;
+
+	return rules_retire(RULES_RETIRED_NODE, node);
+}
+
+/**
+ * Cleanup a rule once the readers can't use it anymore.
+ * The rule must already be removed from the rule list and the rules must
+ * be write locked by the caller. Its targets are stopped right away.
+ * @param rl Rule to cleanup
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int rules_retire_rule(struct rule_list *rl) {
+
+	// Make sure the commands can't find it anymore
+	uid_detach(rl->uid);
+
+	struct target *t;
+	for (t = rl->target; t; t = t->next) {
+		uid_detach(t->uid);
+		target_lock_instance(t, 1);
+		if (t->started)
+			target_close(t);
+		target_unlock_instance(t);
+	}
+
+	return rules_retire(RULES_RETIRED_RULE, rl);
+}
+
+/**
+ * Cleanup a target once the readers can't use it anymore.
+ * The target must already be removed from its rule, must not be locked
+ * and the rules must be write locked by the caller. It is stopped right away.
+ * @param t Target to cleanup
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int rules_retire_target(struct target *t) {
+
+	uid_detach(t->uid);
+
+	target_lock_instance(t, 1);
+	if (t->started)
+		target_close(t);
+	target_unlock_instance(t);
+
+	return rules_retire(RULES_RETIRED_TARGET, t);
+}
@@ -64,14 +64,57 @@ struct rule_list {
 	struct rule_list *prev; ///< previous rule in the list
 };
 
+/// Rule as seen by the packet processing thread
+struct rule_snapshot_entry {
+	struct rule_list *rule; ///< Rule from which this entry was created
+	struct rule_node *node; ///< Node of the rule when the snapshot was created
+	int enabled; ///< True if the rule was enabled when the snapshot was created
+	struct target **targets; ///< Targets of the rule
+	unsigned int targets_count; ///< Number of targets of the rule
+};
+
+/**
+ * Immutable copy of the rule list used by the packet processing thread.
+ * Writers modify the rule list with the rules lock held and publish a new
+ * snapshot when they are done. Old snapshots and the rules, nodes and
+ * targets removed in the meantime are freed once every reader has left
+ * the read side section in which it could have obtained them.
+ */
+struct rule_snapshot {
+	unsigned int count; ///< Number of rules
+	struct rule_snapshot_entry *rules; ///< Rules in processing order
+	struct target **targets; ///< Targets of all the rules
+	unsigned int targets_count; ///< Total number of targets
+};
+
+/// Type of the objects waiting for the end of the grace period
+#define RULES_RETIRED_NODE	1
+#define RULES_RETIRED_RULE	2
+#define RULES_RETIRED_TARGET	3
+
+/// Object removed from the rules and freed after the next grace period
+struct rules_retired {
+	int type; ///< One of RULES_RETIRED_*
+	void *obj; ///< The node, rule or target
+	struct rules_retired *next;
+};
+
+/// Read side state of a thread processing packets with a rule snapshot
+struct rules_reader {
+	volatile uint64_t epoch; ///< Epoch in which the reader entered its section, 0 if outside
+	unsigned int depth; ///< Nesting level of the read side sections
+	struct rules_reader *next;
+};
+
 #include "target.h"
 #include <pthread.h>
 
 int rules_init();
+int rules_cleanup();
 
 int rule_node_match(struct frame *f, struct layer **l, struct rule_node *n, struct rule_node *last);
 
-int do_rules(struct frame *f, struct rule_list *rules, pthread_rwlock_t *rule_lock);
+int do_rules(struct frame *f, struct rule_snapshot *rules);
 
 int node_destroy(struct rule_node *node, int sub);
 
@@ -83,8 +126,20 @@ struct rule_list* rule_list_alloc(struct rule_node *n);
 
 int rule_list_cleanup(struct rule_list *rl);
 
+struct rule_list *rule_list_get(uint32_t uid);
+
+struct target *rule_list_get_target(struct rule_list *rl, uint32_t uid);
+
 int rule_list_enable(struct rule_list *rl);
 
 int rule_list_disable(struct rule_list *rl);
+
+struct rule_snapshot *rules_snapshot_get();
+int rules_snapshot_release();
+int rules_snapshot_publish(struct rule_list *rules);
+
+int rules_retire_node(struct rule_node *node);
+int rules_retire_rule(struct rule_list *rl);
+int rules_retire_target(struct target *t);
 #endif
 
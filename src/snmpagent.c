@@ -28,8 +28,14 @@
 #include "snmpcmd_rules.h"
 #include "snmpcmd_target.h"
 
+static struct eventloop_fd snmpagent_fds[SNMPAGENT_MAX_FDS];
+
 int snmpagent_init() {
 
+	int i;
+	for (i = 0; i < SNMPAGENT_MAX_FDS; i++)
+		snmpagent_fds[i].fd = -1;
+
 	// Install the log handler
 	netsnmp_log_handler *log_handler = malloc(sizeof(netsnmp_log_handler));
 	memset(log_handler, 0, sizeof(netsnmp_log_handler));
@@ -84,15 +90,99 @@ int snmpagent_init_oids() {
 
 }
 
+/**
+ * Synchronize the sockets watched by the event loop with the ones net-snmp uses.
+ * @param timeout Timeout of the event loop, lowered if net-snmp needs to be called earlier
+ * @return POM_OK on success, POM_ERR on failure.
+ */
+int snmpagent_prepare(int *timeout) {
+
+	int numfds = 0, block = 1;
+	fd_set fdset;
+	struct timeval tv;
+
+	FD_ZERO(&fdset);
+	memset(&tv, 0, sizeof(struct timeval));
+	snmp_select_info(&numfds, &fdset, &tv, &block);
+
+	if (!block) {
+		int ms = tv.tv_sec * 1000 + tv.tv_usec / 1000;
+		if (ms < *timeout)
+			*timeout = ms;
+	}
+
+	// Stop watching the sockets which were closed, keep the others
+	int i;
+	for (i = 0; i < SNMPAGENT_MAX_FDS; i++) {
+		int fd = snmpagent_fds[i].fd;
+		if (fd == -1)
+			continue;
+		if (fd < numfds && FD_ISSET(fd, &fdset)) {
+			FD_CLR(fd, &fdset);
+			continue;
+		}
+		eventloop_remove(&snmpagent_fds[i]);
+		snmpagent_fds[i].fd = -1;
+	}
+
+	// Watch the new ones
+	int fd, slot = 0;
+	for (fd = 0; fd < numfds; fd++) {
+		if (!FD_ISSET(fd, &fdset))
+			continue;
+
+		while (slot < SNMPAGENT_MAX_FDS && snmpagent_fds[slot].fd != -1)
+			slot++;
+
+		if (slot >= SNMPAGENT_MAX_FDS) {
+			pom_log(POM_LOG_WARN "Too many SNMP sockets to watch");
+			return POM_ERR;
+		}
+
+		struct eventloop_fd *efd = &snmpagent_fds[slot];
+		efd->fd = fd;
+		efd->events = EVENTLOOP_IN;
+		efd->handler = snmpagent_fd_handler;
+		efd->priv = NULL;
+		if (eventloop_add(efd) != POM_OK)
+			efd->fd = -1;
+	}
+
+	return POM_OK;
+}
+
+int snmpagent_fd_handler(struct eventloop_fd *efd, uint32_t events) {
+
+	fd_set fdset;
+	FD_ZERO(&fdset);
+	FD_SET(efd->fd, &fdset);
+	snmp_read(&fdset);
+
+	return POM_OK;
+}
+
+/**
+ * Handle the timeouts and the pending requests after the event loop ran.
+ */
 int snmpagent_process() {
 
-	agent_check_and_process(1);
+	snmp_timeout();
+	run_alarms();
+	netsnmp_check_outstanding_agent_requests();
 
 	return POM_OK;
 }
 
 int snmpagent_cleanup() {
 
+	int i;
+	for (i = 0; i < SNMPAGENT_MAX_FDS; i++) {
+		if (snmpagent_fds[i].fd == -1)
+			continue;
+		eventloop_remove(&snmpagent_fds[i]);
+		snmpagent_fds[i].fd = -1;
+	}
+
 //	shutdown_agent();
 	snmp_shutdown(PACKAGE_NAME);
 
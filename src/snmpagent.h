@@ -25,9 +25,15 @@
 #include <net-snmp/net-snmp-includes.h>
 #include <net-snmp/agent/net-snmp-agent-includes.h>
 
+#include "eventloop.h"
+
+/// Maximum number of sockets opened by the agent which can be watched
+#define SNMPAGENT_MAX_FDS 16
 
 int snmpagent_init();
 int snmpagent_init_oids();
+int snmpagent_prepare(int *timeout);
+int snmpagent_fd_handler(struct eventloop_fd *efd, uint32_t events);
 int snmpagent_process();
 int snmpagent_cleanup();
 
@@ -92,6 +92,22 @@ int snmpcmd_core_init_oids(oid *base_oid, int base_oid_len) {
 	netsnmp_handler_registration *core_perf_ringbuff_overflow_handler = netsnmp_create_handler_registration("corePerfRingBuffOverflow", snmpcmd_core_perf_ringbuff_overflow_handler, my_oid, base_oid_len + 3, HANDLER_CAN_RONLY);
 	netsnmp_register_instance(core_perf_ringbuff_overflow_handler);
 
+	// Register perf processing stages timing handler
+	my_oid[base_oid_len + 2] = 7;
+	netsnmp_handler_registration *core_perf_stages_handler = netsnmp_create_handler_registration("corePerfStageTable", snmpcmd_core_perf_stages_handler, my_oid, base_oid_len + 3, HANDLER_CAN_RONLY);
+
+	if (!core_perf_stages_handler)
+		return POM_ERR;
+
+	netsnmp_table_registration_info *core_perf_stages_table_info = malloc(sizeof(netsnmp_table_registration_info));
+	memset(core_perf_stages_table_info, 0, sizeof(netsnmp_table_registration_info));
+
+	netsnmp_table_helper_add_indexes(core_perf_stages_table_info, ASN_INTEGER, 0);
+	core_perf_stages_table_info->min_column = 1;
+	core_perf_stages_table_info->max_column = 9;
+
+	netsnmp_register_table(core_perf_stages_handler, core_perf_stages_table_info);
+
 	return POM_OK;
 
 }
@@ -342,3 +358,120 @@ int snmpcmd_core_perf_ringbuff_overflow_handler(netsnmp_mib_handler *handler, ne
 			
 	return SNMP_ERR_NOERROR;
 }
+
+int snmpcmd_core_perf_stages_handler(netsnmp_mib_handler *handler, netsnmp_handler_registration *reginfo, netsnmp_agent_request_info *reqinfo, netsnmp_request_info *requests) {
+
+	struct perf_class *stages = perf_find_class("stages");
+	if (!stages || !stages->instances)
+		return SNMP_ERR_NOERROR;
+
+	struct perf_instance *inst = stages->instances;
+
+	while (requests) {
+		netsnmp_variable_list *var = requests->requestvb;
+		if (requests->processed != 0) {
+			requests = requests->next;
+			continue;
+		}
+
+		netsnmp_table_request_info *table_info = netsnmp_extract_table_info(requests);
+		if (!table_info) {
+			requests = requests->next;
+			continue;
+		}
+
+		// Get rid of useless modes
+		if (reqinfo->mode != MODE_GETNEXT && reqinfo->mode != MODE_GET) {
+			requests = requests->next;
+			continue;
+		}
+
+		// Find the right item
+		int item_id = *(table_info->indexes->val.integer);
+		if (reqinfo->mode == MODE_GETNEXT)
+			item_id++;
+
+		perf_instance_lock(inst, 0);
+
+		struct perf_item *itm = inst->items;
+		int i;
+		for (i = 1; itm && i < item_id; i++)
+			itm = itm->next;
+
+		// Go to the next column
+		if (!itm && reqinfo->mode == MODE_GETNEXT) {
+			table_info->colnum++;
+			item_id = 1;
+			itm = inst->items;
+		}
+
+		if (!itm || table_info->colnum > 9) {
+			perf_instance_unlock(inst);
+			requests = requests->next;
+			continue;
+		}
+
+		unsigned char type = ASN_NULL;
+		char *value = NULL;
+		size_t len = 0;
+		uint64_t v64 = 0;
+		struct counter64 vc64;
+
+		switch (table_info->colnum) {
+			case 1: // Index
+				type = ASN_UNSIGNED;
+				value = (char *)&item_id;
+				len = sizeof(item_id);
+				break;
+			case 2: // Stage name
+				type = ASN_OCTET_STR;
+				value = itm->name;
+				len = strlen(value);
+				break;
+			case 3: // Number of samples
+			case 4: // Mean
+			case 5: // 50th percentile
+			case 6: // 90th percentile
+			case 7: // 99th percentile
+			case 8: // Max
+				if (table_info->colnum == 3)
+					v64 = perf_item_val_get_raw(itm);
+				else if (table_info->colnum == 4)
+					v64 = perf_item_val_get_mean(itm);
+				else if (table_info->colnum == 5)
+					v64 = perf_item_val_get_percentile(itm, 50);
+				else if (table_info->colnum == 6)
+					v64 = perf_item_val_get_percentile(itm, 90);
+				else if (table_info->colnum == 7)
+					v64 = perf_item_val_get_percentile(itm, 99);
+				else
+					v64 = perf_item_val_get_max(itm);
+				vc64.high = v64 >> 32;
+				vc64.low = v64 & 0xFFFFFFFF;
+				type = ASN_COUNTER64;
+				value = (char *)&vc64;
+				len = sizeof(struct counter64);
+				break;
+			case 9: // Description
+				type = ASN_OCTET_STR;
+				value = itm->descr;
+				len = strlen(value);
+				break;
+		}
+
+		if (value) {
+			if (reqinfo->mode == MODE_GETNEXT) {
+				*(table_info->indexes->val.integer) = item_id;
+				netsnmp_table_build_result(reginfo, requests, table_info, type, (unsigned char *)value, len);
+			} else if (reqinfo->mode == MODE_GET && var->type == ASN_NULL) {
+				snmp_set_var_typed_value(var, type, (unsigned char *)value, len);
+			}
+		}
+
+		perf_instance_unlock(inst);
+
+		requests = requests->next;
+	}
+
+	return SNMP_ERR_NOERROR;
+}
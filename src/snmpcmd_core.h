@@ -32,6 +32,7 @@ int snmpcmd_core_perf_ringbuff_pkts_handler(netsnmp_mib_handler *handler, netsnm
 int snmpcmd_core_perf_ringbuff_totpkts_handler(netsnmp_mib_handler *handler, netsnmp_handler_registration *reginfo, netsnmp_agent_request_info *reqinfo, netsnmp_request_info *requests);
 int snmpcmd_core_perf_ringbuff_droppedpkts_handler(netsnmp_mib_handler *handler, netsnmp_handler_registration *reginfo, netsnmp_agent_request_info *reqinfo, netsnmp_request_info *requests);
 int snmpcmd_core_perf_ringbuff_overflow_handler(netsnmp_mib_handler *handler, netsnmp_handler_registration *reginfo, netsnmp_agent_request_info *reqinfo, netsnmp_request_info *requests);
+int snmpcmd_core_perf_stages_handler(netsnmp_mib_handler *handler, netsnmp_handler_registration *reginfo, netsnmp_agent_request_info *reqinfo, netsnmp_request_info *requests);
 #endif
 
 
@@ -258,8 +258,7 @@ int snmpcmd_rules_handler(netsnmp_mib_handler *handler, netsnmp_handler_registra
 						pom_log(POM_LOG_DEBUG "Unable to parse the rule : %s", errbuff);
 						netsnmp_set_request_error(reqinfo, requests, SNMP_ERR_GENERR);
 					} else {
-						if (r->node)
-							node_destroy(r->node, 0);
+						rules_retire_node(r->node);
 						r->node = start;
 						main_config->rules_serial++;
 						r->serial++;
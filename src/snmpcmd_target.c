@@ -122,6 +122,22 @@ int snmpcmd_target_init_oids(oid *base_oid, int base_oid_len) {
 
 	netsnmp_register_table(target_perf_extra_gauge_handler, target_perf_extra_gauge_table_info);
 
+	// Register target extra perf histogram
+	my_oid[base_oid_len + 2] = 4;
+	netsnmp_handler_registration *target_perf_extra_histo_handler = netsnmp_create_handler_registration("targetPerfExtraHistogramTable", snmpcmd_target_perf_extra_handler, my_oid, base_oid_len + 3, HANDLER_CAN_RONLY);
+	if (!target_perf_extra_histo_handler)
+		return POM_ERR;
+
+	target_perf_extra_histo_handler->my_reg_void = (void*) perf_item_type_histogram;
+	netsnmp_table_registration_info *target_perf_extra_histo_table_info = malloc(sizeof(netsnmp_table_registration_info));
+	memset(target_perf_extra_histo_table_info, 0, sizeof(netsnmp_table_registration_info));
+
+	netsnmp_table_helper_add_indexes(target_perf_extra_histo_table_info, ASN_INTEGER, ASN_INTEGER, ASN_INTEGER, 0);
+	target_perf_extra_histo_table_info->min_column = 1;
+	target_perf_extra_histo_table_info->max_column = 11;
+
+	netsnmp_register_table(target_perf_extra_histo_handler, target_perf_extra_histo_table_info);
+
 	return POM_OK;
 
 }
@@ -793,6 +809,7 @@ static struct perf_item *snmpcmd_target_perf_item_getnext(struct target *t, stru
 int snmpcmd_target_perf_extra_handler(netsnmp_mib_handler *handler, netsnmp_handler_registration *reginfo, netsnmp_agent_request_info *reqinfo, netsnmp_request_info *requests) {
 
 	enum perf_item_type type = (enum perf_item_type)reginfo->my_reg_void;
+	unsigned int max_column = (type == perf_item_type_histogram ? 11 : 6);
 
 	while (requests) {
 		netsnmp_variable_list *var = requests->requestvb;
@@ -908,7 +925,7 @@ int snmpcmd_target_perf_extra_handler(netsnmp_mib_handler *handler, netsnmp_hand
 			}
 		}
 
-		if (!r || !t || !itm || table_info->colnum > 8) {
+		if (!r || !t || !itm || table_info->colnum > max_column) {
 			requests = requests->next;
 			main_config_rules_unlock();
 			continue;
@@ -920,6 +937,8 @@ int snmpcmd_target_perf_extra_handler(netsnmp_mib_handler *handler, netsnmp_hand
 		unsigned char res_type = ASN_NULL;
 		char *value = NULL;
 		size_t len = 0;
+		uint64_t v64 = 0;
+		struct counter64 vc64;
 
 		switch(table_info->colnum) {
 			case 1: // Rule Index
@@ -946,10 +965,9 @@ int snmpcmd_target_perf_extra_handler(netsnmp_mib_handler *handler, netsnmp_hand
 				len = strlen(value);
 				break;
 
-			case 5: // Item value
-				if (type == perf_item_type_counter) {
-					uint64_t v64 = perf_item_val_get_raw(itm);
-					struct counter64 vc64;
+			case 5: // Item value, number of samples for histograms
+				if (type == perf_item_type_counter || type == perf_item_type_histogram) {
+					v64 = perf_item_val_get_raw(itm);
 					vc64.high = v64 >> 32;
 					vc64.low = v64 & 0xFFFFFFFF;
 					value = (char *) (&vc64);
@@ -970,6 +988,27 @@ int snmpcmd_target_perf_extra_handler(netsnmp_mib_handler *handler, netsnmp_hand
 				len = strlen(value);
 				break;
 
+			case 7: // Histogram mean
+			case 8: // Histogram 50th percentile
+			case 9: // Histogram 90th percentile
+			case 10: // Histogram 99th percentile
+			case 11: // Histogram max
+				if (table_info->colnum == 7)
+					v64 = perf_item_val_get_mean(itm);
+				else if (table_info->colnum == 8)
+					v64 = perf_item_val_get_percentile(itm, 50);
+				else if (table_info->colnum == 9)
+					v64 = perf_item_val_get_percentile(itm, 90);
+				else if (table_info->colnum == 10)
+					v64 = perf_item_val_get_percentile(itm, 99);
+				else
+					v64 = perf_item_val_get_max(itm);
+				vc64.high = v64 >> 32;
+				vc64.low = v64 & 0xFFFFFFFF;
+				value = (char *) (&vc64);
+				res_type = ASN_COUNTER64;
+				len = sizeof(struct counter64);
+				break;
 
 		}
 
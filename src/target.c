@@ -259,6 +259,7 @@ struct target *target_alloc(int target_type) {
 
 	// Init the target internal stuff
 	t->uid = uid_get_new();
+	uid_attach(t->uid, UID_OBJ_TARGET, t);
 
 	// Default mode is the first one
 	t->mode = targets[target_type]->modes;
@@ -267,6 +268,7 @@ struct target *target_alloc(int target_type) {
 	t->perf_pkts = perf_add_item(t->perfs, "pkts", perf_item_type_counter, "Number of packets processed");
 	t->perf_bytes = perf_add_item(t->perfs, "bytes", perf_item_type_counter, "Number of bytes processed");
 	t->perf_uptime = perf_add_item(t->perfs, "uptime", perf_item_type_uptime, "Time for which the target has been started");
+	t->perf_process_time = perf_add_item(t->perfs, "process_time", perf_item_type_histogram, "Time spent processing each packet");
 
 	if (targets[target_type]->init) {
 		if ((*targets[target_type]->init) (t) != POM_OK) {
@@ -437,12 +439,14 @@ int target_process(struct target *t, struct frame *f) {
 	if (t->started) {
 		perf_item_val_inc(t->perf_pkts, 1);
 		perf_item_val_inc(t->perf_bytes, f->len);
+		uint64_t start = perf_ticks();
 		if (targets[t->type]->process && (*targets[t->type]->process) (t, f) == POM_ERR) {
 			pom_log(POM_LOG_ERR "Target %s returned an error. Stopping it", target_get_name(t->type));
 			target_close(t);
 			target_unlock_instance(t);
 			return POM_ERR;
 		}
+		perf_item_val_record_time(t->perf_process_time, start);
 	}
 	target_unlock_instance(t);
 	return POM_OK;
@@ -952,42 +956,42 @@ int target_dataset_error(struct dataset *dset) {
 
 	// This is ugly and slow but it's not supposed to happen ...
 
-	struct rule_list *rl = main_config->rules;
-
-	while (rl) {
-
-		struct target *t = rl->target;
-		while (t) {
-
-			struct target_dataset *tds = t->datasets;
-			while (tds) {
-				if (tds->dset == dset) {
-					int res = pthread_rwlock_trywrlock(&t->lock);
-					if (res == EBUSY) {
-						// Target is busy, probably processing. Let's close the dataset
-						tds->dset->query_data = tds->orig_ds_data;
-						datastore_dataset_close(tds->dset);
-						tds->dset = NULL;
-					} else if (!res) {
-						// Target is not busy, let's close it
-						target_close(t);
-						target_unlock_instance(t);
-					} else {
-						// Locking operation failed
-						pom_log(POM_LOG_ERR "Error while locking a target instance lock");
-						abort();
-						return POM_ERR;
+	struct rule_snapshot *rules = rules_snapshot_get();
 
-					}
-					return POM_OK;
-				}
+	unsigned int i;
+	for (i = 0; rules && i < rules->targets_count; i++) {
+
+		struct target *t = rules->targets[i];
+
+		struct target_dataset *tds = t->datasets;
+		while (tds) {
+			if (tds->dset == dset) {
+				int res = pthread_rwlock_trywrlock(&t->lock);
+				if (res == EBUSY) {
+					// Target is busy, probably processing. Let's close the dataset
+					tds->dset->query_data = tds->orig_ds_data;
+					datastore_dataset_close(tds->dset);
+					tds->dset = NULL;
+				} else if (!res) {
+					// Target is not busy, let's close it
+					target_close(t);
+					target_unlock_instance(t);
+				} else {
+					// Locking operation failed
+					pom_log(POM_LOG_ERR "Error while locking a target instance lock");
+					abort();
+					return POM_ERR;
 
-				tds = tds->next;
+				}
+				rules_snapshot_release();
+				return POM_OK;
 			}
-			t = t->next;
+
+			tds = tds->next;
 		}
-		rl = rl->next;
 	}
 
+	rules_snapshot_release();
+
 	return POM_OK;
 }
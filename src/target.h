@@ -164,6 +164,7 @@ struct target {
 	struct perf_item *perf_pkts; ///< Number of packets processed by this target
 	struct perf_item *perf_bytes; ///< Number of bytes processed by this target
 	struct perf_item *perf_uptime; ///< Time for which the target has been started
+	struct perf_item *perf_process_time; ///< Time spent processing each packet
 
 	struct target *next; ///< Used for linking
 	struct target *prev; ///< Used for linking
@@ -37,6 +37,7 @@ static struct target_mode *mode_default;
 int target_register_dump_payload(struct target_reg *r) {
 
 	r->init = target_init_dump_payload;
+	r->open = target_open_dump_payload;
 	r->process = target_process_dump_payload;
 	r->close = target_close_dump_payload;
 	r->cleanup = target_cleanup_dump_payload;
@@ -81,6 +82,17 @@ static int target_init_dump_payload(struct target *t) {
 	return POM_OK;
 }
 
+static int target_open_dump_payload(struct target *t) {
+
+	struct target_priv_dump_payload *priv = t->target_priv;
+
+	priv->prefix_tmpl = layer_template_compile(PTYPE_STRING_GETVAL(priv->prefix));
+	if (!priv->prefix_tmpl)
+		return POM_ERR;
+
+	return POM_OK;
+}
+
 static int target_close_dump_payload(struct target *t) {
 
 	struct target_priv_dump_payload *priv = t->target_priv;
@@ -90,6 +102,9 @@ static int target_close_dump_payload(struct target *t) {
 		target_close_connection_dump_payload(t, priv->ct_privs->ce, priv->ct_privs);
 	}
 
+	layer_template_cleanup(priv->prefix_tmpl);
+	priv->prefix_tmpl = NULL;
+
 	return POM_OK;
 }
 
@@ -151,7 +166,8 @@ static int target_process_dump_payload(struct target *t, struct frame *f) {
 		cp = malloc(sizeof(struct target_conntrack_priv_dump_payload));
 		memset(cp, 0, sizeof(struct target_conntrack_priv_dump_payload));
 
-		char filename[NAME_MAX];
+		char filename[NAME_MAX + 1];
+		layer_template_render(priv->prefix_tmpl, f->l, &f->tv, filename, sizeof(filename));
 
 		char outstr[20];
 		memset(outstr, 0, 20);
@@ -162,11 +178,9 @@ static int target_process_dump_payload(struct target *t, struct frame *f) {
 
 		strftime(outstr, 20, format, &tmp);
 
-		strcpy(filename, PTYPE_STRING_GETVAL(priv->prefix));
-		strcat(filename, outstr);
-		sprintf(outstr, "%u", (unsigned int)f->tv.tv_usec);
-		strcat(filename, outstr);
-		cp->fd = target_file_open(f->l, &f->tv, filename, O_RDWR | O_CREAT, 0666);
+		size_t len = strlen(filename);
+		snprintf(filename + len, sizeof(filename) - len, "%s%u", outstr, (unsigned int)f->tv.tv_usec);
+		cp->fd = target_file_open(NULL, NULL, filename, O_RDWR | O_CREAT, 0666);
 
 		if (cp->fd == -1) {
 			free(cp);
@@ -176,6 +190,8 @@ static int target_process_dump_payload(struct target *t, struct frame *f) {
 			return POM_ERR;
 		}
 
+		filewriter_register(cp->fd);
+
 		pom_log(POM_LOG_TSHOOT "%s opened", filename);
 
 		conntrack_add_target_priv(cp, t, f->ce, target_close_connection_dump_payload);
@@ -199,7 +215,7 @@ static int target_process_dump_payload(struct target *t, struct frame *f) {
 		int s = strlen(mark_str);
 
 		while (s > 0) {
-			int wres = write(cp->fd, mark_str, s);
+			int wres = filewriter_write(cp->fd, mark_str, s);
 			if (wres < 0) {
 				char err_str[256];
 				strerror_r(errno, err_str, sizeof(err_str) - 1);
@@ -214,7 +230,7 @@ static int target_process_dump_payload(struct target *t, struct frame *f) {
 	int s = lastl->payload_size;
 	void *buff = f->buff + lastl->payload_start;
 	while (s > 0) {
-		int wres = write(cp->fd, buff, s);
+		int wres = filewriter_write(cp->fd, buff, s);
 		if (wres < 0) {
 			char err_str[256];
 			strerror_r(errno, err_str, sizeof(err_str) - 1);
@@ -237,7 +253,7 @@ static int target_close_connection_dump_payload(struct target *t, struct conntra
 	struct target_conntrack_priv_dump_payload *cp;
 	cp = conntrack_priv;
 
-	close(cp->fd);
+	filewriter_close(cp->fd);
 
 	struct target_priv_dump_payload *priv = t->target_priv;
 
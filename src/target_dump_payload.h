@@ -41,6 +41,7 @@ struct target_priv_dump_payload {
 
 	struct ptype *prefix;
 	struct ptype *markdir;
+	struct layer_template *prefix_tmpl;
 	struct target_conntrack_priv_dump_payload *ct_privs;
 
 	struct perf_item *perf_tot_conn, *perf_cur_conn, *perf_tot_bytes;
@@ -50,6 +51,7 @@ struct target_priv_dump_payload {
 int target_register_dump_payload(struct target_reg *r);
 
 static int target_init_dump_payload(struct target *t);
+static int target_open_dump_payload(struct target *t);
 static int target_process_dump_payload(struct target *t, struct frame *f);
 static int target_close_connection_dump_payload(struct target *t, struct conntrack_entry* ce, void *conntrack_priv);
 static int target_close_dump_payload(struct target *t);
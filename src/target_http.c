@@ -36,9 +36,13 @@
 #include "target_http.h"
 #include "target_http_mime.h"
 #include "target_http_log.h"
+#include "target_http_header.h"
+#include "target_http_dedup.h"
 
 #include "ptype_bool.h"
 #include "ptype_string.h"
+#include "ptype_uint16.h"
+#include "ptype_uint32.h"
 
 static unsigned int match_undefined_id;
 static struct target_mode *mode_default;
@@ -54,6 +58,9 @@ int target_register_http(struct target_reg *r) {
 
 	match_undefined_id = match_register("undefined");
 
+	if (target_http_header_init() != POM_OK)
+		return POM_ERR;
+
 	mode_default = target_register_mode(r->type, "default", "Dump each HTTP connection's content into separate files");
 
 	if (!mode_default)
@@ -62,6 +69,7 @@ int target_register_http(struct target_reg *r) {
 	target_register_param(mode_default, "prefix", "/tmp/", "Path of dumped files");
 #ifdef HAVE_ZLIB
 	target_register_param(mode_default, "decompress", "yes", "Decompress the payload or not on the fly");
+	target_register_param(mode_default, "max_decompress", "256", "Maximum number of bodies decompressed at the same time, the others are saved compressed");
 #endif
 	target_register_param(mode_default, "mime_types_db", DATAROOT "/mime_types.db", "Mime types database path");
 	target_register_param(mode_default, "log_file", "", "File where to log the queries");
@@ -74,6 +82,10 @@ int target_register_http(struct target_reg *r) {
 	target_register_param(mode_default, "dump_txt", "no", "Dump the text or not");
 	target_register_param(mode_default, "dump_bin", "no", "Dump the binary or not");
 	target_register_param(mode_default, "dump_doc", "no", "Dump the documents or not");
+	target_register_param(mode_default, "max_buffer", "16777216", "Maximum memory used to buffer incomplete headers of all the connections");
+	target_register_param(mode_default, "dedup", "no", "Save each unique object once, named after the SHA-256 of its content");
+	target_register_param(mode_default, "dedup_buffer", "1048576", "Objects smaller than this are kept in memory until their digest is known");
+	target_register_param(mode_default, "dedup_max_buffer", "67108864", "Maximum memory used to keep the objects of all the connections in memory");
 
 
 	return POM_OK;
@@ -91,6 +103,9 @@ int target_init_http(struct target *t) {
 	priv->prefix = ptype_alloc("string", NULL);
 #ifdef HAVE_ZLIB
 	priv->decompress = ptype_alloc("bool", NULL);
+	priv->max_decompress = ptype_alloc("uint16", "streams");
+	pthread_mutex_init(&priv->zpool_lock, NULL);
+	pthread_cond_init(&priv->zpool_cond, NULL);
 #endif
 	priv->mime_types_db = ptype_alloc("string", NULL);
 	priv->log_file = ptype_alloc("string", NULL);
@@ -103,10 +118,15 @@ int target_init_http(struct target *t) {
 	priv->dump_txt = ptype_alloc("bool", NULL);
 	priv->dump_bin = ptype_alloc("bool", NULL);
 	priv->dump_doc = ptype_alloc("bool", NULL);
+	priv->max_buffer = ptype_alloc("uint32", "bytes");
+	priv->dedup = ptype_alloc("bool", NULL);
+	priv->dedup_buffer = ptype_alloc("uint32", "bytes");
+	priv->dedup_max_buffer = ptype_alloc("uint32", "bytes");
 
 	if (!priv->prefix ||
 #ifdef HAVE_ZLIB
 		!priv->decompress ||
+		!priv->max_decompress ||
 #endif
 		!priv->mime_types_db ||
 		!priv->log_file ||
@@ -118,7 +138,11 @@ int target_init_http(struct target *t) {
 		!priv->dump_snd ||
 		!priv->dump_txt ||
 		!priv->dump_bin ||
-		!priv->dump_doc) {
+		!priv->dump_doc ||
+		!priv->max_buffer ||
+		!priv->dedup ||
+		!priv->dedup_buffer ||
+		!priv->dedup_max_buffer) {
 		target_cleanup_http(t);
 		return POM_ERR;
 	}
@@ -126,6 +150,7 @@ int target_init_http(struct target *t) {
 	target_register_param_value(t, mode_default, "prefix", priv->prefix);
 #ifdef HAVE_ZLIB
 	target_register_param_value(t, mode_default, "decompress", priv->decompress);
+	target_register_param_value(t, mode_default, "max_decompress", priv->max_decompress);
 #endif
 	target_register_param_value(t, mode_default, "mime_types_db", priv->mime_types_db);
 	target_register_param_value(t, mode_default, "log_file", priv->log_file);
@@ -138,6 +163,10 @@ int target_init_http(struct target *t) {
 	target_register_param_value(t, mode_default, "dump_txt", priv->dump_txt);
 	target_register_param_value(t, mode_default, "dump_bin", priv->dump_bin);
 	target_register_param_value(t, mode_default, "dump_doc", priv->dump_doc);
+	target_register_param_value(t, mode_default, "max_buffer", priv->max_buffer);
+	target_register_param_value(t, mode_default, "dedup", priv->dedup);
+	target_register_param_value(t, mode_default, "dedup_buffer", priv->dedup_buffer);
+	target_register_param_value(t, mode_default, "dedup_max_buffer", priv->dedup_max_buffer);
 
 
 	priv->perf_tot_conn = perf_add_item(t->perfs, "tot_conn", perf_item_type_counter, "Total number of connections handled");
@@ -149,6 +178,14 @@ int target_init_http(struct target *t) {
 	priv->perf_parsed_resps = perf_add_item(t->perfs, "parsed_resps", perf_item_type_counter, "Number of response parsed");
 	priv->perf_parsed_transactions  = perf_add_item(t->perfs, "parsed_transactions", perf_item_type_counter, "Number of transactions parsed (a transaction is either a single request, single response or both)");
 	priv->perf_parse_errors = perf_add_item(t->perfs, "parse_errors", perf_item_type_counter, "Number of errors while parsing");
+	priv->perf_buffered_bytes = perf_add_item(t->perfs, "buffered_bytes", perf_item_type_gauge, "Memory used to buffer incomplete headers");
+	priv->perf_buffer_evictions = perf_add_item(t->perfs, "buffer_evictions", perf_item_type_counter, "Number of connections discarded because the buffer limit was reached");
+	priv->perf_dedup_hits = perf_add_item(t->perfs, "dedup_hits", perf_item_type_counter, "Number of objects which were already saved");
+	priv->perf_dedup_bytes = perf_add_item(t->perfs, "dedup_bytes", perf_item_type_counter, "Number of bytes not written because the object was already saved");
+#ifdef HAVE_ZLIB
+	priv->perf_decompress_active = perf_add_item(t->perfs, "decompress_active", perf_item_type_gauge, "Number of bodies being decompressed");
+	priv->perf_decompress_skipped = perf_add_item(t->perfs, "decompress_skipped", perf_item_type_counter, "Number of bodies saved compressed because max_decompress was reached");
+#endif
 
 
 	return POM_OK;
@@ -168,6 +205,19 @@ int target_close_http(struct target *t) {
 
 	target_http_mime_types_cleanup_db(priv);
 
+#ifdef HAVE_ZLIB
+	target_zstream_cleanup_http(priv);
+#endif
+
+	if (priv->linear_buff) {
+		free(priv->linear_buff);
+		priv->linear_buff = NULL;
+		priv->linear_buff_size = 0;
+	}
+
+	layer_template_cleanup(priv->prefix_tmpl);
+	priv->prefix_tmpl = NULL;
+
 	return POM_OK;
 }
 
@@ -180,6 +230,9 @@ int target_cleanup_http(struct target *t) {
 		ptype_cleanup(priv->prefix);
 #ifdef HAVE_ZLIB
 		ptype_cleanup(priv->decompress);
+		ptype_cleanup(priv->max_decompress);
+		pthread_mutex_destroy(&priv->zpool_lock);
+		pthread_cond_destroy(&priv->zpool_cond);
 #endif
 		ptype_cleanup(priv->mime_types_db);
 		ptype_cleanup(priv->log_file);
@@ -192,6 +245,10 @@ int target_cleanup_http(struct target *t) {
 		ptype_cleanup(priv->dump_txt);
 		ptype_cleanup(priv->dump_bin);
 		ptype_cleanup(priv->dump_doc);
+		ptype_cleanup(priv->max_buffer);
+		ptype_cleanup(priv->dedup);
+		ptype_cleanup(priv->dedup_buffer);
+		ptype_cleanup(priv->dedup_max_buffer);
 
 		perf_remove_item(t->perfs, priv->perf_tot_conn);
 		perf_remove_item(t->perfs, priv->perf_cur_conn);
@@ -202,6 +259,14 @@ int target_cleanup_http(struct target *t) {
 		perf_remove_item(t->perfs, priv->perf_parsed_resps);
 		perf_remove_item(t->perfs, priv->perf_parsed_transactions);
 		perf_remove_item(t->perfs, priv->perf_parse_errors);
+		perf_remove_item(t->perfs, priv->perf_buffered_bytes);
+		perf_remove_item(t->perfs, priv->perf_buffer_evictions);
+		perf_remove_item(t->perfs, priv->perf_dedup_hits);
+		perf_remove_item(t->perfs, priv->perf_dedup_bytes);
+#ifdef HAVE_ZLIB
+		perf_remove_item(t->perfs, priv->perf_decompress_active);
+		perf_remove_item(t->perfs, priv->perf_decompress_skipped);
+#endif
 
 		free(priv);
 	}
@@ -228,6 +293,11 @@ int target_open_http(struct target *t) {
 	if (PTYPE_BOOL_GETVAL(priv->dump_doc)) // doc
 		priv->match_mask |= HTTP_MIME_TYPE_DOC;
 
+	// Parse the prefix once instead of for each file
+	priv->prefix_tmpl = layer_template_compile(PTYPE_STRING_GETVAL(priv->prefix));
+	if (!priv->prefix_tmpl)
+		return POM_ERR;
+
 	int res = target_init_log_http(t);
 	if (res == POM_ERR)
 		return POM_ERR;
@@ -287,16 +357,48 @@ int target_process_http(struct target *t, struct frame *f) {
 
 	char *pload = f->buff + lastl->payload_start;
 
-	if (cp->buff) {
-		int size = cp->buff_size + psize;
-		cp->buff = realloc(cp->buff, size);
-		memcpy(cp->buff + cp->buff_size, pload, psize);
-		cp->buff_size = size;
-		psize = size;
-		pload = cp->buff;
+	// Payload following the linearized buffered data, parsed in place afterwards
+	char *rest = NULL;
+	size_t rest_size = 0;
+
+	if (cp->buff_head) {
+		// The buffered data ends with an incomplete line, only linearize it with the end of that line
+		char *nl = memchr(pload, '\n', psize);
+		size_t len = (nl ? nl - pload + 1 : psize);
+		target_buffer_append_http(priv, cp, pload, len);
+		if (cp->state == HTTP_INVALID) // Discarded by the buffer limit
+			return POM_OK;
+		rest = pload + len;
+		rest_size = psize - len;
+
+		if (priv->linear_buff_size < cp->buff_size) {
+			char *linear_buff = realloc(priv->linear_buff, cp->buff_size);
+			if (!linear_buff) {
+				pom_log(POM_LOG_ERR "Not enough memory to parse the buffered data of connection 0x%lx", (unsigned long) cp);
+				target_buffer_discard_http(priv, cp);
+				return POM_OK;
+			}
+			priv->linear_buff = linear_buff;
+			priv->linear_buff_size = cp->buff_size;
+		}
+		struct http_buff_chunk *chunk;
+		psize = 0;
+		for (chunk = cp->buff_head; chunk; chunk = chunk->next) {
+			memcpy(priv->linear_buff + psize, chunk->data + chunk->start, chunk->end - chunk->start);
+			psize += chunk->end - chunk->start;
+		}
+		pload = priv->linear_buff;
 	}
 
-	while (psize > 0) {
+	while (psize > 0 || rest_size > 0) {
+
+		if (!psize) {
+			// The linearized data was parsed, the chunks aren't needed anymore
+			target_buffer_release_http(priv, cp);
+			pload = rest;
+			psize = rest_size;
+			rest_size = 0;
+		}
 
 		if (cp->state == HTTP_INVALID)
 			return POM_OK;
@@ -322,7 +424,7 @@ int target_process_http(struct target *t, struct frame *f) {
 						perf_item_val_inc(priv->perf_parse_errors, 1);
 						break;
 					} else  {
-						target_buffer_payload_http(cp, pload, psize);
+						target_buffer_payload_http(priv, cp, pload, psize, rest, rest_size);
 						return POM_OK;
 					}
 				}
@@ -336,7 +438,8 @@ int target_process_http(struct target *t, struct frame *f) {
 				psize -= len;
 			}
 
-			char *nl = memchr(pload, '\n', psize);
+			char *colon = NULL;
+			char *nl = target_http_header_scan_line(pload, psize, &colon);
 			if (!nl) { // Buffer incomplete
 				if (psize > HTTP_MAX_HEADER_LINE) {
 					pom_log(POM_LOG_TSHOOT "Header too long. Discarding");
@@ -345,7 +448,7 @@ int target_process_http(struct target *t, struct frame *f) {
 						perf_item_val_inc(priv->perf_parse_errors, 1);
 					break;
 				} else {
-					target_buffer_payload_http(cp, pload, psize);
+					target_buffer_payload_http(priv, cp, pload, psize, rest, rest_size);
 					return POM_OK;
 				}
 
@@ -395,7 +498,6 @@ int target_process_http(struct target *t, struct frame *f) {
 				continue;
 			}
 
-			char *colon = memchr(pload, ':', strsize);
 			if (!colon) {
 				if (strsize > HTTP_MAX_HEADER_LINE) { // I've never seen a so long buffer name
 					pom_log(POM_LOG_TSHOOT "Invalid header line. Discarding connection");
@@ -404,7 +506,7 @@ int target_process_http(struct target *t, struct frame *f) {
 					perf_item_val_inc(priv->perf_parse_errors, 1);
 					break;
 				} else {
-					target_buffer_payload_http(cp, pload, psize);
+					target_buffer_payload_http(priv, cp, pload, psize, rest, rest_size);
 					return POM_OK;
 				}
 
@@ -424,6 +526,7 @@ int target_process_http(struct target *t, struct frame *f) {
 			cp->info.headers[cp->info.headers_num - 1].name = malloc(name_size + 1);
 			memcpy(cp->info.headers[cp->info.headers_num - 1].name, pload, name_size);
 			cp->info.headers[cp->info.headers_num - 1].name[name_size] = 0;
+			cp->info.headers[cp->info.headers_num - 1].id = target_http_header_get_id(pload, name_size);
 			colon++;
 			while (*colon && *colon == ' ')
 				colon++;
@@ -476,7 +579,7 @@ int target_process_http(struct target *t, struct frame *f) {
 					if (!crlf) {
 						if (size < 8) {
 							// buffer too short
-							target_buffer_payload_http(cp, pload, psize);
+							target_buffer_payload_http(priv, cp, pload, psize, rest, rest_size);
 							return POM_OK;
 						} else {
 							pom_log(POM_LOG_TSHOOT "Invalid chunk size : cannot find CRLF");
@@ -536,40 +639,18 @@ int target_process_http(struct target *t, struct frame *f) {
 				break;
 			
 			if (priv->mime_types[cp->info.content_type].type & priv->match_mask) { // Should we process the payload ?
-#ifdef HAVE_ZLIB
-				if ((cp->info.flags & HTTP_FLAG_GZIP || cp->info.flags & HTTP_FLAG_DEFLATE) && PTYPE_BOOL_GETVAL(priv->decompress)) { // same shit, different headers
-					if (cp->fd == -1 && target_file_open_http(t, cp, f, 0) == POM_ERR)
-						return POM_ERR;
-					size_t len = target_process_gzip_http(priv, cp, pload, size);
-					if (len == POM_ERR)
-						return POM_ERR;
-					else if (len == 0) // Was marked as invalid
-						break;
-					pload += len;
-					psize -= len;
-					size -= len;
-					cp->info.content_pos += len;
-				} else {
-
-#endif
-					if (cp->fd == -1 && target_file_open_http(t, cp, f, (cp->info.flags & HTTP_FLAG_GZIP || cp->info.flags & HTTP_FLAG_DEFLATE)) == POM_ERR)
-						return POM_ERR;
-					size_t wres = 0;
-					while (size > 0) {
-						wres = write(cp->fd, pload, size);
-						if (wres == -1) {
-							pom_log(POM_LOG_ERR "Unable to write into a file");
-							return POM_ERR;
-						}
-						perf_item_val_inc(priv->perf_dumped_bytes, wres);
-						pload += wres;
-						size -= wres;
-						psize -= wres;
-						cp->info.content_pos += wres;
-					}
-#ifdef HAVE_ZLIB
-				}
-#endif
+				if (cp->fd == -1 && !cp->dedup && target_file_open_http(t, cp, f, (cp->info.flags & HTTP_FLAG_GZIP || cp->info.flags & HTTP_FLAG_DEFLATE)) == POM_ERR)
+					return POM_ERR;
+				int res;
+				if (cp->dedup)
+					res = target_dedup_write_http(priv, cp, pload, size);
+				else
+					res = target_file_write_http(priv, cp, pload, size);
+				if (res == POM_ERR)
+					return POM_ERR;
+				pload += size;
+				psize -= size;
+				cp->info.content_pos += size;
 			} else {
 				pload += size;
 				psize -= size;
@@ -591,11 +672,8 @@ int target_process_http(struct target *t, struct frame *f) {
 		}
 	}
 
-	if (cp->buff) {
-		free(cp->buff);
-		cp->buff = NULL;
-		cp->buff_size = 0;
-	}
+	if (cp->buff_head)
+		target_buffer_release_http(priv, cp);
 
 	return POM_OK;
 }
@@ -612,8 +690,8 @@ int target_close_connection_http(struct target *t, struct conntrack_entry *ce, v
 	int res = target_write_log_http(priv, cp);
 	target_reset_conntrack_http(priv, cp);
 
-	if (cp->buff)
-		free(cp->buff);
+	if (cp->buff_head)
+		target_buffer_release_http(priv, cp);
 
 	if (cp->prev)
 		cp->prev->next = cp->next;
@@ -638,7 +716,7 @@ size_t target_parse_query_response_http(struct target_priv_http *priv, struct ta
 		return 0; // Buffer incomplete
 
 	size_t hdr_size;
-	char *nl = memchr(pload, '\n', psize);
+	char *nl = target_http_header_scan_line(pload, psize, NULL);
 	if (!nl) {
 		if (psize > HTTP_MAX_HEADER_LINE) {
 			pom_log(POM_LOG_TSHOOT "Header line too big. Ignoring connection");
@@ -821,16 +899,18 @@ int target_parse_payload_headers_http(struct target_priv_http *priv, struct targ
 		if (cp->info.headers[i].type != cp->state)
 			continue;
 
-		if (!(cp->info.flags & HTTP_FLAG_HAVE_CLEN) && !strcasecmp(cp->info.headers[i].name, "Content-Length")) {
+		int id = cp->info.headers[i].id;
+
+		if (!(cp->info.flags & HTTP_FLAG_HAVE_CLEN) && id == HTTP_HEADER_ID_CONTENT_LENGTH) {
 			if(sscanf(cp->info.headers[i].value, "%u", &cp->info.content_len) != 1)
 				return POM_ERR;
 			cp->info.flags |= HTTP_FLAG_HAVE_CLEN;
-		} else if (!(cp->info.flags & (HTTP_FLAG_GZIP | HTTP_FLAG_DEFLATE)) && !strcasecmp(cp->info.headers[i].name, "Content-Encoding")) {
+		} else if (!(cp->info.flags & (HTTP_FLAG_GZIP | HTTP_FLAG_DEFLATE)) && id == HTTP_HEADER_ID_CONTENT_ENCODING) {
 			if (!strcasecmp(cp->info.headers[i].value, "gzip"))
 				cp->info.flags |= HTTP_FLAG_GZIP;
 			if (!strcasecmp(cp->info.headers[i].value, "deflate"))
 				cp->info.flags |= HTTP_FLAG_DEFLATE;
-		} else if (!strcasecmp(cp->info.headers[i].name, "Content-Type")) {
+		} else if (id == HTTP_HEADER_ID_CONTENT_TYPE) {
 			// Make sure it's lowercase as some stupid ppl put that uppercase
 			int j;
 			for (j = 0; j < strlen(cp->info.headers[i].value); j++)
@@ -841,7 +921,7 @@ int target_parse_payload_headers_http(struct target_priv_http *priv, struct targ
 
 			cp->info.content_type = target_http_mime_type_get_id(priv, cp->info.headers[i].value);
 
-		} else if (!(cp->info.flags & HTTP_FLAG_CHUNKED) && !strcasecmp(cp->info.headers[i].name, "Transfer-Encoding")) {
+		} else if (!(cp->info.flags & HTTP_FLAG_CHUNKED) && id == HTTP_HEADER_ID_TRANSFER_ENCODING) {
 			if (!strcasecmp(cp->info.headers[i].value, "chunked"))
 				cp->info.flags |= HTTP_FLAG_CHUNKED;
 		}
@@ -854,89 +934,150 @@ int target_parse_payload_headers_http(struct target_priv_http *priv, struct targ
 
 #ifdef HAVE_ZLIB
 
-size_t target_process_gzip_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp, char *pload, size_t size) {
+/**
+ * Get a decompression context for a new body.
+ * @param priv Private data of the target
+ * @param flags Flags of the body, HTTP_FLAG_GZIP or HTTP_FLAG_DEFLATE
+ * @return The context or NULL if too many bodies are already decompressed
+ */
+struct http_zstream *target_zstream_get_http(struct target_priv_http *priv, unsigned int flags) {
 
-	if (!cp->info.zbuff) {
+	pthread_mutex_lock(&priv->zpool_lock);
 
-		cp->info.zbuff = malloc(sizeof(z_stream));
-		memset(cp->info.zbuff, 0, sizeof(z_stream));
+	if (priv->zstreams_active >= PTYPE_UINT16_GETVAL(priv->max_decompress)) {
+		pthread_mutex_unlock(&priv->zpool_lock);
+		perf_item_val_inc(priv->perf_decompress_skipped, 1);
+		return NULL;
+	}
 
-		if (cp->info.flags & HTTP_FLAG_GZIP) {
-			if (inflateInit2(cp->info.zbuff, 15 + 32) != Z_OK) { // 15, default window bits. 32, magic value to enable header detection
-				if (cp->info.zbuff->msg)
-					pom_log(POM_LOG_ERR "Unable to init Zlib : %s", cp->info.zbuff->msg);
-				else
-					pom_log(POM_LOG_ERR "Unable to init Zlib : Unknown error");
-				free(cp->info.zbuff);
-				cp->info.zbuff = NULL;
-				cp->state = HTTP_INVALID;
-				return 0;
-			}
-		} else if (cp->info.flags & HTTP_FLAG_DEFLATE) {
+	struct http_zstream *zs = priv->zpool;
+	if (zs)
+		priv->zpool = zs->next;
+	priv->zstreams_active++;
 
-			if (inflateInit2(cp->info.zbuff, -15) != Z_OK) { // Raw content
-				if (cp->info.zbuff->msg)
-					pom_log(POM_LOG_ERR "Unable to init Zlib : %s", cp->info.zbuff->msg);
-				else
-					pom_log(POM_LOG_ERR "Unable to init Zlib : Unknown error");
-				free(cp->info.zbuff);
-				cp->info.zbuff = NULL;
-				cp->state = HTTP_INVALID;
-				return 0;
-			}
-			
-		}
+	pthread_mutex_unlock(&priv->zpool_lock);
+
+	// 15, default window bits. 32, magic value to enable header detection. Negative for raw content
+	int window_bits = (flags & HTTP_FLAG_GZIP) ? 15 + 32 : -15;
+
+	int res;
+	if (zs) {
+		res = inflateReset2(&zs->zbuff, window_bits);
+	} else {
+		zs = malloc(sizeof(struct http_zstream));
+		memset(zs, 0, sizeof(struct http_zstream));
+		zs->priv = priv;
+		res = inflateInit2(&zs->zbuff, window_bits);
 	}
 
-	cp->info.zbuff->next_in = (unsigned char *) pload;
-	cp->info.zbuff->avail_in = size;
-	int out_size = size * 2;
-	char *buff = malloc(out_size);
+	if (res != Z_OK) {
+		if (zs->zbuff.msg)
+			pom_log(POM_LOG_ERR "Unable to init Zlib : %s", zs->zbuff.msg);
+		else
+			pom_log(POM_LOG_ERR "Unable to init Zlib : Unknown error");
+		inflateEnd(&zs->zbuff);
+		free(zs);
+		pthread_mutex_lock(&priv->zpool_lock);
+		priv->zstreams_active--;
+		pthread_cond_broadcast(&priv->zpool_cond);
+		pthread_mutex_unlock(&priv->zpool_lock);
+		return NULL;
+	}
 
-	do {
-		cp->info.zbuff->next_out = (unsigned char *)buff;
-		cp->info.zbuff->avail_out = out_size;
-		int res = inflate(cp->info.zbuff, Z_SYNC_FLUSH);
-		if (res == Z_OK || res == Z_STREAM_END) {
-			size_t wpos = 0, wres = 0, wsize = out_size - cp->info.zbuff->avail_out;
-			while (wsize > 0) {
-				wres = write(cp->fd, buff + wpos, wsize);
-				if (wres == -1) {
-					pom_log(POM_LOG_ERR "Unable to write into a file");
-					free(buff);
-					return POM_ERR;
-				}
-				perf_item_val_inc(priv->perf_dumped_bytes, wres);
-				wpos += wres;
-				wsize -= wres;
-					
-			}
-			if (res == Z_STREAM_END) {
-				inflateEnd(cp->info.zbuff);
-				free(cp->info.zbuff);
-				cp->info.zbuff = NULL;
-				break;
-			}
+	zs->done = 0;
+	zs->next = NULL;
 
-		} else {
-			char *msg = cp->info.zbuff->msg;
+	perf_item_val_inc(priv->perf_decompress_active, 1);
+
+	return zs;
+}
+
+/**
+ * File writer filter decompressing the body.
+ * Runs in the file writer threads when they are started.
+ */
+int target_zstream_inflate_http(void *zstream, int fd, char *buf, size_t count) {
+
+	struct http_zstream *zs = zstream;
+
+	if (zs->done)
+		return POM_OK;
+
+	zs->zbuff.next_in = (unsigned char *) buf;
+	zs->zbuff.avail_in = count;
+
+	do {
+		zs->zbuff.next_out = (unsigned char *) zs->out;
+		zs->zbuff.avail_out = HTTP_INFLATE_BUFF_SIZE;
+		int res = inflate(&zs->zbuff, Z_SYNC_FLUSH);
+		if (res == Z_BUF_ERROR) // No progress possible, wait for more data
+			break;
+		if (res != Z_OK && res != Z_STREAM_END) {
+			char *msg = zs->zbuff.msg;
 			if (!msg)
 				msg = "Unknown error";
 			pom_log(POM_LOG_TSHOOT "Error while uncompressing the gzip content : %s", msg);
-			cp->state = HTTP_INVALID;
-			free(buff);
-			if (cp->info.zbuff) {
-				inflateEnd(cp->info.zbuff);
-				free(cp->info.zbuff);
-				cp->info.zbuff = NULL;
-			}
-			return 0;
+			zs->done = 1;
+			return POM_OK;
+		}
+
+		size_t len = HTTP_INFLATE_BUFF_SIZE - zs->zbuff.avail_out;
+		if (len) {
+			if (filewriter_output(fd, zs->out, len) != POM_OK)
+				return POM_ERR;
+			perf_item_val_inc(zs->priv->perf_dumped_bytes, len);
+		}
+
+		if (res == Z_STREAM_END) {
+			zs->done = 1;
+			break;
 		}
 
-	} while (cp->info.zbuff->avail_in);
-	free(buff);
+	} while (zs->zbuff.avail_in || !zs->zbuff.avail_out);
+
+	return POM_OK;
+}
+
+/**
+ * Put the context back in the pool once the file is closed.
+ */
+int target_zstream_release_http(void *zstream) {
+
+	struct http_zstream *zs = zstream;
+	struct target_priv_http *priv = zs->priv;
 
-	return size;
+	pthread_mutex_lock(&priv->zpool_lock);
+	zs->next = priv->zpool;
+	priv->zpool = zs;
+	priv->zstreams_active--;
+	pthread_cond_broadcast(&priv->zpool_cond);
+	pthread_mutex_unlock(&priv->zpool_lock);
+
+	perf_item_val_inc(priv->perf_decompress_active, -1);
+
+	return POM_OK;
+}
+
+/**
+ * Wait for the file writer to release all the contexts and free them.
+ */
+int target_zstream_cleanup_http(struct target_priv_http *priv) {
+
+	pthread_mutex_lock(&priv->zpool_lock);
+
+	while (priv->zstreams_active)
+		pthread_cond_wait(&priv->zpool_cond, &priv->zpool_lock);
+
+	while (priv->zpool) {
+		struct http_zstream *zs = priv->zpool;
+		priv->zpool = zs->next;
+		inflateEnd(&zs->zbuff);
+		free(zs);
+	}
+
+	pthread_mutex_unlock(&priv->zpool_lock);
+
+	return POM_OK;
 }
 
 #endif
@@ -960,20 +1101,16 @@ int target_reset_conntrack_http(struct target_priv_http *priv, struct target_con
 
 int target_reset_conntrack_for_response_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp) {
 
+	if (cp->dedup)
+		target_dedup_close_http(priv, cp);
+
 	if (cp->fd != -1) {
-		close(cp->fd);
+		filewriter_close(cp->fd);
 		cp->fd = -1;
 		perf_item_val_inc(priv->perf_open_files, -1);
 		perf_item_val_inc(priv->perf_dumped_files, 1);
 	}
 
-#ifdef HAVE_ZLIB
-	if (cp->info.zbuff) {
-		inflateEnd(cp->info.zbuff);
-		free(cp->info.zbuff);
-		cp->info.zbuff = NULL;
-	}
-#endif
 	cp->info.flags = 0;
 	
 	cp->info.chunk_len = 0;
@@ -986,36 +1123,179 @@ int target_reset_conntrack_for_response_http(struct target_priv_http *priv, stru
 	return POM_OK;
 }
 
-int target_buffer_payload_http(struct target_conntrack_priv_http *cp, char *pload, size_t psize) {
+int target_buffer_payload_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp, char *pload, size_t psize, char *rest, size_t rest_size) {
+
+	if (!cp->buff_head)
+		return target_buffer_append_http(priv, cp, pload, psize);
 
 	if (psize == 0) {
-		free(cp->buff);
-		cp->buff = NULL;
-		cp->buff_size = 0;
+		target_buffer_release_http(priv, cp);
+		return target_buffer_append_http(priv, cp, rest, rest_size);
+	}
+
+	// The payload was parsed from the chunks, the remaining data is at their end
+	size_t consumed = cp->buff_size - psize;
+	while (consumed > 0) {
+		struct http_buff_chunk *chunk = cp->buff_head;
+		size_t len = chunk->end - chunk->start;
+		if (len > consumed) {
+			chunk->start += consumed;
+			break;
+		}
+		consumed -= len;
+		cp->buff_head = chunk->next;
+		free(chunk);
+		cp->buff_chunks--;
+		priv->buffered -= sizeof(struct http_buff_chunk);
+		perf_item_val_inc(priv->perf_buffered_bytes, -(int64_t) sizeof(struct http_buff_chunk));
+	}
+	cp->buff_size = psize;
+
+	// The payload following the linearized data wasn't parsed yet
+	return target_buffer_append_http(priv, cp, rest, rest_size);
+
+}
+
+int target_buffer_append_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp, char *pload, size_t psize) {
+
+	if (psize == 0)
 		return POM_OK;
+
+	while (psize > 0) {
+		struct http_buff_chunk *chunk = cp->buff_tail;
+		if (!chunk || chunk->end == HTTP_BUFF_CHUNK_SIZE) {
+			chunk = malloc(sizeof(struct http_buff_chunk));
+			if (!chunk) {
+				pom_log(POM_LOG_ERR "Not enough memory to buffer the payload of connection 0x%lx", (unsigned long) cp);
+				target_buffer_discard_http(priv, cp);
+				return POM_ERR;
+			}
+			chunk->next = NULL;
+			chunk->start = 0;
+			chunk->end = 0;
+			if (cp->buff_tail)
+				cp->buff_tail->next = chunk;
+			else
+				cp->buff_head = chunk;
+			cp->buff_tail = chunk;
+			cp->buff_chunks++;
+			priv->buffered += sizeof(struct http_buff_chunk);
+			perf_item_val_inc(priv->perf_buffered_bytes, sizeof(struct http_buff_chunk));
+		}
+
+		size_t len = HTTP_BUFF_CHUNK_SIZE - chunk->end;
+		if (len > psize)
+			len = psize;
+		memcpy(chunk->data + chunk->end, pload, len);
+		chunk->end += len;
+		cp->buff_size += len;
+		pload += len;
+		psize -= len;
 	}
 
+	// Move the connection to the head of the LRU
+	if (priv->buff_lru_head != cp) {
+		if (cp->lru_prev) {
+			cp->lru_prev->lru_next = cp->lru_next;
+			if (cp->lru_next)
+				cp->lru_next->lru_prev = cp->lru_prev;
+			else
+				priv->buff_lru_tail = cp->lru_prev;
+		}
+		cp->lru_prev = NULL;
+		cp->lru_next = priv->buff_lru_head;
+		if (priv->buff_lru_head)
+			priv->buff_lru_head->lru_prev = cp;
+		else
+			priv->buff_lru_tail = cp;
+		priv->buff_lru_head = cp;
+	}
 
-	char *new_buff = malloc(psize);
-	memcpy(new_buff, pload, psize);
-	if (cp->buff)
-		free(cp->buff);
-	cp->buff = new_buff;
-	cp->buff_size = psize;
+	if (priv->buffered > PTYPE_UINT32_GETVAL(priv->max_buffer))
+		target_buffer_evict_http(priv, cp);
+
+	return POM_OK;
+}
+
+int target_buffer_release_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp) {
+
+	if (!cp->buff_head)
+		return POM_OK;
+
+	while (cp->buff_head) {
+		struct http_buff_chunk *chunk = cp->buff_head;
+		cp->buff_head = chunk->next;
+		free(chunk);
+	}
+	cp->buff_tail = NULL;
+	priv->buffered -= cp->buff_chunks * sizeof(struct http_buff_chunk);
+	perf_item_val_inc(priv->perf_buffered_bytes, -(int64_t) (cp->buff_chunks * sizeof(struct http_buff_chunk)));
+	cp->buff_chunks = 0;
+	cp->buff_size = 0;
+
+	if (cp->lru_prev)
+		cp->lru_prev->lru_next = cp->lru_next;
+	else
+		priv->buff_lru_head = cp->lru_next;
+
+	if (cp->lru_next)
+		cp->lru_next->lru_prev = cp->lru_prev;
+	else
+		priv->buff_lru_tail = cp->lru_prev;
+
+	cp->lru_prev = NULL;
+	cp->lru_next = NULL;
 
 	return POM_OK;
+}
+
+int target_buffer_discard_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp) {
+
+	target_buffer_release_http(priv, cp);
+	target_reset_conntrack_http(priv, cp);
+	cp->state = HTTP_INVALID;
 
+	return POM_OK;
+}
+
+int target_buffer_evict_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cur) {
+
+	// Discard the connections idle for the longest time first
+	struct target_conntrack_priv_http *cp = priv->buff_lru_tail;
+	while (cp && priv->buffered > PTYPE_UINT32_GETVAL(priv->max_buffer)) {
+		struct target_conntrack_priv_http *prev = cp->lru_prev;
+		if (cp != cur) {
+			pom_log(POM_LOG_TSHOOT "Buffer limit reached, discarding connection 0x%lx", (unsigned long) cp);
+			target_buffer_discard_http(priv, cp);
+			perf_item_val_inc(priv->perf_buffer_evictions, 1);
+		}
+		cp = prev;
+	}
+
+	// The current connection alone doesn't fit in the budget
+	if (priv->buffered > PTYPE_UINT32_GETVAL(priv->max_buffer) && cur->buff_head) {
+		pom_log(POM_LOG_TSHOOT "Buffer limit reached, discarding current connection 0x%lx", (unsigned long) cur);
+		target_buffer_discard_http(priv, cur);
+		perf_item_val_inc(priv->perf_buffer_evictions, 1);
+	}
+
+	return POM_OK;
 }
 
 int target_file_open_http(struct target *t, struct target_conntrack_priv_http *cp, struct frame *f, int is_gzip) {
 
 	struct target_priv_http *priv = t->target_priv;
 
-	if (cp->fd != -1)
+	if (cp->fd != -1 || cp->dedup)
 		return POM_ERR;
 
-	char filename[NAME_MAX];
-	memset(filename, 0, NAME_MAX);
+	if (PTYPE_BOOL_GETVAL(priv->dedup))
+		return target_dedup_open_http(t, cp, f, is_gzip);
+
+	is_gzip = target_file_prepare_http(priv, cp, is_gzip);
+
+	char filename_final[NAME_MAX];
+	layer_template_render(priv->prefix_tmpl, f->l, &f->tv, filename_final, NAME_MAX);
 
 	char outstr[20];
 	memset(outstr, 0, sizeof(outstr));
@@ -1026,36 +1306,105 @@ int target_file_open_http(struct target *t, struct target_conntrack_priv_http *c
 
 	strftime(outstr, sizeof(outstr), format, &tmp);
 
-	if (is_gzip)
-		snprintf(filename, NAME_MAX, "%s%s%u.%s.gz", PTYPE_STRING_GETVAL(priv->prefix), outstr, (unsigned int)f->tv.tv_usec, priv->mime_types[cp->info.content_type].extension);
-	else
-		snprintf(filename, NAME_MAX, "%s%s%u.%s", PTYPE_STRING_GETVAL(priv->prefix), outstr, (unsigned int)f->tv.tv_usec, priv->mime_types[cp->info.content_type].extension);
-
-	char filename_final[NAME_MAX];
-	memset(filename_final, 0, NAME_MAX);
-
-	layer_field_parse(f->l, &f->tv, filename, filename_final, NAME_MAX);
+	size_t len = strlen(filename_final);
+	snprintf(filename_final + len, NAME_MAX - len, "%s%u.%s%s", outstr, (unsigned int)f->tv.tv_usec, priv->mime_types[cp->info.content_type].extension, (is_gzip ? ".gz" : ""));
 
 	cp->fd = target_file_open(NULL, NULL, filename_final, O_RDWR | O_CREAT, 0666);
 
 	if (cp->fd == -1) {
 		char errbuff[256];
 		strerror_r(errno, errbuff, sizeof(errbuff));
-		pom_log(POM_LOG_ERR "Unable to open file %s for writing : %s", filename, errbuff);
+		pom_log(POM_LOG_ERR "Unable to open file %s for writing : %s", filename_final, errbuff);
 		cp->state = HTTP_INVALID;
+		target_file_abort_http(priv, cp);
 		return POM_ERR;
 	}
 
+	target_file_register_http(priv, cp, filename_final);
+
 	if (cp->log_info && (cp->log_info->log_flags & HTTP_LOG_FILENAME)) {
 		cp->log_info->filename = malloc(strlen(filename_final) + 1);
 		strcpy(cp->log_info->filename, filename_final);
 	}
 
+	pom_log(POM_LOG_TSHOOT "%s opened", filename_final);
+
+	return POM_OK;
+}
+
+/**
+ * Decide if the body will be decompressed before opening its file.
+ * @param priv Private data of the target
+ * @param cp Connection of the body
+ * @param is_gzip The body is compressed
+ * @return 1 if the body will be saved compressed, 0 if not
+ */
+int target_file_prepare_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp, int is_gzip) {
+
+#ifdef HAVE_ZLIB
+	if (is_gzip && PTYPE_BOOL_GETVAL(priv->decompress)) {
+		cp->zstream = target_zstream_get_http(priv, cp->info.flags);
+		if (cp->zstream)
+			return 0;
+	}
+#endif
+
+	return is_gzip;
+}
+
+/**
+ * Hand the newly opened cp->fd to the file writer.
+ */
+int target_file_register_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp, char *filename) {
+
+	filewriter_register(cp->fd);
+
+#ifdef HAVE_ZLIB
+	if (cp->zstream) {
+		if (filewriter_set_filter(cp->fd, target_zstream_inflate_http, target_zstream_release_http, cp->zstream) == POM_OK) {
+			cp->info.flags |= HTTP_FLAG_INFLATE;
+		} else {
+			pom_log(POM_LOG_WARN "Unable to decompress the content of %s", filename);
+			target_zstream_release_http(cp->zstream);
+		}
+		cp->zstream = NULL;
+	}
+#endif
+
 	perf_item_val_inc(priv->perf_open_files, 1);
 
-	pom_log(POM_LOG_TSHOOT "%s opened", filename);
+	return POM_OK;
+}
+
+/**
+ * Release what target_file_prepare_http() reserved when the file won't be opened.
+ */
+int target_file_abort_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp) {
+
+#ifdef HAVE_ZLIB
+	if (cp->zstream) {
+		target_zstream_release_http(cp->zstream);
+		cp->zstream = NULL;
+	}
+#endif
 
 	return POM_OK;
 }
 
+int target_file_write_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp, char *pload, size_t size) {
+
+	while (size > 0) {
+		ssize_t wres = filewriter_write(cp->fd, pload, size);
+		if (wres == -1) {
+			pom_log(POM_LOG_ERR "Unable to write into a file");
+			return POM_ERR;
+		}
+		// Decompressed bytes are accounted by the file writer
+		if (!(cp->info.flags & HTTP_FLAG_INFLATE))
+			perf_item_val_inc(priv->perf_dumped_bytes, wres);
+		pload += wres;
+		size -= wres;
+	}
 
+	return POM_OK;
+}
@@ -41,6 +41,7 @@
 #define HTTP_FLAG_CHUNKED	0x04
 #define HTTP_FLAG_GZIP		0x08
 #define HTTP_FLAG_DEFLATE	0x10
+#define HTTP_FLAG_INFLATE	0x20 ///< The body is decompressed by the file writer
 
 #define HTTP_GZIP_MAGIC_0	0x1f
 #define HTTP_GZIP_MAGIC_1	0x8b
@@ -53,6 +54,10 @@
 
 #define HTTP_MAX_HEADER_LINE	4096
 
+#define HTTP_BUFF_CHUNK_SIZE	2048 ///< Size of the chunks used to buffer incomplete headers
+
+#define HTTP_INFLATE_BUFF_SIZE	65536 ///< Size of the buffer receiving decompressed data
+
 #define HTTP_MIME_TYPE_UNK 0x00
 #define HTTP_MIME_TYPE_BIN 0x01
 #define HTTP_MIME_TYPE_IMG 0x02
@@ -66,6 +71,7 @@ struct http_header {
 	char *name;
 	char *value;
 	int type; // either HTTP_QUERY or HTTP_RESPONSE
+	int id; ///< Id of the known headers, HTTP_HEADER_ID_UNK for the others
 
 };
 
@@ -82,6 +88,53 @@ struct http_mime_type_hash_entry {
 	struct http_mime_type_hash_entry *next;
 };
 
+/// Chunk of the payload waiting for the rest of a header
+struct http_buff_chunk {
+
+	struct http_buff_chunk *next;
+	size_t start; ///< Offset of the first unconsumed byte
+	size_t end; ///< Offset after the last byte
+	char data[HTTP_BUFF_CHUNK_SIZE];
+
+};
+
+#ifdef HAVE_ZLIB
+/// Decompression context, kept in a pool once the body is done
+struct http_zstream {
+
+	z_stream zbuff;
+	int done; ///< End of the stream or error, the remaining data is ignored
+	struct target_priv_http *priv;
+	struct http_zstream *next; ///< Next idle context in the pool
+	char out[HTTP_INFLATE_BUFF_SIZE];
+
+};
+#endif
+
+#define HTTP_SHA256_DIGEST_SIZE	32
+#define HTTP_SHA256_BLOCK_SIZE	64
+
+struct http_sha256 {
+	uint32_t state[8];
+	uint64_t len; ///< Number of bytes hashed
+	unsigned char block[HTTP_SHA256_BLOCK_SIZE];
+	unsigned int block_len;
+};
+
+/// Body being stored under the digest of its content
+struct http_dedup {
+
+	struct http_sha256 sha;
+	char *buff; ///< Body kept in memory until its digest is known
+	size_t buff_len, buff_size;
+	char *prefix; ///< Expanded prefix of the file names
+	char *ext; ///< Extension of the file
+	int compressed; ///< The body is compressed
+	int store_compressed; ///< The body is saved without being decompressed
+	char *tmp_name; ///< Temporary file used once the body doesn't fit in memory
+
+};
+
 struct target_conntrack_priv_info_http {
 
 	struct http_header *headers;
@@ -92,10 +145,6 @@ struct target_conntrack_priv_info_http {
 	unsigned int content_type; // index in the mime_type array
 	unsigned int flags;
 
-#ifdef HAVE_ZLIB
-	z_stream *zbuff;
-#endif
-
 };
 
 struct target_conntrack_priv_http {
@@ -103,14 +152,22 @@ struct target_conntrack_priv_http {
 	int fd;
 	unsigned int state;
 	unsigned int direction;
-	char *buff;
-	size_t buff_size;
+	struct http_buff_chunk *buff_head, *buff_tail; ///< Incomplete header data
+	size_t buff_size; ///< Number of bytes in the chunks
+	unsigned int buff_chunks; ///< Number of allocated chunks
 	struct target_conntrack_priv_info_http info;
 	struct http_log_info *log_info;
+	struct http_dedup *dedup; ///< Body being stored under its digest
+#ifdef HAVE_ZLIB
+	struct http_zstream *zstream; ///< Context reserved for the file about to be opened
+#endif
 
 	struct conntrack_entry *ce;
 	struct target_conntrack_priv_http *next;
 	struct target_conntrack_priv_http *prev;
+
+	struct target_conntrack_priv_http *lru_next; ///< Less recently buffered connection
+	struct target_conntrack_priv_http *lru_prev; ///< More recently buffered connection
 };
 
 
@@ -119,7 +176,9 @@ struct target_priv_http {
 	int match_mask;
 
 	struct ptype *prefix;
+	struct layer_template *prefix_tmpl; ///< Compiled prefix of the file names
 	struct ptype *decompress;
+	struct ptype *max_decompress;
 	struct ptype *mime_types_db;
 	struct ptype *log_file;
 	struct ptype *log_format;
@@ -131,6 +190,10 @@ struct target_priv_http {
 	struct ptype *dump_txt;
 	struct ptype *dump_bin;
 	struct ptype *dump_doc;
+	struct ptype *max_buffer;
+	struct ptype *dedup;
+	struct ptype *dedup_buffer;
+	struct ptype *dedup_max_buffer;
 
 	struct http_mime_type_entry *mime_types;
 	unsigned int mime_types_size;
@@ -142,6 +205,23 @@ struct target_priv_http {
 
 	struct target_conntrack_priv_http *ct_privs;
 
+	struct target_conntrack_priv_http *buff_lru_head; ///< Connection which buffered data most recently
+	struct target_conntrack_priv_http *buff_lru_tail;
+	size_t buffered; ///< Memory used by the chunks of all the connections
+
+	char *linear_buff; ///< Used to parse the buffered incomplete line and its end as one
+	size_t linear_buff_size;
+
+	unsigned int dedup_tmp_id; ///< Used to name the temporary files
+	size_t dedup_buffered; ///< Memory used to keep the objects of all the connections
+
+#ifdef HAVE_ZLIB
+	pthread_mutex_t zpool_lock; ///< Contexts are released by the file writer threads
+	pthread_cond_t zpool_cond; ///< Signaled when a context is released
+	struct http_zstream *zpool; ///< Idle decompression contexts
+	unsigned int zstreams_active; ///< Number of bodies being decompressed
+#endif
+
 	struct perf_item *perf_tot_conn;
 	struct perf_item *perf_cur_conn;
 	struct perf_item *perf_dumped_files;
@@ -151,6 +231,12 @@ struct target_priv_http {
 	struct perf_item *perf_parsed_resps;
 	struct perf_item *perf_parsed_transactions;
 	struct perf_item *perf_parse_errors;
+	struct perf_item *perf_buffered_bytes;
+	struct perf_item *perf_buffer_evictions;
+	struct perf_item *perf_decompress_active;
+	struct perf_item *perf_decompress_skipped;
+	struct perf_item *perf_dedup_hits;
+	struct perf_item *perf_dedup_bytes;
 
 };
 
@@ -167,12 +253,23 @@ int target_cleanup_http(struct target *t);
 size_t target_parse_query_response_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp, char *pload, size_t psize);
 int target_parse_payload_headers_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp);
 #ifdef HAVE_ZLIB
-size_t target_process_gzip_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp, char * pload, size_t size);
+struct http_zstream *target_zstream_get_http(struct target_priv_http *priv, unsigned int flags);
+int target_zstream_inflate_http(void *zstream, int fd, char *buf, size_t count);
+int target_zstream_release_http(void *zstream);
+int target_zstream_cleanup_http(struct target_priv_http *priv);
 #endif
 int target_reset_conntrack_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp);
 int target_reset_conntrack_for_response_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp);
-int target_buffer_payload_http(struct target_conntrack_priv_http *cp, char *pload, size_t psize);
+int target_buffer_payload_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp, char *pload, size_t psize, char *rest, size_t rest_size);
+int target_buffer_append_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp, char *pload, size_t psize);
+int target_buffer_release_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp);
+int target_buffer_discard_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp);
+int target_buffer_evict_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cur);
 int target_file_open_http(struct target *t, struct target_conntrack_priv_http *cp, struct frame *f, int is_gzip);
+int target_file_prepare_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp, int is_gzip);
+int target_file_register_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp, char *filename);
+int target_file_abort_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp);
+int target_file_write_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp, char *pload, size_t size);
 
 
 #endif
@@ -0,0 +1,378 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Objects are named after the SHA-256 of the body as it was transfered.
+ * Small bodies are kept in memory until they are complete so duplicates
+ * are never written. Bigger ones are written to a temporary file which
+ * is linked under its final name or removed if the object already exists.
+ */
+
+#include "target_http.h"
+#include "target_http_dedup.h"
+#include "target_http_log.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "ptype_bool.h"
+#include "ptype_string.h"
+#include "ptype_uint32.h"
+
+int target_dedup_open_http(struct target *t, struct target_conntrack_priv_http *cp, struct frame *f, int compressed) {
+
+	struct target_priv_http *priv = t->target_priv;
+
+	char prefix[NAME_MAX];
+	layer_template_render(priv->prefix_tmpl, f->l, &f->tv, prefix, NAME_MAX);
+
+	struct http_dedup *dedup = malloc(sizeof(struct http_dedup));
+	if (!dedup) {
+		pom_log(POM_LOG_ERR "Not enough memory to save the object");
+		return POM_ERR;
+	}
+	memset(dedup, 0, sizeof(struct http_dedup));
+
+	char *ext = priv->mime_types[cp->info.content_type].extension;
+	dedup->prefix = malloc(strlen(prefix) + 1);
+	dedup->ext = malloc(strlen(ext) + 1);
+	if (!dedup->prefix || !dedup->ext) {
+		pom_log(POM_LOG_ERR "Not enough memory to save the object");
+		free(dedup->prefix);
+		free(dedup->ext);
+		free(dedup);
+		return POM_ERR;
+	}
+	strcpy(dedup->prefix, prefix);
+	strcpy(dedup->ext, ext);
+	dedup->compressed = compressed;
+
+	http_sha256_init(&dedup->sha);
+
+	cp->dedup = dedup;
+
+	return POM_OK;
+}
+
+int target_dedup_write_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp, char *pload, size_t size) {
+
+	struct http_dedup *dedup = cp->dedup;
+
+	http_sha256_update(&dedup->sha, (unsigned char *) pload, size);
+
+	if (cp->fd == -1) {
+
+		size_t len = dedup->buff_len + size;
+		if (len <= dedup->buff_size) {
+			memcpy(dedup->buff + dedup->buff_len, pload, size);
+			dedup->buff_len = len;
+			return POM_OK;
+		}
+
+		if (len <= PTYPE_UINT32_GETVAL(priv->dedup_buffer)) {
+			size_t buff_size = (dedup->buff_size ? dedup->buff_size * 2 : 4096);
+			if (buff_size < len)
+				buff_size = len;
+
+			// The objects of all the connections share the same budget
+			if (priv->dedup_buffered - dedup->buff_size + buff_size <= PTYPE_UINT32_GETVAL(priv->dedup_max_buffer)) {
+				char *buff = realloc(dedup->buff, buff_size);
+				if (buff) {
+					priv->dedup_buffered += buff_size - dedup->buff_size;
+					dedup->buff = buff;
+					dedup->buff_size = buff_size;
+					memcpy(dedup->buff + dedup->buff_len, pload, size);
+					dedup->buff_len = len;
+					return POM_OK;
+				}
+				pom_log(POM_LOG_WARN "Not enough memory to keep the object in memory, using a temporary file");
+			} else {
+				pom_log(POM_LOG_TSHOOT "Maximum memory for objects reached, using a temporary file");
+			}
+		}
+
+		// Too big to be kept in memory, continue in a temporary file
+		dedup->store_compressed = target_file_prepare_http(priv, cp, dedup->compressed);
+
+		char tmp_name[NAME_MAX];
+		snprintf(tmp_name, NAME_MAX, "%sdedup-%u-%u.tmp", dedup->prefix, (unsigned int) getpid(), priv->dedup_tmp_id++);
+
+		cp->fd = target_file_open(NULL, NULL, tmp_name, O_RDWR | O_CREAT | O_EXCL, 0666);
+		if (cp->fd == -1) {
+			char errbuff[256];
+			strerror_r(errno, errbuff, sizeof(errbuff));
+			pom_log(POM_LOG_ERR "Unable to open file %s for writing : %s", tmp_name, errbuff);
+			target_file_abort_http(priv, cp);
+			cp->state = HTTP_INVALID;
+			return POM_ERR;
+		}
+
+		dedup->tmp_name = malloc(strlen(tmp_name) + 1);
+		if (!dedup->tmp_name) {
+			pom_log(POM_LOG_ERR "Not enough memory to save the object");
+			unlink(tmp_name);
+			close(cp->fd);
+			cp->fd = -1;
+			target_file_abort_http(priv, cp);
+			cp->state = HTTP_INVALID;
+			return POM_ERR;
+		}
+		strcpy(dedup->tmp_name, tmp_name);
+
+		target_file_register_http(priv, cp, tmp_name);
+
+		if (dedup->buff) {
+			int res = target_file_write_http(priv, cp, dedup->buff, dedup->buff_len);
+			free(dedup->buff);
+			priv->dedup_buffered -= dedup->buff_size;
+			dedup->buff = NULL;
+			dedup->buff_len = 0;
+			dedup->buff_size = 0;
+			if (res != POM_OK)
+				return POM_ERR;
+		}
+	}
+
+	return target_file_write_http(priv, cp, pload, size);
+}
+
+/**
+ * Save the object under its digest unless it already exists.
+ */
+int target_dedup_close_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp) {
+
+	struct http_dedup *dedup = cp->dedup;
+	if (!dedup)
+		return POM_OK;
+
+	cp->dedup = NULL;
+
+	int res = POM_OK;
+
+	uint64_t len = dedup->sha.len;
+	unsigned char digest[HTTP_SHA256_DIGEST_SIZE];
+	http_sha256_final(&dedup->sha, digest);
+
+	if (!len)
+		goto end;
+
+	if (cp->fd == -1)
+		dedup->store_compressed = target_file_prepare_http(priv, cp, dedup->compressed);
+
+	char filename[NAME_MAX];
+	char hex[(HTTP_SHA256_DIGEST_SIZE * 2) + 1];
+	int i;
+	for (i = 0; i < HTTP_SHA256_DIGEST_SIZE; i++)
+		sprintf(hex + (i * 2), "%02x", digest[i]);
+	snprintf(filename, NAME_MAX, "%s%s.%s%s", dedup->prefix, hex, dedup->ext, (dedup->store_compressed ? ".gz" : ""));
+
+	int exists = 0;
+
+	if (cp->fd != -1) {
+		// The data keeps going to the same inode once the temporary file is linked or removed
+		if (link(dedup->tmp_name, filename)) {
+			if (errno == EEXIST) {
+				exists = 1;
+			} else {
+				char errbuff[256];
+				strerror_r(errno, errbuff, sizeof(errbuff));
+				pom_log(POM_LOG_ERR "Unable to link %s to %s : %s", dedup->tmp_name, filename, errbuff);
+				res = POM_ERR;
+			}
+		}
+		unlink(dedup->tmp_name);
+
+		filewriter_close(cp->fd);
+		cp->fd = -1;
+		perf_item_val_inc(priv->perf_open_files, -1);
+
+	} else {
+		cp->fd = target_file_open(NULL, NULL, filename, O_RDWR | O_CREAT | O_EXCL, 0666);
+		if (cp->fd == -1) {
+			if (errno == EEXIST) {
+				exists = 1;
+			} else {
+				char errbuff[256];
+				strerror_r(errno, errbuff, sizeof(errbuff));
+				pom_log(POM_LOG_ERR "Unable to open file %s for writing : %s", filename, errbuff);
+				res = POM_ERR;
+			}
+			target_file_abort_http(priv, cp);
+		} else {
+			target_file_register_http(priv, cp, filename);
+			res = target_file_write_http(priv, cp, dedup->buff, dedup->buff_len);
+			filewriter_close(cp->fd);
+			cp->fd = -1;
+			perf_item_val_inc(priv->perf_open_files, -1);
+		}
+	}
+
+	if (exists) {
+		perf_item_val_inc(priv->perf_dedup_hits, 1);
+		perf_item_val_inc(priv->perf_dedup_bytes, len);
+		pom_log(POM_LOG_TSHOOT "%s already saved", filename);
+	} else if (res == POM_OK) {
+		perf_item_val_inc(priv->perf_dumped_files, 1);
+		pom_log(POM_LOG_TSHOOT "%s saved", filename);
+	}
+
+	if (res == POM_OK && cp->log_info && (cp->log_info->log_flags & HTTP_LOG_FILENAME)) {
+		if (cp->log_info->filename)
+			free(cp->log_info->filename);
+		cp->log_info->filename = malloc(strlen(filename) + 1);
+		if (cp->log_info->filename)
+			strcpy(cp->log_info->filename, filename);
+	}
+
+end:
+	if (dedup->buff) {
+		free(dedup->buff);
+		priv->dedup_buffered -= dedup->buff_size;
+	}
+	if (dedup->tmp_name)
+		free(dedup->tmp_name);
+	free(dedup->prefix);
+	free(dedup->ext);
+	free(dedup);
+
+	return res;
+}
+
+static const uint32_t http_sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define HTTP_SHA256_ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void http_sha256_transform(struct http_sha256 *sha, const unsigned char *block) {
+
+	uint32_t w[64];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = ((uint32_t) block[i * 4] << 24) | ((uint32_t) block[(i * 4) + 1] << 16) | ((uint32_t) block[(i * 4) + 2] << 8) | block[(i * 4) + 3];
+
+	for (i = 16; i < 64; i++) {
+		uint32_t s0 = HTTP_SHA256_ROR(w[i - 15], 7) ^ HTTP_SHA256_ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = HTTP_SHA256_ROR(w[i - 2], 17) ^ HTTP_SHA256_ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = sha->state[0], b = sha->state[1], c = sha->state[2], d = sha->state[3];
+	uint32_t e = sha->state[4], f = sha->state[5], g = sha->state[6], h = sha->state[7];
+
+	for (i = 0; i < 64; i++) {
+		uint32_t s1 = HTTP_SHA256_ROR(e, 6) ^ HTTP_SHA256_ROR(e, 11) ^ HTTP_SHA256_ROR(e, 25);
+		uint32_t ch = (e & f) ^ (~e & g);
+		uint32_t t1 = h + s1 + ch + http_sha256_k[i] + w[i];
+		uint32_t s0 = HTTP_SHA256_ROR(a, 2) ^ HTTP_SHA256_ROR(a, 13) ^ HTTP_SHA256_ROR(a, 22);
+		uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+		uint32_t t2 = s0 + maj;
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	sha->state[0] += a;
+	sha->state[1] += b;
+	sha->state[2] += c;
+	sha->state[3] += d;
+	sha->state[4] += e;
+	sha->state[5] += f;
+	sha->state[6] += g;
+	sha->state[7] += h;
+}
+
+void http_sha256_init(struct http_sha256 *sha) {
+
+	static const uint32_t init[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+	memcpy(sha->state, init, sizeof(init));
+	sha->len = 0;
+	sha->block_len = 0;
+}
+
+void http_sha256_update(struct http_sha256 *sha, const unsigned char *data, size_t len) {
+
+	sha->len += len;
+
+	if (sha->block_len) {
+		size_t fill = HTTP_SHA256_BLOCK_SIZE - sha->block_len;
+		if (fill > len)
+			fill = len;
+		memcpy(sha->block + sha->block_len, data, fill);
+		sha->block_len += fill;
+		data += fill;
+		len -= fill;
+		if (sha->block_len < HTTP_SHA256_BLOCK_SIZE)
+			return;
+		http_sha256_transform(sha, sha->block);
+		sha->block_len = 0;
+	}
+
+	while (len >= HTTP_SHA256_BLOCK_SIZE) {
+		http_sha256_transform(sha, data);
+		data += HTTP_SHA256_BLOCK_SIZE;
+		len -= HTTP_SHA256_BLOCK_SIZE;
+	}
+
+	if (len) {
+		memcpy(sha->block, data, len);
+		sha->block_len = len;
+	}
+}
+
+void http_sha256_final(struct http_sha256 *sha, unsigned char *digest) {
+
+	uint64_t bits = sha->len * 8;
+
+	unsigned char pad[HTTP_SHA256_BLOCK_SIZE + 8];
+	memset(pad, 0, sizeof(pad));
+	pad[0] = 0x80;
+
+	size_t pad_len = (sha->block_len < 56 ? 56 - sha->block_len : 120 - sha->block_len);
+	int i;
+	for (i = 0; i < 8; i++)
+		pad[pad_len + i] = bits >> (56 - (i * 8));
+
+	http_sha256_update(sha, pad, pad_len + 8);
+
+	for (i = 0; i < 8; i++) {
+		digest[i * 4] = sha->state[i] >> 24;
+		digest[(i * 4) + 1] = sha->state[i] >> 16;
+		digest[(i * 4) + 2] = sha->state[i] >> 8;
+		digest[(i * 4) + 3] = sha->state[i];
+	}
+}
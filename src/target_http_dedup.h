@@ -0,0 +1,34 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __HTTP_DEDUP_H__
+#define __HTTP_DEDUP_H__
+
+#include "target_http.h"
+
+int target_dedup_open_http(struct target *t, struct target_conntrack_priv_http *cp, struct frame *f, int compressed);
+int target_dedup_write_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp, char *pload, size_t size);
+int target_dedup_close_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp);
+
+void http_sha256_init(struct http_sha256 *sha);
+void http_sha256_update(struct http_sha256 *sha, const unsigned char *data, size_t len);
+void http_sha256_final(struct http_sha256 *sha, unsigned char *digest);
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "target_http_header.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+static struct http_header_name http_header_names[] = {
+	{ "Content-Length", sizeof("Content-Length") - 1, HTTP_HEADER_ID_CONTENT_LENGTH },
+	{ "Content-Encoding", sizeof("Content-Encoding") - 1, HTTP_HEADER_ID_CONTENT_ENCODING },
+	{ "Content-Type", sizeof("Content-Type") - 1, HTTP_HEADER_ID_CONTENT_TYPE },
+	{ "Transfer-Encoding", sizeof("Transfer-Encoding") - 1, HTTP_HEADER_ID_TRANSFER_ENCODING },
+	{ "Host", sizeof("Host") - 1, HTTP_HEADER_ID_HOST },
+	{ "Authorization", sizeof("Authorization") - 1, HTTP_HEADER_ID_AUTHORIZATION },
+	{ NULL, 0, HTTP_HEADER_ID_UNK },
+};
+
+static struct http_header_name *http_header_hash[HTTP_HEADER_HASH_SIZE];
+
+/**
+ * The length and the first letter are enough to tell apart the known names.
+ * Any other header needs at most one strncasecmp() to be rejected.
+ */
+#define HTTP_HEADER_HASH(name, len) (((len) + ((name)[0] | 0x20)) & (HTTP_HEADER_HASH_SIZE - 1))
+
+int target_http_header_init() {
+
+	memset(http_header_hash, 0, sizeof(http_header_hash));
+
+	int i;
+	for (i = 0; http_header_names[i].name; i++) {
+		unsigned int hash = HTTP_HEADER_HASH(http_header_names[i].name, http_header_names[i].len);
+		if (http_header_hash[hash]) {
+			pom_log(POM_LOG_ERR "Header names %s and %s have the same hash", http_header_hash[hash]->name, http_header_names[i].name);
+			return POM_ERR;
+		}
+		http_header_hash[hash] = &http_header_names[i];
+	}
+
+	return POM_OK;
+}
+
+/**
+ * Get the id of a header name.
+ * @param name Name of the header, not necessarily NULL terminated
+ * @param len Length of the name
+ * @return The id of the header or HTTP_HEADER_ID_UNK
+ */
+int target_http_header_get_id(char *name, size_t len) {
+
+	if (!len)
+		return HTTP_HEADER_ID_UNK;
+
+	struct http_header_name *hdr = http_header_hash[HTTP_HEADER_HASH(name, len)];
+	if (hdr && hdr->len == len && !strncasecmp(hdr->name, name, len))
+		return hdr->id;
+
+	return HTTP_HEADER_ID_UNK;
+}
+
+/**
+ * Find the end of a header line and its first colon in a single pass.
+ * @param buff Buffer to scan
+ * @param len Length of the buffer
+ * @param colon If not NULL, set to the first ':' before the end of the line or NULL
+ * @return A pointer to the '\n' or NULL if the line is incomplete
+ */
+char *target_http_header_scan_line(char *buff, size_t len, char **colon) {
+
+	size_t i = 0;
+
+	if (colon)
+		*colon = NULL;
+
+#ifdef __AVX2__
+	__m256i nl32 = _mm256_set1_epi8('\n'), colon32 = _mm256_set1_epi8(':');
+	for (; i + 32 <= len; i += 32) {
+		__m256i data = _mm256_loadu_si256((__m256i *) (buff + i));
+		unsigned int nl_mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(data, nl32));
+		if (colon && !*colon) {
+			unsigned int colon_mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(data, colon32));
+			if (nl_mask)
+				colon_mask &= nl_mask - 1; // Only the ones before the line return
+			if (colon_mask)
+				*colon = buff + i + __builtin_ctz(colon_mask);
+		}
+		if (nl_mask)
+			return buff + i + __builtin_ctz(nl_mask);
+	}
+#endif
+
+#ifdef __SSE2__
+	__m128i nl16 = _mm_set1_epi8('\n'), colon16 = _mm_set1_epi8(':');
+	for (; i + 16 <= len; i += 16) {
+		__m128i data = _mm_loadu_si128((__m128i *) (buff + i));
+		unsigned int nl_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(data, nl16));
+		if (colon && !*colon) {
+			unsigned int colon_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(data, colon16));
+			if (nl_mask)
+				colon_mask &= nl_mask - 1;
+			if (colon_mask)
+				*colon = buff + i + __builtin_ctz(colon_mask);
+		}
+		if (nl_mask)
+			return buff + i + __builtin_ctz(nl_mask);
+	}
+#endif
+
+	// Let memchr() handle the remaining bytes
+	char *nl = memchr(buff + i, '\n', len - i);
+	if (colon && !*colon)
+		*colon = memchr(buff + i, ':', (nl ? nl : buff + len) - (buff + i));
+
+	return nl;
+}
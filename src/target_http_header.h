@@ -0,0 +1,49 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef __HTTP_HEADER_H__
+#define __HTTP_HEADER_H__
+
+#include "modules_common.h"
+
+/// Headers the target knows about
+#define HTTP_HEADER_ID_UNK		0
+#define HTTP_HEADER_ID_CONTENT_LENGTH	1
+#define HTTP_HEADER_ID_CONTENT_ENCODING	2
+#define HTTP_HEADER_ID_CONTENT_TYPE	3
+#define HTTP_HEADER_ID_TRANSFER_ENCODING	4
+#define HTTP_HEADER_ID_HOST		5
+#define HTTP_HEADER_ID_AUTHORIZATION	6
+
+/// Size of the header name hash table, must be a power of 2
+#define HTTP_HEADER_HASH_SIZE	0x20
+
+/// Known header name
+struct http_header_name {
+	char *name;
+	size_t len;
+	int id;
+};
+
+int target_http_header_init();
+int target_http_header_get_id(char *name, size_t len);
+char *target_http_header_scan_line(char *buff, size_t len, char **colon);
+
+#endif
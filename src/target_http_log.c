@@ -25,6 +25,8 @@
 #include <errno.h>
 
 #include "target_http_log.h"
+#include "target_http_header.h"
+#include "target_http_dedup.h"
 
 #include "ptype_string.h"
 #include "ptype_uint16.h"
@@ -335,6 +337,10 @@ static int write_to_log(int fd, char *data, size_t size) {
 
 int target_write_log_http(struct target_priv_http *priv, struct target_conntrack_priv_http *cp) {
 
+	// The name of deduplicated objects is only known once they are complete
+	if (cp->dedup)
+		target_dedup_close_http(priv, cp);
+
 	struct http_log_info *info = cp->log_info;
 
 	if (!info)
@@ -358,7 +364,7 @@ int target_write_log_http(struct target_priv_http *priv, struct target_conntrack
 	if (info->log_flags & HTTP_LOG_CREDENTIALS) {
 		int i;
 		for (i = 0; i < cp->info.headers_num; i++) {
-			if (cp->info.headers[i].type == HTTP_QUERY && !strcasecmp("Authorization", cp->info.headers[i].name)) {
+			if (cp->info.headers[i].type == HTTP_QUERY && cp->info.headers[i].id == HTTP_HEADER_ID_AUTHORIZATION) {
 				char *value = cp->info.headers[i].value;
 				int j;
 				for (j = 0; value[j] && value[j] != ' '; j++)
@@ -544,7 +550,7 @@ int target_write_log_http(struct target_priv_http *priv, struct target_conntrack
 
 				case 'v':
 					for (i = 0; i < cp->info.headers_num; i++) {
-						if (cp->info.headers[i].type == HTTP_QUERY && !strcasecmp("Host", cp->info.headers[i].name)) {
+						if (cp->info.headers[i].type == HTTP_QUERY && cp->info.headers[i].id == HTTP_HEADER_ID_HOST) {
 							output = cp->info.headers[i].value;
 							break;
 						}
@@ -709,7 +715,7 @@ int target_write_log_http(struct target_priv_http *priv, struct target_conntrack
 
 				case 'v':
 					for (j = 0; j < cp->info.headers_num; j++) {
-						if (cp->info.headers[j].type == HTTP_QUERY && !strcasecmp("Host", cp->info.headers[j].name)) {
+						if (cp->info.headers[j].type == HTTP_QUERY && cp->info.headers[j].id == HTTP_HEADER_ID_HOST) {
 							PTYPE_STRING_SETVAL(info->dset_data[i].value, cp->info.headers[j].value);
 							break;
 						}
@@ -18,11 +18,13 @@
  *
  */
 
+#define _GNU_SOURCE // For sendmmsg()
 
 #include <errno.h>
 
 #include "target_inject.h"
 #include "ptype_string.h"
+#include "ptype_uint32.h"
 
 // Maximum segment len with ethernet header
 #define MAX_SEGMENT_LEN 1518
@@ -50,6 +52,8 @@ int target_register_inject(struct target_reg *r) {
 		dev = "none";
 
 	target_register_param(mode_default, "interface", dev, "Where to reinject packets to");
+	target_register_param(mode_default, "batch_size", "1", "Number of packets queued before sending them at once");
+	target_register_param(mode_default, "batch_timeout", "100", "Maximum time in milliseconds a packet stays queued, rounded up to the second when no other packet is matched");
 
 	return POM_OK;
 
@@ -66,13 +70,21 @@ static int target_init_inject(struct target *t) {
 	t->target_priv = priv;
 
 	priv->iface = ptype_alloc("string", NULL);
+	priv->batch_size = ptype_alloc("uint32", "pkts");
+	priv->batch_timeout = ptype_alloc("uint32", "ms");
 
-	if (!priv->iface) {
+	if (!priv->iface || !priv->batch_size || !priv->batch_timeout) {
 		target_cleanup_inject(t);
 		return POM_ERR;
 	}
 	
 	target_register_param_value(t, mode_default, "interface", priv->iface);
+	target_register_param_value(t, mode_default, "batch_size", priv->batch_size);
+	target_register_param_value(t, mode_default, "batch_timeout", priv->batch_timeout);
+
+	priv->perf_batches = perf_add_item(t->perfs, "batches", perf_item_type_counter, "Number of batches of packets sent");
+	priv->perf_pkts_sent = perf_add_item(t->perfs, "pkts_sent", perf_item_type_counter, "Number of packets injected");
+	priv->perf_send_errors = perf_add_item(t->perfs, "send_errors", perf_item_type_counter, "Number of packets that could not be injected");
 
 	return POM_OK;
 }
@@ -83,6 +95,8 @@ static int target_cleanup_inject(struct target *t) {
 
 	if (priv) {
 		ptype_cleanup(priv->iface);
+		ptype_cleanup(priv->batch_size);
+		ptype_cleanup(priv->batch_timeout);
 		free(priv);
 	}
 
@@ -99,6 +113,12 @@ static int target_open_inject(struct target *t) {
 		return POM_ERR;
 	}
 
+	unsigned int batch_max = PTYPE_UINT32_GETVAL(priv->batch_size);
+	if (!batch_max || batch_max > TARGET_INJECT_MAX_BATCH) {
+		pom_log(POM_LOG_ERR "The batch size must be between 1 and %u", TARGET_INJECT_MAX_BATCH);
+		return POM_ERR;
+	}
+
 	char errbuf[PCAP_ERRBUF_SIZE];
 
 	int snaplen = 2000; // This param won't be used anyway
@@ -109,8 +129,42 @@ static int target_open_inject(struct target *t) {
 	}
 	pom_log(POM_LOG_DEBUG "Interface %s opened for injection", PTYPE_STRING_GETVAL(priv->iface));
 
+	priv->batch_count = 0;
+	priv->batch_max = batch_max;
+	if (batch_max == 1) // Packets are injected right away
+		return POM_OK;
+
+	priv->batch_buff = malloc(batch_max * MAX_SEGMENT_LEN);
+	priv->batch_len = malloc(batch_max * sizeof(unsigned int));
+#ifdef TARGET_INJECT_SENDMMSG
+	// On Linux, pcap injects with send() on its packet socket which is already bound to the interface
+	priv->fd = pcap_get_selectable_fd(priv->p);
+	priv->batch_iov = malloc(batch_max * sizeof(struct iovec));
+	priv->batch_msgs = malloc(batch_max * sizeof(struct mmsghdr));
+	if (!priv->batch_iov || !priv->batch_msgs) {
+		pom_log(POM_LOG_ERR "Not enough memory to allocate a batch of %u packets", batch_max);
+		goto err;
+	}
+	memset(priv->batch_msgs, 0, batch_max * sizeof(struct mmsghdr));
+	unsigned int i;
+	for (i = 0; i < batch_max; i++) {
+		priv->batch_iov[i].iov_base = priv->batch_buff + i * MAX_SEGMENT_LEN;
+		priv->batch_msgs[i].msg_hdr.msg_iov = &priv->batch_iov[i];
+		priv->batch_msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+#endif
+	if (!priv->batch_buff || !priv->batch_len) {
+		pom_log(POM_LOG_ERR "Not enough memory to allocate a batch of %u packets", batch_max);
+		goto err;
+	}
 
 	return POM_OK;
+
+err:
+	target_free_batch_inject(priv);
+	pcap_close(priv->p);
+	priv->p = NULL;
+	return POM_ERR;
 }
 
 static int target_process_inject(struct target *t, struct frame *f) {
@@ -131,16 +185,151 @@ static int target_process_inject(struct target *t, struct frame *f) {
 
 	if (len > MAX_SEGMENT_LEN)
 		len = MAX_SEGMENT_LEN;
-	
-	if (pcap_inject(priv->p, f->buff + start, len - start) != -1) {
-		
-		pom_log(POM_LOG_DEBUG "Packet injected (+%u bytes)", len);
+
+	if (priv->batch_max == 1) {
+		if (pcap_inject(priv->p, f->buff + start, len - start) != -1) {
+			perf_item_val_inc(priv->perf_batches, 1);
+			perf_item_val_inc(priv->perf_pkts_sent, 1);
+			return POM_OK;
+		}
+
+		perf_item_val_inc(priv->perf_send_errors, 1);
+		pom_log(POM_LOG_ERR "Error while injecting packet : %s", pcap_geterr(priv->p));
+		return POM_ERR;
+	}
+
+	if (!priv->batch_count)
+		memcpy(&priv->batch_start, &f->tv, sizeof(struct timeval));
+
+	memcpy(priv->batch_buff + priv->batch_count * MAX_SEGMENT_LEN, f->buff + start, len - start);
+	priv->batch_len[priv->batch_count] = len - start;
+	priv->batch_count++;
+
+	struct timeval expiry;
+	unsigned int timeout = PTYPE_UINT32_GETVAL(priv->batch_timeout);
+	expiry.tv_sec = priv->batch_start.tv_sec + timeout / 1000;
+	expiry.tv_usec = priv->batch_start.tv_usec + (timeout % 1000) * 1000;
+	if (expiry.tv_usec >= 1000000) {
+		expiry.tv_sec++;
+		expiry.tv_usec -= 1000000;
+	}
+
+	if (priv->batch_count >= priv->batch_max || !timercmp(&f->tv, &expiry, <))
+		return target_flush_inject(t);
+
+	// Make sure the batch doesn't stay queued if no other packet is matched
+	// Timers only have a one second granularity so the timeout is rounded up in that case
+	if (!priv->batch_timer) {
+		priv->batch_timer = timer_alloc(t, f->input, target_flush_timer_inject);
+		if (!priv->batch_timer)
+			return target_flush_inject(t);
+	}
+	if (!priv->batch_timer_queued) {
+		unsigned int delay = (timeout + 999) / 1000;
+		timer_queue(priv->batch_timer, delay ? delay : 1);
+		priv->batch_timer_queued = 1;
+	}
+
+	return POM_OK;
+
+}
+
+/**
+ * Send all the queued packets.
+ * Packets which can't be sent are dropped and accounted as send errors.
+ * @param t The target
+ * @return POM_OK if all the packets were sent, POM_ERR if not.
+ */
+static int target_flush_inject(struct target *t) {
+
+	struct target_priv_inject *priv = t->target_priv;
+
+	if (priv->batch_timer_queued) {
+		timer_dequeue(priv->batch_timer);
+		priv->batch_timer_queued = 0;
+	}
+
+	if (!priv->batch_count)
 		return POM_OK;
-	} 
 
-	pom_log(POM_LOG_ERR "Error while injecting packet : %s", pcap_geterr(priv->p));
-	return POM_ERR;
+	unsigned int i, sent = 0, errors = 0;
+
+#ifdef TARGET_INJECT_SENDMMSG
+	for (i = 0; i < priv->batch_count; i++)
+		priv->batch_iov[i].iov_len = priv->batch_len[i];
+
+	char errbuff[256];
+	memset(errbuff, 0, sizeof(errbuff));
+
+	while (sent + errors < priv->batch_count) {
+		int res = sendmmsg(priv->fd, priv->batch_msgs + sent + errors, priv->batch_count - sent - errors, 0);
+		if (res == -1) {
+			if (errno == EINTR)
+				continue;
+			// The first remaining packet is the one which failed, skip it
+			strerror_r(errno, errbuff, sizeof(errbuff) - 1);
+			errors++;
+			continue;
+		}
+		sent += res;
+	}
+#else
+	char *errbuff = NULL;
+
+	for (i = 0; i < priv->batch_count; i++) {
+		if (pcap_inject(priv->p, priv->batch_buff + i * MAX_SEGMENT_LEN, priv->batch_len[i]) == -1) {
+			errbuff = pcap_geterr(priv->p);
+			errors++;
+		} else {
+			sent++;
+		}
+	}
+#endif
+
+	priv->batch_count = 0;
 
+	perf_item_val_inc(priv->perf_batches, 1);
+	perf_item_val_inc(priv->perf_pkts_sent, sent);
+
+	if (errors) {
+		perf_item_val_inc(priv->perf_send_errors, errors);
+		pom_log(POM_LOG_ERR "Error while injecting %u packets out of %u : %s", errors, sent + errors, errbuff);
+		return POM_ERR;
+	}
+
+	return POM_OK;
+}
+
+static int target_free_batch_inject(struct target_priv_inject *priv) {
+
+	free(priv->batch_buff);
+	priv->batch_buff = NULL;
+	free(priv->batch_len);
+	priv->batch_len = NULL;
+#ifdef TARGET_INJECT_SENDMMSG
+	free(priv->batch_iov);
+	priv->batch_iov = NULL;
+	free(priv->batch_msgs);
+	priv->batch_msgs = NULL;
+#endif
+
+	return POM_OK;
+}
+
+static int target_flush_timer_inject(void *priv) {
+
+	struct target *t = priv;
+	struct target_priv_inject *p = t->target_priv;
+
+	target_lock_instance(t, 0);
+
+	// The timer is not queued anymore if the target was closed in the meantime
+	if (t->started && p->batch_timer_queued)
+		target_flush_inject(t);
+
+	target_unlock_instance(t);
+
+	return POM_OK;
 }
 
 static int target_close_inject(struct target *t) {
@@ -156,8 +345,21 @@ static int target_close_inject(struct target *t) {
 
 	pom_log("%s bytes injected in %s packets", size_str, count_str);
 
+	int res = POM_OK;
+	if (priv->p)
+		res = target_flush_inject(t);
+
+	if (priv->batch_timer) {
+		timer_cleanup(priv->batch_timer);
+		priv->batch_timer = NULL;
+		priv->batch_timer_queued = 0;
+	}
+
+	target_free_batch_inject(priv);
+
 	if (priv->p) 
 		pcap_close(priv->p);
+	priv->p = NULL;
 	
-	return POM_OK;
+	return res;
 }
@@ -30,10 +30,38 @@
 
 #include <pcap.h>
 
+#if defined(HAVE_SENDMMSG) && defined(HAVE_NETPACKET_PACKET_H)
+#include <sys/socket.h>
+#define TARGET_INJECT_SENDMMSG
+#endif
+
+/// Maximum number of packets queued before being sent
+#define TARGET_INJECT_MAX_BATCH 1024
+
 struct target_priv_inject {
 
 	pcap_t *p;
 	struct ptype *iface;
+	struct ptype *batch_size;
+	struct ptype *batch_timeout; ///< In milliseconds, the timer flushing idle batches rounds it up to the second
+
+	unsigned char *batch_buff; ///< Packets queued, MAX_SEGMENT_LEN bytes each
+	unsigned int *batch_len; ///< Length of the queued packets
+	unsigned int batch_count; ///< Number of packets queued
+	unsigned int batch_max; ///< Batch size used since the target was opened
+	struct timeval batch_start; ///< When the first packet of the batch was queued
+#ifdef TARGET_INJECT_SENDMMSG
+	int fd; ///< Packet socket of pcap, bound to the interface
+	struct iovec *batch_iov;
+	struct mmsghdr *batch_msgs;
+#endif
+
+	struct timer *batch_timer; ///< Flush the batch when no packet matched for a while
+	int batch_timer_queued;
+
+	struct perf_item *perf_batches;
+	struct perf_item *perf_pkts_sent;
+	struct perf_item *perf_send_errors;
 };
 
 int target_register_inject(struct target_reg *r);
@@ -41,6 +69,9 @@ int target_register_inject(struct target_reg *r);
 static int target_init_inject(struct target *t);
 static int target_open_inject(struct target *t);
 static int target_process_inject(struct target *t, struct frame *f);
+static int target_flush_inject(struct target *t);
+static int target_flush_timer_inject(void *priv);
+static int target_free_batch_inject(struct target_priv_inject *priv);
 static int target_close_inject(struct target *t);
 static int target_cleanup_inject(struct target *t);
 
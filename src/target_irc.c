@@ -40,6 +40,7 @@ static struct target_mode *mode_dump;
 int target_register_irc(struct target_reg *r) {
 
 	r->init = target_init_irc;
+	r->open = target_open_irc;
 	r->process = target_process_irc;
 	r->close = target_close_irc;
 	r->cleanup = target_cleanup_irc;
@@ -77,6 +78,18 @@ static int target_init_irc(struct target *t) {
 	return POM_OK;
 }
 
+static int target_open_irc(struct target *t) {
+
+	struct target_priv_irc *priv = t->target_priv;
+
+	// Parse the path once instead of for each conversation
+	priv->path_tmpl = layer_template_compile(PTYPE_STRING_GETVAL(priv->path));
+	if (!priv->path_tmpl)
+		return POM_ERR;
+
+	return POM_OK;
+}
+
 static int target_close_irc(struct target *t) {
 
 	struct target_priv_irc *priv = t->target_priv;
@@ -86,6 +99,9 @@ static int target_close_irc(struct target *t) {
 		target_close_connection_irc(t, priv->ct_privs->ce, priv->ct_privs);
 	}
 
+	layer_template_cleanup(priv->path_tmpl);
+	priv->path_tmpl = NULL;
+
 	return POM_OK;
 }
 
@@ -1800,7 +1816,7 @@ static struct target_conversation_irc* target_get_conv_irc(struct target_conntra
 		while ((slash = strchr(safe_conv, '/')))
 			*slash = '_';
 
-		char filename[NAME_MAX + 1];
+		char final_name[NAME_MAX];
 		char outstr[20];
 		memset(outstr, 0, sizeof(outstr));
 		// YYYYMMDD-HHMMSS-UUUUUU
@@ -1811,17 +1827,15 @@ static struct target_conversation_irc* target_get_conv_irc(struct target_conntra
 
 		struct target_priv_irc *priv = c->cp->t->target_priv;
 
-		char *path = PTYPE_STRING_GETVAL(priv->path);
-		if (path[strlen(path) - 1] == '/') {
-			snprintf(filename, NAME_MAX, "%s%s%s%u.txt", path, safe_conv, outstr, (unsigned int)f->tv.tv_usec);
+		layer_template_render(priv->path_tmpl, f->l, &f->tv, final_name, NAME_MAX);
+		size_t len = strlen(final_name);
+		if (len > 0 && final_name[len - 1] == '/') {
+			snprintf(final_name + len, NAME_MAX - len, "%s%s%u.txt", safe_conv, outstr, (unsigned int)f->tv.tv_usec);
 		} else {
-			snprintf(filename, NAME_MAX, "%s/%s%s%u.txt", path, safe_conv, outstr, (unsigned int)f->tv.tv_usec);
+			snprintf(final_name + len, NAME_MAX - len, "/%s%s%u.txt", safe_conv, outstr, (unsigned int)f->tv.tv_usec);
 		}
 
 		free(safe_conv);
-		char final_name[NAME_MAX];
-		memset(final_name, 0, NAME_MAX);
-		layer_field_parse(f->l, &f->tv, filename, final_name, NAME_MAX - 1);
 
 		c->filename = strdup(final_name);
 
@@ -1878,7 +1892,7 @@ static struct target_conversation_irc* target_get_conv_irc(struct target_conntra
 static int target_write_log_irc(int fd, char *buff, size_t count) {
 
 	while (count > 0) {
-		ssize_t res = write(fd, buff, count);
+		ssize_t res = filewriter_write(fd, buff, count);
 		if (res == -1) {
 			char errbuff[256];
 			memset(errbuff, 0, sizeof(errbuff));
@@ -1993,6 +2007,8 @@ static int target_open_log_irc(struct target_conversation_irc *c) {
 		pom_log(POM_LOG_ERR "Could not open conversation file %s : %s", c->filename, errbuff);
 		return POM_ERR;
 	}
+
+	filewriter_register(c->fd);
 	
 	pom_log("Log file %s opened", c->filename);
 
@@ -2146,7 +2162,7 @@ static int target_close_conv_irc(struct target_conversation_irc *c) {
 	free(c->filename);
 
 	if (c->fd != -1)
-		close(c->fd);
+		filewriter_close(c->fd);
 
 	if (c->expiry) 
 		timer_cleanup(c->expiry);
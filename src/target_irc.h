@@ -185,6 +185,7 @@ struct target_conntrack_priv_irc {
 struct target_priv_irc {
 
 	struct ptype *path;
+	struct layer_template *path_tmpl; ///< Compiled path of the files
 
 	struct target_conntrack_priv_irc *ct_privs;
 
@@ -193,6 +194,7 @@ struct target_priv_irc {
 
 int target_register_irc(struct target_reg *r);
 static int target_init_irc(struct target *t);
+static int target_open_irc(struct target *t);
 static int target_process_irc(struct target *t, struct frame *f);
 static int target_close_connection_irc(struct target *t, struct conntrack_entry *ce, void *conntrack_priv);
 static int target_close_irc(struct target *t);
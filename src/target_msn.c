@@ -168,6 +168,13 @@ int target_init_msn(struct target *t) {
 
 int target_open_msn(struct target *t) {
 
+	struct target_priv_msn *priv = t->target_priv;
+
+	// Parse the path once instead of for each session
+	priv->path_tmpl = layer_template_compile(PTYPE_STRING_GETVAL(priv->path));
+	if (!priv->path_tmpl)
+		return POM_ERR;
+
 	return target_msn_session_init_buddy_table(t);
 }
 
@@ -198,6 +205,9 @@ int target_close_msn(struct target *t) {
 		}
 	}
 
+	layer_template_cleanup(priv->path_tmpl);
+	priv->path_tmpl = NULL;
+
 	return POM_OK;
 }
 
@@ -281,7 +291,7 @@ int target_process_msn(struct target *t, struct frame *f) {
 
 		char tmp[NAME_MAX + 1];
 		memset(tmp, 0, sizeof(tmp));
-		if (layer_field_parse(f->l, &f->tv, PTYPE_STRING_GETVAL(priv->path), tmp, NAME_MAX) == POM_ERR) {
+		if (layer_template_render(priv->path_tmpl, f->l, &f->tv, tmp, NAME_MAX) == POM_ERR) {
 			pom_log(POM_LOG_WARN "Error while parsing the path");
 			return POM_ERR;
 		}
@@ -722,7 +732,7 @@ int target_close_connection_msn(struct target *t, struct conntrack_entry *ce, vo
 			}
 
 			if (conv->fd != -1)
-				close(conv->fd);
+				filewriter_close(conv->fd);
 
 			if (conv->next)
 				conv->next->prev = conv->prev;
@@ -743,7 +753,7 @@ int target_close_connection_msn(struct target *t, struct conntrack_entry *ce, vo
 
 		if (sess->fd != -1) {
 			target_msn_session_dump_buddy_list(cp);
-			close(sess->fd);
+			filewriter_close(sess->fd);
 		}
 
 		struct target_buddy_list_session_msn *bud_lst = sess->buddies;
@@ -831,7 +841,7 @@ int target_close_connection_msn(struct target *t, struct conntrack_entry *ce, vo
 			}
 
 			if (conv->fd != -1)
-				close(conv->fd);
+				filewriter_close(conv->fd);
 
 			sess->conv = conv->next;
 			free(conv);
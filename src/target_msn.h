@@ -272,6 +272,7 @@ struct target_conntrack_priv_msn {
 struct target_priv_msn {
 
 	struct ptype *path;
+	struct layer_template *path_tmpl; ///< Compiled path of the files
 	struct ptype *dump_session;
 	struct ptype *dump_avatar;
 	struct ptype *dump_file_transfer;
@@ -1174,6 +1174,8 @@ int target_process_bin_p2p_msg(struct target *t, struct target_conntrack_priv_ms
 			return POM_ERR;
 		}
 
+		filewriter_register(fd);
+
 		perf_item_val_inc(priv->perf_cur_files, 1);
 
 		if (cp->flags & MSN_CONN_FLAG_WLM2009_BIN) // WLM2009 doesn't provide the total_size
@@ -1212,15 +1214,12 @@ int target_process_bin_p2p_msg(struct target *t, struct target_conntrack_priv_ms
 
 	if (file->pos != offset) {
 		pom_log(POM_LOG_TSHOOT "Chunks out of order ! current pos : %llu, given pos : %llu", (uint64_t)file->pos, (uint64_t)offset);
-		if (lseek(file->fd, offset, SEEK_SET) == -1) {
-			pom_log(POM_LOG_DEBUG "Could not seek to %z !", offset);
-			return POM_OK;
-		}
 		file->pos = offset;
 	}
 	
+	// Write at the chunk position, the writes may be performed asynchronously
 	size_t res = 0, len = msg_size;
-	while ((res = write(file->fd, cp->buffer[cp->curdir] + m->cur_pos, len))) {
+	while ((res = filewriter_pwrite(file->fd, cp->buffer[cp->curdir] + m->cur_pos, len, file->pos + msg_size - len))) {
 		if (res == -1) {
 			char errbuff[256];
 			strerror_r(errno, errbuff, sizeof(errbuff) - 1);
@@ -2088,7 +2087,7 @@ int target_session_close_file_msn(struct target_priv_msn *priv, struct target_fi
 	pom_log(POM_LOG_TSHOOT "P2P file of SessionID %u closed", file->session_id);
 	
 	if (file->fd != -1) {
-		close(file->fd);
+		filewriter_close(file->fd);
 		if (file->written_len < file->len) {
 			pom_log(POM_LOG_DEBUG "File for session %u is not complete");
 			perf_item_val_inc(priv->perf_partial_files, 1);
@@ -991,6 +991,7 @@ int target_msn_session_process_event(struct target_event_msn *evt) {
 			pom_log(POM_LOG_ERR "Unable to open file %s for writing : %s", filename, errbuff);
 			return POM_ERR;
 		}
+		filewriter_register(conv->fd);
 	}
 
 	// Open the session logs
@@ -1026,6 +1027,7 @@ int target_msn_session_process_event(struct target_event_msn *evt) {
 			pom_log(POM_LOG_ERR "Unable to open file %s for writing : %s", filename, errbuff);
 			return POM_ERR;
 		}
+		filewriter_register(sess->fd);
 	}
 
 	char timestamp[12];
@@ -1230,7 +1232,7 @@ int target_msn_session_write(int fd, char *buff) {
 
 	size_t len = strlen(buff);
 	size_t res = 0, pos = 0;
-	while ((res = write(fd, buff + pos, len - pos)) && pos < len) {
+	while ((res = filewriter_write(fd, buff + pos, len - pos)) && pos < len) {
 		if (res == -1) {
 			char errbuff[256];
 			strerror_r(errno, errbuff, sizeof(errbuff) - 1);
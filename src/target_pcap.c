@@ -20,16 +20,21 @@
 
 #include "target_pcap.h"
 #include "ptype_string.h"
+#include "ptype_uint8.h"
 #include "ptype_uint16.h"
+#include "ptype_uint32.h"
 #include "ptype_uint64.h"
 #include "ptype_bool.h"
 #include "ptype_interval.h"
+#include "ptype_ipv4.h"
+#include "ptype_ipv6.h"
 
 #include <sys/stat.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stddef.h>
 
-static struct target_mode *mode_default, *mode_split, *mode_connection;
+static struct target_mode *mode_default, *mode_split, *mode_connection, *mode_segment, *mode_archive;
 
 int target_register_pcap(struct target_reg *r) {
 
@@ -42,14 +47,19 @@ int target_register_pcap(struct target_reg *r) {
 	mode_default = target_register_mode(r->type, "default", "Dump all the packets into a PCAP file");
 	mode_split = target_register_mode(r->type, "split", "Dump all packets into multiple PCAP files");
 	mode_connection = target_register_mode(r->type, "connection", "Dump connections in separate PCAP files");
+	mode_segment = target_register_mode(r->type, "segment", "Dump connections into shared PCAP files with an index of the packets of each connection");
+	mode_archive = target_register_mode(r->type, "archive", "Dump all packets into multiple PCAP files indexed by time, addresses and ports");
 
-	if (!mode_default || !mode_split || !mode_connection)
+	if (!mode_default || !mode_split || !mode_connection || !mode_segment || !mode_archive)
 		return POM_ERR;
 
 	target_register_param(mode_default, "filename", "dump.cap", "Filename to save packets to");
 	target_register_param(mode_default, "snaplen", "1522", "Maximum size of saved packets");
 	target_register_param(mode_default, "layer", "ethernet", "Type of layer to capture. Either ethernet, linux_cooked, docsis, 80211 or ipv4");
 	target_register_param(mode_default, "unbuffered", "no", "Write each packet to the output file directly without using a buffer");
+	target_register_param(mode_default, "compress", "no", "Compress the output files with gzip");
+	target_register_param(mode_default, "compress_level", "6", "Compression level from 1 to 9");
+	target_register_param(mode_default, "compress_threads", "2", "Number of threads compressing each file, 0 to compress while writing");
 
 	target_register_param(mode_split, "prefix", "dump", "Prefix of output files to save packets to");
 	target_register_param(mode_split, "overwrite", "no", "Overwrite existing file in the directory");
@@ -59,12 +69,39 @@ int target_register_pcap(struct target_reg *r) {
 	target_register_param(mode_split, "split_packets", "0", "Split when reaching this number of packets");
 	target_register_param(mode_split, "split_interval", "0", "Split when reaching this number of seconds");
 	target_register_param(mode_split, "unbuffered", "no", "Write each packet to the output file directly without using a buffer");
+	target_register_param(mode_split, "compress", "no", "Compress the output files with gzip");
+	target_register_param(mode_split, "compress_level", "6", "Compression level from 1 to 9");
+	target_register_param(mode_split, "compress_threads", "2", "Number of threads compressing each file, 0 to compress while writing");
 
 	target_register_param(mode_connection, "prefix", "dump", "Prefix of output files to save packets to");
 	target_register_param(mode_connection, "snaplen", "1522", "Maximum size of saved packets");
 	target_register_param(mode_connection, "layer", "ethernet", "Type of layer to capture. Either ethernet, linux_cooked, docsis, 80211 or ipv4");
 	target_register_param(mode_connection, "unbuffered", "no", "Write each packet to the output file directly without using a buffer");
 
+	target_register_param(mode_segment, "prefix", "dump", "Prefix of the segment and index files");
+	target_register_param(mode_segment, "snaplen", "1522", "Maximum size of saved packets");
+	target_register_param(mode_segment, "layer", "ethernet", "Type of layer to capture. Either ethernet, linux_cooked, docsis, 80211 or ipv4");
+	target_register_param(mode_segment, "split_size", "1073741824", "Start a new segment when reaching this size");
+	target_register_param(mode_segment, "flow_name", "${ipv4.src}:${tcp.sport}-${ipv4.dst}:${tcp.dport}", "Name of the connections in the index");
+	target_register_param(mode_segment, "unbuffered", "no", "Write each packet to the output file directly without using a buffer");
+	target_register_param(mode_segment, "compress", "no", "Compress the output files with gzip");
+	target_register_param(mode_segment, "compress_level", "6", "Compression level from 1 to 9");
+	target_register_param(mode_segment, "compress_threads", "2", "Number of threads compressing each file, 0 to compress while writing");
+
+	target_register_param(mode_archive, "prefix", "dump", "Prefix of output files to save packets to");
+	target_register_param(mode_archive, "overwrite", "no", "Overwrite existing file in the directory");
+	target_register_param(mode_archive, "snaplen", "1522", "Maximum size of saved packets");
+	target_register_param(mode_archive, "layer", "ethernet", "Type of layer to capture. Either ethernet, linux_cooked, docsis, 80211 or ipv4");
+	target_register_param(mode_archive, "split_size", "0", "Split when reaching this size");
+	target_register_param(mode_archive, "split_packets", "0", "Split when reaching this number of packets");
+	target_register_param(mode_archive, "split_interval", "3600", "Split when reaching this number of seconds");
+	target_register_param(mode_archive, "index_packets", "1024", "Maximum number of packets in an index block");
+	target_register_param(mode_archive, "index_interval", "60", "Duration of the time buckets of the index");
+	target_register_param(mode_archive, "index_bloom_size", "1024", "Size in bytes of the bloom filter of each index block");
+	target_register_param(mode_archive, "unbuffered", "no", "Write each packet to the output file directly without using a buffer");
+	target_register_param(mode_archive, "compress", "no", "Compress the output files with gzip");
+	target_register_param(mode_archive, "compress_level", "6", "Compression level from 1 to 9");
+	target_register_param(mode_archive, "compress_threads", "2", "Number of threads compressing each file, 0 to compress while writing");
 
 	return POM_OK;
 
@@ -88,6 +125,13 @@ static int target_init_pcap(struct target *t) {
 	priv->split_packets = ptype_alloc("uint64", "packets");
 	priv->split_packets->print_mode = PTYPE_UINT64_PRINT_HUMAN;
 	priv->split_interval = ptype_alloc("interval", NULL);
+	priv->flow_name = ptype_alloc("string", NULL);
+	priv->compress = ptype_alloc("bool", NULL);
+	priv->compress_level = ptype_alloc("uint8", NULL);
+	priv->compress_threads = ptype_alloc("uint8", "threads");
+	priv->index_packets = ptype_alloc("uint32", "packets");
+	priv->index_interval = ptype_alloc("interval", NULL);
+	priv->index_bloom_size = ptype_alloc("uint16", "bytes");
 
 	if (!priv->filename ||
 		!priv->snaplen ||
@@ -97,7 +141,14 @@ static int target_init_pcap(struct target *t) {
 		!priv->split_overwrite ||
 		!priv->split_size ||
 		!priv->split_packets ||
-		!priv->split_interval) {
+		!priv->split_interval ||
+		!priv->flow_name ||
+		!priv->compress ||
+		!priv->compress_level ||
+		!priv->compress_threads ||
+		!priv->index_packets ||
+		!priv->index_interval ||
+		!priv->index_bloom_size) {
 		target_cleanup_pcap(t);
 		return POM_ERR;
 	}
@@ -106,12 +157,18 @@ static int target_init_pcap(struct target *t) {
 	target_register_param_value(t, mode_default, "snaplen", priv->snaplen);
 	target_register_param_value(t, mode_default, "layer", priv->layer);
 	target_register_param_value(t, mode_default, "unbuffered", priv->unbuffered);
+	target_register_param_value(t, mode_default, "compress", priv->compress);
+	target_register_param_value(t, mode_default, "compress_level", priv->compress_level);
+	target_register_param_value(t, mode_default, "compress_threads", priv->compress_threads);
 	
 	target_register_param_value(t, mode_split, "prefix", priv->prefix);
 	target_register_param_value(t, mode_split, "overwrite", priv->split_overwrite);
 	target_register_param_value(t, mode_split, "snaplen", priv->snaplen);
 	target_register_param_value(t, mode_split, "layer", priv->layer);
 	target_register_param_value(t, mode_split, "unbuffered", priv->unbuffered);
+	target_register_param_value(t, mode_split, "compress", priv->compress);
+	target_register_param_value(t, mode_split, "compress_level", priv->compress_level);
+	target_register_param_value(t, mode_split, "compress_threads", priv->compress_threads);
 	target_register_param_value(t, mode_split, "split_size", priv->split_size);
 	target_register_param_value(t, mode_split, "split_packets", priv->split_packets);
 	target_register_param_value(t, mode_split, "split_interval", priv->split_interval);
@@ -120,6 +177,31 @@ static int target_init_pcap(struct target *t) {
 	target_register_param_value(t, mode_connection, "snaplen", priv->snaplen);
 	target_register_param_value(t, mode_connection, "layer", priv->layer);
 	target_register_param_value(t, mode_connection, "unbuffered", priv->unbuffered);
+
+	target_register_param_value(t, mode_segment, "prefix", priv->prefix);
+	target_register_param_value(t, mode_segment, "snaplen", priv->snaplen);
+	target_register_param_value(t, mode_segment, "layer", priv->layer);
+	target_register_param_value(t, mode_segment, "split_size", priv->split_size);
+	target_register_param_value(t, mode_segment, "flow_name", priv->flow_name);
+	target_register_param_value(t, mode_segment, "unbuffered", priv->unbuffered);
+	target_register_param_value(t, mode_segment, "compress", priv->compress);
+	target_register_param_value(t, mode_segment, "compress_level", priv->compress_level);
+	target_register_param_value(t, mode_segment, "compress_threads", priv->compress_threads);
+
+	target_register_param_value(t, mode_archive, "prefix", priv->prefix);
+	target_register_param_value(t, mode_archive, "overwrite", priv->split_overwrite);
+	target_register_param_value(t, mode_archive, "snaplen", priv->snaplen);
+	target_register_param_value(t, mode_archive, "layer", priv->layer);
+	target_register_param_value(t, mode_archive, "split_size", priv->split_size);
+	target_register_param_value(t, mode_archive, "split_packets", priv->split_packets);
+	target_register_param_value(t, mode_archive, "split_interval", priv->split_interval);
+	target_register_param_value(t, mode_archive, "index_packets", priv->index_packets);
+	target_register_param_value(t, mode_archive, "index_interval", priv->index_interval);
+	target_register_param_value(t, mode_archive, "index_bloom_size", priv->index_bloom_size);
+	target_register_param_value(t, mode_archive, "unbuffered", priv->unbuffered);
+	target_register_param_value(t, mode_archive, "compress", priv->compress);
+	target_register_param_value(t, mode_archive, "compress_level", priv->compress_level);
+	target_register_param_value(t, mode_archive, "compress_threads", priv->compress_threads);
 	
 	return POM_OK;
 }
@@ -139,6 +221,20 @@ static int target_cleanup_pcap(struct target *t) {
 		ptype_cleanup(priv->split_size);
 		ptype_cleanup(priv->split_packets);
 		ptype_cleanup(priv->split_interval);
+		ptype_cleanup(priv->flow_name);
+		ptype_cleanup(priv->compress);
+		ptype_cleanup(priv->compress_level);
+		ptype_cleanup(priv->compress_threads);
+		ptype_cleanup(priv->index_packets);
+		ptype_cleanup(priv->index_interval);
+		ptype_cleanup(priv->index_bloom_size);
+
+		if (priv->seg_flows)
+			free(priv->seg_flows);
+		if (priv->seg_entries)
+			free(priv->seg_entries);
+		if (priv->archive_bloom)
+			free(priv->archive_bloom);
 
 		free(priv);
 	}
@@ -181,15 +277,34 @@ static int target_open_pcap(struct target *t) {
 		return POM_ERR;
 	}
 
+#ifndef HAVE_ZLIB
+	if (t->mode != mode_connection && PTYPE_BOOL_GETVAL(priv->compress)) {
+		pom_log(POM_LOG_ERR "Compression is not supported, zlib was not found at compile time");
+		pcap_close(priv->p);
+		priv->p = NULL;
+		return POM_ERR;
+	}
+#endif
+
+	// Parse the names once instead of for each connection
+	if (t->mode == mode_connection || t->mode == mode_segment) {
+		struct ptype *name = (t->mode == mode_connection ? priv->prefix : priv->flow_name);
+		priv->name_tmpl = layer_template_compile(PTYPE_STRING_GETVAL(name));
+		if (!priv->name_tmpl) {
+			pcap_close(priv->p);
+			priv->p = NULL;
+			return POM_ERR;
+		}
+	}
+
 	char *filename = NULL;
 
-	if (t->mode == mode_split) {
+	if (t->mode == mode_split || t->mode == mode_archive) {
 		char my_name[NAME_MAX];
 		if (!PTYPE_BOOL_GETVAL(priv->split_overwrite)) {
 			do {
-				struct stat tmp;
 				snprintf(my_name, NAME_MAX - 1, "%s_%05lu.cap", PTYPE_STRING_GETVAL(priv->prefix), priv->split_index);
-				if (stat(my_name, &tmp) != 0) {
+				if (!target_file_exists_pcap(priv, my_name)) {
 					break;
 				}
 				priv->split_index++;
@@ -211,13 +326,30 @@ static int target_open_pcap(struct target *t) {
 
 	if (filename) { // Only not NULL when mode is split or default
 
-		priv->pdump = pcap_dump_open(priv->p, filename);
+		priv->pdump = target_dump_open_pcap(priv, filename);
 		if (!priv->pdump) {
 			pom_log(POM_LOG_ERR "Unable to open pcap file %s for writing !", filename);
 			pcap_close(priv->p);
 			return POM_ERR;
 		}
 
+		if (t->mode == mode_archive && (target_archive_init_fields_pcap(priv) != POM_OK || target_archive_open_pcap(priv) != POM_OK)) {
+			pcap_dump_close(priv->pdump);
+			priv->pdump = NULL;
+			pcap_close(priv->p);
+			priv->p = NULL;
+			return POM_ERR;
+		}
+
+	} else if (t->mode == mode_segment) {
+
+		if (target_segment_open_pcap(priv) != POM_OK) {
+			layer_template_cleanup(priv->name_tmpl);
+			priv->name_tmpl = NULL;
+			pcap_close(priv->p);
+			priv->p = NULL;
+			return POM_ERR;
+		}
 	}
 
 	return POM_OK;
@@ -260,7 +392,7 @@ static int target_process_pcap(struct target *t, struct frame *f) {
 	if (t->mode == mode_default) {
 		pdump = priv->pdump;
 
-	} else if (t->mode == mode_split) {
+	} else if (t->mode == mode_split || t->mode == mode_archive) {
 		// Let's see if we have to open the next file
 
 		int next = 0;
@@ -278,15 +410,17 @@ static int target_process_pcap(struct target *t, struct frame *f) {
 		if (next) {
 			char filename[NAME_MAX];
 
+			if (t->mode == mode_archive)
+				target_archive_close_pcap(priv, priv->cur_size);
+
 			pcap_dump_close(priv->pdump);
 			priv->split_files_num++;
 			priv->split_index++;
 
 			if (!PTYPE_BOOL_GETVAL(priv->split_overwrite)) {
 				do {
-					struct stat tmp;
 					snprintf(filename, NAME_MAX - 1, "%s_%05lu.cap", PTYPE_STRING_GETVAL(priv->prefix), priv->split_index);
-					if (stat(filename, &tmp) != 0) {
+					if (!target_file_exists_pcap(priv, filename)) {
 						break;
 					}
 					priv->split_index++;
@@ -295,7 +429,7 @@ static int target_process_pcap(struct target *t, struct frame *f) {
 			} else {
 				snprintf(filename, NAME_MAX - 1, "%s_%05lu.cap", PTYPE_STRING_GETVAL(priv->prefix), priv->split_index);
 			}
-			priv->pdump = pcap_dump_open(priv->p, filename);
+			priv->pdump = target_dump_open_pcap(priv, filename);
 			if (!priv->pdump) {
 				pom_log(POM_LOG_ERR "Unable to open pcap file %s for writing !", filename);
 				pcap_close(priv->p);
@@ -303,6 +437,9 @@ static int target_process_pcap(struct target *t, struct frame *f) {
 				return POM_ERR;
 			}
 
+			if (t->mode == mode_archive && target_archive_open_pcap(priv) != POM_OK)
+				return POM_ERR;
+
 			priv->split_time = now + PTYPE_INTERVAL_GETVAL(priv->split_interval);
 			priv->tot_size += priv->cur_size;
 			priv->cur_size = 0;
@@ -340,8 +477,9 @@ static int target_process_pcap(struct target *t, struct frame *f) {
 			memset(cp, 0, sizeof(struct target_conntrack_priv_pcap));
 		
 
-			char filename[NAME_MAX];
-			memset(filename, 0, NAME_MAX);
+			char filename_final[NAME_MAX];
+			layer_template_render(priv->name_tmpl, f->l, &f->tv, filename_final, NAME_MAX - 1);
+
 			char outstr[20];
 			memset(outstr, 0, sizeof(outstr));
 			// YYYYMMDD-HHMMSS-UUUUUU
@@ -351,11 +489,8 @@ static int target_process_pcap(struct target *t, struct frame *f) {
 		
 			strftime(outstr, sizeof(outstr), format, &tmp);
 		
-			snprintf(filename, NAME_MAX - 1, "%s%s%u.cap", PTYPE_STRING_GETVAL(priv->prefix), outstr, (unsigned int)f->tv.tv_usec);
-
-			char filename_final[NAME_MAX];
-			memset(filename_final, 0, NAME_MAX);
-			layer_field_parse(f->l, &f->tv, filename, filename_final, NAME_MAX);
+			size_t len = strlen(filename_final);
+			snprintf(filename_final + len, NAME_MAX - 1 - len, "%s%u.cap", outstr, (unsigned int)f->tv.tv_usec);
 
 			// Since we are not calling target_file_open(), we need to create the missing directories ourselves
 
@@ -398,6 +533,50 @@ static int target_process_pcap(struct target *t, struct frame *f) {
 
 		pdump = cp->pdump;
 
+	} else if (t->mode == mode_segment) {
+		// All the connections share the same file, only the index tells them apart
+
+		if (!f->ce)
+			if (conntrack_create_entry(f) == POM_ERR)
+				return POM_OK; // This packet can't be tracked
+
+		if (PTYPE_UINT64_GETVAL(priv->split_size) > 0 && priv->cur_packets_num && priv->cur_size + sizeof(struct pcap_pkthdr) + phdr.caplen > PTYPE_UINT64_GETVAL(priv->split_size)) {
+
+			if (target_segment_close_pcap(priv) != POM_OK || target_segment_open_pcap(priv) != POM_OK) {
+				pcap_close(priv->p);
+				priv->p = NULL;
+				return POM_ERR;
+			}
+
+			priv->split_files_num++;
+			priv->tot_size += priv->cur_size;
+			priv->cur_size = 0;
+			priv->tot_packets_num += priv->cur_packets_num;
+			priv->cur_packets_num = 0;
+		}
+
+		struct target_conntrack_priv_pcap *cp;
+		cp = conntrack_get_target_priv(t, f->ce);
+
+		if (!cp) {
+			cp = malloc(sizeof(struct target_conntrack_priv_pcap));
+			memset(cp, 0, sizeof(struct target_conntrack_priv_pcap));
+
+			cp->flow_id = priv->next_flow_id++;
+			layer_template_render(priv->name_tmpl, f->l, &f->tv, cp->name, PCAP_INDEX_NAME_SIZE);
+
+			conntrack_add_target_priv(cp, t, f->ce, target_close_connection_pcap);
+			cp->ce = f->ce;
+			cp->next = priv->ct_privs;
+			if (priv->ct_privs)
+				priv->ct_privs->prev = cp;
+			priv->ct_privs = cp;
+		}
+
+		if (target_segment_add_pcap(priv, cp, pcap_dump_ftell(priv->pdump)) != POM_OK)
+			return POM_ERR;
+
+		pdump = priv->pdump;
 	}
 
 	if (!pdump) {
@@ -405,6 +584,9 @@ static int target_process_pcap(struct target *t, struct frame *f) {
 		return POM_ERR;
 	}
 
+	if (t->mode == mode_archive && target_archive_add_pcap(priv, f, pcap_dump_ftell(pdump)) != POM_OK)
+		return POM_ERR;
+
 	pcap_dump((u_char*)pdump, &phdr, f->buff + start);
 
 	if (PTYPE_BOOL_GETVAL(priv->unbuffered)) 
@@ -425,7 +607,8 @@ int target_close_connection_pcap(struct target *t, struct conntrack_entry *ce, v
 	struct target_conntrack_priv_pcap *cp;
 	cp = conntrack_priv;
 
-	pcap_dump_close(cp->pdump);
+	if (cp->pdump)
+		pcap_dump_close(cp->pdump);
 
 	struct target_priv_pcap *priv = t->target_priv;
 
@@ -449,14 +632,18 @@ static int target_close_pcap(struct target *t) {
 	if (!t->target_priv)
 		return POM_ERR;
 
+	if (t->mode == mode_archive && priv->archive_index)
+		target_archive_close_pcap(priv, priv->cur_size);
+
 	priv->tot_packets_num += priv->cur_packets_num;
 	priv->cur_packets_num = 0;
 	priv->tot_size += priv->cur_size;
 	priv->cur_size = 0;
 	priv->split_files_num++;
-	priv->split_index++;
+	if (t->mode != mode_segment) // Closing the segment moves to the next index itself
+		priv->split_index++;
 
-	if (t->mode == mode_split)
+	if (t->mode == mode_split || t->mode == mode_segment || t->mode == mode_archive)
 		pom_log("Saved %lu packets and %lu bytes in %lu files", priv->tot_packets_num, priv->tot_size, priv->split_files_num);
 	else
 		pom_log("Saved %lu packets and %lu bytes", priv->tot_packets_num, priv->tot_size);
@@ -466,6 +653,9 @@ static int target_close_pcap(struct target *t) {
 		target_close_connection_pcap(t, priv->ct_privs->ce, priv->ct_privs);
 	}
 
+	if (t->mode == mode_segment && priv->pdump)
+		target_segment_close_pcap(priv);
+
 	if (priv->pdump) {
 		pcap_dump_close(priv->pdump);
 		priv->pdump = NULL;
@@ -476,9 +666,395 @@ static int target_close_pcap(struct target *t) {
 		priv->p = NULL;
 	}
 
+	layer_template_cleanup(priv->name_tmpl);
+	priv->name_tmpl = NULL;
+
 	priv->split_files_num = 0;
 
 	return POM_OK;
 }
 
 
+
+/**
+ * Open the next segment which doesn't exist yet.
+ */
+static int target_segment_open_pcap(struct target_priv_pcap *priv) {
+
+	char filename[NAME_MAX];
+	do {
+		snprintf(filename, NAME_MAX - 1, "%s_%05lu" PCAP_INDEX_SEGMENT_EXT, PTYPE_STRING_GETVAL(priv->prefix), priv->split_index);
+		if (!target_file_exists_pcap(priv, filename))
+			break;
+		priv->split_index++;
+	} while (1);
+
+	priv->pdump = target_dump_open_pcap(priv, filename);
+	if (!priv->pdump) {
+		pom_log(POM_LOG_ERR "Unable to open pcap file %s for writing !", filename);
+		return POM_ERR;
+	}
+
+	priv->segment_id++;
+	priv->seg_flows_count = 0;
+	priv->seg_entries_count = 0;
+
+	pom_log("Writing output to segment %s", filename);
+
+	return POM_OK;
+}
+
+/**
+ * Remember the offset of a packet record of a connection in the current segment.
+ */
+static int target_segment_add_pcap(struct target_priv_pcap *priv, struct target_conntrack_priv_pcap *cp, uint64_t offset) {
+
+	if (cp->segment_id != priv->segment_id) {
+		// First packet of this connection in the segment
+		if (priv->seg_flows_count >= priv->seg_flows_size) {
+			priv->seg_flows_size = (priv->seg_flows_size ? priv->seg_flows_size * 2 : 256);
+			priv->seg_flows = realloc(priv->seg_flows, sizeof(struct pcap_index_flow) * priv->seg_flows_size);
+		}
+		struct pcap_index_flow *flow = &priv->seg_flows[priv->seg_flows_count];
+		memset(flow, 0, sizeof(struct pcap_index_flow));
+		flow->id = cp->flow_id;
+		memcpy(flow->name, cp->name, PCAP_INDEX_NAME_SIZE);
+		priv->seg_flows_count++;
+		cp->segment_id = priv->segment_id;
+	}
+
+	if (priv->seg_entries_count >= priv->seg_entries_size) {
+		priv->seg_entries_size = (priv->seg_entries_size ? priv->seg_entries_size * 2 : 4096);
+		priv->seg_entries = realloc(priv->seg_entries, sizeof(struct target_segment_entry_pcap) * priv->seg_entries_size);
+	}
+	priv->seg_entries[priv->seg_entries_count].flow_id = cp->flow_id;
+	priv->seg_entries[priv->seg_entries_count].offset = offset;
+	priv->seg_entries_count++;
+
+	return POM_OK;
+}
+
+/**
+ * Close the current segment and write its index.
+ */
+static int target_segment_close_pcap(struct target_priv_pcap *priv) {
+
+	pcap_dump_close(priv->pdump);
+	priv->pdump = NULL;
+
+	char filename[NAME_MAX];
+	snprintf(filename, NAME_MAX - 1, "%s_%05lu" PCAP_INDEX_EXT, PTYPE_STRING_GETVAL(priv->prefix), priv->split_index);
+	priv->split_index++;
+
+	qsort(priv->seg_entries, priv->seg_entries_count, sizeof(struct target_segment_entry_pcap), target_segment_compare_entry_pcap);
+	qsort(priv->seg_flows, priv->seg_flows_count, sizeof(struct pcap_index_flow), target_segment_compare_flow_pcap);
+
+	// Both tables are now sorted by connection and each connection has at least one packet
+	uint64_t pos = 0;
+	unsigned int i;
+	for (i = 0; i < priv->seg_flows_count; i++) {
+		struct pcap_index_flow *flow = &priv->seg_flows[i];
+		flow->first = pos;
+		while (pos < priv->seg_entries_count && priv->seg_entries[pos].flow_id == flow->id)
+			pos++;
+		flow->count = pos - flow->first;
+	}
+
+	FILE *idx = fopen(filename, "w");
+	if (!idx) {
+		char errbuff[256];
+		strerror_r(errno, errbuff, sizeof(errbuff));
+		pom_log(POM_LOG_ERR "Unable to open index file %s : %s", filename, errbuff);
+		return POM_ERR;
+	}
+
+	struct pcap_index_header hdr;
+	memset(&hdr, 0, sizeof(struct pcap_index_header));
+	memcpy(hdr.magic, PCAP_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.flows = priv->seg_flows_count;
+	hdr.records = priv->seg_entries_count;
+
+	int res = POM_OK;
+	if (fwrite(&hdr, sizeof(struct pcap_index_header), 1, idx) != 1)
+		res = POM_ERR;
+
+	if (res == POM_OK && priv->seg_flows_count && fwrite(priv->seg_flows, sizeof(struct pcap_index_flow), priv->seg_flows_count, idx) != priv->seg_flows_count)
+		res = POM_ERR;
+
+	uint64_t j;
+	for (j = 0; j < priv->seg_entries_count && res == POM_OK; j++)
+		if (fwrite(&priv->seg_entries[j].offset, sizeof(uint64_t), 1, idx) != 1)
+			res = POM_ERR;
+
+	if (fclose(idx))
+		res = POM_ERR;
+
+	if (res != POM_OK)
+		pom_log(POM_LOG_ERR "Error while writing index file %s", filename);
+
+	return res;
+}
+
+static int target_segment_compare_entry_pcap(const void *a, const void *b) {
+
+	const struct target_segment_entry_pcap *ea = a, *eb = b;
+
+	if (ea->flow_id != eb->flow_id)
+		return (ea->flow_id < eb->flow_id ? -1 : 1);
+	if (ea->offset != eb->offset)
+		return (ea->offset < eb->offset ? -1 : 1);
+	return 0;
+}
+
+static int target_segment_compare_flow_pcap(const void *a, const void *b) {
+
+	const struct pcap_index_flow *fa = a, *fb = b;
+
+	if (fa->id != fb->id)
+		return (fa->id < fb->id ? -1 : 1);
+	return 0;
+}
+
+/**
+ * Find the fields whose values are added to the bloom filters.
+ */
+static int target_archive_init_fields_pcap(struct target_priv_pcap *priv) {
+
+	static const struct {
+		char *match;
+		char *field;
+		unsigned char kind;
+	} fields[] = {
+		{ "ipv4", "src", PCAP_ARCHIVE_KEY_IPV4 },
+		{ "ipv4", "dst", PCAP_ARCHIVE_KEY_IPV4 },
+		{ "ipv6", "src", PCAP_ARCHIVE_KEY_IPV6 },
+		{ "ipv6", "dst", PCAP_ARCHIVE_KEY_IPV6 },
+		{ "tcp", "sport", PCAP_ARCHIVE_KEY_PORT },
+		{ "tcp", "dport", PCAP_ARCHIVE_KEY_PORT },
+		{ "udp", "sport", PCAP_ARCHIVE_KEY_PORT },
+		{ "udp", "dport", PCAP_ARCHIVE_KEY_PORT },
+	};
+
+	priv->archive_fields_count = 0;
+
+	unsigned int i;
+	for (i = 0; i < sizeof(fields) / sizeof(fields[0]) && priv->archive_fields_count < PCAP_ARCHIVE_MAX_FIELDS; i++) {
+		int type = match_register(fields[i].match);
+		if (type == POM_ERR)
+			continue;
+
+		int j;
+		for (j = 0; j < MAX_LAYER_FIELDS; j++) {
+			struct match_field_reg *reg = match_get_field(type, j);
+			if (!reg)
+				break;
+			if (!strcmp(reg->name, fields[i].field)) {
+				struct target_archive_field_pcap *fld = &priv->archive_fields[priv->archive_fields_count];
+				fld->match_type = type;
+				fld->field_id = j;
+				fld->kind = fields[i].kind;
+				priv->archive_fields_count++;
+				break;
+			}
+		}
+	}
+
+	if (!priv->archive_fields_count)
+		pom_log(POM_LOG_WARN "No address or port field found, the index will only be useful to search by time");
+
+	return POM_OK;
+}
+
+/**
+ * Create the index of the file which was just opened.
+ */
+static int target_archive_open_pcap(struct target_priv_pcap *priv) {
+
+	char filename[NAME_MAX];
+	snprintf(filename, NAME_MAX - 1, "%s_%05lu" PCAP_ARCHIVE_EXT, PTYPE_STRING_GETVAL(priv->prefix), priv->split_index);
+
+	priv->archive_index = fopen(filename, "w");
+	if (!priv->archive_index) {
+		char errbuff[256];
+		strerror_r(errno, errbuff, sizeof(errbuff));
+		pom_log(POM_LOG_ERR "Unable to open index file %s : %s", filename, errbuff);
+		return POM_ERR;
+	}
+
+	priv->archive_bloom_size = PTYPE_UINT16_GETVAL(priv->index_bloom_size);
+	if (!priv->archive_bloom_size)
+		priv->archive_bloom_size = 1;
+	priv->archive_bloom = realloc(priv->archive_bloom, priv->archive_bloom_size);
+	memset(priv->archive_bloom, 0, priv->archive_bloom_size);
+	memset(&priv->archive_block, 0, sizeof(struct pcap_archive_block));
+	priv->archive_blocks = 0;
+
+	struct pcap_archive_header hdr;
+	memset(&hdr, 0, sizeof(struct pcap_archive_header));
+	memcpy(hdr.magic, PCAP_ARCHIVE_MAGIC, sizeof(hdr.magic));
+	hdr.bloom_size = priv->archive_bloom_size;
+	hdr.interval = PTYPE_INTERVAL_GETVAL(priv->index_interval);
+
+	if (fwrite(&hdr, sizeof(struct pcap_archive_header), 1, priv->archive_index) != 1) {
+		pom_log(POM_LOG_ERR "Error while writing index file %s", filename);
+		fclose(priv->archive_index);
+		priv->archive_index = NULL;
+		return POM_ERR;
+	}
+
+	return POM_OK;
+}
+
+/**
+ * Add a packet to the current block of the index.
+ */
+static int target_archive_add_pcap(struct target_priv_pcap *priv, struct frame *f, uint64_t offset) {
+
+	if (!priv->archive_index)
+		return POM_OK;
+
+	struct pcap_archive_block *block = &priv->archive_block;
+
+	time_t bucket = 0;
+	if (PTYPE_INTERVAL_GETVAL(priv->index_interval) > 0)
+		bucket = f->tv.tv_sec / PTYPE_INTERVAL_GETVAL(priv->index_interval);
+
+	if (block->packets && (bucket != priv->archive_bucket || block->packets >= PTYPE_UINT32_GETVAL(priv->index_packets)))
+		if (target_archive_flush_pcap(priv, offset) != POM_OK)
+			return POM_ERR;
+
+	uint64_t now = ((uint64_t) f->tv.tv_sec * 1000000) + f->tv.tv_usec;
+	if (!block->packets) {
+		block->start = offset;
+		block->first_time = now;
+		block->last_time = now;
+		priv->archive_bucket = bucket;
+	} else if (now < block->first_time) {
+		block->first_time = now;
+	} else if (now > block->last_time) {
+		block->last_time = now;
+	}
+	block->packets++;
+
+	unsigned char key[PCAP_ARCHIVE_KEY_SIZE];
+	struct layer *l;
+	for (l = f->l; l; l = l->next) {
+		unsigned int i;
+		for (i = 0; i < priv->archive_fields_count; i++) {
+			struct target_archive_field_pcap *fld = &priv->archive_fields[i];
+			if (fld->match_type != l->type || !l->fields[fld->field_id])
+				continue;
+
+			struct ptype *value = l->fields[fld->field_id];
+			uint32_t len = 0;
+			switch (fld->kind) {
+				case PCAP_ARCHIVE_KEY_IPV4:
+					len = pcap_archive_key(key, fld->kind, &((struct ptype_ipv4_val *) value->value)->addr, sizeof(struct in_addr));
+					break;
+				case PCAP_ARCHIVE_KEY_IPV6:
+					len = pcap_archive_key(key, fld->kind, &((struct ptype_ipv6_val *) value->value)->addr, sizeof(struct in6_addr));
+					break;
+				case PCAP_ARCHIVE_KEY_PORT: {
+					uint16_t port = htons(PTYPE_UINT16_GETVAL(value));
+					len = pcap_archive_key(key, fld->kind, &port, sizeof(port));
+					break;
+				}
+			}
+			pcap_archive_bloom_add(priv->archive_bloom, priv->archive_bloom_size, key, len);
+		}
+	}
+
+	return POM_OK;
+}
+
+/**
+ * Write the current block to the index.
+ */
+static int target_archive_flush_pcap(struct target_priv_pcap *priv, uint64_t end) {
+
+	struct pcap_archive_block *block = &priv->archive_block;
+
+	if (!block->packets)
+		return POM_OK;
+
+	block->end = end;
+
+	if (fwrite(block, sizeof(struct pcap_archive_block), 1, priv->archive_index) != 1 ||
+		fwrite(priv->archive_bloom, priv->archive_bloom_size, 1, priv->archive_index) != 1) {
+		pom_log(POM_LOG_ERR "Error while writing an index file");
+		return POM_ERR;
+	}
+
+	priv->archive_blocks++;
+
+	memset(block, 0, sizeof(struct pcap_archive_block));
+	memset(priv->archive_bloom, 0, priv->archive_bloom_size);
+
+	return POM_OK;
+}
+
+/**
+ * Write the last block and the number of blocks in the index.
+ */
+static int target_archive_close_pcap(struct target_priv_pcap *priv, uint64_t end) {
+
+	int res = target_archive_flush_pcap(priv, end);
+
+	if (fseeko(priv->archive_index, offsetof(struct pcap_archive_header, blocks), SEEK_SET) ||
+		fwrite(&priv->archive_blocks, sizeof(priv->archive_blocks), 1, priv->archive_index) != 1)
+		res = POM_ERR;
+
+	if (fclose(priv->archive_index))
+		res = POM_ERR;
+
+	priv->archive_index = NULL;
+
+	if (res != POM_OK)
+		pom_log(POM_LOG_ERR "Error while closing an index file");
+
+	return res;
+}
+
+/**
+ * Open a pcap file for writing, compressed if asked to.
+ */
+static pcap_dumper_t *target_dump_open_pcap(struct target_priv_pcap *priv, char *filename) {
+
+#ifdef HAVE_ZLIB
+	if (PTYPE_BOOL_GETVAL(priv->compress)) {
+		char name[NAME_MAX + sizeof(PCAP_COMPRESS_EXT)];
+		snprintf(name, sizeof(name), "%s" PCAP_COMPRESS_EXT, filename);
+
+		FILE *f = pcap_compress_fopen(name, PTYPE_UINT8_GETVAL(priv->compress_level), PTYPE_UINT8_GETVAL(priv->compress_threads));
+		if (!f) {
+			char errbuff[256];
+			strerror_r(errno, errbuff, sizeof(errbuff));
+			pom_log(POM_LOG_ERR "Unable to open compressed file %s : %s", name, errbuff);
+			return NULL;
+		}
+
+		pcap_dumper_t *pdump = pcap_dump_fopen(priv->p, f);
+		if (!pdump)
+			fclose(f);
+
+		return pdump;
+	}
+#endif
+
+	return pcap_dump_open(priv->p, filename);
+}
+
+/**
+ * Check if a file or its compressed version exists.
+ */
+static int target_file_exists_pcap(struct target_priv_pcap *priv, char *filename) {
+
+	struct stat tmp;
+	if (!stat(filename, &tmp))
+		return 1;
+
+	char name[NAME_MAX + sizeof(PCAP_COMPRESS_EXT)];
+	snprintf(name, sizeof(name), "%s" PCAP_COMPRESS_EXT, filename);
+
+	return !stat(name, &tmp);
+}
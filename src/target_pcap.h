@@ -25,9 +25,31 @@
 
 #include "modules_common.h"
 #include "rules.h"
+#include "pcap_index.h"
+#include "pcap_compress.h"
 
 #include <pcap.h>
 
+/// A packet record of the current segment
+struct target_segment_entry_pcap {
+
+	uint64_t flow_id;
+	uint64_t offset;
+
+};
+
+/// Maximum number of fields whose values are added to the bloom filters
+#define PCAP_ARCHIVE_MAX_FIELDS	8
+
+/// A layer field whose value is added to the bloom filters in archive mode
+struct target_archive_field_pcap {
+
+	int match_type;
+	int field_id;
+	unsigned char kind; ///< One of PCAP_ARCHIVE_KEY_*
+
+};
+
 struct target_priv_pcap {
 
 	pcap_dumper_t *pdump;
@@ -47,6 +69,31 @@ struct target_priv_pcap {
 	struct ptype *split_interval;
 	unsigned long split_index, split_files_num;
 
+	struct ptype *flow_name;
+	struct layer_template *name_tmpl; ///< Compiled prefix in connection mode or flow name in segment mode
+	uint64_t next_flow_id; ///< Id of the next connection in segment mode
+	unsigned long segment_id; ///< Incremented each time a segment is opened
+	struct pcap_index_flow *seg_flows; ///< Connections of the current segment
+	unsigned int seg_flows_count, seg_flows_size;
+	struct target_segment_entry_pcap *seg_entries; ///< Packets of the current segment
+	uint64_t seg_entries_count, seg_entries_size;
+
+	struct ptype *compress;
+	struct ptype *compress_level;
+	struct ptype *compress_threads;
+
+	struct ptype *index_packets;
+	struct ptype *index_interval;
+	struct ptype *index_bloom_size;
+	FILE *archive_index; ///< Index of the current file in archive mode
+	uint32_t archive_bloom_size;
+	uint32_t archive_blocks; ///< Number of blocks written in the index
+	struct pcap_archive_block archive_block; ///< Block being filled
+	unsigned char *archive_bloom; ///< Bloom filter of the block being filled
+	time_t archive_bucket; ///< Time bucket of the block being filled
+	struct target_archive_field_pcap archive_fields[PCAP_ARCHIVE_MAX_FIELDS];
+	unsigned int archive_fields_count;
+
 	struct target_conntrack_priv_pcap *ct_privs;
 
 	int issued_warning; ///< Make sure we warn users only once about some possible issue
@@ -57,6 +104,10 @@ struct target_conntrack_priv_pcap {
 	struct conntrack_entry *ce;
 	pcap_dumper_t *pdump;
 
+	uint64_t flow_id; ///< Id of the connection in segment mode
+	unsigned long segment_id; ///< Last segment in which the connection was added to the index
+	char name[PCAP_INDEX_NAME_SIZE];
+
 	struct target_conntrack_priv_pcap *next;
 	struct target_conntrack_priv_pcap *prev;
 
@@ -70,6 +121,21 @@ int target_close_connection_pcap(struct target *t, struct conntrack_entry *ce, v
 static int target_close_pcap(struct target *t);
 static int target_cleanup_pcap(struct target *t);
 
+static pcap_dumper_t *target_dump_open_pcap(struct target_priv_pcap *priv, char *filename);
+static int target_file_exists_pcap(struct target_priv_pcap *priv, char *filename);
+
+static int target_segment_open_pcap(struct target_priv_pcap *priv);
+static int target_segment_add_pcap(struct target_priv_pcap *priv, struct target_conntrack_priv_pcap *cp, uint64_t offset);
+static int target_segment_close_pcap(struct target_priv_pcap *priv);
+static int target_segment_compare_entry_pcap(const void *a, const void *b);
+static int target_segment_compare_flow_pcap(const void *a, const void *b);
+
+static int target_archive_init_fields_pcap(struct target_priv_pcap *priv);
+static int target_archive_open_pcap(struct target_priv_pcap *priv);
+static int target_archive_add_pcap(struct target_priv_pcap *priv, struct frame *f, uint64_t offset);
+static int target_archive_flush_pcap(struct target_priv_pcap *priv, uint64_t end);
+static int target_archive_close_pcap(struct target_priv_pcap *priv, uint64_t end);
+
 
 
 #endif
@@ -110,6 +110,11 @@ static int target_open_pop(struct target *t) {
 
 	struct target_priv_pop *priv = t->target_priv;
 
+	// Parse the path once instead of for each connection
+	priv->path_tmpl = layer_template_compile(PTYPE_STRING_GETVAL(priv->path));
+	if (!priv->path_tmpl)
+		return POM_ERR;
+
 	char *ds_path = PTYPE_STRING_GETVAL(priv->ds_path);
 
 	if (ds_path && strlen(ds_path)) {
@@ -117,6 +122,8 @@ static int target_open_pop(struct target *t) {
 
 		if (!priv->dset) {
 			pom_log(POM_LOG_ERR "Unable to open the credential dataset");
+			layer_template_cleanup(priv->path_tmpl);
+			priv->path_tmpl = NULL;
 			return POM_ERR;
 		}
 
@@ -135,6 +142,9 @@ static int target_close_pop(struct target *t) {
 		target_close_connection_pop(t, priv->ct_privs->ce, priv->ct_privs);
 	}
 
+	layer_template_cleanup(priv->path_tmpl);
+	priv->path_tmpl = NULL;
+
 	return POM_OK;
 }
 
@@ -189,7 +199,7 @@ static int target_process_pop(struct target *t, struct frame *f) {
 
 		char tmp[NAME_MAX + 1];
 		memset(tmp, 0, sizeof(tmp));
-		layer_field_parse(f->l, &f->tv, PTYPE_STRING_GETVAL(priv->path), tmp, NAME_MAX);
+		layer_template_render(priv->path_tmpl, f->l, &f->tv, tmp, NAME_MAX);
 		cp->parsed_path = malloc(strlen(tmp) + 3);
 		strcpy(cp->parsed_path, tmp);
 		if (*(cp->parsed_path + strlen(cp->parsed_path) - 1) != '/')
@@ -321,7 +331,7 @@ static int pop_process_line(struct target *t, struct target_conntrack_priv_pop *
 
 					int res, count = 0;
 					do {
-						res = write(cp->fd, line, size);
+						res = filewriter_write(cp->fd, line, size);
 						if (res == -1)
 							return POM_ERR;
 						count += res;
@@ -581,6 +591,8 @@ static int pop_file_open(struct target_priv_pop *priv, struct target_conntrack_p
 		return POM_ERR;
 	}
 
+	filewriter_register(cp->fd);
+
 	total_delivery++;
 
 	perf_item_val_inc(priv->perf_cur_emails, 1);
@@ -594,7 +606,9 @@ static int pop_file_close(struct target_priv_pop *priv, struct target_conntrack_
 
 	if (cp->fd == -1)
 		return POM_ERR;
-	close(cp->fd);
+	// The mail must be complete before it's moved out of the tmp directory
+	filewriter_flush(cp->fd);
+	filewriter_close(cp->fd);
 	cp->fd = -1;
 
 
@@ -53,6 +53,7 @@ struct target_conntrack_priv_pop {
 struct target_priv_pop {
 
 	struct ptype *path;
+	struct layer_template *path_tmpl; ///< Compiled path of the maildir folder
 	struct ptype *ds_path;
 	struct target_dataset *dset;
 
@@ -29,9 +29,14 @@
 
 #include "ptype_string.h"
 #include "ptype_uint16.h"
+#include "ptype_uint32.h"
 
 #include <rtp.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 static unsigned int match_rtp_id;
 
 static struct target_mode *mode_default;
@@ -39,6 +44,7 @@ static struct target_mode *mode_default;
 int target_register_rtp(struct target_reg *r) {
 
 	r->init = target_init_rtp;
+	r->open = target_open_rtp;
 	r->process = target_process_rtp;
 	r->close = target_close_rtp;
 	r->cleanup = target_cleanup_rtp;
@@ -52,6 +58,7 @@ int target_register_rtp(struct target_reg *r) {
 
 	target_register_param(mode_default, "prefix", "dump", "Prefix of dumped filenames including path");
 	target_register_param(mode_default, "jitter_buffer", "4000", "Data to buffer while waiting for reverse direction channels");
+	target_register_param(mode_default, "write_buffer", "65536", "Interleaved data to buffer before writing it to the file");
 
 	return POM_OK;
 
@@ -66,18 +73,31 @@ static int target_init_rtp(struct target *t) {
 
 	priv->prefix = ptype_alloc("string", NULL);
 	priv->jitter_buffer = ptype_alloc("uint16", "bytes");
-	if (!priv->prefix || !priv->jitter_buffer) {
+	priv->write_buffer = ptype_alloc("uint32", "bytes");
+	if (!priv->prefix || !priv->jitter_buffer || !priv->write_buffer) {
 		target_cleanup_rtp(t);
 		return POM_ERR;
 	}
 
 	target_register_param_value(t, mode_default, "prefix", priv->prefix);
 	target_register_param_value(t, mode_default, "jitter_buffer", priv->jitter_buffer);
+	target_register_param_value(t, mode_default, "write_buffer", priv->write_buffer);
 
 
 	return POM_OK;
 }
 
+static int target_open_rtp(struct target *t) {
+
+	struct target_priv_rtp *priv = t->target_priv;
+
+	// Parse the prefix once instead of for each stream
+	priv->prefix_tmpl = layer_template_compile(PTYPE_STRING_GETVAL(priv->prefix));
+	if (!priv->prefix_tmpl)
+		return POM_ERR;
+
+	return POM_OK;
+}
 
 static int target_close_rtp(struct target *t) {
 
@@ -88,6 +108,9 @@ static int target_close_rtp(struct target *t) {
 		target_close_connection_rtp(t, priv->ct_privs->ce, priv->ct_privs);
 	}
 
+	layer_template_cleanup(priv->prefix_tmpl);
+	priv->prefix_tmpl = NULL;
+
 	return POM_OK;
 }
 
@@ -99,6 +122,7 @@ static int target_cleanup_rtp(struct target *t) {
 
 		ptype_cleanup(priv->prefix);
 		ptype_cleanup(priv->jitter_buffer);
+		ptype_cleanup(priv->write_buffer);
 		free(priv);
 	}
 
@@ -168,7 +192,9 @@ static int target_process_rtp(struct target *t, struct frame *f) {
 		priv->ct_privs = cp;
 
 		// Compute filename right away
-		char filename[NAME_MAX + 1];
+		if (layer_template_render(priv->prefix_tmpl, f->l, &f->tv, cp->filename, NAME_MAX) == POM_ERR)
+			return POM_ERR;
+
 		char outstr[20];
 		memset(outstr, 0, 20);
 		// YYYYMMDD-HHMMSS-UUUUUU
@@ -178,13 +204,8 @@ static int target_process_rtp(struct target *t, struct frame *f) {
 
 		strftime(outstr, 20, format, &tmp);
 
-		strcpy(filename, PTYPE_STRING_GETVAL(priv->prefix));
-		strcat(filename, outstr);
-		sprintf(outstr, "%u", (unsigned int)f->tv.tv_usec);
-		strcat(filename, outstr);
-		strcat(filename, ".au");
-		if (layer_field_parse(f->l, &f->tv, filename, cp->filename, NAME_MAX) == POM_ERR)
-			return POM_ERR;
+		size_t len = strlen(cp->filename);
+		snprintf(cp->filename + len, NAME_MAX - len, "%s%u.au", outstr, (unsigned int)f->tv.tv_usec);
 
 
 		cp->fd = -1;
@@ -308,8 +329,10 @@ static int open_file(struct target_priv_rtp *priv, struct target_conntrack_priv_
 		char errbuff[256];
 		strerror_r(errno, errbuff, 256);
 		pom_log(POM_LOG_ERR "Unable to open file %s for writing : %s", cp->filename, errbuff);
-	} else
+	} else {
+		filewriter_register(cp->fd);
 		pom_log(POM_LOG_TSHOOT "%s opened", cp->filename);
+	}
 	
 	struct au_hdr auhdr;
 	memset(&auhdr, 0, sizeof(struct au_hdr));
@@ -347,10 +370,25 @@ static int open_file(struct target_priv_rtp *priv, struct target_conntrack_priv_
 		return POM_ERR;
 	}
 
+	// Interleaved samples are accumulated here and written in large chunks
+	// The buffer must at least hold one 16 bit sample for each channel
+	cp->out.buff_size = PTYPE_UINT32_GETVAL(priv->write_buffer);
+	if (cp->out.buff_size < 4)
+		cp->out.buff_size = 4;
+	cp->out.buff = malloc(cp->out.buff_size);
+	if (!cp->out.buff) {
+		pom_log(POM_LOG_ERR "Not enough memory to allocate the write buffer of %s", cp->filename);
+		cp->out.buff_size = 0;
+		filewriter_close(cp->fd);
+		cp->fd = -1;
+		return POM_ERR;
+	}
+	cp->out.buff_pos = 0;
+
 	auhdr.data_size = AU_UNKNOWN_SIZE;
 	auhdr.channels = htonl(cp->channels);
 
-	if (write(cp->fd, &auhdr, sizeof(struct au_hdr)) < sizeof(struct au_hdr))
+	if (filewriter_write(cp->fd, &auhdr, sizeof(struct au_hdr)) < sizeof(struct au_hdr))
 		return POM_ERR;
 
 	return POM_OK;
@@ -392,19 +430,20 @@ static int target_close_connection_rtp(struct target *t, struct conntrack_entry
 	struct target_priv_rtp *priv = t->target_priv;
 
 
-	if (cp->fd == -1) {
-		if (open_file(priv, cp) == POM_ERR)
-			return POM_ERR;
-	}
-
+	int res = POM_OK;
+	if (cp->fd == -1)
+		res = open_file(priv, cp);
 
-	flush_buffers(cp, CE_DIR_FWD);
+	// The connection is released even if the file couldn't be opened
+	if (cp->fd != -1) {
+		flush_buffers(cp, CE_DIR_FWD);
+		flush_output(cp);
 
-	lseek(cp->fd, 8, SEEK_SET);
-	uint32_t size = htonl(cp->total_size);
-	write(cp->fd, &size , 4);
+		uint32_t size = htonl(cp->total_size);
+		filewriter_pwrite(cp->fd, &size, 4, 8);
 
-	close(cp->fd);
+		filewriter_close(cp->fd);
+	}
 
 	if (cp->prev)
 		cp->prev->next = cp->next;
@@ -420,63 +459,84 @@ static int target_close_connection_rtp(struct target *t, struct conntrack_entry
 			free(cp->buffer[i].buff);
 	}
 
+	if (cp->out.buff)
+		free(cp->out.buff);
+
 	free(cp);
 	
-	return POM_OK;
+	return res;
 
 }
 
 static int flush_buffers(struct target_conntrack_priv_rtp *cp, int dir) {
 
-	struct rtp_buffer* buff = &cp->buffer[dir];
+	struct rtp_buffer *out = &cp->out;
+
 	if (cp->channels == 1) {
-		write(cp->fd, buff->buff, buff->buff_pos);
+		struct rtp_buffer* buff = &cp->buffer[dir];
+		unsigned int read_pos = 0;
+		while (read_pos < buff->buff_pos) {
+			if (out->buff_pos == out->buff_size && flush_output(cp) == POM_ERR)
+				return POM_ERR;
+			unsigned int len = out->buff_size - out->buff_pos;
+			if (len > buff->buff_pos - read_pos)
+				len = buff->buff_pos - read_pos;
+			memcpy(out->buff + out->buff_pos, buff->buff + read_pos, len);
+			out->buff_pos += len;
+			read_pos += len;
+		}
 		cp->total_size += buff->buff_pos;
 		buff->buff_pos = 0;
 	} else { // channels = 2
-		int read_pos = 0;
+
+		void (*interleave) (char *, char *, char *, unsigned int);
+		unsigned int sample_size;
+
 		switch (cp->payload_type) {
 			case RTP_CODEC_G711U: // 8 bit interleaving
 			case RTP_CODEC_G711A:
-
-				while (read_pos < cp->buffer[CE_DIR_FWD].buff_pos && read_pos < cp->buffer[CE_DIR_REV].buff_pos) {
-					write(cp->fd, cp->buffer[CE_DIR_FWD].buff + read_pos, 1);
-					write(cp->fd, cp->buffer[CE_DIR_REV].buff + read_pos, 1);
-					read_pos++;
-					cp->total_size += 2;
-				}
-
+				interleave = interleave_8;
+				sample_size = 1;
 				break;
 
 			case RTP_CODEC_G722: // 16 bit interleaving. XXX : Most likely broken for G.722, need to check
-				while (read_pos < cp->buffer[CE_DIR_FWD].buff_pos && read_pos < cp->buffer[CE_DIR_REV].buff_pos) {
-					write(cp->fd, cp->buffer[CE_DIR_FWD].buff + read_pos, 2);
-					write(cp->fd, cp->buffer[CE_DIR_REV].buff + read_pos, 2);
-					read_pos += 2;
-					cp->total_size += 4;
-				}
-
+				interleave = interleave_16;
+				sample_size = 2;
 				break;
 
 			case RTP_CODEC_G721: // 4 bit interleaving
-				while (read_pos < cp->buffer[CE_DIR_FWD].buff_pos && read_pos < cp->buffer[CE_DIR_REV].buff_pos) {
-					char buff, fwd, rev;
-					fwd = *(cp->buffer[CE_DIR_FWD].buff + read_pos);
-					rev = *(cp->buffer[CE_DIR_REV].buff + read_pos);
-
-					buff = (fwd & 0xf0) | ((rev & 0xf0) >> 4);
-					write(cp->fd, &buff, 1);
-					buff = ((fwd & 0xf) << 4) | (rev & 0xf);
-					write(cp->fd, &buff, 1);
-					read_pos++;
-					cp->total_size += 2;
-				}
-				break;	
+				interleave = interleave_4;
+				sample_size = 1;
+				break;
 
 			default:
 				return POM_ERR;
+		}
 
+		unsigned int avail = cp->buffer[CE_DIR_FWD].buff_pos;
+		if (avail > cp->buffer[CE_DIR_REV].buff_pos)
+			avail = cp->buffer[CE_DIR_REV].buff_pos;
+		avail -= avail % sample_size;
+
+		unsigned int read_pos = 0;
+		while (read_pos < avail) {
+			// Each input byte produces two output bytes
+			unsigned int len = (out->buff_size - out->buff_pos) / 2;
+			len -= len % sample_size;
+			if (!len) {
+				if (flush_output(cp) == POM_ERR)
+					return POM_ERR;
+				continue;
+			}
+			if (len > avail - read_pos)
+				len = avail - read_pos;
+
+			interleave(out->buff + out->buff_pos, cp->buffer[CE_DIR_FWD].buff + read_pos, cp->buffer[CE_DIR_REV].buff + read_pos, len);
+			out->buff_pos += len * 2;
+			read_pos += len;
+			cp->total_size += len * 2;
 		}
+
 		if (cp->buffer[CE_DIR_FWD].buff_pos - read_pos > 0) {
 			memmove(cp->buffer[CE_DIR_FWD].buff, cp->buffer[CE_DIR_FWD].buff + read_pos, cp->buffer[CE_DIR_FWD].buff_pos - read_pos);
 			cp->buffer[CE_DIR_FWD].buff_pos = cp->buffer[CE_DIR_FWD].buff_pos - read_pos;
@@ -494,3 +554,107 @@ static int flush_buffers(struct target_conntrack_priv_rtp *cp, int dir) {
 	return POM_OK;
 }
 
+
+static int flush_output(struct target_conntrack_priv_rtp *cp) {
+
+	unsigned int pos = 0;
+	while (pos < cp->out.buff_pos) {
+		ssize_t res = filewriter_write(cp->fd, cp->out.buff + pos, cp->out.buff_pos - pos);
+		if (res == -1) {
+			if (errno == EINTR)
+				continue;
+			char errbuff[256];
+			strerror_r(errno, errbuff, 256);
+			pom_log(POM_LOG_ERR "Error while writing to file %s : %s", cp->filename, errbuff);
+			cp->out.buff_pos = 0;
+			return POM_ERR;
+		}
+		pos += res;
+	}
+
+	cp->out.buff_pos = 0;
+
+	return POM_OK;
+}
+
+/**
+ * Interleave 8 bit samples of both directions.
+ * @param out Output buffer, must be at least 2 * len bytes
+ * @param fwd Forward direction samples
+ * @param rev Reverse direction samples
+ * @param len Number of bytes to use from each direction
+ */
+static void interleave_8(char *out, char *fwd, char *rev, unsigned int len) {
+
+	unsigned int i = 0;
+
+#ifdef __SSE2__
+	for (; i + 16 <= len; i += 16) {
+		__m128i f = _mm_loadu_si128((__m128i *) (fwd + i));
+		__m128i r = _mm_loadu_si128((__m128i *) (rev + i));
+		_mm_storeu_si128((__m128i *) (out + (i * 2)), _mm_unpacklo_epi8(f, r));
+		_mm_storeu_si128((__m128i *) (out + (i * 2) + 16), _mm_unpackhi_epi8(f, r));
+	}
+#endif
+
+	for (; i < len; i++) {
+		out[i * 2] = fwd[i];
+		out[(i * 2) + 1] = rev[i];
+	}
+}
+
+/**
+ * Interleave 16 bit samples of both directions.
+ * @param out Output buffer, must be at least 2 * len bytes
+ * @param fwd Forward direction samples
+ * @param rev Reverse direction samples
+ * @param len Number of bytes to use from each direction, must be even
+ */
+static void interleave_16(char *out, char *fwd, char *rev, unsigned int len) {
+
+	unsigned int i = 0;
+
+#ifdef __SSE2__
+	for (; i + 16 <= len; i += 16) {
+		__m128i f = _mm_loadu_si128((__m128i *) (fwd + i));
+		__m128i r = _mm_loadu_si128((__m128i *) (rev + i));
+		_mm_storeu_si128((__m128i *) (out + (i * 2)), _mm_unpacklo_epi16(f, r));
+		_mm_storeu_si128((__m128i *) (out + (i * 2) + 16), _mm_unpackhi_epi16(f, r));
+	}
+#endif
+
+	for (; i < len; i += 2) {
+		memcpy(out + (i * 2), fwd + i, 2);
+		memcpy(out + (i * 2) + 2, rev + i, 2);
+	}
+}
+
+/**
+ * Interleave 4 bit samples of both directions.
+ * @param out Output buffer, must be at least 2 * len bytes
+ * @param fwd Forward direction samples
+ * @param rev Reverse direction samples
+ * @param len Number of bytes to use from each direction
+ */
+static void interleave_4(char *out, char *fwd, char *rev, unsigned int len) {
+
+	unsigned int i = 0;
+
+#ifdef __SSE2__
+	__m128i hi_mask = _mm_set1_epi8(0xf0), lo_mask = _mm_set1_epi8(0xf);
+	for (; i + 16 <= len; i += 16) {
+		__m128i f = _mm_loadu_si128((__m128i *) (fwd + i));
+		__m128i r = _mm_loadu_si128((__m128i *) (rev + i));
+		// There is no 8 bit shift, shift 16 bit words and mask out the bits coming from the next byte
+		__m128i first = _mm_or_si128(_mm_and_si128(f, hi_mask), _mm_and_si128(_mm_srli_epi16(r, 4), lo_mask));
+		__m128i second = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(f, 4), hi_mask), _mm_and_si128(r, lo_mask));
+		_mm_storeu_si128((__m128i *) (out + (i * 2)), _mm_unpacklo_epi8(first, second));
+		_mm_storeu_si128((__m128i *) (out + (i * 2) + 16), _mm_unpackhi_epi8(first, second));
+	}
+#endif
+
+	for (; i < len; i++) {
+		out[i * 2] = (fwd[i] & 0xf0) | ((rev[i] & 0xf0) >> 4);
+		out[(i * 2) + 1] = ((fwd[i] & 0xf) << 4) | (rev[i] & 0xf);
+	}
+}
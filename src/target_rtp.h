@@ -78,6 +78,8 @@ struct target_conntrack_priv_rtp {
 	struct rtp_buffer buffer[2];
 	int channels;
 
+	struct rtp_buffer out; ///< Interleaved samples waiting to be written to the file
+
 	struct target_conntrack_priv_rtp *next;
 	struct target_conntrack_priv_rtp *prev;
 
@@ -86,7 +88,9 @@ struct target_conntrack_priv_rtp {
 struct target_priv_rtp {
 
 	struct ptype *prefix;
+	struct layer_template *prefix_tmpl; ///< Compiled prefix of the files
 	struct ptype *jitter_buffer;
+	struct ptype *write_buffer;
 
 	struct target_conntrack_priv_rtp *ct_privs;
 
@@ -95,6 +99,7 @@ struct target_priv_rtp {
 int target_register_rtp(struct target_reg *r);
 
 static int target_init_rtp(struct target *t);
+static int target_open_rtp(struct target *t);
 static int target_process_rtp(struct target *t, struct frame *f);
 static int target_close_connection_rtp(struct target *t, struct conntrack_entry *ce, void *conntrack_priv);
 static int target_close_rtp(struct target *t);
@@ -103,5 +108,9 @@ static int target_cleanup_rtp(struct target *t);
 static int write_packet(struct target_conntrack_priv_rtp *cp, struct target_priv_rtp *priv, int dir, void *data, int len);
 static int open_file(struct target_priv_rtp *priv, struct target_conntrack_priv_rtp *cp);
 static int flush_buffers(struct target_conntrack_priv_rtp *cp, int dir);
+static int flush_output(struct target_conntrack_priv_rtp *cp);
+static void interleave_8(char *out, char *fwd, char *rev, unsigned int len);
+static void interleave_16(char *out, char *fwd, char *rev, unsigned int len);
+static void interleave_4(char *out, char *fwd, char *rev, unsigned int len);
 
 #endif
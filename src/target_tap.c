@@ -83,6 +83,9 @@ static int target_init_tap(struct target *t) {
 	target_register_param_value(t, mode_default, "ifname", priv->ifname);
 	target_register_param_value(t, mode_default, "persistent", priv->persistent);
 
+	priv->perf_pkts_sent = perf_add_item(t->perfs, "pkts_sent", perf_item_type_counter, "Number of packets sent to the interface");
+	priv->perf_send_errors = perf_add_item(t->perfs, "send_errors", perf_item_type_counter, "Number of packets that could not be sent to the interface");
+
 	char buff[32];
 	snprintf(buff, 31, "pom%u", instance_count);
 	PTYPE_STRING_SETVAL(priv->ifname, buff);
@@ -109,7 +112,7 @@ static int target_open_tap(struct target *t) {
 
 	struct target_priv_tap *priv = t->target_priv;
 
-	priv->fd = open("/dev/net/tun", O_RDWR | O_SYNC);
+	priv->fd = open("/dev/net/tun", O_RDWR);
 	if (priv->fd < 0) {
 		pom_log(POM_LOG_ERR "Failed to open tap device");
 		return POM_ERR;
@@ -144,7 +147,7 @@ static int target_process_tap(struct target *t, struct frame *f) {
 		return POM_ERR;
 	}
 	
-	size_t start = layer_find_start(f->l, match_ethernet_id);
+	int start = layer_find_start(f->l, match_ethernet_id);
 
 	if (start == POM_ERR) {
 		pom_log(POM_LOG_ERR "Unable to find the start of the packet");
@@ -152,20 +155,26 @@ static int target_process_tap(struct target *t, struct frame *f) {
 
 	}
 
-	size_t wres = 0, size = f->len - start;
-
-	while (size > 0) {
-		wres = write(priv->fd, f->buff + start, size);
-		if (wres == -1) {
-			char errbuff[256];
-			strerror_r(errno, errbuff, sizeof(errbuff) - 1);
-			pom_log(POM_LOG_ERR "Error while writing to the tap interface : %s", errbuff);
-			return POM_ERR;
-		}
-		start += wres;
-		size -= wres;
+	// The tap device takes exactly one frame per write() so there is nothing to batch
+	size_t size = f->len - start;
+	ssize_t wres = write(priv->fd, f->buff + start, size);
+	if (wres == -1) {
+		perf_item_val_inc(priv->perf_send_errors, 1);
+		char errbuff[256];
+		memset(errbuff, 0, sizeof(errbuff));
+		strerror_r(errno, errbuff, sizeof(errbuff) - 1);
+		pom_log(POM_LOG_ERR "Error while writing to the tap interface : %s", errbuff);
+		return POM_ERR;
+	}
+
+	if (wres != size) {
+		perf_item_val_inc(priv->perf_send_errors, 1);
+		pom_log(POM_LOG_WARN "Frame truncated by the tap interface (%zd bytes out of %zu)", wres, size);
+		return POM_OK;
 	}
 
+	perf_item_val_inc(priv->perf_pkts_sent, 1);
+
 	return POM_OK;
 }
 
@@ -31,6 +31,9 @@ struct target_priv_tap {
 	struct ptype *ifname;
 	struct ptype *persistent;
 
+	struct perf_item *perf_pkts_sent;
+	struct perf_item *perf_send_errors;
+
 };
 
 int target_register_tap(struct target_reg *r);
@@ -27,6 +27,7 @@
 #include <netinet/ip6.h>
 #include "ptype_uint16.h"
 #include "ptype_string.h"
+#include "checksum.h"
 
 #ifdef HAVE_LINUX_IP_SOCKET
 #include <sys/ioctl.h>
@@ -41,27 +42,6 @@
 #include <netinet/ip.h>
 #include <ethernet.h>
 
-static int cksum(uint16_t *addr, int len)
-{
-	int sum;
-	uint16_t last_byte;
-
-	sum = 0;
-	last_byte = 0;
-
-	while (len > 1)	{
-		sum += *addr++;
-		len -= 2;
-	}
-	if (len == 1) {
-		*(uint8_t*)&last_byte = *(uint8_t*)addr;
-		sum += last_byte;
-	}
-
-	 return (sum);
-}
-
-
 static int match_ipv4_id, match_ipv6_id, match_tcp_id, match_ethernet_id;
 
 static struct target_mode *mode_routed, *mode_interface;
@@ -319,16 +299,13 @@ static int target_process_tcpkill(struct target *t, struct frame *f) {
 		dv4hdr->ip_hl = 5;
 		dv4hdr->ip_v = 4;
 		int ipsum;
-		ipsum = cksum((uint16_t *)dv4hdr, dv4hdr->ip_hl * 4);
+		ipsum = checksum_inet(dv4hdr, dv4hdr->ip_hl * 4);
 
 		while (ipsum >> 16)
 			ipsum = (ipsum & 0xFFFF)+(ipsum >> 16);
 		dv4hdr->ip_sum = ~ipsum;
 
-		// localcopy of addr to make compiler happy
-		uint16_t saddr[8];
-		memcpy(saddr, &dv4hdr->ip_src, 8);
-		tcpsum = cksum(saddr, 8);
+		tcpsum = checksum_inet(&dv4hdr->ip_src, 8);
 		blen += sizeof(struct tcphdr);
 
 
@@ -345,7 +322,7 @@ static int target_process_tcpkill(struct target *t, struct frame *f) {
 		dv6hdr->ip6_plen = htons(sizeof(struct tcphdr));
 		dv6hdr->ip6_hlim = 255;
 
-		tcpsum = cksum((uint16_t *)&dv6hdr->ip6_src, 32);
+		tcpsum = checksum_inet(&dv6hdr->ip6_src, 32);
 		blen += sizeof(struct ip6_hdr);
 
 	} 
@@ -369,7 +346,7 @@ static int target_process_tcpkill(struct target *t, struct frame *f) {
 	for (i = 0; i < PTYPE_UINT16_GETVAL(priv->severity); i++) {
 
 		dhdr->th_sum = 0;
-		int mysum = tcpsum + cksum((uint16_t*)(dhdr), sizeof(struct tcphdr));
+		int mysum = tcpsum + checksum_inet(dhdr, sizeof(struct tcphdr));
 	
 	    	while (mysum >> 16)
 			mysum = (mysum & 0xFFFF)+(mysum >> 16);
@@ -36,6 +36,7 @@ static struct target_mode *mode_default;
 int target_register_tftp(struct target_reg *r) {
 
 	r->init = target_init_tftp;
+	r->open = target_open_tftp;
 	r->process = target_process_tftp;
 	r->close = target_close_tftp;
 	r->cleanup = target_cleanup_tftp;
@@ -80,6 +81,17 @@ static int target_init_tftp(struct target *t) {
 	return POM_OK;
 }
 
+static int target_open_tftp(struct target *t) {
+
+	struct target_priv_tftp *priv = t->target_priv;
+
+	// Parse the path once instead of for each connection
+	priv->path_tmpl = layer_template_compile(PTYPE_STRING_GETVAL(priv->path));
+	if (!priv->path_tmpl)
+		return POM_ERR;
+
+	return POM_OK;
+}
 
 static int target_close_tftp(struct target *t) {
 
@@ -90,6 +102,9 @@ static int target_close_tftp(struct target *t) {
 		target_close_connection_tftp(t, priv->ct_privs->ce, priv->ct_privs);
 	}
 
+	layer_template_cleanup(priv->path_tmpl);
+	priv->path_tmpl = NULL;
+
 	return POM_OK;
 }
 
@@ -144,7 +159,7 @@ static int target_process_tftp(struct target *t, struct frame *f) {
 
 		char tmp[NAME_MAX + 1];
 		memset(tmp, 0, sizeof(tmp));
-		layer_field_parse(f->l, &f->tv, PTYPE_STRING_GETVAL(priv->path), tmp, NAME_MAX);
+		layer_template_render(priv->path_tmpl, f->l, &f->tv, tmp, NAME_MAX);
 		cp->parsed_path = malloc(strlen(tmp) + 3);
 		strcpy(cp->parsed_path, tmp);
 		if (*(cp->parsed_path + strlen(cp->parsed_path) - 1) != '/')
@@ -301,7 +316,7 @@ static int tftp_process_packet(struct target *t, struct conntrack_entry *ce, str
 				memset(missed, 0, sizeof(missed));
 				size_t wres = 0, wsize = sizeof(missed);
 				while (wsize > 0) {
-					wres = write(conn->fd, missed, wsize);
+					wres = filewriter_write(conn->fd, missed, wsize);
 					if (wres < 0) {
 						char errbuff[256];
 						memset(errbuff, 0, sizeof(errbuff));
@@ -319,7 +334,7 @@ static int tftp_process_packet(struct target *t, struct conntrack_entry *ce, str
 
 			size_t wres = 0, wsize = size;
 			while (wsize > 0) {
-				wres = write(conn->fd, payload, wsize);
+				wres = filewriter_write(conn->fd, payload, wsize);
 				if (wres < 0) {
 					char errbuff[256];
 					memset(errbuff, 0, sizeof(errbuff));
@@ -415,6 +430,8 @@ static int tftp_file_open(struct target_priv_tftp *priv, struct target_conntrack
 		return POM_ERR;
 	}
 
+	filewriter_register(conn->fd);
+
 	perf_item_val_inc(priv->perf_cur_files, 1);
 
 	pom_log(POM_LOG_TSHOOT "TFTP : %s opened", final_name);
@@ -428,7 +445,7 @@ static int tftp_file_close(struct target_priv_tftp *priv, struct target_conntrac
 
 	if (conn->fd == -1)
 		return POM_ERR;
-	close(conn->fd);
+	filewriter_close(conn->fd);
 	conn->fd = -1;
 	pom_log(POM_LOG_TSHOOT "TFTP : %s closed", conn->filename);
 	*conn->filename = 0;
@@ -58,6 +58,7 @@ struct target_conntrack_priv_tftp {
 struct target_priv_tftp {
 
 	struct ptype *path;
+	struct layer_template *path_tmpl; ///< Compiled path of the files
 
 	/// All the connections of this target
 	struct target_conntrack_priv_tftp *ct_privs;
@@ -74,6 +75,7 @@ struct target_priv_tftp {
 int target_register_tftp(struct target_reg *r);
 
 static int target_init_tftp(struct target *t);
+static int target_open_tftp(struct target *t);
 static int target_process_tftp(struct target *t, struct frame *f);
 static int target_close_connection_tftp(struct target *t, struct conntrack_entry* ce, void *conntrack_priv);
 static int target_close_tftp(struct target *t);
@@ -0,0 +1,107 @@
+#!/bin/sh
+#
+#  packet-o-matic : modular network traffic processor
+#  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+#
+
+# Write a capture in segment mode and extract a connection from each
+# segment, the last one included, with pom-pcap-extract.
+
+PACKETS=60
+
+# The pcap target is only built when libpcap is available
+if [ ! -f .libs/target_pcap.so ]; then
+	echo "target_pcap not built, skipping"
+	exit 77
+fi
+
+dir=`mktemp -d` || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+# Write hexadecimal bytes in binary
+hex() {
+	for b in $*; do
+		printf "\\`printf '%03o' 0x$b`"
+	done
+}
+
+# Ethernet, IPv4 10.0.0.1 -> 10.0.0.2, UDP 1234 -> 5678 and 16 bytes of payload
+hex 00 11 22 33 44 55 00 66 77 88 99 aa 08 00 > "$dir/frame"
+hex 45 00 00 2c 00 00 00 00 40 11 66 bf 0a 00 00 01 0a 00 00 02 >> "$dir/frame"
+hex 04 d2 16 2e 00 18 00 00 >> "$dir/frame"
+hex 70 61 63 6b 65 74 2d 6f 2d 6d 61 74 69 63 0a 00 >> "$dir/frame"
+
+hex d4 c3 b2 a1 02 00 04 00 00 00 00 00 00 00 00 00 ff ff 00 00 01 00 00 00 > "$dir/in.cap"
+i=1
+while [ $i -le $PACKETS ]; do
+	hex `printf '%02x' $i` 00 00 00 00 00 00 00 3a 00 00 00 3a 00 00 00 >> "$dir/in.cap"
+	cat "$dir/frame" >> "$dir/in.cap"
+	i=`expr $i + 1`
+done
+
+cat > "$dir/pom.xml" << EOF
+<?xml version="1.0" encoding="ISO-8859-1"?>
+<config>
+	<rule>
+		<target type="pcap" start="yes" mode="segment">
+			<param name="prefix">$dir/seg</param>
+			<param name="layer">ethernet</param>
+			<param name="split_size">1000</param>
+			<param name="flow_name">\${ipv4.src}-\${ipv4.dst}</param>
+		</target>
+		<matches>
+			<match layer="udp"/>
+		</matches>
+	</rule>
+</config>
+EOF
+
+LD_LIBRARY_PATH=.libs:$LD_LIBRARY_PATH ./packet-o-matic --no-cli -c "$dir/pom.xml" --benchmark="$dir/in.cap" --benchmark-loops=1 > "$dir/pom.log" 2>&1
+if [ $? -ne 0 ]; then
+	cat "$dir/pom.log"
+	exit 1
+fi
+
+indexes=`ls "$dir"/seg_*.idx 2> /dev/null`
+if [ -z "$indexes" ] || [ `echo "$indexes" | wc -l` -lt 2 ]; then
+	echo "Expected at least two segments"
+	ls "$dir"
+	exit 1
+fi
+
+total=0
+for idx in $indexes; do
+	if [ ! -f "${idx%.idx}.cap" ]; then
+		echo "Segment of index $idx not found"
+		exit 1
+	fi
+	./pom-pcap-extract -f 0 -o "$dir/out.cap" "$idx" > "$dir/extract.log" 2>&1
+	if [ $? -ne 0 ]; then
+		echo "Unable to extract the connection from $idx"
+		cat "$dir/extract.log"
+		exit 1
+	fi
+	count=`sed -n 's/^Extracted \([0-9]*\) packets$/\1/p' "$dir/extract.log"`
+	total=`expr $total + ${count:-0}`
+done
+
+if [ $total -ne $PACKETS ]; then
+	echo "Extracted $total packets instead of $PACKETS"
+	exit 1
+fi
+
+exit 0
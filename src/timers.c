@@ -34,7 +34,7 @@
 static struct timer_queue *timer_queues;
 
 
-int timers_process(struct rule_list *list, pthread_rwlock_t *lock) {
+int timers_process(struct rule_snapshot *rules) {
 
 	struct timeval now;
 	get_current_time(&now);
@@ -46,7 +46,7 @@ int timers_process(struct rule_list *list, pthread_rwlock_t *lock) {
 		while (tq->head && timercmp(&tq->head->expires, &now, <)) {
 				timer_tshoot( "Timer 0x%lx reached. Starting handler ...", (unsigned long) tq->head);
 				(*tq->head->handler) (tq->head->priv);
-				helper_process_queue(list, lock);
+				helper_process_queue(rules);
 		}
 		tq = tq->next;
 
@@ -55,7 +55,7 @@ struct timer_queue {
 
 
 
-int timers_process(struct rule_list *list, pthread_rwlock_t *lock);
+int timers_process(struct rule_snapshot *rules);
 int timers_cleanup();
 struct timer *timer_alloc(void* priv, struct input *i, int (*handler) (void*));
 int timer_cleanup(struct timer *t);
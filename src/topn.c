@@ -0,0 +1,279 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "topn.h"
+
+#include <jhash.h>
+
+#define INITVAL 0x2c3b9e75 // Random value
+
+/**
+ * @param size Maximum number of keys to monitor
+ * @return The summary or NULL on failure.
+ */
+struct topn *topn_alloc(unsigned int size) {
+
+	if (!size)
+		return NULL;
+
+	struct topn *t = malloc(sizeof(struct topn));
+	if (!t) {
+		pom_log(POM_LOG_ERR "Not enough memory to allocate a summary of %u entries", size);
+		return NULL;
+	}
+	memset(t, 0, sizeof(struct topn));
+
+	unsigned int hash_size = 1;
+	while (hash_size < size * 2)
+		hash_size <<= 1;
+
+	t->size = size;
+	t->entries = malloc(sizeof(struct topn_entry) * size);
+	t->heap = malloc(sizeof(unsigned int) * size);
+	t->hash = malloc(sizeof(int) * hash_size);
+	t->hash_mask = hash_size - 1;
+
+	if (!t->entries || !t->heap || !t->hash) {
+		pom_log(POM_LOG_ERR "Not enough memory to allocate a summary of %u entries", size);
+		topn_cleanup(t);
+		return NULL;
+	}
+
+	topn_reset(t);
+
+	return t;
+}
+
+static inline unsigned int topn_hash(struct topn *t, const void *key, unsigned int key_len) {
+
+	return jhash(key, key_len, INITVAL) & t->hash_mask;
+}
+
+static void topn_heap_swap(struct topn *t, unsigned int a, unsigned int b) {
+
+	unsigned int tmp = t->heap[a];
+	t->heap[a] = t->heap[b];
+	t->heap[b] = tmp;
+	t->entries[t->heap[a]].heap_pos = a;
+	t->entries[t->heap[b]].heap_pos = b;
+}
+
+static void topn_heap_down(struct topn *t, unsigned int pos) {
+
+	while (1) {
+		unsigned int min = pos, left = pos * 2 + 1, right = pos * 2 + 2;
+		if (left < t->used && t->entries[t->heap[left]].count < t->entries[t->heap[min]].count)
+			min = left;
+		if (right < t->used && t->entries[t->heap[right]].count < t->entries[t->heap[min]].count)
+			min = right;
+		if (min == pos)
+			return;
+		topn_heap_swap(t, pos, min);
+		pos = min;
+	}
+}
+
+static void topn_heap_up(struct topn *t, unsigned int pos) {
+
+	while (pos) {
+		unsigned int parent = (pos - 1) / 2;
+		if (t->entries[t->heap[parent]].count <= t->entries[t->heap[pos]].count)
+			return;
+		topn_heap_swap(t, pos, parent);
+		pos = parent;
+	}
+}
+
+static void topn_hash_remove(struct topn *t, int slot) {
+
+	struct topn_entry *e = &t->entries[slot];
+	int *prev = &t->hash[topn_hash(t, e->key, e->key_len)];
+	while (*prev != -1) {
+		if (*prev == slot) {
+			*prev = e->hash_next;
+			return;
+		}
+		prev = &t->entries[*prev].hash_next;
+	}
+}
+
+/**
+ * @param t Summary to look into
+ * @param key Key to find
+ * @param key_len Length of the key
+ * @return The slot of the key or POM_ERR if it's not monitored.
+ */
+int topn_find(struct topn *t, const void *key, unsigned int key_len) {
+
+	int slot = t->hash[topn_hash(t, key, key_len)];
+	while (slot != -1) {
+		struct topn_entry *e = &t->entries[slot];
+		if (e->key_len == key_len && !memcmp(e->key, key, key_len))
+			return slot;
+		slot = e->hash_next;
+	}
+
+	return POM_ERR;
+}
+
+/**
+ * When the key isn't monitored and the summary is full, the lightest key
+ * is replaced and the new one inherits its count as error margin.
+ * @param t Summary to update
+ * @param key Key to account
+ * @param key_len Length of the key, at most TOPN_KEY_SIZE
+ * @param weight Weight to add to the key
+ * @param replaced Set to 1 if the slot returned was monitoring another key, 0 if not
+ * @return The slot of the key or POM_ERR on failure.
+ */
+int topn_update(struct topn *t, const void *key, unsigned int key_len, uint64_t weight, int *replaced) {
+
+	if (key_len > TOPN_KEY_SIZE)
+		return POM_ERR;
+
+	*replaced = 0;
+
+	unsigned int hash = topn_hash(t, key, key_len);
+	int slot = t->hash[hash];
+	while (slot != -1) {
+		struct topn_entry *e = &t->entries[slot];
+		if (e->key_len == key_len && !memcmp(e->key, key, key_len)) {
+			e->count += weight;
+			e->hits++;
+			topn_heap_down(t, e->heap_pos);
+			return slot;
+		}
+		slot = e->hash_next;
+	}
+
+	struct topn_entry *e;
+	if (t->used < t->size) {
+		slot = t->used;
+		e = &t->entries[slot];
+		e->count = weight;
+		e->error = 0;
+		e->heap_pos = t->used;
+		t->heap[t->used] = slot;
+		t->used++;
+		topn_heap_up(t, e->heap_pos);
+	} else {
+		slot = t->heap[0];
+		e = &t->entries[slot];
+		topn_hash_remove(t, slot);
+		e->error = e->count;
+		e->count += weight;
+		topn_heap_down(t, 0);
+		*replaced = 1;
+	}
+
+	memcpy(e->key, key, key_len);
+	e->key_len = key_len;
+	e->hits = 1;
+	e->hash_next = t->hash[hash];
+	t->hash[hash] = slot;
+
+	return slot;
+}
+
+/**
+ * Sift down an entry of the min-heap of slots used to select the heaviest keys.
+ */
+static void topn_select_down(struct topn *t, unsigned int *slots, unsigned int size, unsigned int pos) {
+
+	while (1) {
+		unsigned int min = pos, left = pos * 2 + 1, right = pos * 2 + 2;
+		if (left < size && t->entries[slots[left]].count < t->entries[slots[min]].count)
+			min = left;
+		if (right < size && t->entries[slots[right]].count < t->entries[slots[min]].count)
+			min = right;
+		if (min == pos)
+			return;
+		unsigned int tmp = slots[pos];
+		slots[pos] = slots[min];
+		slots[min] = tmp;
+		pos = min;
+	}
+}
+
+/**
+ * The heaviest keys are selected with a min-heap of max entries built in
+ * the slots array so the cost is O(n log max) without any allocation.
+ * @param t Summary to query
+ * @param slots Array filled with the slots of the heaviest keys, heaviest first
+ * @param max Size of the array
+ * @return Number of slots returned.
+ */
+unsigned int topn_get_top(struct topn *t, unsigned int *slots, unsigned int max) {
+
+	if (max > t->used)
+		max = t->used;
+
+	if (!max)
+		return 0;
+
+	unsigned int i;
+	for (i = 0; i < max; i++)
+		slots[i] = i;
+
+	for (i = max / 2; i > 0; i--)
+		topn_select_down(t, slots, max, i - 1);
+
+	// Replace the lightest selected key by any heavier one
+	for (i = max; i < t->used; i++) {
+		if (t->entries[i].count > t->entries[slots[0]].count) {
+			slots[0] = i;
+			topn_select_down(t, slots, max, 0);
+		}
+	}
+
+	// Move the lightest key at the end until the heap is empty to sort the slots, heaviest first
+	for (i = max - 1; i > 0; i--) {
+		unsigned int tmp = slots[0];
+		slots[0] = slots[i];
+		slots[i] = tmp;
+		topn_select_down(t, slots, i, 0);
+	}
+
+	return max;
+}
+
+int topn_reset(struct topn *t) {
+
+	t->used = 0;
+
+	unsigned int i;
+	for (i = 0; i <= t->hash_mask; i++)
+		t->hash[i] = -1;
+
+	return POM_OK;
+}
+
+int topn_cleanup(struct topn *t) {
+
+	if (!t)
+		return POM_OK;
+
+	free(t->entries);
+	free(t->heap);
+	free(t->hash);
+	free(t);
+
+	return POM_OK;
+}
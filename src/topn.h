@@ -0,0 +1,66 @@
+/*
+ *  packet-o-matic : modular network traffic processor
+ *  Copyright (C) 2011 Guy Martin <gmsoft@tuxicoman.be>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef __TOPN_H__
+#define __TOPN_H__
+
+#include "common.h"
+
+/// Maximum size of the keys tracked
+#define TOPN_KEY_SIZE 20
+
+/// A key monitored by the summary
+struct topn_entry {
+
+	unsigned char key[TOPN_KEY_SIZE];
+	unsigned int key_len;
+	uint64_t count; ///< Estimated weight of the key, never lower than the real one
+	uint64_t error; ///< Maximum overestimation of count
+	uint64_t hits; ///< Number of updates since the key is monitored
+	unsigned int heap_pos; ///< Position in the heap
+	int hash_next; ///< Next entry in the same hash bucket or -1
+
+};
+
+/**
+ * Bounded summary of the heaviest keys of a stream using the space-saving algorithm.
+ * The monitored keys are kept in a min-heap on their count so that the
+ * lightest one can be replaced in O(log n) when an unknown key shows up.
+ */
+struct topn {
+
+	unsigned int size; ///< Maximum number of keys monitored
+	unsigned int used; ///< Number of keys monitored
+	struct topn_entry *entries;
+	unsigned int *heap; ///< Entries sorted as a min-heap on their count
+	int *hash; ///< First entry of each hash bucket or -1
+	unsigned int hash_mask;
+
+};
+
+struct topn *topn_alloc(unsigned int size);
+int topn_update(struct topn *t, const void *key, unsigned int key_len, uint64_t weight, int *replaced);
+int topn_find(struct topn *t, const void *key, unsigned int key_len);
+unsigned int topn_get_top(struct topn *t, unsigned int *slots, unsigned int max);
+int topn_reset(struct topn *t);
+int topn_cleanup(struct topn *t);
+
+#endif
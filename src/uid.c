@@ -20,8 +20,13 @@
 
 #include "uid.h"
 
-static uint32_t *uid_table = NULL;
+#include <jhash.h>
+
+#define INITVAL 0x6a3e91d7 // Random value
+
+static struct uid_entry **uid_table = NULL;
 static uint32_t uid_table_size = 0;
+static uint32_t uid_count = 0;
 static unsigned int uid_random_seed;
 pthread_mutex_t uid_table_lock;
 
@@ -32,21 +37,104 @@ int uid_init() {
 
 	if (pthread_mutex_init(&uid_table_lock, NULL))
 		return POM_ERR;
+
+	uid_table = malloc(sizeof(struct uid_entry *) * UID_TABLE_INITIAL_SIZE);
+	if (!uid_table) {
+		pom_log(POM_LOG_ERR "Not enough memory to allocate the uid table");
+		return POM_ERR;
+	}
+	memset(uid_table, 0, sizeof(struct uid_entry *) * UID_TABLE_INITIAL_SIZE);
+	uid_table_size = UID_TABLE_INITIAL_SIZE;
+	uid_count = 0;
 	
 	return POM_OK;
 }
 
-int uid_check(uint32_t uid) {
+static inline uint32_t uid_hash(uint32_t uid) {
 
-	if (!uid) // 0 is not allowed
+	return jhash_1word(uid, INITVAL) & (uid_table_size - 1);
+}
+
+static struct uid_entry *uid_find(uint32_t uid) {
+
+	struct uid_entry *e;
+	for (e = uid_table[uid_hash(uid)]; e; e = e->next) {
+		if (e->uid == uid)
+			return e;
+	}
+
+	return NULL;
+}
+
+/**
+ * Double the size of the table once it holds more entries than buckets.
+ * The uid table must be locked.
+ */
+static int uid_table_grow() {
+
+	uint32_t old_size = uid_table_size;
+	struct uid_entry **old_table = uid_table;
+
+	struct uid_entry **new_table = malloc(sizeof(struct uid_entry *) * old_size * 2);
+	if (!new_table) // We can keep on using the current table
 		return POM_ERR;
+	memset(new_table, 0, sizeof(struct uid_entry *) * old_size * 2);
+
+	uid_table = new_table;
+	uid_table_size = old_size * 2;
 
 	uint32_t i;
+	for (i = 0; i < old_size; i++) {
+		while (old_table[i]) {
+			struct uid_entry *e = old_table[i];
+			old_table[i] = e->next;
+			uint32_t hash = uid_hash(e->uid);
+			e->next = uid_table[hash];
+			uid_table[hash] = e;
+		}
+	}
 
-	for (i = 0; i < uid_table_size; i++) {
-		if (uid_table[i] == uid)
-			return POM_ERR;
+	free(old_table);
+
+	return POM_OK;
+}
+
+/**
+ * The uid table must be locked.
+ */
+static int uid_add(uint32_t uid) {
+
+	struct uid_entry *e = malloc(sizeof(struct uid_entry));
+	if (!e) {
+		pom_log(POM_LOG_ERR "Not enough memory to allocate a new uid");
+		return POM_ERR;
 	}
+	memset(e, 0, sizeof(struct uid_entry));
+	e->uid = uid;
+
+	uint32_t hash = uid_hash(uid);
+	e->next = uid_table[hash];
+	uid_table[hash] = e;
+
+	uid_count++;
+	if (uid_count > uid_table_size)
+		uid_table_grow();
+
+	return POM_OK;
+}
+
+/**
+ * The uid table must be locked.
+ * @param uid Uid to check
+ * @return POM_OK if the uid can be used, POM_ERR if it is 0 or already used.
+ */
+static int uid_check(uint32_t uid) {
+
+	if (!uid) // 0 is not allowed
+		return POM_ERR;
+
+	if (uid_find(uid))
+		return POM_ERR;
 
 	return POM_OK;
 }
@@ -61,9 +149,7 @@ uint32_t uid_get_new() {
 		new_uid = rand_r(&uid_random_seed);
 	} while (uid_check(new_uid) == POM_ERR);
 
-	uid_table_size++;
-	uid_table = realloc(uid_table, sizeof(uint32_t) * uid_table_size);
-	uid_table[uid_table_size - 1] = new_uid;
+	uid_add(new_uid);
 
 	uid_unlock();
 
@@ -79,9 +165,7 @@ uint32_t uid_set(uint32_t uid) {
 		uid = rand_r(&uid_random_seed);
 	}
 
-	uid_table_size++;
-	uid_table = realloc(uid_table, sizeof(uint32_t) * uid_table_size);
-	uid_table[uid_table_size - 1] = uid;
+	uid_add(uid);
 
 	uid_unlock();
 
@@ -91,30 +175,84 @@ uint32_t uid_set(uint32_t uid) {
 
 int uid_release(uint32_t uid) {
 
-	uint32_t i = 0;
-
 	uid_lock();
 
-	for (i = 0; i < uid_table_size; i++) {
-		if (uid_table[i] == uid)
-			break;
-	}
+	struct uid_entry **prev = &uid_table[uid_hash(uid)];
+	while (*prev && (*prev)->uid != uid)
+		prev = &(*prev)->next;
 
-	if (i > uid_table_size) {
+	if (!*prev) {
 		pom_log(POM_LOG_WARN "UID %u not found when releasing it", uid);
 		uid_unlock();
 		return POM_ERR;
 	}
 
-	uid_table_size--;
-	memmove(&uid_table[i], &uid_table[i + 1], sizeof(uint32_t) * (uid_table_size - i));
+	struct uid_entry *e = *prev;
+	*prev = e->next;
+	free(e);
+	uid_count--;
+
+	uid_unlock();
+
+	return POM_OK;
+
+}
+
+/**
+ * The object must be detached before it stops being reachable by the commands.
+ * @param uid Used uid to attach the object to
+ * @param type UID_OBJ_* type of the object
+ * @param obj Object identified by the uid
+ * @return POM_OK on success, POM_ERR if the uid isn't used.
+ */
+int uid_attach(uint32_t uid, unsigned int type, void *obj) {
+
+	uid_lock();
+
+	struct uid_entry *e = uid_find(uid);
+	if (!e) {
+		uid_unlock();
+		pom_log(POM_LOG_WARN "UID %u not found when attaching an object", uid);
+		return POM_ERR;
+	}
 
-	uid_table = realloc(uid_table, sizeof(uint32_t) * uid_table_size);
+	e->type = type;
+	e->obj = obj;
 
 	uid_unlock();
 
 	return POM_OK;
+}
+
+/**
+ * The uid stays used until it's released.
+ * @param uid Uid to detach the object from
+ * @return POM_OK on success, POM_ERR if the uid isn't used.
+ */
+int uid_detach(uint32_t uid) {
+
+	return uid_attach(uid, UID_OBJ_NONE, NULL);
+}
+
+/**
+ * The caller must hold the lock protecting this type of object.
+ * @param uid Uid to resolve
+ * @param type Expected UID_OBJ_* type of the object
+ * @return The object or NULL if no object of this type is attached to the uid.
+ */
+void *uid_get_obj(uint32_t uid, unsigned int type) {
+
+	void *obj = NULL;
+
+	uid_lock();
+
+	struct uid_entry *e = uid_find(uid);
+	if (e && e->type == type)
+		obj = e->obj;
 
+	uid_unlock();
+
+	return obj;
 }
 
 int uid_lock() {
@@ -141,10 +279,19 @@ int uid_unlock() {
 
 int uid_cleanup() {
 
-	if (uid_table)
-		free(uid_table);
-	
+	uint32_t i;
+	for (i = 0; i < uid_table_size; i++) {
+		while (uid_table[i]) {
+			struct uid_entry *e = uid_table[i];
+			uid_table[i] = e->next;
+			free(e);
+		}
+	}
+
+	free(uid_table);
+	uid_table = NULL;
 	uid_table_size = 0;
+	uid_count = 0;
 
 	pthread_mutex_destroy(&uid_table_lock);
 
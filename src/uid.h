@@ -23,12 +23,34 @@
 
 #include "common.h"
 
+/// Initial number of buckets of the uid table, must be a power of 2
+#define UID_TABLE_INITIAL_SIZE 256
+
+/// No object is attached to the uid
+#define UID_OBJ_NONE 0
+
+/// The uid identifies a struct rule_list
+#define UID_OBJ_RULE 1
+
+/// The uid identifies a struct target
+#define UID_OBJ_TARGET 2
+
+/// The uid identifies a struct datastore
+#define UID_OBJ_DATASTORE 3
+
+/// Used uid and the object it identifies
+struct uid_entry {
+
+	uint32_t uid;
+	unsigned int type; ///< UID_OBJ_* type of the object
+	void *obj; ///< Object identified by the uid if any
+	struct uid_entry *next; ///< Next entry in the same bucket
+
+};
+
 /// Init the uid API
 int uid_init();
 
-/// Check if a uid is already used
-int uid_check(uint32_t uid);
-
 /// Get a new unused uid
 uint32_t uid_get_new();
 
@@ -38,6 +60,15 @@ uint32_t uid_set(uint32_t uid);
 /// Release a used uid
 int uid_release(uint32_t uid);
 
+/// Attach an object to a used uid
+int uid_attach(uint32_t uid, unsigned int type, void *obj);
+
+/// Detach the object from a uid
+int uid_detach(uint32_t uid);
+
+/// Get the object identified by a uid
+void *uid_get_obj(uint32_t uid, unsigned int type);
+
 /// Lock the uid table
 int uid_lock();
 
@@ -27,6 +27,7 @@
 #include "main.h"
 #include "core_param.h"
 #include "helper.h"
+#include "perf.h"
 
 #include "version.h"
 
@@ -38,7 +39,7 @@
 #include "xmlrpccmd_target.h"
 #include "xmlrpccmd_datastore.h"
 
-#define XMLRPC_COMMANDS_NUM 7
+#define XMLRPC_COMMANDS_NUM 9
 
 static struct xmlrpc_command xmlrpc_commands[XMLRPC_COMMANDS_NUM] = { 
 
@@ -89,6 +90,20 @@ static struct xmlrpc_command xmlrpc_commands[XMLRPC_COMMANDS_NUM] = {
 		.callback_func = xmlrpccmd_get_version,
 		.signature = "s:",
 		.help = "Get packet-o-matic version",
+	},
+
+	{
+		.name = "perf.getTimings",
+		.callback_func = xmlrpccmd_perf_get_timings,
+		.signature = "A:",
+		.help = "Get the time spent in each processing stage and target in nanoseconds",
+	},
+
+	{
+		.name = "perf.listItems",
+		.callback_func = xmlrpccmd_perf_list_items,
+		.signature = "S:sii",
+		.help = "List the performance items of a class (core, input, rules, target, stages, ...) given a cursor and a maximum count. Start with cursor 0 and call again with the returned cursor until it's 0",
 	}
 
 };
@@ -253,6 +268,155 @@ xmlrpc_value *xmlrpccmd_get_version(xmlrpc_env * const envP, xmlrpc_value * cons
 
 }
 
+static xmlrpc_value *xmlrpccmd_perf_build_histo(xmlrpc_env * const envP, struct perf_item *itm, char *class, uint32_t rule_uid, uint32_t target_uid) {
+
+	return xmlrpc_build_value(envP, "{s:s,s:s,s:i,s:i,s:I,s:I,s:I,s:I,s:I,s:I}",
+				"class", class,
+				"name", itm->name,
+				"rule_uid", rule_uid,
+				"target_uid", target_uid,
+				"samples", (xmlrpc_int64)perf_item_val_get_raw(itm),
+				"mean", (xmlrpc_int64)perf_item_val_get_mean(itm),
+				"p50", (xmlrpc_int64)perf_item_val_get_percentile(itm, 50),
+				"p90", (xmlrpc_int64)perf_item_val_get_percentile(itm, 90),
+				"p99", (xmlrpc_int64)perf_item_val_get_percentile(itm, 99),
+				"max", (xmlrpc_int64)perf_item_val_get_max(itm));
+
+}
+
+xmlrpc_value *xmlrpccmd_perf_get_timings(xmlrpc_env * const envP, xmlrpc_value * const paramArrayP, void * const userData) {
+
+	xmlrpc_value *result = xmlrpc_array_new(envP);
+	if (envP->fault_occurred)
+		return NULL;
+
+	struct perf_class *stages = perf_find_class("stages");
+	if (stages && stages->instances) {
+		struct perf_instance *inst = stages->instances;
+		perf_instance_lock(inst, 0);
+		struct perf_item *itm = inst->items;
+		while (itm) {
+			xmlrpc_value *entry = xmlrpccmd_perf_build_histo(envP, itm, "stages", 0, 0);
+			xmlrpc_array_append_item(envP, result, entry);
+			xmlrpc_DECREF(entry);
+			itm = itm->next;
+		}
+		perf_instance_unlock(inst);
+	}
+
+	main_config_rules_lock(0);
+
+	struct rule_list *rl = main_config->rules;
+	while (rl) {
+		struct target *t = rl->target;
+		while (t) {
+			xmlrpc_value *entry = xmlrpccmd_perf_build_histo(envP, t->perf_process_time, target_get_name(t->type), rl->uid, t->uid);
+			xmlrpc_array_append_item(envP, result, entry);
+			xmlrpc_DECREF(entry);
+			t = t->next;
+		}
+		rl = rl->next;
+	}
+
+	main_config_rules_unlock();
+
+	return result;
+}
+
+/// Private data of xmlrpccmd_perf_add_item()
+struct xmlrpccmd_perf_list {
+	xmlrpc_env *envP;
+	xmlrpc_value *items;
+};
+
+static int xmlrpccmd_perf_add_item(struct perf_instance *inst, struct perf_item *itm, void *priv) {
+
+	struct xmlrpccmd_perf_list *lst = priv;
+	xmlrpc_env *envP = lst->envP;
+
+	if (envP->fault_occurred)
+		return POM_ERR;
+
+	char *type = "counter";
+	char human[256];
+
+	switch (itm->type) {
+		case perf_item_type_gauge:
+			type = "gauge";
+			perf_item_val_get_human(itm, human, sizeof(human));
+			break;
+		case perf_item_type_uptime:
+			type = "uptime";
+			perf_item_val_get_human(itm, human, sizeof(human));
+			break;
+		case perf_item_type_histogram:
+			type = "histogram";
+			perf_item_val_get_human_histo(itm, human, sizeof(human));
+			break;
+		default:
+			perf_item_val_get_human(itm, human, sizeof(human));
+			break;
+	}
+
+	xmlrpc_value *item = xmlrpc_build_value(envP, "{s:i,s:s,s:s,s:s,s:I,s:s}",
+				"instance", (xmlrpc_int32) inst->id,
+				"name", itm->name,
+				"descr", itm->descr,
+				"type", type,
+				"value", (xmlrpc_int64) perf_item_val_get_raw(itm),
+				"human", human);
+	xmlrpc_array_append_item(envP, lst->items, item);
+	xmlrpc_DECREF(item);
+
+	return POM_OK;
+}
+
+xmlrpc_value *xmlrpccmd_perf_list_items(xmlrpc_env * const envP, xmlrpc_value * const paramArrayP, void * const userData) {
+
+	char *class_name;
+	xmlrpc_int32 cursor, count;
+	xmlrpc_decompose_value(envP, paramArrayP, "(sii)", &class_name, &cursor, &count);
+
+	if (envP->fault_occurred)
+		return NULL;
+
+	struct perf_class *class = perf_find_class(class_name);
+	if (!class) {
+		xmlrpc_faultf(envP, "Performance class %s not found", class_name);
+		free(class_name);
+		return NULL;
+	}
+	free(class_name);
+
+	if (cursor < 0 || count <= 0) {
+		xmlrpc_faultf(envP, "Invalid cursor or count");
+		return NULL;
+	}
+
+	if (count > XMLRPC_PERF_MAX_ITEMS)
+		count = XMLRPC_PERF_MAX_ITEMS;
+
+	struct xmlrpccmd_perf_list lst;
+	lst.envP = envP;
+	lst.items = xmlrpc_array_new(envP);
+	if (envP->fault_occurred)
+		return NULL;
+
+	uint32_t next = perf_class_iterate(class, cursor, count, xmlrpccmd_perf_add_item, &lst);
+
+	if (envP->fault_occurred) {
+		xmlrpc_DECREF(lst.items);
+		return NULL;
+	}
+
+	xmlrpc_value *result = xmlrpc_build_value(envP, "{s:i,s:A}",
+				"cursor", (xmlrpc_int32) next,
+				"items", lst.items);
+	xmlrpc_DECREF(lst.items);
+
+	return result;
+}
+
 xmlrpc_value *xmlrpccmd_list_avail_modules(xmlrpc_env * const envP, char *type) {
 
 
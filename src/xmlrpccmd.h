@@ -25,6 +25,9 @@
 #include <xmlrpc-c/base.h>
 #include <xmlrpc-c/server.h>
 
+/// Maximum number of items returned by a single perf.listItems call
+#define XMLRPC_PERF_MAX_ITEMS 1000
+
 int xmlrpccmd_register_all();
 
 
@@ -35,6 +38,8 @@ xmlrpc_value *xmlrpccmd_main_halt(xmlrpc_env * const envP, xmlrpc_value * const
 xmlrpc_value *xmlrpccmd_main_set_password(xmlrpc_env * const envP, xmlrpc_value * const paramArrayP, void * const userData);
 xmlrpc_value *xmlrpccmd_get_logs(xmlrpc_env * const envP, xmlrpc_value * const paramArrayP, void * const userData);
 xmlrpc_value *xmlrpccmd_get_version(xmlrpc_env * const envP, xmlrpc_value * const paramArrayP, void * const userData);
+xmlrpc_value *xmlrpccmd_perf_get_timings(xmlrpc_env * const envP, xmlrpc_value * const paramArrayP, void * const userData);
+xmlrpc_value *xmlrpccmd_perf_list_items(xmlrpc_env * const envP, xmlrpc_value * const paramArrayP, void * const userData);
 
 xmlrpc_value *xmlrpccmd_list_avail_modules(xmlrpc_env * const envP, char *type);
 
@@ -26,10 +26,11 @@
 #include "ptype.h"
 
 #include "conntrack.h"
+#include "target.h"
 
 #include "main.h"
 
-#define XMLRPC_CONNTRACK_COMMANDS_NUM 5
+#define XMLRPC_CONNTRACK_COMMANDS_NUM 7
 
 static struct xmlrpc_command xmlrpc_conntrack_commands[XMLRPC_CONNTRACK_COMMANDS_NUM] = { 
 
@@ -67,6 +68,20 @@ static struct xmlrpc_command xmlrpc_conntrack_commands[XMLRPC_CONNTRACK_COMMANDS
 		.signature = "i:",
 		.help = "Unload a conntrack given its name",
 	},
+
+	{
+		.name = "conntrack.listEntries",
+		.callback_func = xmlrpccmd_list_conntrack_entries,
+		.signature = "S:ii",
+		.help = "List the tracked connections given a cursor and a maximum count. Start with cursor 0 and call again with the returned cursor until it's 0",
+	},
+
+	{
+		.name = "conntrack.getTop",
+		.callback_func = xmlrpccmd_get_conntrack_top,
+		.signature = "A:si",
+		.help = "Get the heaviest connections, sources or ports given the summary name (flows, sources or ports) and a maximum count",
+	},
 };
 
 int xmlrpccmd_conntrack_register_all() {
@@ -256,3 +271,165 @@ xmlrpc_value *xmlrpccmd_list_avail_conntrack(xmlrpc_env * const envP, xmlrpc_val
 	return xmlrpccmd_list_avail_modules(envP, "conntrack");
 
 }
+
+/// Private data of xmlrpccmd_conntrack_add_entry()
+struct xmlrpccmd_conntrack_list {
+	xmlrpc_env *envP;
+	xmlrpc_value *entries;
+	struct timeval *now;
+};
+
+static int xmlrpccmd_conntrack_add_entry(struct conntrack_entry *ce, void *priv) {
+
+	struct xmlrpccmd_conntrack_list *lst = priv;
+	xmlrpc_env *envP = lst->envP;
+
+	if (envP->fault_occurred)
+		return POM_ERR;
+
+	char key[256];
+	conntrack_print_key(ce, key, sizeof(key));
+
+	xmlrpc_value *helpers = xmlrpc_array_new(envP);
+	struct conntrack_helper_priv *hp;
+	for (hp = ce->helper_privs; hp; hp = hp->next) {
+		xmlrpc_value *helper = xmlrpc_string_new(envP, match_get_name(hp->type));
+		xmlrpc_array_append_item(envP, helpers, helper);
+		xmlrpc_DECREF(helper);
+	}
+
+	xmlrpc_value *targets = xmlrpc_array_new(envP);
+	struct conntrack_target_priv *tp;
+	for (tp = ce->target_privs; tp; tp = tp->next) {
+		xmlrpc_value *target = xmlrpc_build_value(envP, "{s:i,s:s}",
+						"uid", tp->t->uid,
+						"type", target_get_name(tp->t->type));
+		xmlrpc_array_append_item(envP, targets, target);
+		xmlrpc_DECREF(target);
+	}
+
+	xmlrpc_value *entry = xmlrpc_build_value(envP, "{s:s,s:i,s:i,s:I,s:I,s:I,s:I,s:A,s:A}",
+					"key", key,
+					"age", (int) (lst->now->tv_sec - ce->first_seen.tv_sec),
+					"idle", (int) (lst->now->tv_sec - ce->last_seen.tv_sec),
+					"packets_fwd", (xmlrpc_int64) ce->packets[CE_DIR_FWD],
+					"packets_rev", (xmlrpc_int64) ce->packets[CE_DIR_REV],
+					"bytes_fwd", (xmlrpc_int64) ce->bytes[CE_DIR_FWD],
+					"bytes_rev", (xmlrpc_int64) ce->bytes[CE_DIR_REV],
+					"helpers", helpers,
+					"targets", targets);
+	xmlrpc_DECREF(helpers);
+	xmlrpc_DECREF(targets);
+
+	xmlrpc_array_append_item(envP, lst->entries, entry);
+	xmlrpc_DECREF(entry);
+
+	return POM_OK;
+}
+
+xmlrpc_value *xmlrpccmd_list_conntrack_entries(xmlrpc_env * const envP, xmlrpc_value * const paramArrayP, void * const userData) {
+
+	xmlrpc_int32 cursor, count;
+	xmlrpc_decompose_value(envP, paramArrayP, "(ii)", &cursor, &count);
+
+	if (envP->fault_occurred)
+		return NULL;
+
+	if (cursor < 0 || count <= 0) {
+		xmlrpc_faultf(envP, "Invalid cursor or count");
+		return NULL;
+	}
+
+	if (count > XMLRPC_CONNTRACK_MAX_ENTRIES)
+		count = XMLRPC_CONNTRACK_MAX_ENTRIES;
+
+	struct xmlrpccmd_conntrack_list lst;
+	lst.envP = envP;
+	lst.entries = xmlrpc_array_new(envP);
+	if (envP->fault_occurred)
+		return NULL;
+
+	// Only hold the locks for one page so the packet processing isn't delayed for long
+	reader_process_lock();
+	conntrack_lock(0);
+
+	lst.now = get_current_time_p();
+	uint32_t next = conntrack_iterate(cursor, count, xmlrpccmd_conntrack_add_entry, &lst);
+
+	conntrack_unlock();
+	reader_process_unlock();
+
+	if (envP->fault_occurred) {
+		xmlrpc_DECREF(lst.entries);
+		return NULL;
+	}
+
+	xmlrpc_value *result = xmlrpc_build_value(envP, "{s:i,s:A}",
+					"cursor", (xmlrpc_int32) next,
+					"entries", lst.entries);
+	xmlrpc_DECREF(lst.entries);
+
+	return result;
+}
+
+xmlrpc_value *xmlrpccmd_get_conntrack_top(xmlrpc_env * const envP, xmlrpc_value * const paramArrayP, void * const userData) {
+
+	char *type_name;
+	xmlrpc_int32 count;
+	xmlrpc_decompose_value(envP, paramArrayP, "(si)", &type_name, &count);
+
+	if (envP->fault_occurred)
+		return NULL;
+
+	enum conntrack_top_type type;
+	if (!strcmp(type_name, "flows")) {
+		type = conntrack_top_flows;
+	} else if (!strcmp(type_name, "sources")) {
+		type = conntrack_top_sources;
+	} else if (!strcmp(type_name, "ports")) {
+		type = conntrack_top_ports;
+	} else {
+		xmlrpc_faultf(envP, "Unknown top summary %s", type_name);
+		free(type_name);
+		return NULL;
+	}
+	free(type_name);
+
+	if (count <= 0) {
+		xmlrpc_faultf(envP, "Invalid count");
+		return NULL;
+	}
+
+	if (count > CONNTRACK_TOP_MAX_SIZE)
+		count = CONNTRACK_TOP_MAX_SIZE;
+
+	struct conntrack_top_entry *entries = malloc(sizeof(struct conntrack_top_entry) * count);
+	if (!entries) {
+		xmlrpc_faultf(envP, "Not enough memory");
+		return NULL;
+	}
+
+	int res = conntrack_top_get(type, entries, count);
+	if (res == POM_ERR) {
+		free(entries);
+		xmlrpc_faultf(envP, "Unable to get the top entries");
+		return NULL;
+	}
+
+	xmlrpc_value *result = xmlrpc_array_new(envP);
+
+	int i;
+	for (i = 0; i < res; i++) {
+		xmlrpc_value *entry = xmlrpc_build_value(envP, "{s:s,s:I,s:I,s:I}",
+						"name", entries[i].name,
+						"bytes", (xmlrpc_int64) entries[i].bytes,
+						"error", (xmlrpc_int64) entries[i].error,
+						"packets", (xmlrpc_int64) entries[i].packets);
+		xmlrpc_array_append_item(envP, result, entry);
+		xmlrpc_DECREF(entry);
+	}
+
+	free(entries);
+
+	return result;
+}
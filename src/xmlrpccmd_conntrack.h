@@ -25,6 +25,9 @@
 #include <xmlrpc-c/base.h>
 #include <xmlrpc-c/server.h>
 
+/// Maximum number of connections returned by a single conntrack.listEntries call
+#define XMLRPC_CONNTRACK_MAX_ENTRIES 1000
+
 int xmlrpccmd_conntrack_register_all();
 
 xmlrpc_value *xmlrpccmd_list_loaded_conntrack(xmlrpc_env * const envP, xmlrpc_value * const paramArrayP, void * const userData);
@@ -32,6 +35,8 @@ xmlrpc_value *xmlrpccmd_set_conntrack_parameter(xmlrpc_env * const envP, xmlrpc_
 xmlrpc_value *xmlrpccmd_load_conntrack(xmlrpc_env * const envP, xmlrpc_value * const paramArrayP, void * const userData);
 xmlrpc_value *xmlrpccmd_unload_conntrack(xmlrpc_env * const envP, xmlrpc_value * const paramArrayP, void * const userData);
 xmlrpc_value *xmlrpccmd_list_avail_conntrack(xmlrpc_env * const envP, xmlrpc_value * const paramArrayP, void * const userData);
+xmlrpc_value *xmlrpccmd_list_conntrack_entries(xmlrpc_env * const envP, xmlrpc_value * const paramArrayP, void * const userData);
+xmlrpc_value *xmlrpccmd_get_conntrack_top(xmlrpc_env * const envP, xmlrpc_value * const paramArrayP, void * const userData);
 
 
 #endif
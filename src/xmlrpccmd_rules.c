@@ -198,9 +198,7 @@ xmlrpc_value *xmlrpccmd_set_rule(xmlrpc_env * const envP, xmlrpc_value * const p
 
 	main_config_rules_lock(0);
 
-	struct rule_list *rl = main_config->rules;
-	while (rl && rl->uid != rule_id)
-		rl = rl->next;
+	struct rule_list *rl = rule_list_get(rule_id);
 
 	if (!rl) {
 		main_config_rules_unlock();
@@ -226,7 +224,7 @@ xmlrpc_value *xmlrpccmd_set_rule(xmlrpc_env * const envP, xmlrpc_value * const p
 
 	main_config_rules_lock(1);
 
-	node_destroy(rl->node, 0);
+	rules_retire_node(rl->node);
 	rl->node = start;
 	main_config->rules_serial++;
 	rl->serial++;
@@ -247,9 +245,7 @@ xmlrpc_value *xmlrpccmd_set_rule_description(xmlrpc_env * const envP, xmlrpc_val
 
 	main_config_rules_lock(1);
 
-	struct rule_list *rl = main_config->rules;
-	while (rl && rl->uid != rule_id)
-		rl = rl->next;
+	struct rule_list *rl = rule_list_get(rule_id);
 
 	if (!rl) {
 		main_config_rules_unlock();
@@ -285,9 +281,7 @@ xmlrpc_value *xmlrpccmd_remove_rule(xmlrpc_env * const envP, xmlrpc_value * cons
 
 	main_config_rules_lock(1);
 
-	struct rule_list *rl = main_config->rules;
-	while (rl && rl->uid != rule_id)
-		rl = rl->next;
+	struct rule_list *rl = rule_list_get(rule_id);
 
 	if (!rl) {
 		xmlrpc_faultf(envP, "Rule not found");
@@ -304,7 +298,7 @@ xmlrpc_value *xmlrpccmd_remove_rule(xmlrpc_env * const envP, xmlrpc_value * cons
 	if (rl->next)
 		rl->next->prev = rl->prev;
 
-	rule_list_cleanup(rl);
+	rules_retire_rule(rl);
 
 	main_config->rules_serial++;
 	main_config_rules_unlock();
@@ -323,9 +317,7 @@ xmlrpc_value *xmlrpccmd_enable_rule(xmlrpc_env * const envP, xmlrpc_value * cons
 
 	main_config_rules_lock(1);
 
-	struct rule_list *rl = main_config->rules;
-	while (rl && rl->uid != rule_id)
-		rl = rl->next;
+	struct rule_list *rl = rule_list_get(rule_id);
 
 	if (!rl) {
 		main_config_rules_unlock();
@@ -357,9 +349,7 @@ xmlrpc_value *xmlrpccmd_disable_rule(xmlrpc_env * const envP, xmlrpc_value * con
 
 	main_config_rules_lock(1);
 
-	struct rule_list *rl = main_config->rules;
-	while (rl && rl->uid != rule_id)
-		rl = rl->next;
+	struct rule_list *rl = rule_list_get(rule_id);
 
 	if (!rl) {
 		main_config_rules_unlock();
@@ -203,9 +203,7 @@ xmlrpc_value *xmlrpccmd_get_target(xmlrpc_env * const envP, xmlrpc_value * const
 
 	main_config_rules_lock(0);
 
-	struct rule_list *rl = main_config->rules;
-	while (rl && rl->uid != rule_id)
-		rl = rl->next;
+	struct rule_list *rl = rule_list_get(rule_id);
 
 	if (!rl) {
 		main_config_rules_unlock();
@@ -287,9 +285,7 @@ xmlrpc_value *xmlrpccmd_add_target(xmlrpc_env * const envP, xmlrpc_value * const
 
 	main_config_rules_lock(1);
 
-	struct rule_list *rl = main_config->rules;
-	while (rl && rl->uid != rule_id)
-		rl = rl->next;
+	struct rule_list *rl = rule_list_get(rule_id);
 
 	if (!rl) {
 		main_config_rules_unlock();
@@ -349,9 +345,7 @@ xmlrpc_value *xmlrpccmd_remove_target(xmlrpc_env * const envP, xmlrpc_value * co
 
 	main_config_rules_lock(1);
 
-	struct rule_list *rl = main_config->rules;
-	while (rl && rl->uid != rule_id)
-		rl = rl->next;
+	struct rule_list *rl = rule_list_get(rule_id);
 
 	if (!rl) {
 		main_config_rules_unlock();
@@ -359,9 +353,7 @@ xmlrpc_value *xmlrpccmd_remove_target(xmlrpc_env * const envP, xmlrpc_value * co
 		return NULL;
 	}
 
-	struct target *t = rl->target;
-	while (t && t->uid != target_id)
-		t = t->next;
+	struct target *t = rule_list_get_target(rl, target_id);
 
 	if (!t) {
 		main_config_rules_unlock();
@@ -369,11 +361,7 @@ xmlrpc_value *xmlrpccmd_remove_target(xmlrpc_env * const envP, xmlrpc_value * co
 		return NULL;
 	}
 
-	target_lock_instance(t, 1);
-
-	if (t->started) {
-		target_close(t);
-	} else {
+	if (!t->started) {
 		rl->target_serial++;
 		main_config->target_serial++;
 	}
@@ -386,7 +374,7 @@ xmlrpc_value *xmlrpccmd_remove_target(xmlrpc_env * const envP, xmlrpc_value * co
 	if (t->next)
 		t->next->prev = t->prev;
 
-	target_cleanup_module(t);
+	rules_retire_target(t);
 
 	main_config_rules_unlock();
 
@@ -405,9 +393,7 @@ xmlrpc_value *xmlrpccmd_start_target(xmlrpc_env * const envP, xmlrpc_value * con
 
 	main_config_rules_lock(0);
 
-	struct rule_list *rl = main_config->rules;
-	while (rl && rl->uid != rule_id)
-		rl = rl->next;
+	struct rule_list *rl = rule_list_get(rule_id);
 
 	if (!rl) {
 		main_config_rules_unlock();
@@ -415,9 +401,7 @@ xmlrpc_value *xmlrpccmd_start_target(xmlrpc_env * const envP, xmlrpc_value * con
 		return NULL;
 	}
 
-	struct target *t = rl->target;
-	while (t && t->uid != target_id)
-		t = t->next;
+	struct target *t = rule_list_get_target(rl, target_id);
 
 	if (!t) {
 		main_config_rules_unlock();
@@ -456,9 +440,7 @@ xmlrpc_value *xmlrpccmd_stop_target(xmlrpc_env * const envP, xmlrpc_value * cons
 
 	main_config_rules_lock(0);
 
-	struct rule_list *rl = main_config->rules;
-	while (rl && rl->uid != rule_id)
-		rl = rl->next;
+	struct rule_list *rl = rule_list_get(rule_id);
 
 	if (!rl) {
 		main_config_rules_unlock();
@@ -466,9 +448,7 @@ xmlrpc_value *xmlrpccmd_stop_target(xmlrpc_env * const envP, xmlrpc_value * cons
 		return NULL;
 	}
 
-	struct target *t = rl->target;
-	while (t && t->uid != target_id)
-		t = t->next;
+	struct target *t = rule_list_get_target(rl, target_id);
 
 	if (!t) {
 		main_config_rules_unlock();
@@ -508,9 +488,7 @@ xmlrpc_value *xmlrpccmd_set_target_mode(xmlrpc_env * const envP, xmlrpc_value *
 
 	main_config_rules_lock(0);
 
-	struct rule_list *rl = main_config->rules;
-	while (rl && rl->uid != rule_id)
-		rl = rl->next;
+	struct rule_list *rl = rule_list_get(rule_id);
 
 	if (!rl) {
 		main_config_rules_unlock();
@@ -519,9 +497,7 @@ xmlrpc_value *xmlrpccmd_set_target_mode(xmlrpc_env * const envP, xmlrpc_value *
 		return NULL;
 	}
 
-	struct target *t = rl->target;
-	while (t && t->uid != target_id)
-		t = t->next;
+	struct target *t = rule_list_get_target(rl, target_id);
 
 	if (!t) {
 		xmlrpc_faultf( envP, "Target not found");
@@ -568,9 +544,7 @@ xmlrpc_value *xmlrpccmd_set_target_parameter(xmlrpc_env * const envP, xmlrpc_val
 
 	main_config_rules_lock(0);
 
-	struct rule_list *rl = main_config->rules;
-	while (rl && rl->uid != rule_id)
-		rl = rl->next;
+	struct rule_list *rl = rule_list_get(rule_id);
 
 	if (!rl) {
 		main_config_rules_unlock();
@@ -580,9 +554,7 @@ xmlrpc_value *xmlrpccmd_set_target_parameter(xmlrpc_env * const envP, xmlrpc_val
 		return NULL;
 	}
 
-	struct target *t = rl->target;
-	while (t && t->uid != target_id)
-		t = t->next;
+	struct target *t = rule_list_get_target(rl, target_id);
 
 	if (!t) {
 		xmlrpc_faultf( envP, "Target not found");
@@ -635,9 +607,7 @@ xmlrpc_value *xmlrpccmd_set_target_description(xmlrpc_env * const envP, xmlrpc_v
 
 	main_config_rules_lock(0);
 
-	struct rule_list *rl = main_config->rules;
-	while (rl && rl->uid != rule_id)
-		rl = rl->next;
+	struct rule_list *rl = rule_list_get(rule_id);
 
 	if (!rl) {
 		main_config_rules_unlock();
@@ -646,9 +616,7 @@ xmlrpc_value *xmlrpccmd_set_target_description(xmlrpc_env * const envP, xmlrpc_v
 		return NULL;
 	}
 
-	struct target *t = rl->target;
-	while (t && t->uid != target_id)
-		t = t->next;
+	struct target *t = rule_list_get_target(rl, target_id);
 
 	if (!t) {
 		xmlrpc_faultf( envP, "Target not found");
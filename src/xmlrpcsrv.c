@@ -25,7 +25,6 @@
 #include "xmlrpccmd.h"
 
 #include <signal.h>
-#include <sys/select.h>
 #include <netinet/in.h>
 
 static struct xmlrpc_connection *sockets_head;
@@ -35,6 +34,16 @@ static xmlrpc_registry * registryP;
 
 static char *xmlrpc_password = NULL;
 
+// Accepted connections are served by a dedicated thread as abyss blocks until the request is complete
+static pthread_t xmlrpcsrv_thread;
+static int xmlrpcsrv_thread_running = 0;
+static pthread_mutex_t xmlrpcsrv_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t xmlrpcsrv_cond = PTHREAD_COND_INITIALIZER; ///< Signaled when a connection is queued or the thread must stop
+static struct xmlrpc_connection *pending_head = NULL, *pending_tail = NULL; ///< Connections waiting to be served
+static unsigned int pending_count = 0;
+static int current_fd = -1; ///< Connection being served, -1 if none
+static time_t current_start = 0; ///< When the current connection started to be served
+
 #ifdef XMLRPC_IPV6
 void socketGetPeerName(const TSocket *socketP, TIPAddr *ipAddrP, uint16_t *portNumberP, abyss_bool *successP) {
 
@@ -158,12 +167,33 @@ int xmlrpcsrv_init(const char *port) {
 			continue;
 		}
 
-		pom_log("XML-RPC server listening on %s:%s", host, port);
+		int flags = fcntl(sockfd, F_GETFL);
+		if (flags < 0 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) < 0) {
+			pom_log(POM_LOG_ERR "Unable to set non blocking flag for socket %d", sockfd);
+			close(sockfd);
+			tmpres = tmpres->ai_next;
+			continue;
+		}
 
 		struct xmlrpc_connection *tmp = malloc(sizeof(struct xmlrpc_connection));
 		memset(tmp, 0, sizeof(struct xmlrpc_connection));
 
 		tmp->fd = sockfd;
+		tmp->listening = 1;
+		tmp->efd.fd = sockfd;
+		tmp->efd.events = EVENTLOOP_IN;
+		tmp->efd.handler = xmlrpcsrv_listen_handler;
+		tmp->efd.priv = tmp;
+
+		if (eventloop_add(&tmp->efd) != POM_OK) {
+			close(sockfd);
+			free(tmp);
+			tmpres = tmpres->ai_next;
+			continue;
+		}
+
+		pom_log("XML-RPC server listening on %s:%s", host, port);
+
 		tmp->next = sockets_head;
 		sockets_head = tmp;
 
@@ -205,52 +235,41 @@ int xmlrpcsrv_init(const char *port) {
 	// setup the default handler
 	ServerDefaultHandler(&abyssServer, xmlrpcsrv_default_handler);
 
+	// only serve one request per connection so a client can't keep the thread busy
+	ServerSetKeepaliveMaxConn(&abyssServer, 1);
+
 	xmlrpc_env_clean(&env);
 
 	// register all the commands
 	xmlrpccmd_register_all();
 
-	return POM_OK;
-}
-
-int xmlrpcsrv_process() {
-
-	fd_set fds;
-
-	FD_ZERO(&fds);
-	int max_fd = 0;
-
-	struct xmlrpc_connection *cc = sockets_head;
-	while(cc) {
-
-		FD_SET(cc->fd, &fds);
-		if (cc->fd > max_fd)
-			max_fd = cc->fd;
-		cc = cc->next;
+	xmlrpcsrv_thread_running = 1;
+	if (pthread_create(&xmlrpcsrv_thread, NULL, xmlrpcsrv_thread_func, NULL)) {
+		pom_log(POM_LOG_ERR "Error while creating the XML-RPC thread");
+		xmlrpcsrv_thread_running = 0;
+		xmlrpcsrv_cleanup();
+		return POM_ERR;
 	}
 
-	struct timeval tv;
-	tv.tv_sec = 1;
-	tv.tv_usec = 0;
+	return POM_OK;
+}
 
-	if (select(max_fd + 1, &fds, NULL, NULL, &tv) <= 0)
-		return POM_OK;
+/**
+ * Accept all the pending connections of a listening socket.
+ */
+int xmlrpcsrv_listen_handler(struct eventloop_fd *efd, uint32_t events) {
 
-	cc = sockets_head;
-	while(cc) {
+	struct xmlrpc_connection *c = efd->priv;
 
-		if (FD_ISSET(cc->fd, &fds)) {
-			xmlrpcsrv_process_connection(cc);
-		}
-		cc = cc->next;
-	}
+	while (xmlrpcsrv_accept_connection(c) == POM_OK);
 
 	return POM_OK;
-
 }
 
-int xmlrpcsrv_process_connection(struct xmlrpc_connection *c) {
-
+/**
+ * Accept a connection and queue it for the XML-RPC thread.
+ */
+int xmlrpcsrv_accept_connection(struct xmlrpc_connection *c) {
 
 	struct sockaddr_storage remote_addr;
 	socklen_t remote_addr_len = sizeof(struct sockaddr_storage);
@@ -259,19 +278,130 @@ int xmlrpcsrv_process_connection(struct xmlrpc_connection *c) {
 	sockfd = accept(c->fd, (struct sockaddr *) &remote_addr, &remote_addr_len);
 
 	if (sockfd < 0) {
-		pom_log(POM_LOG_ERR "Error while accepting new connection");
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			pom_log(POM_LOG_ERR "Error while accepting new connection");
 		return POM_ERR;
 	}
 
-
 	char host[NI_MAXHOST], port[NI_MAXSERV];
 	memset(host, 0, NI_MAXHOST);
 	memset(port, 0, NI_MAXSERV);
 
 	getnameinfo((struct sockaddr*)&remote_addr, remote_addr_len, host, NI_MAXHOST, port, NI_MAXSERV, NI_NUMERICHOST);
 
+	struct xmlrpc_connection *conn = malloc(sizeof(struct xmlrpc_connection));
+	if (!conn) {
+		pom_log(POM_LOG_ERR "Not enough memory to allocate the XML-RPC connection from %s", host);
+		close(sockfd);
+		return POM_OK;
+	}
+	memset(conn, 0, sizeof(struct xmlrpc_connection));
+	conn->fd = sockfd;
+
+	pthread_mutex_lock(&xmlrpcsrv_lock);
+
+	if (pending_count >= XMLRPC_MAX_PENDING_CONNS) {
+		pthread_mutex_unlock(&xmlrpcsrv_lock);
+		pom_log(POM_LOG_WARN "Too many pending XML-RPC connections, dropping connection from %s", host);
+		close(sockfd);
+		free(conn);
+		return POM_OK;
+	}
+
+	if (pending_tail)
+		pending_tail->next = conn;
+	else
+		pending_head = conn;
+	pending_tail = conn;
+	pending_count++;
+
+	pthread_cond_signal(&xmlrpcsrv_cond);
+	pthread_mutex_unlock(&xmlrpcsrv_lock);
+
 	pom_log(POM_LOG_TSHOOT "Accepted XML-RPC connection from %s on socket %u", host, sockfd);
 
+	return POM_OK;
+}
+
+/**
+ * Serve the queued connections one after the other.
+ */
+void *xmlrpcsrv_thread_func(void *params) {
+
+	pthread_mutex_lock(&xmlrpcsrv_lock);
+
+	while (1) {
+
+		while (!pending_head && xmlrpcsrv_thread_running)
+			pthread_cond_wait(&xmlrpcsrv_cond, &xmlrpcsrv_lock);
+
+		if (!xmlrpcsrv_thread_running)
+			break;
+
+		struct xmlrpc_connection *conn = pending_head;
+		pending_head = conn->next;
+		if (!pending_head)
+			pending_tail = NULL;
+		pending_count--;
+
+		current_fd = conn->fd;
+		current_start = time(NULL);
+
+		pthread_mutex_unlock(&xmlrpcsrv_lock);
+
+		xmlrpcsrv_process_connection(conn);
+
+		pthread_mutex_lock(&xmlrpcsrv_lock);
+		current_fd = -1;
+		pthread_mutex_unlock(&xmlrpcsrv_lock);
+
+		close(conn->fd);
+		free(conn);
+
+		pthread_mutex_lock(&xmlrpcsrv_lock);
+	}
+
+	pthread_mutex_unlock(&xmlrpcsrv_lock);
+
+	return NULL;
+}
+
+/**
+ * Drop the connection being served if it's taking too long.
+ * Called by the event loop thread after each iteration.
+ */
+int xmlrpcsrv_process() {
+
+	pthread_mutex_lock(&xmlrpcsrv_lock);
+	if (current_fd != -1 && time(NULL) - current_start >= XMLRPC_CONN_MAX_DURATION) {
+		pom_log(POM_LOG_DEBUG "XML-RPC connection on socket %u took too long, dropping it", current_fd);
+		// Wakes up the XML-RPC thread, the socket will be closed by it
+		shutdown(current_fd, SHUT_RDWR);
+		current_start = time(NULL);
+	}
+	pthread_mutex_unlock(&xmlrpcsrv_lock);
+
+	return POM_OK;
+}
+
+/**
+ * Serve a single connection with abyss.
+ */
+int xmlrpcsrv_process_connection(struct xmlrpc_connection *c) {
+
+	int sockfd = c->fd;
+
+	// Abyss expects a blocking socket
+	int flags = fcntl(sockfd, F_GETFL);
+	if (flags >= 0)
+		fcntl(sockfd, F_SETFL, flags & ~O_NONBLOCK);
+
+	struct timeval timeout;
+	timeout.tv_sec = XMLRPC_CONN_TIMEOUT;
+	timeout.tv_usec = 0;
+	setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
 	TSocket * socketP;
 	char * error;
 	int res = POM_OK;
@@ -289,8 +419,7 @@ int xmlrpcsrv_process_connection(struct xmlrpc_connection *c) {
 	}
 
 	SocketDestroy(socketP);
-	close(sockfd);
-	return POM_OK;
+	return res;
 
 }
 
@@ -332,6 +461,26 @@ int xmlrpcsrv_set_password(const char *password) {
 
 int xmlrpcsrv_cleanup() {
 
+	pthread_mutex_lock(&xmlrpcsrv_lock);
+	int joinable = xmlrpcsrv_thread_running;
+	xmlrpcsrv_thread_running = 0;
+	if (current_fd != -1) // Don't wait for the current client
+		shutdown(current_fd, SHUT_RDWR);
+	pthread_cond_signal(&xmlrpcsrv_cond);
+	pthread_mutex_unlock(&xmlrpcsrv_lock);
+
+	if (joinable)
+		pthread_join(xmlrpcsrv_thread, NULL);
+
+	while (pending_head) {
+		struct xmlrpc_connection *tmp = pending_head->next;
+		close(pending_head->fd);
+		free(pending_head);
+		pending_head = tmp;
+	}
+	pending_tail = NULL;
+	pending_count = 0;
+
 	if (registryP)
 		xmlrpc_registry_free(registryP);
 	
@@ -342,6 +491,7 @@ int xmlrpcsrv_cleanup() {
 
 	while (sockets_head) {
 		struct xmlrpc_connection *tmp = sockets_head->next;
+		eventloop_remove(&sockets_head->efd);
 		close(sockets_head->fd);
 		free(sockets_head);
 		sockets_head = tmp;
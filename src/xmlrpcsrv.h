@@ -36,11 +36,22 @@
 #include <xmlrpc-c/server.h>
 #include <xmlrpc-c/server_abyss.h>
 
+#include "eventloop.h"
+
 
 #define XMLRPC_URI "/RPC2"
 #define XMLRPC_REALM "Packet-o-matic XML-RPC interface"
 #define XMLRPC_READ_BLOCK_SIZE 2048
 
+/// Seconds after which a client which stops sending or reading is dropped
+#define XMLRPC_CONN_TIMEOUT 5
+
+/// Maximum number of accepted connections waiting for the XML-RPC thread
+#define XMLRPC_MAX_PENDING_CONNS 16
+
+/// Seconds after which a connection is dropped even if the client is still sending or reading
+#define XMLRPC_CONN_MAX_DURATION 30
+
 
 /*
  * Enable IPv6 for XML-RPC, right now it's just a hack.
@@ -89,6 +100,7 @@ void socketGetPeerName(const TSocket * socketP, TIPAddr *ipAddrP, uint16_t *port
 struct xmlrpc_connection {
 	int fd; ///< fd of the socket
 	int listening; ///< If it's a listening or active socket
+	struct eventloop_fd efd; ///< Registration in the event loop, only for listening sockets
 	struct xmlrpc_connection *next; ///< Used for linking
 
 };
@@ -101,6 +113,9 @@ struct xmlrpc_command {
 };
 
 int xmlrpcsrv_init(const char *port);
+int xmlrpcsrv_listen_handler(struct eventloop_fd *efd, uint32_t events);
+int xmlrpcsrv_accept_connection(struct xmlrpc_connection *c);
+void *xmlrpcsrv_thread_func(void *params);
 int xmlrpcsrv_process();
 int xmlrpcsrv_process_connection(struct xmlrpc_connection *c);
 int xmlrpcsrv_register_command(struct xmlrpc_command *cmd);